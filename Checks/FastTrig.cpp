@@ -0,0 +1,156 @@
+// Checks the fast trigonometry functions against the std functions and the accuracy bounds documented in Play.h
+// Build on its own, for example: g++ -std=c++17 -O2 -I.. FastTrig.cpp -pthread
+// Exits with 0 when every bound holds and 1 otherwise
+#define PLAY_IMPLEMENTATION
+#include "Play.h"
+
+#include <random>
+
+static int g_failures = 0;
+
+// Reports the largest error found and whether it is within the bound
+static void Report( const char* name, double error, double bound )
+{
+	bool pass = error <= bound;
+	printf( "%-40s max error %.3g (bound %.3g) %s\n", name, error, bound, pass ? "ok" : "FAILED" );
+	if( !pass ) g_failures++;
+}
+
+// Reports whether a single result matches the std result exactly, including its sign (or both are NaN)
+static void Exact( const char* name, float result, float expected )
+{
+	bool pass = ( result == expected && std::signbit( result ) == std::signbit( expected ) ) || ( std::isnan( result ) && std::isnan( expected ) );
+	printf( "%-40s %g (std %g) %s\n", name, result, expected, pass ? "ok" : "FAILED" );
+	if( !pass ) g_failures++;
+}
+
+static void CheckSinCos( float range, double bound, double batchBound )
+{
+	constexpr int count = 1 << 20;
+	std::mt19937 rng( 1 );
+	std::uniform_real_distribution<float> angle( -range, range );
+
+	std::vector<float> angles( count ), sinOut( count ), cosOut( count );
+	for( float& a : angles )
+		a = angle( rng );
+
+	double error = 0.0;
+	for( float a : angles )
+	{
+		float s, c;
+		FastSinCos( a, s, c );
+		error = std::max( { error, std::abs( s - std::sin( double( a ) ) ), std::abs( c - std::cos( double( a ) ) ) } );
+	}
+
+	// An odd count so the scalar remainder of the batch is checked too
+	FastSinCosBatch( angles.data(), sinOut.data(), cosOut.data(), count - 3 );
+	double batchError = 0.0;
+	for( int i = 0; i < count - 3; i++ )
+		batchError = std::max( { batchError, std::abs( sinOut[i] - std::sin( double( angles[i] ) ) ), std::abs( cosOut[i] - std::cos( double( angles[i] ) ) ) } );
+
+	std::string within = " within +/-" + std::to_string( int( range ) );
+	Report( ( "FastSinCos" + within ).c_str(), error, bound );
+	Report( ( "FastSinCosBatch" + within ).c_str(), batchError, batchBound );
+}
+
+// Angles outside the range of the fast functions, which must give the std results
+static void CheckOutOfRange()
+{
+	const float inf = std::numeric_limits<float>::infinity();
+	const float special[] = { 1000.5f, -1000.5f, 1e6f, -3e9f, 1e30f, inf, -inf, std::numeric_limits<float>::quiet_NaN() };
+	constexpr int count = int( std::size( special ) );
+
+	// Mixed with in-range angles so the batch has to fix up single lanes
+	float angles[count * 2], sinOut[count * 2], cosOut[count * 2];
+	for( int i = 0; i < count; i++ )
+	{
+		angles[i * 2] = special[i];
+		angles[i * 2 + 1] = i * 0.5f;
+	}
+	FastSinCosBatch( angles, sinOut, cosOut, count * 2 );
+
+	for( int i = 0; i < count; i++ )
+	{
+		float s, c;
+		FastSinCos( special[i], s, c );
+		char name[64];
+		snprintf( name, sizeof( name ), "FastSinCos( %g ) sine", special[i] );
+		Exact( name, s, std::sin( special[i] ) );
+		snprintf( name, sizeof( name ), "FastSinCos( %g ) cosine", special[i] );
+		Exact( name, c, std::cos( special[i] ) );
+		snprintf( name, sizeof( name ), "FastSinCosBatch( %g ) sine", special[i] );
+		Exact( name, sinOut[i * 2], std::sin( special[i] ) );
+		snprintf( name, sizeof( name ), "FastSinCosBatch( %g ) cosine", special[i] );
+		Exact( name, cosOut[i * 2], std::cos( special[i] ) );
+	}
+
+	double error = 0.0;
+	for( int i = 0; i < count; i++ )
+		error = std::max( { error, std::abs( sinOut[i * 2 + 1] - std::sin( double( angles[i * 2 + 1] ) ) ), std::abs( cosOut[i * 2 + 1] - std::cos( double( angles[i * 2 + 1] ) ) ) } );
+	Report( "FastSinCosBatch next to out of range", error, 2e-7 );
+}
+
+static void CheckAtan2( double bound )
+{
+	constexpr int count = 1 << 20;
+	std::mt19937 rng( 2 );
+	std::uniform_real_distribution<float> value( -1000.0f, 1000.0f );
+
+	std::vector<float> y( count ), x( count ), angleOut( count );
+	for( int i = 0; i < count; i++ )
+	{
+		y[i] = value( rng );
+		x[i] = value( rng );
+	}
+
+	// The axes and the origin, with both signs of zero
+	const float special[][2] = { { 0.0f, 0.0f }, { -0.0f, 0.0f }, { 0.0f, -0.0f }, { -0.0f, -0.0f }, { 1.0f, 0.0f }, { -2.0f, 0.0f },
+		{ 0.0f, 1.0f }, { 0.0f, -1.0f }, { -0.0f, -1.0f }, { 3.0f, -0.0f }, { -3.0f, -0.0f } };
+	for( int i = 0; i < int( std::size( special ) ); i++ )
+	{
+		y[i] = special[i][0];
+		x[i] = special[i][1];
+		char name[64];
+		snprintf( name, sizeof( name ), "FastAtan2( %g, %g )", y[i], x[i] );
+		Exact( name, FastAtan2( y[i], x[i] ), std::atan2( y[i], x[i] ) );
+	}
+
+	double error = 0.0;
+	for( int i = 0; i < count; i++ )
+		error = std::max( error, std::abs( FastAtan2( y[i], x[i] ) - std::atan2( double( y[i] ), double( x[i] ) ) ) );
+
+	FastAtan2Batch( y.data(), x.data(), angleOut.data(), count - 1 );
+	double batchError = 0.0;
+	for( int i = 0; i < count - 1; i++ )
+		batchError = std::max( batchError, std::abs( angleOut[i] - std::atan2( double( y[i] ), double( x[i] ) ) ) );
+
+	// The batch must agree exactly with the scalar version on the special cases
+	for( int i = 0; i < int( std::size( special ) ); i++ )
+		if( angleOut[i] != FastAtan2( y[i], x[i] ) || std::signbit( angleOut[i] ) != std::signbit( FastAtan2( y[i], x[i] ) ) )
+			batchError = std::max( batchError, double( PLAY_PI ) );
+
+	Report( "FastAtan2", error, bound );
+	Report( "FastAtan2Batch", batchError, bound );
+}
+
+void MainGameEntry( PLAY_IGNORE_COMMAND_LINE )
+{
+	CheckSinCos( 10.0f, 5e-6, 2e-7 );
+	CheckSinCos( 100.0f, 1e-5, 2e-7 );
+	CheckSinCos( 1000.0f, 1e-4, 2e-7 );
+	CheckOutOfRange();
+	CheckAtan2( 1.2e-5 );
+
+	printf( g_failures ? "%d checks FAILED\n" : "All checks passed\n", g_failures );
+	exit( g_failures ? 1 : 0 );
+}
+
+bool MainGameUpdate( float )
+{
+	return true;
+}
+
+int MainGameExit( void )
+{
+	return PLAY_OK;
+}
@@ -0,0 +1,112 @@
+// Times UpscaleNearest and UpscaleSharpBilinear against a plain nearest-neighbour loop
+// Build on its own, for example: g++ -std=c++17 -O2 -I.. UpscaleBenchmark.cpp -pthread
+// The results are first checked against the plain loop, and the program exits with 1 if they differ
+#define PLAY_IMPLEMENTATION
+#include "Play.h"
+
+#include <chrono>
+
+constexpr int RUNS = 200;
+
+// The simplest possible nearest-neighbour upscale, used as the reference and the baseline
+static void UpscalePlain( const PixelData& src, Pixel* pDest, int destPitch, int scale )
+{
+	int destWidth = src.width * scale;
+	for( int y = 0; y < src.height * scale; y++ )
+		for( int x = 0; x < destWidth; x++ )
+			pDest[y * destPitch + x] = src.pPixels[( y / scale ) * src.width + x / scale];
+}
+
+static PixelData CreateSource( int width, int height )
+{
+	PixelData src;
+	src.width = width;
+	src.height = height;
+	src.pPixels = new Pixel[width * height];
+	for( int i = 0; i < width * height; i++ )
+		src.pPixels[i].bits = i * 2654435761u;
+	return src;
+}
+
+// Returns the average time in milliseconds of RUNS calls, after one call to warm up
+template< typename Function >
+static double Time( Function function )
+{
+	function();
+	auto start = std::chrono::steady_clock::now();
+	for( int i = 0; i < RUNS; i++ )
+		function();
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() / RUNS;
+}
+
+// Compares both upscalers with the plain loop at whole-number scales, odd widths and an unaligned, padded destination
+static bool CheckResults()
+{
+	bool match = true;
+	for( int scale = 1; scale <= 6; scale++ )
+	{
+		for( int width : { 1, 3, 4, 7, 33 } )
+		{
+			PixelData src = CreateSource( width, 5 );
+			int pitch = width * scale + 3;
+			size_t size = pitch * 5 * scale + 1;
+			std::vector<Pixel> plain( size ), nearest( size ), sharp( size );
+
+			UpscalePlain( src, plain.data() + 1, pitch, scale );
+			UpscaleNearest( src, nearest.data() + 1, pitch, scale );
+			UpscaleSharpBilinear( src, sharp.data() + 1, width * scale, 5 * scale, pitch );
+
+			for( size_t i = 0; i < size; i++ )
+			{
+				if( plain[i].bits != nearest[i].bits || plain[i].bits != sharp[i].bits )
+				{
+					printf( "Mismatch at scale %d, width %d\n", scale, width );
+					match = false;
+					break;
+				}
+			}
+			delete[] src.pPixels;
+		}
+	}
+	return match;
+}
+
+void MainGameEntry( PLAY_IGNORE_COMMAND_LINE )
+{
+	if( !CheckResults() )
+		exit( 1 );
+
+	printf( "Output 1920x1080, average of %d runs\n", RUNS );
+	for( int scale : { 2, 3, 4 } )
+	{
+		PixelData src = CreateSource( 1920 / scale, 1080 / scale );
+		int destWidth = src.width * scale;
+		std::vector<Pixel> dest( 1920 * 1080 );
+
+		double plain = Time( [&] { UpscalePlain( src, dest.data(), destWidth, scale ); } );
+		double nearest = Time( [&] { UpscaleNearest( src, dest.data(), destWidth, scale ); } );
+		double sharp = Time( [&] { UpscaleSharpBilinear( src, dest.data(), 1920, 1080, 1920 ); } );
+
+		printf( "scale %d (%dx%d): plain %.2fms, UpscaleNearest %.2fms, UpscaleSharpBilinear %.2fms\n", scale, src.width, src.height, plain, nearest, sharp );
+		delete[] src.pPixels;
+	}
+
+	// A non-integer scale, where sharp bilinear blends across the pixel edges
+	PixelData src = CreateSource( 640, 360 );
+	std::vector<Pixel> dest( 1997 * 1120 );
+	double sharp = Time( [&] { UpscaleSharpBilinear( src, dest.data(), 1997, 1120, 1997 ); } );
+	printf( "640x360 to 1997x1120: UpscaleSharpBilinear %.2fms\n", sharp );
+	delete[] src.pPixels;
+
+	exit( 0 );
+}
+
+bool MainGameUpdate( float )
+{
+	return true;
+}
+
+int MainGameExit( void )
+{
+	return PLAY_OK;
+}
@@ -29,18 +29,56 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cmath> 
+#include <cstring>
+#include <cctype>
+#include <cstdio>
+#include <cstdarg>
+#include <ctime>
 
 #include <string>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <list>
 #include <algorithm>
+#include <limits>
 #include <chrono>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <thread>
 #include <future>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+
+// SSE2 is always available on x64 and is used by the batch maths functions where present
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define PLAY_SSE2
+#include <emmintrin.h>
+#endif
+// AVX is only used when the compiler has been told it can be (/arch:AVX or -mavx)
+#if defined( __AVX__ )
+#define PLAY_AVX
+#include <immintrin.h>
+#endif
+// AVX2 adds the gather used to expand indexed sprites through their palettes (/arch:AVX2 or -mavx2)
+#if defined( __AVX2__ )
+#define PLAY_AVX2
+#endif
+
+// Define PLAY_PLATFORM_HEADLESS to build without a window, keyboard, mouse or sound (e.g. for Linux build and test machines)
+// > This is the default on anything other than Windows
+#if !defined( _WIN32 ) && !defined( PLAY_PLATFORM_HEADLESS )
+#define PLAY_PLATFORM_HEADLESS
+#endif
+
+#ifndef PLAY_PLATFORM_HEADLESS
 
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used content from the Windows headers
 #define NOMINMAX // Stop windows macros defining their own min and max macros
@@ -50,22 +88,27 @@
 #include <windowsx.h>
 #include <mmsystem.h>
 
-// Includes the GDI plus headers.
-// These are only needed by internal parts of the library.
-
 #include "dwmapi.h"
 #include <Shlobj.h>
-#pragma warning(push)
-#pragma warning(disable:4458) // Suppress warning for declaration of 'xyz' hides class member
 
- // Redirect the GDI to use the standard library for min and max
-namespace Gdiplus
-{
-	using std::min;
-	using std::max;
-}
-#include <GdiPlus.h>
-#pragma warning(pop)
+#else
+
+// POSIX headers for memory-mapped files
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// Linux headers for batched file reads (see ReadFileBatch)
+#if defined( __linux__ ) && !defined( PLAY_NO_IO_URING ) && __has_include( <linux/io_uring.h> )
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#define PLAY_IO_URING
+#endif
+
+#endif // PLAY_PLATFORM_HEADLESS
 
 // Macros for Assertion and Tracing
 void TracePrintf(const char* file, int line, const char* fmt, ...);
@@ -73,10 +116,16 @@ void AssertFailMessage(const char* message, const char* file, long line );
 void DebugOutput( const char* s );
 void DebugOutput( std::string s );
 
+#ifdef _MSC_VER
+#define PLAY_DEBUG_BREAK() __debugbreak()
+#else
+#define PLAY_DEBUG_BREAK() __builtin_trap()
+#endif
+
 #ifdef _DEBUG
-#define PLAY_TRACE(fmt, ...) TracePrintf(__FILE__, __LINE__, fmt, __VA_ARGS__);
-#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), __debugbreak(); }
-#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), __debugbreak(); }
+#define PLAY_TRACE(fmt, ...) TracePrintf(__FILE__, __LINE__, fmt, ##__VA_ARGS__);
+#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
+#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
 #else
 #define PLAY_TRACE(fmt, ...)
 #define PLAY_ASSERT(x) if(!(x)){ AssertFailMessage(#x, __FILE__, __LINE__);  }
@@ -132,17 +181,19 @@ constexpr float PLAY_PI	= 3.14159265358979323846f;   // pi
 struct Vector3f;
 
 // The main 2D structure used in the library
+// > Everything which doesn't need a square root is constexpr so constant vectors can be calculated at compile time
 struct Vector2f
 {
-	Vector2f() {}
+	constexpr Vector2f() : x( 0.0f ), y( 0.0f ) {}
 	// We're encouraging implicit type conversions between float and int with the same number of parameters
 	// This is really just to help new players who already suffering from cognitive overload! :-)
-	Vector2f( float x, float y ) : x( x ), y( y ) {}
-	Vector2f( int x, int y ) : x( static_cast<float>( x ) ), y( static_cast<float>( y ) ) {}
-	Vector2f( float x, int y ) : x( x ), y( static_cast<float>( y ) ) {}
-	Vector2f( int x, float y ) : x( static_cast<float>( x ) ), y( y ) {}
+	constexpr Vector2f( float x, float y ) : x( x ), y( y ) {}
+	constexpr Vector2f( int x, int y ) : x( static_cast<float>( x ) ), y( static_cast<float>( y ) ) {}
+	constexpr Vector2f( float x, int y ) : x( x ), y( static_cast<float>( y ) ) {}
+	constexpr Vector2f( int x, float y ) : x( static_cast<float>( x ) ), y( y ) {}
 
 	// Different ways of accessing member data
+	// > Only x and y can be used in constant expressions as the other members aren't the ones initialised
 	union
 	{
 		float v[2];
@@ -153,54 +204,57 @@ struct Vector2f
 	// Calculates and returns the length of the vector
 	float Length() const;
 	// Calculates and returns the length of the vector squared (faster)
-	float LengthSqr() const;
+	constexpr float LengthSqr() const;
 	// Scales this vector to a unit length (with the same direction)
 	void Normalize();
 	// Returns a vector at right angles to this one
-	Vector2f Perpendicular() const;
+	constexpr Vector2f Perpendicular() const;
 	// Returns true if the vector is euivalent to this one within tolerances (read about floating point accuracy!)
-	bool AboutEqualTo( const Vector2f& rhs, const float tolerance ) const;
+	constexpr bool AboutEqualTo( const Vector2f& rhs, const float tolerance ) const;
 	// Returns the dot product between the  vector provided and this one
-	float Dot( const Vector2f& rhs ) const;
+	constexpr float Dot( const Vector2f& rhs ) const;
 	// Assignment operator with Vector3f
-	Vector2f& operator = ( const Vector3f& rhs );
+	constexpr Vector2f& operator = ( const Vector3f& rhs );
 	// Copy constructor with Vector3f
-	Vector2f( const Vector3f& rhs );
+	constexpr Vector2f( const Vector3f& rhs );
 };
 
 // A 2D vector with a w component for use with matrices
 struct Vector3f
 {
-	Vector3f() {}
-	Vector3f( float x, float y, float w ) : x( x ), y( y ), w( w ) {}
+	constexpr Vector3f() : x( 0.0f ), y( 0.0f ), w( 0.0f ) {}
+	constexpr Vector3f( float x, float y, float w ) : x( x ), y( y ), w( w ) {}
 	//Vector3f( Vector2f v ) : x( v.x ), y( v.y ), w( 1.0f ) {}
 
 	// Different ways of accessing member data
+	// > Only x, y and w can be used in constant expressions as the other members aren't the ones initialised
 	union
 	{
 		float v[3];
 		struct { float x; float y; float w; };
-		struct { float width; float height; float w; };
+		struct { float width; float height; };
 	};
 
 	// Returns the 2D part of the 3D vector
-	Vector2f As2D() const { return Vector2f( x, y ); }
+	constexpr Vector2f As2D() const { return Vector2f( x, y ); }
+	// Returns one component (the same as v[i], but can be used in constant expressions)
+	constexpr float Element( int i ) const { return i == 0 ? x : ( i == 1 ? y : w ); }
 	// Calculates and returns the length of the vector
 	float Length() const;
 	// Calculates and returns the length of the vector squared (faster)
-	float LengthSqr() const;
+	constexpr float LengthSqr() const;
 	// Scales this vector to a unit length (with the same direction)
 	void Normalize();
 	// Returns a vector at right angles to this one
 	Vector3f Perpendicular() const;
 	// Returns true if the vector is euivalent to this one within tolerances (read about floating point accuracy!)
-	bool AboutEqualTo( const Vector3f& rhs, const float tolerance ) const;
+	constexpr bool AboutEqualTo( const Vector3f& rhs, const float tolerance ) const;
 	// Returns the dot product between the  vector provided and this one
-	float Dot( const Vector3f& rhs ) const;
+	constexpr float Dot( const Vector3f& rhs ) const;
 	// Assignment operator with Vector2f
-	Vector3f& operator = ( const Vector2f& rhs );
+	constexpr Vector3f& operator = ( const Vector2f& rhs );
 	// Copy constructor with Vector3f
-	Vector3f( const Vector2f& rhs );
+	constexpr Vector3f( const Vector2f& rhs );
 };
 
 #pragma warning(pop)
@@ -218,201 +272,148 @@ using Vector3D = Vector3f;
 // Vector assignment and copy operations
 //**************************************************************************************************
 
-inline Vector2f& Vector2f::operator = ( const Vector3f& rhs )
+constexpr Vector2f& Vector2f::operator = ( const Vector3f& rhs )
 {
-	v[0] = rhs.v[0];
-	v[1] = rhs.v[1];
+	x = rhs.x;
+	y = rhs.y;
 	return *this;
 }
 
-inline Vector2f::Vector2f( const Vector3f& rhs )
+constexpr Vector2f::Vector2f( const Vector3f& rhs ) : x( rhs.x ), y( rhs.y )
 {
-	v[0] = rhs.v[0];
-	v[1] = rhs.v[1];
 }
 
-inline Vector3f& Vector3f::operator = ( const Vector2f& rhs )
+constexpr Vector3f& Vector3f::operator = ( const Vector2f& rhs )
 {
-	v[0] = rhs.v[0];
-	v[1] = rhs.v[1];
-	v[2] = 0.0f;
+	x = rhs.x;
+	y = rhs.y;
+	w = 0.0f;
 	return *this;
 }
 
-inline Vector3f::Vector3f( const Vector2f& rhs )
+constexpr Vector3f::Vector3f( const Vector2f& rhs ) : x( rhs.x ), y( rhs.y ), w( 0.0f )
 {
-	v[0] = rhs.v[0];
-	v[1] = rhs.v[1];
-	v[2] = 0.0f;
 }
 
 // Vector component operations
 //**************************************************************************************************
 
 // Vector component addition
-inline Vector2f operator + ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator + ( const Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs.v[i] + rhs.v[i];
-	
-	return ret;
+	return Vector2f( lhs.x + rhs.x, lhs.y + rhs.y );
 }
 
-inline Vector3f operator + ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator + ( const Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs.v[i] + rhs.v[i];
-
-	return ret;
+	return Vector3f( lhs.x + rhs.x, lhs.y + rhs.y, lhs.w + rhs.w );
 }
 
 // Vector component assignment addition
-inline Vector2f& operator += ( Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f& operator += ( Vector2f& lhs, const Vector2f& rhs )
 {
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] += rhs.v[i];
-	
+	lhs.x += rhs.x;
+	lhs.y += rhs.y;
 	return lhs;
 }
 
-inline Vector3f& operator += ( Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f& operator += ( Vector3f& lhs, const Vector3f& rhs )
 {
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] += rhs.v[i];
-
+	lhs.x += rhs.x;
+	lhs.y += rhs.y;
+	lhs.w += rhs.w;
 	return lhs;
 }
 
 // Vector component subtraction
-inline Vector2f operator - ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator - ( const Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs.v[i] - rhs.v[i];
-	
-	return ret;
+	return Vector2f( lhs.x - rhs.x, lhs.y - rhs.y );
 }
 
-inline Vector3f operator - ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator - ( const Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs.v[i] - rhs.v[i];
-
-	return ret;
+	return Vector3f( lhs.x - rhs.x, lhs.y - rhs.y, lhs.w - rhs.w );
 }
 
 // Vector component assignment subtraction
-inline Vector2f& operator -= ( Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f& operator -= ( Vector2f& lhs, const Vector2f& rhs )
 {
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] -= rhs.v[i];
-	
+	lhs.x -= rhs.x;
+	lhs.y -= rhs.y;
 	return lhs;
 }
 
-inline Vector3f& operator -= ( Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f& operator -= ( Vector3f& lhs, const Vector3f& rhs )
 {
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] -= rhs.v[i];
-
+	lhs.x -= rhs.x;
+	lhs.y -= rhs.y;
+	lhs.w -= rhs.w;
 	return lhs;
 }
 
 // Vector component unary negation
-inline Vector2f operator - ( const Vector2f& op )
+constexpr Vector2f operator - ( const Vector2f& op )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = -op.v[i];
-	
-	return ret;
+	return Vector2f( -op.x, -op.y );
 }
 
-inline Vector3f operator - ( const Vector3f& op )
+constexpr Vector3f operator - ( const Vector3f& op )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = -op.v[i];
-
-	return ret;
+	return Vector3f( -op.x, -op.y, -op.w );
 }
 
 // Vector component multiplication
-inline Vector2f operator * ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator * ( const Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs.v[i] * rhs.v[i];
-	
-	return ret;
+	return Vector2f( lhs.x * rhs.x, lhs.y * rhs.y );
 }
 
-inline Vector3f operator * ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator * ( const Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs.v[i] * rhs.v[i];
-
-	return ret;
+	return Vector3f( lhs.x * rhs.x, lhs.y * rhs.y, lhs.w * rhs.w );
 }
 
 // Vector component assignment multiplication
-inline Vector2f operator *= ( Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator *= ( Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] *= rhs.v[i];
-	
+	lhs.x *= rhs.x;
+	lhs.y *= rhs.y;
 	return lhs;
 }
 
-inline Vector3f operator *= ( Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator *= ( Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] *= rhs.v[i];
-
+	lhs.x *= rhs.x;
+	lhs.y *= rhs.y;
+	lhs.w *= rhs.w;
 	return lhs;
 }
 
 // Vector component division
-inline Vector2f operator / ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator / ( const Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs.v[i] / rhs.v[i];
-	
-	return ret;
+	return Vector2f( lhs.x / rhs.x, lhs.y / rhs.y );
 }
 
-inline Vector3f operator / ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator / ( const Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs.v[i] / rhs.v[i];
-
-	return ret;
+	return Vector3f( lhs.x / rhs.x, lhs.y / rhs.y, lhs.w / rhs.w );
 }
 
 // Vector component assignment division
-inline Vector2f operator /= ( Vector2f& lhs, const Vector2f& rhs )
+constexpr Vector2f operator /= ( Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] /= rhs.v[i];
-	
+	lhs.x /= rhs.x;
+	lhs.y /= rhs.y;
 	return lhs;
 }
 
-inline Vector3f operator /= ( Vector3f& lhs, const Vector3f& rhs )
+constexpr Vector3f operator /= ( Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] /= rhs.v[i];
-
+	lhs.x /= rhs.x;
+	lhs.y /= rhs.y;
+	lhs.w /= rhs.w;
 	return lhs;
 }
 
@@ -420,101 +421,79 @@ inline Vector3f operator /= ( Vector3f& lhs, const Vector3f& rhs )
 //**************************************************************************************************
 
 // Vector scalar multiplication
-inline Vector2f operator * ( const Vector2f& lhs, const float rhs )
+constexpr Vector2f operator * ( const Vector2f& lhs, const float rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs.v[i] * rhs;
-	
-	return ret;
+	return Vector2f( lhs.x * rhs, lhs.y * rhs );
 }
 
-inline Vector3f operator * ( const Vector3f& lhs, const float rhs )
+constexpr Vector3f operator * ( const Vector3f& lhs, const float rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs.v[i] * rhs;
-
-	return ret;
+	return Vector3f( lhs.x * rhs, lhs.y * rhs, lhs.w * rhs );
 }
 
 // Vector scalar multiplication (reverse operands)
-inline Vector2f operator * ( const float lhs, const Vector2f& rhs )
+constexpr Vector2f operator * ( const float lhs, const Vector2f& rhs )
 {
 	return rhs * lhs;
 }
 
-inline Vector3f operator * ( const float lhs, const Vector3f& rhs )
+constexpr Vector3f operator * ( const float lhs, const Vector3f& rhs )
 {
 	return rhs * lhs;
 }
 
 // Vector scalar assignment multiplication
-inline Vector2f operator *= ( Vector2f& lhs, const float& rhs )
+constexpr Vector2f operator *= ( Vector2f& lhs, const float& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] *= rhs;
-	
+	lhs.x *= rhs;
+	lhs.y *= rhs;
 	return lhs;
 }
 
-inline Vector3f operator *= ( Vector3f& lhs, const float& rhs )
+constexpr Vector3f operator *= ( Vector3f& lhs, const float& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] *= rhs;
-
+	lhs.x *= rhs;
+	lhs.y *= rhs;
+	lhs.w *= rhs;
 	return lhs;
 }
 
 // Vector scalar division
-inline Vector2f operator / ( const Vector2f& lhs, const float rhs )
+constexpr Vector2f operator / ( const Vector2f& lhs, const float rhs )
 {
 	return lhs * ( float( 1 ) / rhs );
 }
 
-inline Vector3f operator / ( const Vector3f& lhs, const float rhs )
+constexpr Vector3f operator / ( const Vector3f& lhs, const float rhs )
 {
 	return lhs * ( float( 1 ) / rhs );
 }
 
 
 // Vector scalar division (reverse operands)
-inline Vector2f operator / ( const float lhs, const Vector2f& rhs )
+constexpr Vector2f operator / ( const float lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		ret.v[i] = lhs / rhs.v[i];
-	
-	return ret;
+	return Vector2f( lhs / rhs.x, lhs / rhs.y );
 }
 
-inline Vector3f operator / ( const float lhs, const Vector3f& rhs )
+constexpr Vector3f operator / ( const float lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		ret.v[i] = lhs / rhs.v[i];
-
-	return ret;
+	return Vector3f( lhs / rhs.x, lhs / rhs.y, lhs / rhs.w );
 }
 
 // Vector scalar assignment multiplication
-inline Vector2f operator /= ( Vector2f& lhs, const float& rhs )
+constexpr Vector2f operator /= ( Vector2f& lhs, const float& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-		lhs.v[i] /= rhs;
-	
+	lhs.x /= rhs;
+	lhs.y /= rhs;
 	return lhs;
 }
 
-inline Vector3f operator /= ( Vector3f& lhs, const float& rhs )
+constexpr Vector3f operator /= ( Vector3f& lhs, const float& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-		lhs.v[i] /= rhs;
-
+	lhs.x /= rhs;
+	lhs.y /= rhs;
+	lhs.w /= rhs;
 	return lhs;
 }
 
@@ -522,130 +501,98 @@ inline Vector3f operator /= ( Vector3f& lhs, const float& rhs )
 //**************************************************************************************************
 
 // Vector components exactly equal
-inline bool operator == ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr bool operator == ( const Vector2f& lhs, const Vector2f& rhs )
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-	{
-		if( lhs.v[i] != rhs.v[i] )
-			return false;
-	}
-	return true;
+	return lhs.x == rhs.x && lhs.y == rhs.y;
 }
 
-inline bool operator == ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr bool operator == ( const Vector3f& lhs, const Vector3f& rhs )
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-	{
-		if( lhs.v[i] != rhs.v[i] )
-			return false;
-	}
-	return true;
+	return lhs.x == rhs.x && lhs.y == rhs.y && lhs.w == rhs.w;
 }
 
 // Vector components not equal
-inline bool operator != ( const Vector2f& lhs, const Vector2f& rhs )
+constexpr bool operator != ( const Vector2f& lhs, const Vector2f& rhs )
 {
 	return !( lhs == rhs );
 }
 
-inline bool operator != ( const Vector3f& lhs, const Vector3f& rhs )
+constexpr bool operator != ( const Vector3f& lhs, const Vector3f& rhs )
 {
 	return !( lhs == rhs );
 }
 
+// Returns true if the difference between two values is within a tolerance (std::abs isn't constexpr)
+constexpr bool AboutEqual( float lhs, float rhs, float tolerance )
+{
+	return lhs - rhs <= tolerance && rhs - lhs <= tolerance;
+}
+
 // Vector components equal to within specified tolerance.
-inline bool Vector2f::AboutEqualTo( const Vector2f& rhs, const float tolerance ) const
+constexpr bool Vector2f::AboutEqualTo( const Vector2f& rhs, const float tolerance ) const
 {
-	Vector2f ret;
-	for( int i = 0; i < 2; ++i )
-	{
-		if( std::abs( v[i] - rhs.v[i] ) > tolerance )
-			return false;
-	}
-	return true;
+	return AboutEqual( x, rhs.x, tolerance ) && AboutEqual( y, rhs.y, tolerance );
 }
 
-inline bool Vector3f::AboutEqualTo( const Vector3f& rhs, const float tolerance ) const
+constexpr bool Vector3f::AboutEqualTo( const Vector3f& rhs, const float tolerance ) const
 {
-	Vector3f ret;
-	for( int i = 0; i < 3; ++i )
-	{
-		if( std::abs( v[i] - rhs.v[i] ) > tolerance )
-			return false;
-	}
-	return true;
+	return AboutEqual( x, rhs.x, tolerance ) && AboutEqual( y, rhs.y, tolerance ) && AboutEqual( w, rhs.w, tolerance );
 }
 
 // Common maths functions
 //**************************************************************************************************
 
 // Dot product
-inline float  Vector2f::Dot( const Vector2f& rhs ) const
+constexpr float Vector2f::Dot( const Vector2f& rhs ) const
 {
-	float ret = 0.f;
-	for( int i = 0; i < 2; ++i )
-		ret += v[i] * rhs.v[i];
-	
-	return ret;
+	return x * rhs.x + y * rhs.y;
 }
 
-inline float dot( const Vector2f& lhs, const Vector2f& rhs )
+constexpr float dot( const Vector2f& lhs, const Vector2f& rhs )
 {
 	return lhs.Dot( rhs );
 }
 
 
-inline float Vector3f::Dot( const Vector3f& rhs ) const
+constexpr float Vector3f::Dot( const Vector3f& rhs ) const
 {
-	float ret = 0.f;
-	for( int i = 0; i < 3; ++i )
-		ret += v[i] * rhs.v[i];
-
-	return ret;
+	return x * rhs.x + y * rhs.y + w * rhs.w;
 }
 
-inline float dot( const Vector3f& lhs, const Vector3f& rhs )
+constexpr float dot( const Vector3f& lhs, const Vector3f& rhs )
 {
 	return lhs.Dot( rhs );
 }
 
 // Orthogonal vector
-inline Vector2f Vector2f::Perpendicular() const
+constexpr Vector2f Vector2f::Perpendicular() const
 {
-	Vector2f ret;
-	ret.v[0] = -v[1];
-	ret.v[1] = v[0];
-	return ret;
+	return Vector2f( -y, x );
 }
 
 // Orthogonal vector
-inline Vector2f perpendicular( const Vector3f& rhs ) 
+constexpr Vector2f perpendicular( const Vector3f& rhs ) 
 {
-	Vector2f ret;
-	ret.v[0] = -rhs.v[1];
-	ret.v[1] = rhs.v[0];
-	return ret;
+	return Vector2f( -rhs.y, rhs.x );
 }
 
 // Vector length squared
-inline float Vector2f::LengthSqr() const
+constexpr float Vector2f::LengthSqr() const
 {
 	return Dot( *this );
 }
 
-inline float Vector3f::LengthSqr() const
+constexpr float Vector3f::LengthSqr() const
 {
 	return Dot( *this );
 }
 
-inline float lengthSqr( const Vector2f& v )
+constexpr float lengthSqr( const Vector2f& v )
 {
 	return dot( v, v );
 }
 
-inline float lengthSqr( const Vector3f& v )
+constexpr float lengthSqr( const Vector3f& v )
 {
 	return dot( v, v );
 }
@@ -694,121 +641,241 @@ inline Vector3f normalize( const Vector3f& v )
 }
 
 
+// Fast trigonometry
+//**************************************************************************************************
+// Approximations for the per-object maths where sin, cos and atan2 show up in profiles. Measured accuracy:
+// > FastSinCos: table lookup with linear interpolation, absolute error below 5e-6 for angles within +/-10 radians,
+//   1e-5 within +/-100 radians and 1e-4 within +/-1000 radians (float precision runs out for large angles)
+// > FastAtan2: polynomial, absolute error below 1.2e-5 radians (exact at 0, +/-pi/2 and +/-pi, with signed zeros handled as std::atan2 does)
+// > FastSinCosBatch: range reduction and polynomials (SSE2 when available), absolute error below 2e-7 within +/-1000 radians
+// > FastSinCos and FastSinCosBatch fall back to std::sin and std::cos beyond +/-1000 radians, and for infinities and NaN
+// > FastAtan2Batch: the same polynomial as FastAtan2 (SSE2 when available) with the same error bound
+// Define PLAY_FAST_TRIG before including Play.h to make the library use these (via PlaySinCos and PlayAtan2)
+// The bounds are checked against the std functions by Checks/FastTrig.cpp
+
+// The number of entries in a full turn of the sine table (must be a power of two)
+constexpr int PLAY_SINE_TABLE_SIZE = 1024;
+// The largest angle (in radians) the fast sine and cosine functions handle themselves
+constexpr float PLAY_FAST_TRIG_RANGE = 1000.0f;
+
+// A full turn of sine values calculated at compile time, plus one extra entry so interpolation never needs to wrap
+struct PlaySineTable
+{
+	float value[PLAY_SINE_TABLE_SIZE + 1]{};
+
+	constexpr PlaySineTable()
+	{
+		constexpr int quarter = PLAY_SINE_TABLE_SIZE / 4;
+		for( int i = 0; i <= PLAY_SINE_TABLE_SIZE; ++i )
+		{
+			// Use a Taylor series in double precision within the first quadrant and reflect it into the others
+			double r = ( i % quarter ) * ( 3.14159265358979323846 * 2.0 / PLAY_SINE_TABLE_SIZE );
+			double sinR = 0.0, cosR = 0.0, term = 1.0;
+			for( int n = 0; n < 24; ++n )
+			{
+				if( n & 1 )
+					sinR += ( n & 2 ) ? -term : term;
+				else
+					cosR += ( n & 2 ) ? -term : term;
+				term *= r / ( n + 1 );
+			}
+
+			switch( ( i / quarter ) & 3 )
+			{
+				case 0: value[i] = static_cast<float>( sinR ); break;
+				case 1: value[i] = static_cast<float>( cosR ); break;
+				case 2: value[i] = static_cast<float>( -sinR ); break;
+				case 3: value[i] = static_cast<float>( -cosR ); break;
+			}
+		}
+	}
+};
+
+inline constexpr PlaySineTable g_playSineTable{};
+
+// Calculates the sine and cosine of an angle (in radians) from the sine table
+inline void FastSinCos( float angle, float& sinOut, float& cosOut )
+{
+	// Also true for NaN, which can't be converted to a table index
+	if( !( std::abs( angle ) <= PLAY_FAST_TRIG_RANGE ) )
+	{
+		sinOut = std::sin( angle );
+		cosOut = std::cos( angle );
+		return;
+	}
+
+	constexpr float toIndex = PLAY_SINE_TABLE_SIZE / ( 2.0f * PLAY_PI );
+	float t = angle * toIndex;
+	float whole = std::floor( t );
+	float frac = t - whole;
+
+	// The cosine is the same as the sine a quarter of a turn further on
+	int i = static_cast<int>( static_cast<long long>( whole ) & ( PLAY_SINE_TABLE_SIZE - 1 ) );
+	int j = ( i + PLAY_SINE_TABLE_SIZE / 4 ) & ( PLAY_SINE_TABLE_SIZE - 1 );
+
+	const float* table = g_playSineTable.value;
+	sinOut = table[i] + ( table[i + 1] - table[i] ) * frac;
+	cosOut = table[j] + ( table[j + 1] - table[j] ) * frac;
+}
+
+// Calculates the sine of an angle (in radians) from the sine table
+inline float FastSin( float angle )
+{
+	float s, c;
+	FastSinCos( angle, s, c );
+	return s;
+}
+
+// Calculates the cosine of an angle (in radians) from the sine table
+inline float FastCos( float angle )
+{
+	float s, c;
+	FastSinCos( angle, s, c );
+	return c;
+}
+
+// Calculates the angle of the vector (x,y) using a polynomial approximation of atan
+inline float FastAtan2( float y, float x )
+{
+	float ax = std::abs( x );
+	float ay = std::abs( y );
+	float maxXY = ax > ay ? ax : ay;
+	float minXY = ax > ay ? ay : ax;
+
+	// Approximate atan over 0-1 and then use symmetry to find the right octant
+	float a = maxXY > 0.0f ? minXY / maxXY : 0.0f;
+	float s = a * a;
+	float r = ( ( ( ( 0.0208351f * s - 0.0851330f ) * s + 0.1801410f ) * s - 0.3302995f ) * s + 0.9998660f ) * a;
+
+	// The sign bits are used so that signed zeros give the same result as std::atan2
+	if( ay > ax ) r = ( PLAY_PI / 2 ) - r;
+	if( std::signbit( x ) ) r = PLAY_PI - r;
+	if( std::signbit( y ) ) r = -r;
+	return r;
+}
+
+// Calculates the sine and cosine of an array of angles
+void FastSinCosBatch( const float* angles, float* sinOut, float* cosOut, int count );
+// Calculates atan2 for arrays of y and x values
+void FastAtan2Batch( const float* y, const float* x, float* angleOut, int count );
+
+// Calculates a sine and cosine for use within the library: define PLAY_FAST_TRIG to use FastSinCos instead of the std functions
+inline void PlaySinCos( float angle, float& sinOut, float& cosOut )
+{
+#ifdef PLAY_FAST_TRIG
+	FastSinCos( angle, sinOut, cosOut );
+#else
+	sinOut = sin( angle );
+	cosOut = cos( angle );
+#endif
+}
+
+// Calculates atan2 for use within the library: define PLAY_FAST_TRIG to use FastAtan2 instead of the std function
+inline float PlayAtan2( float y, float x )
+{
+#ifdef PLAY_FAST_TRIG
+	return FastAtan2( y, x );
+#else
+	return atan2( y, x );
+#endif
+}
+
+
 // A 3x3 structure for representing 2D matrices
+// > Everything except MatrixRotation and Inverse is constexpr so constant transforms can be calculated at compile time
 struct Matrix2D
 {
-	Matrix2D() {}
-	explicit Matrix2D( const Vector3f& row0, const Vector3f& row1, const Vector3f& row2 )
+	constexpr Matrix2D() {}
+	explicit constexpr Matrix2D( const Vector3f& row0, const Vector3f& row1, const Vector3f& row2 )
 		: row{ row0, row1, row2 }
 	{
 	}
+	// Only row can be used in constant expressions as m isn't the member which is initialised
 	union
 	{
 		float m[3][3];
 		Vector3f row[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
 	};
 
+	// Returns one element (the same as m[r][c], but can be used in constant expressions)
+	constexpr float Element( int r, int c ) const { return row[r].Element( c ); }
+	// Multiplies a row vector by this matrix and returns all three components
+	constexpr Vector3f Multiply( const Vector3f& v ) const;
 	// Transforms a vector by this matrix
-	Vector2f Transform( const Vector3f& v ) const;
+	constexpr Vector2f Transform( const Vector3f& v ) const;
 	// Transforms a vector by this matrix
-	Vector2f Transform( const Vector2f& v ) const;
+	constexpr Vector2f Transform( const Vector2f& v ) const;
 	// Transposes the matrix (swaps the columns and rows)
-	void Transpose();
+	constexpr void Transpose();
 	// Compares this matrix to another within a tolerance (read about floating point inaccuracies!)
-	bool AboutEqualTo( const Matrix2D& rhs, const float tolerance ) const;
+	constexpr bool AboutEqualTo( const Matrix2D& rhs, const float tolerance ) const;
 	// Inverts this matrix (makes it perform the opposite operation)
 	void Inverse();
 };
 
 // Matrix addition
-inline Matrix2D operator + ( const Matrix2D& lhs, const Matrix2D& rhs )
+constexpr Matrix2D operator + ( const Matrix2D& lhs, const Matrix2D& rhs )
 {
-	Matrix2D ret;
-	for( int i = 0; i < 3; ++i )
-		for( int j = 0; j < 3; ++j )
-			ret.m[i][j] = lhs.m[i][j] + rhs.m[i][j];
-	
-	return ret;
+	return Matrix2D( lhs.row[0] + rhs.row[0], lhs.row[1] + rhs.row[1], lhs.row[2] + rhs.row[2] );
 }
 
 // Matrix subtraction
-inline Matrix2D operator - ( const Matrix2D& lhs, const Matrix2D& rhs )
+constexpr Matrix2D operator - ( const Matrix2D& lhs, const Matrix2D& rhs )
 {
-	Matrix2D ret;
-	for( int i = 0; i < 3; ++i )
-		for( int j = 0; j < 3; ++j )
-			ret.m[i][j] = lhs.m[i][j] - rhs.m[i][j];
-	
-	return ret;
+	return Matrix2D( lhs.row[0] - rhs.row[0], lhs.row[1] - rhs.row[1], lhs.row[2] - rhs.row[2] );
+}
+
+// Multiply a row vector by a matrix
+constexpr Vector3f Matrix2D::Multiply( const Vector3f& v ) const
+{
+	return Vector3f(
+		v.x * row[0].x + v.y * row[1].x + v.w * row[2].x,
+		v.x * row[0].y + v.y * row[1].y + v.w * row[2].y,
+		v.x * row[0].w + v.y * row[1].w + v.w * row[2].w
+	);
 }
 
 // Matrix multiplication
-inline Matrix2D operator * ( const Matrix2D& lhs, const Matrix2D& rhs )
+// > Each row of the result is the corresponding row of rhs multiplied by lhs
+constexpr Matrix2D operator * ( const Matrix2D& lhs, const Matrix2D& rhs )
 {
-	Matrix2D ret;
-	for( int i = 0; i < 3; ++i )
-	{
-		for( int j = 0; j < 3; ++j )
-		{
-			float t = 0;
-			for( int k = 0; k < 3; ++k )
-				t += lhs.m[k][i] * rhs.m[j][k];
-			
-			ret.m[j][i] = t;
-		}
-	}
-	return ret;
+	return Matrix2D( lhs.Multiply( rhs.row[0] ), lhs.Multiply( rhs.row[1] ), lhs.Multiply( rhs.row[2] ) );
 }
 
 // Multipy a vector by a matrix
-inline Vector2f Matrix2D::Transform( const Vector2f& v ) const
+constexpr Vector2f Matrix2D::Transform( const Vector2f& v ) const
 {
-	Vector3f v3 = v;
-	v3.w = 1.0f;
-	return Transform( v3 );
+	return Transform( Vector3f( v.x, v.y, 1.0f ) );
 }
 
 // Multipy a vector by a matrix
-inline Vector2f Matrix2D::Transform( const Vector3f& v ) const
+constexpr Vector2f Matrix2D::Transform( const Vector3f& v ) const
 {
-	Vector3f ret;
-
-	for( int i = 0; i < 3; ++i )
-	{
-		ret.v[i] = float( 0 );
-		for( int j = 0; j < 3; ++j )
-			ret.v[i] += m[j][i] * v.v[j];
-	}
-	return Vector2f( ret.x, ret.y );
+	return Multiply( v ).As2D();
 }
 
 // Transpose the contents of a matrix
-inline void Matrix2D::Transpose()
+constexpr void Matrix2D::Transpose()
 {
-	Matrix2D temp;
-	for( int i = 0; i < 3; ++i )
-	{
-		for( int j = 0; j < 3; ++j )
-			temp.m[j][i] = m[i][j];
-	}
+	Matrix2D temp(
+		Vector3f( row[0].x, row[1].x, row[2].x ),
+		Vector3f( row[0].y, row[1].y, row[2].y ),
+		Vector3f( row[0].w, row[1].w, row[2].w )
+	);
 	*this = temp;
 }
 
 // Create an identity matrix
-inline Matrix2D MatrixIdentity()
+constexpr Matrix2D MatrixIdentity()
 {
-	Matrix2D mat;
-	for( int i = 0; i < 3; ++i )
-		for( int j = 0; j < 3; ++j )
-			mat.m[i][j] = ( i == j ) ? float( 1 ) : 0;
-	return mat;
+	return Matrix2D();
 }
 
 // Create a rotation matrix
 inline Matrix2D MatrixRotation( const float theta )
 {
-	float c = cos( theta );
-	float s = sin( theta );
+	float s, c;
+	PlaySinCos( theta, s, c );
 
 	return Matrix2D(
 		Vector3f( c, s, 0 ),
@@ -818,7 +885,7 @@ inline Matrix2D MatrixRotation( const float theta )
 }
 
 // Create a scaling matrix
-inline Matrix2D MatrixScale( const float x, const float y )
+constexpr Matrix2D MatrixScale( const float x, const float y )
 {
 	return Matrix2D(
 		Vector3f( x, 0, 0 ),
@@ -828,7 +895,7 @@ inline Matrix2D MatrixScale( const float x, const float y )
 }
 
 // Create a translation matrix
-inline Matrix2D MatrixTranslation( const float x, const float y )
+constexpr Matrix2D MatrixTranslation( const float x, const float y )
 {
 	return Matrix2D(
 		Vector3f( 1, 0, 0 ),
@@ -838,32 +905,29 @@ inline Matrix2D MatrixTranslation( const float x, const float y )
 }
 
 // Compare two matrices within a tolerance value
-inline bool Matrix2D::AboutEqualTo( const Matrix2D& rhs, const float tolerance ) const
+constexpr bool Matrix2D::AboutEqualTo( const Matrix2D& rhs, const float tolerance ) const
 {
 	for( int i = 0; i < 3; ++i )
 	{
-		for( int j = 0; j < 3; ++j )
-		{
-			if( std::abs( m[i][j] - rhs.m[i][j] ) > tolerance )
-				return false;
-		}
+		if( !row[i].AboutEqualTo( rhs.row[i], tolerance ) )
+			return false;
 	}
 	return true;
 }
 
 
 // Calculate the determinant of a 2x2 matrix
-inline float Determinant( const Matrix2D& m )
+constexpr float Determinant( const Matrix2D& m )
 {
-	return m.m[0][0] * m.m[1][1] * m.m[2][2]
-		+ m.m[1][0] * m.m[2][1] * m.m[0][2]
-		+ m.m[2][0] * m.m[0][1] * m.m[1][2]
-		- m.m[0][0] * m.m[2][1] * m.m[1][2]
-		- m.m[1][0] * m.m[0][1] * m.m[2][2]
-		- m.m[2][0] * m.m[1][1] * m.m[0][2];
+	return m.Element( 0, 0 ) * m.Element( 1, 1 ) * m.Element( 2, 2 )
+		+ m.Element( 1, 0 ) * m.Element( 2, 1 ) * m.Element( 0, 2 )
+		+ m.Element( 2, 0 ) * m.Element( 0, 1 ) * m.Element( 1, 2 )
+		- m.Element( 0, 0 ) * m.Element( 2, 1 ) * m.Element( 1, 2 )
+		- m.Element( 1, 0 ) * m.Element( 0, 1 ) * m.Element( 2, 2 )
+		- m.Element( 2, 0 ) * m.Element( 1, 1 ) * m.Element( 0, 2 );
 }
 
-inline float det2x2( float a, float b, float c, float d )
+constexpr float det2x2( float a, float b, float c, float d )
 {
 	return a * d - b * c;
 }
@@ -894,6 +958,127 @@ inline void Matrix2D::Inverse()
 }
 
 
+// A 2x3 affine structure for the transforms used to draw sprites
+// > Same row layout as Matrix2D without the constant third column, so x' = x*m00 + y*m10 + tx and y' = x*m01 + y*m11 + ty
+struct Affine2D
+{
+	constexpr Affine2D() {}
+	constexpr Affine2D( float m00, float m01, float m10, float m11, float tx, float ty )
+		: m00( m00 ), m01( m01 ), m10( m10 ), m11( m11 ), tx( tx ), ty( ty )
+	{
+	}
+	// Takes the affine part of a matrix (the third column is assumed to be 0, 0, 1)
+	explicit constexpr Affine2D( const Matrix2D& mat )
+		: m00( mat.row[0].x ), m01( mat.row[0].y ), m10( mat.row[1].x ), m11( mat.row[1].y ), tx( mat.row[2].x ), ty( mat.row[2].y )
+	{
+	}
+
+	float m00{ 1.0f }, m01{ 0.0f };
+	float m10{ 0.0f }, m11{ 1.0f };
+	float tx{ 0.0f }, ty{ 0.0f };
+
+	// Transforms a point by this affine transform
+	constexpr Vector2f Transform( const Vector2f& v ) const { return { v.x * m00 + v.y * m10 + tx, v.x * m01 + v.y * m11 + ty }; }
+	// Calculates the determinant of the 2x2 part (the translation doesn't affect it)
+	constexpr float Determinant() const { return m00 * m11 - m01 * m10; }
+	// Returns the inverse transform using the closed form for a 2x2 matrix and a translation
+	Affine2D Inverted() const;
+	// Returns a copy of this transform with an additional translation applied afterwards
+	constexpr Affine2D Translated( const Vector2f& offset ) const { return { m00, m01, m10, m11, tx + offset.x, ty + offset.y }; }
+	// Returns the equivalent 3x3 matrix
+	constexpr Matrix2D ToMatrix() const { return Matrix2D( { m00, m01, 0.0f }, { m10, m11, 0.0f }, { tx, ty, 1.0f } ); }
+};
+
+// The same as Affine2D with each element in 16.16 fixed point for stepping through pixels using integer adds
+struct Affine2Dfx
+{
+	int32_t m00{ 0x10000 }, m01{ 0 };
+	int32_t m10{ 0 }, m11{ 0x10000 };
+	int32_t tx{ 0 }, ty{ 0 };
+};
+
+// Converts a float to 16.16 fixed point (rounded to nearest)
+// > Values outside +/-32767 are clamped to the int32_t range, and NaN gives 0
+constexpr int32_t ToFixed16( float f )
+{
+	float fixed = f * 65536.0f + ( f < 0.0f ? -0.5f : 0.5f );
+	if( fixed != fixed ) return 0;
+	if( fixed >= 2147483648.0f ) return std::numeric_limits<int32_t>::max();
+	if( fixed <= -2147483648.0f ) return std::numeric_limits<int32_t>::min();
+	return static_cast<int32_t>( fixed );
+}
+
+// Converts an affine transform to 16.16 fixed point
+// > Only accurate for translations within +/-32767 pixels, beyond which the elements are clamped
+constexpr Affine2Dfx AffineToFixed( const Affine2D& a )
+{
+	Affine2Dfx fx;
+	fx.m00 = ToFixed16( a.m00 ); fx.m01 = ToFixed16( a.m01 );
+	fx.m10 = ToFixed16( a.m10 ); fx.m11 = ToFixed16( a.m11 );
+	fx.tx = ToFixed16( a.tx ); fx.ty = ToFixed16( a.ty );
+	return fx;
+}
+
+// Create a rotation and uniform scale followed by a translation from a precalculated sine and cosine
+// > Equivalent to MatrixScale( scale, scale ) * MatrixRotation( angle ) with the translation in the bottom row
+constexpr Affine2D AffineRotationScale( float sinAngle, float cosAngle, float scale, const Vector2f& pos )
+{
+	return { cosAngle * scale, sinAngle * scale, -sinAngle * scale, cosAngle * scale, pos.x, pos.y };
+}
+
+// Create the inverse of AffineRotationScale directly: the inverse of a rotation is its transpose, so no determinant is needed
+constexpr Affine2D AffineRotationScaleInverse( float sinAngle, float cosAngle, float scale, const Vector2f& pos )
+{
+	float invScale = 1.0f / scale;
+	float i00 = cosAngle * invScale;
+	float i01 = -sinAngle * invScale;
+	float i10 = sinAngle * invScale;
+	float i11 = cosAngle * invScale;
+	return { i00, i01, i10, i11, -( pos.x * i00 + pos.y * i10 ), -( pos.x * i01 + pos.y * i11 ) };
+}
+
+// Calculate the inverse of a 2x3 affine transform
+inline Affine2D Affine2D::Inverted() const
+{
+	float d = Determinant();
+	PLAY_ASSERT_MSG( d != 0.f, "Zero determinant" );
+
+	float f = float( 1 ) / d;
+	float i00 = m11 * f;
+	float i01 = -m01 * f;
+	float i10 = -m10 * f;
+	float i11 = m00 * f;
+	return { i00, i01, i10, i11, -( tx * i00 + ty * i10 ), -( tx * i01 + ty * i11 ) };
+}
+
+
+// Batch vector operations
+//**************************************************************************************************
+// These process whole arrays of points at once using AVX or SSE2 where available (with a plain C++ fallback).
+// > The AoS versions take arrays of Vector2f, the SoA versions take separate x and y arrays which are faster still
+// > Output arrays can be the same as the input arrays, but must not otherwise overlap them
+
+// Adds a scaled vector to each vector: v[i] += add[i] * scale (e.g. pos += vel * dt)
+void BatchAddScaled( Vector2f* v, const Vector2f* add, float scale, int count );
+void BatchAddScaled( float* x, float* y, const float* addX, const float* addY, float scale, int count );
+// Transforms each point by a matrix (the third column is assumed to be 0, 0, 1)
+void BatchTransform( const Vector2f* in, Vector2f* out, const Matrix2D& m, int count );
+void BatchTransform( const float* inX, const float* inY, float* outX, float* outY, const Matrix2D& m, int count );
+// Transforms each point by an affine transform
+void BatchTransform( const Vector2f* in, Vector2f* out, const Affine2D& m, int count );
+void BatchTransform( const float* inX, const float* inY, float* outX, float* outY, const Affine2D& m, int count );
+// Calculates the length of each vector
+void BatchLength( const Vector2f* v, float* lengthOut, int count );
+void BatchLength( const float* x, const float* y, float* lengthOut, int count );
+// Normalizes each vector
+// > Unlike Vector2f::Normalize, zero length vectors are left as zero
+void BatchNormalize( Vector2f* v, int count );
+void BatchNormalize( float* x, float* y, int count );
+// Calculates the squared distance from each point to a single target point
+void BatchDistanceSqr( const Vector2f* points, const Point2f& target, float* distSqrOut, int count );
+void BatchDistanceSqr( const float* x, const float* y, const Point2f& target, float* distSqrOut, int count );
+
+
 #endif
 
 
@@ -908,21 +1093,28 @@ inline void Matrix2D::Inverse()
 // A pixel structure to represent an ARBG format pixel
 struct Pixel
 {
-	Pixel() {}
-	Pixel( uint32_t bits ) : bits( bits ) {}
-	Pixel( float r, float g, float b ) :
-		a( 0xFF ), r( static_cast<uint8_t>( r ) ), g( static_cast<uint8_t>( g ) ), b( static_cast<uint8_t>( b ) )
+	constexpr Pixel() {}
+	constexpr Pixel( uint32_t bits ) : bits( bits ) {}
+	constexpr Pixel( float r, float g, float b ) :
+		bits( Pack( 0xFF, static_cast<uint8_t>( r ), static_cast<uint8_t>( g ), static_cast<uint8_t>( b ) ) )
+	{
+	}
+	constexpr Pixel( int r, int g, int b ) :
+		bits( Pack( 0xFF, static_cast<uint8_t>( r ), static_cast<uint8_t>( g ), static_cast<uint8_t>( b ) ) )
 	{
 	}
-	Pixel( int r, int g, int b ) :
-		a( 0xFF ), r( static_cast<uint8_t>( r ) ), g( static_cast<uint8_t>( g ) ), b( static_cast<uint8_t>( b ) )
+	constexpr Pixel( int a, int r, int g, int b ) :
+		bits( Pack( static_cast<uint8_t>( a ), static_cast<uint8_t>( r ), static_cast<uint8_t>( g ), static_cast<uint8_t>( b ) ) )
 	{
 	}
-	Pixel( int a, int r, int g, int b ) :
-		a( static_cast<uint8_t>( a ) ), r( static_cast<uint8_t>( r ) ), g( static_cast<uint8_t>( g ) ), b( static_cast<uint8_t>( b ) )
+
+	// Combines the four channels into the same layout as the struct below
+	static constexpr uint32_t Pack( uint8_t a, uint8_t r, uint8_t g, uint8_t b )
 	{
+		return ( static_cast<uint32_t>( a ) << 24 ) | ( static_cast<uint32_t>( r ) << 16 ) | ( static_cast<uint32_t>( g ) << 8 ) | b;
 	}
 
+	// The constructors always set bits so that pixels can be constexpr: only bits can be used in constant expressions
 	union
 	{
 		uint32_t bits{ 0xFF000000 }; // Alpha set to opaque by default
@@ -930,17 +1122,17 @@ struct Pixel
 	};
 };
 
-const Pixel PIX_BLACK{ 0x00, 0x00, 0x00 };
-const Pixel PIX_WHITE{ 0xFF, 0xFF, 0xFF };
-const Pixel PIX_RED{ 0xFF, 0x00, 0x00 };
-const Pixel PIX_GREEN{ 0x00, 0x8F, 0x00 };
-const Pixel PIX_BLUE{ 0x00, 0x00, 0xFF };
-const Pixel PIX_MAGENTA{ 0xFF, 0x00, 0xFF };
-const Pixel PIX_CYAN{ 0x00, 0xFF, 0xFF };
-const Pixel PIX_YELLOW{ 0xFF, 0xFF, 0x00 };
-const Pixel PIX_ORANGE{ 0xFF, 0x8F, 0x00 };
-const Pixel PIX_GREY{ 0x80, 0x80, 0x80 };
-const Pixel PIX_TRANS{ 0x00, 0x00, 0x00, 0x00 };
+constexpr Pixel PIX_BLACK{ 0x00, 0x00, 0x00 };
+constexpr Pixel PIX_WHITE{ 0xFF, 0xFF, 0xFF };
+constexpr Pixel PIX_RED{ 0xFF, 0x00, 0x00 };
+constexpr Pixel PIX_GREEN{ 0x00, 0x8F, 0x00 };
+constexpr Pixel PIX_BLUE{ 0x00, 0x00, 0xFF };
+constexpr Pixel PIX_MAGENTA{ 0xFF, 0x00, 0xFF };
+constexpr Pixel PIX_CYAN{ 0x00, 0xFF, 0xFF };
+constexpr Pixel PIX_YELLOW{ 0xFF, 0xFF, 0x00 };
+constexpr Pixel PIX_ORANGE{ 0xFF, 0x8F, 0x00 };
+constexpr Pixel PIX_GREY{ 0x80, 0x80, 0x80 };
+constexpr Pixel PIX_TRANS{ 0x00, 0x00, 0x00, 0x00 };
 
 
 struct PixelData
@@ -975,8 +1167,8 @@ struct MouseData
 //********************************************************************************************************************************
 // File:		PlayWindow.h
 // Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
-// Notes:		Uses a 32-bit ARGB display buffer
+// Platform:	Windows or headless
+// Notes:		Uses a 32-bit ARGB display buffer. The headless version presents to memory instead of a window.
 //********************************************************************************************************************************
 
 // The target frame rate
@@ -988,6 +1180,177 @@ constexpr int FRAMES_PER_SECOND = 60;
 constexpr int PLAY_OK = 0;
 constexpr int PLAY_ERROR = -1;
 
+// Converts a path written with Windows separators (e.g. "Data\\Sprites\\") into one the platform understands
+inline std::string PlatformPath( std::string path )
+{
+#ifdef PLAY_PLATFORM_HEADLESS
+	std::replace( path.begin(), path.end(), '\\', '/' );
+#endif
+	return path;
+}
+
+// Calls function( index ) for every index from 0 to count - 1, spread across all of the processor's cores
+// > Returns once every call has finished. The calls happen at the same time and in any order, so each must only change its own data
+inline void ParallelFor( int count, const std::function<void( int index )>& function )
+{
+	int threadCount = std::min( count, static_cast<int>( std::max( 1u, std::thread::hardware_concurrency() ) ) );
+	std::atomic<int> next{ 0 };
+	auto Work = [&]()
+	{
+		for( int index = next++; index < count; index = next++ )
+			function( index );
+	};
+
+	// The calling thread does its share too
+	std::vector<std::thread> vThreads;
+	for( int t = 1; t < threadCount; t++ )
+		vThreads.emplace_back( Work );
+	Work();
+	for( std::thread& thread : vThreads )
+		thread.join();
+}
+
+// Called by ReadFileBatch with the contents of each file, or with no bytes if the file couldn't be read
+using FileBatchFunction = std::function<void( int index, std::vector<uint8_t>& bytes )>;
+// Reads whole files into memory, calling function( index, bytes ) on a worker thread for each file as soon as it has arrived
+// > Returns once every call has finished. As with ParallelFor, the calls happen at the same time and in any order
+// > On Linux all the reads are submitted together using io_uring, so they overlap each other as well as the calls
+// > Elsewhere, or if io_uring isn't available or PLAY_NO_IO_URING is defined, each worker thread uses ordinary reads
+void ReadFileBatch( const std::vector<std::string>& vFiles, const FileBatchFunction& function );
+
+#ifdef PLAY_PLATFORM_HEADLESS
+// Options for running without a window, read from the command line by the headless main()
+// > --frames N : quit after N frames (the default of 0 runs until MainGameUpdate returns true)
+// > --unlocked : run as fast as possible instead of at FRAMES_PER_SECOND (MainGameUpdate is still given one frame at the target rate)
+// > --input FILE : read scripted input from a text file with one event per line:
+//   "<frame> key <vkey or character> <1|0>", "<frame> mouse <x> <y> <left 1|0> <right 1|0>" or "<frame> quit"
+struct HeadlessSettings
+{
+	int maxFrames{ 0 };
+	bool unlocked{ false };
+	std::string inputScript;
+};
+#endif
+
+// Timing statistics gathered by the PlayFrameScheduler
+// > Per-frame values are for the most recent frame, averages are weighted towards roughly the last second
+struct FrameStats
+{
+	// Time left in the frame budget when the game finished its work (negative if it overran)
+	double slackMs{ 0.0 };
+	// How late the game finished its work, or zero if it was on time
+	double overrunMs{ 0.0 };
+	// How late the scheduler started the frame after the deadline (its own error)
+	double jitterMs{ 0.0 };
+	double averageSlackMs{ 0.0 };
+	double averageJitterMs{ 0.0 };
+	// The worst values since the stats were last reset
+	double maxOverrunMs{ 0.0 };
+	double maxJitterMs{ 0.0 };
+	// The number of frames which overran, out of the total number of frames
+	int overrunFrames{ 0 };
+	int frames{ 0 };
+};
+
+// Paces the game loop to a target frame rate without pinning a core
+// > Sleeps for most of the time remaining in each frame and then spins for the last fraction. The length of the
+//   spin is calibrated from how long the OS actually takes to wake up, so it adapts to the platform's timer resolution.
+class PlayFrameScheduler
+{
+public:
+	// Creates a scheduler for the given frame rate, timing from now
+	explicit PlayFrameScheduler( int framesPerSecond = FRAMES_PER_SECOND );
+
+	// Changes the target frame rate
+	void SetTargetFrameRate( int framesPerSecond );
+	// Gets the target frame rate
+	int GetTargetFrameRate() const { return m_framesPerSecond; }
+	// Sets a minimum time before each deadline which is always spun rather than slept (default 1ms)
+	void SetSpinMargin( double ms ) { m_spinMarginMs = ms; }
+	// Restarts the frame timing from now
+	void Reset();
+	// Waits until the next frame is due and updates the statistics
+	// > Returns the time since the previous frame started in seconds
+	double WaitForNextFrame();
+
+	// Gets the timing statistics
+	const FrameStats& GetStats() const { return m_stats; }
+	// Clears the timing statistics
+	void ResetStats() { m_stats = FrameStats(); }
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// Folds the measured duration of a sleep into the wake-up estimate
+	void UpdateSleepEstimate( double sleptMs );
+
+	int m_framesPerSecond{ FRAMES_PER_SECOND };
+	Clock::duration m_period{};
+	// The time the next frame is due and the time the last one started
+	Clock::time_point m_deadline;
+	Clock::time_point m_lastFrame;
+	double m_spinMarginMs{ 1.0 };
+	// Running mean and variance of how long a 1ms sleep really takes
+	double m_sleepMeanMs{ 1.0 };
+	double m_sleepVarianceMs{ 0.0 };
+	FrameStats m_stats;
+};
+
+// Scales a frame up by a whole number using pixel duplication (nearest neighbour) into the destination
+// > The destination must have room for src.width * scale by src.height * scale pixels, destPitch is its row length in pixels
+// > Uses non-temporal stores where available, as the output is written once and not read back by the CPU
+void UpscaleNearest( const PixelData& src, Pixel* pDest, int destPitch, int scale );
+// Scales a frame to any size using "sharp bilinear" filtering into the destination
+// > Equivalent to scaling up by the largest whole number with pixel duplication and then bilinear filtering to the final
+//   size, so pixels stay crisp but are evenly sized at non-integer scales. Whole number scales give the same result as UpscaleNearest.
+void UpscaleSharpBilinear( const PixelData& src, Pixel* pDest, int destWidth, int destHeight, int destPitch );
+// Both are checked and timed against a plain nearest-neighbour loop by Checks/UpscaleBenchmark.cpp
+
+// Presents finished frames to the display
+// > Derive from this and pass it to PlayWindow::SetPresenter to present somewhere else
+// > Present may be called on the present thread, so it mustn't touch game state
+class PlayPresenter
+{
+public:
+	virtual ~PlayPresenter() = default;
+	// Presents the frame scaled up by an integer amount
+	// > Returns the time taken in milliseconds
+	virtual double Present( const PixelData& frame, int scale ) = 0;
+};
+
+// Presents frames into a buffer in memory (used by headless builds and for capturing frames in tests)
+// > Presents at the display scale, unless given an output size in which case it uses sharp bilinear scaling
+class PlayMemoryPresenter : public PlayPresenter
+{
+public:
+	PlayMemoryPresenter( int outputWidth = 0, int outputHeight = 0 ) : m_outputWidth( outputWidth ), m_outputHeight( outputHeight ) {}
+	~PlayMemoryPresenter() override { delete[] m_frame.pPixels; }
+	double Present( const PixelData& frame, int scale ) override;
+	// Gets the last frame presented
+	const PixelData& GetFrame() const { return m_frame; }
+
+private:
+	PixelData m_frame;
+	int m_outputWidth{ 0 };
+	int m_outputHeight{ 0 };
+};
+
+#ifndef PLAY_PLATFORM_HEADLESS
+// Presents frames to a window using GDI, then waits for the DWM compositor
+class PlayGDIPresenter : public PlayPresenter
+{
+public:
+	explicit PlayGDIPresenter( HWND hWindow ) : m_hWindow( hWindow ) {}
+	~PlayGDIPresenter() override { delete[] m_scaled.pPixels; }
+	double Present( const PixelData& frame, int scale ) override;
+
+private:
+	HWND m_hWindow{ nullptr };
+	// The frame scaled up to the window size
+	PixelData m_scaled;
+};
+#endif
+
 // Encapsulates the platform specific functionality of creating and managing a window 
 // > Singleton class accessed using PlayWindow::Instance()
 class PlayWindow
@@ -1004,6 +1367,7 @@ public:
 	// Destroys the PlayWindow instance
 	static void Destroy();
 
+#ifndef PLAY_PLATFORM_HEADLESS
 	// Windows functions
 	//********************************************************************************************************************************
 
@@ -1011,11 +1375,39 @@ public:
 	int HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int nCmdShow, LPCWSTR windowName );
 	// Handles Windows messages for the PlayWindow  
 	static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam );
+#else
+	// Headless functions
+	//********************************************************************************************************************************
+
+	// Call within main to run the game loop without a window
+	int HandleHeadless( const HeadlessSettings& settings );
+	// Reads the headless settings from the command line arguments
+	static HeadlessSettings ReadHeadlessSettings( int argc, char* argv[] );
+	// Returns the last frame presented (at the display scale, like the window)
+	// > Only valid while the default memory presenter is in use
+	const PixelData& GetPresentedFrame();
+	// Returns the number of frames presented so far
+	int GetFrameCount() const { return m_frameCount; }
+#endif
 	// Copies the display buffer pixels to the window
-	// > Returns the time taken for the present in seconds
+	// > Returns the time taken for the present in milliseconds
 	double Present();
+	// Hands a finished frame to the present thread, which presents it while the game carries on drawing the next one
+	// > Waits first if maxFramesInFlight frames are already queued or being presented: the frame's buffer mustn't be
+	//   drawn into again until that many more frames have been handed over
+	void PresentAsync( const PixelData* pFrame, int maxFramesInFlight );
+	// Waits until every frame handed to PresentAsync has been presented
+	void WaitForPresents();
+	// Gets the time taken by the most recent present in milliseconds
+	double GetLastPresentTime() const { return m_lastPresentTime; }
+	// Replaces the presenter (the window, or memory for headless builds)
+	void SetPresenter( std::unique_ptr<PlayPresenter> pPresenter );
+	// Gets the current presenter
+	PlayPresenter* GetPresenter() { return m_pPresenter.get(); }
 	// Sets the pointer to write mouse input data to
 	void RegisterMouse( MouseData* pMouseData ) { m_pMouseData = pMouseData; }
+	// Gets the scheduler which paces the game loop
+	PlayFrameScheduler& GetScheduler() { return m_scheduler; }
 
 	// Getter functions
 	//********************************************************************************************************************************
@@ -1030,10 +1422,15 @@ public:
 	// Loading functions
 	//********************************************************************************************************************************
 
+	// Called with each row of a png image as soon as it has been decoded
+	using PNGRowFunction = std::function<void( int y, Pixel* pRow )>;
 	// Reads the width and height of a png image
 	static int ReadPNGImage( std::string& fileAndPath, int& width, int& height );
 	// Loads a png image and puts the image data into the destination image provided
-	static int LoadPNGImage( std::string& fileAndPath, PixelData& destImage );
+	// > The rows are also passed to rowFunction (if given) while they are still in the cache, so they can be processed in the same pass
+	static int LoadPNGImage( std::string& fileAndPath, PixelData& destImage, const PNGRowFunction& rowFunction = nullptr );
+	// Decodes a png image which has already been read into memory, in the same way as LoadPNGImage
+	static int DecodePNGImage( const std::vector<uint8_t>& bytes, PixelData& destImage, const PNGRowFunction& rowFunction = nullptr );
 
 private:
 
@@ -1059,12 +1456,45 @@ private:
 	PixelData* m_pPlayBuffer{ nullptr };
 	//Pointer to external mouse data
 	MouseData* m_pMouseData{ nullptr };
+	// Paces the game loop
+	PlayFrameScheduler m_scheduler;
+	// Where frames are presented to
+	std::unique_ptr<PlayPresenter> m_pPresenter;
+	// The present thread and the queue of frames waiting for it
+	// > A frame stays at the front of the queue until it has been presented
+	void PresentThread();
+	std::thread m_presentThread;
+	std::mutex m_presentMutex;
+	std::condition_variable m_presentCondition;
+	std::deque<const PixelData*> m_presentQueue;
+	bool m_stopPresentThread{ false };
+	std::atomic<double> m_lastPresentTime{ 0.0 };
 	// Pointer to the instance.
 	static PlayWindow* s_pInstance;
+#ifndef PLAY_PLATFORM_HEADLESS
 	// The handle to the Window 
 	HWND m_hWindow{ nullptr };
-	// A GDI+ token
-	static unsigned long long s_pGDIToken;
+#else
+	// Applies the scripted input events for the current frame
+	// > Returns false if the script asks to quit
+	bool ApplyScriptedInput();
+
+	// A scripted input event
+	struct ScriptedInput
+	{
+		int frame{ 0 };
+		enum { KEY, MOUSE, QUIT } type{ KEY };
+		int key{ 0 };
+		bool down{ false };
+		MouseData mouse;
+	};
+
+	// The number of frames presented so far
+	int m_frameCount{ 0 };
+	// The scripted input events in frame order, and the next one to apply
+	std::vector<ScriptedInput> m_vScriptedInput;
+	size_t m_nextScriptedInput{ 0 };
+#endif
 };
 
 #endif
@@ -1081,6 +1511,16 @@ private:
 
 // A software pixel renderer for drawing 2D primitives into a PixelData buffer
 // > A singleton class accessed using PlayBlitter::Instance()
+// Pixel data stored as one byte per pixel, each indexing a palette of 256 pre-multiplied colours
+// > Index 0 is always fully transparent
+struct IndexedPixelData
+{
+	int width{ 0 };
+	int height{ 0 };
+	const uint8_t* pIndices{ nullptr };
+	const Pixel* pPalette{ nullptr };
+};
+
 class PlayBlitter
 {
 public:
@@ -1101,39 +1541,282 @@ public:
 	void DrawPixel( int posX, int posY, Pixel pix ) const;
 	// Draws a line of pixels into the render target
 	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const;
+	// Sets the pixels in a row whose bits are set in the mask, with bit 0 at posX
+	// > Each run of set bits is clipped once and filled directly when the colour is opaque
+	void DrawRowMask( int posX, int posY, uint32_t mask, Pixel pix ) const;
 	// Draws pixel data to the render target using a direct copy
 	// > Setting alphaMultiply < 1 forces a less optimal rendering approach (~50% slower) 
-	void BlitPixels( const PixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const;
+	// > Setting colourMultiply to anything but white multiplies the pixels by it as they're drawn, like PlayGraphics::ColourSprite
+	void BlitPixels( const PixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel colourMultiply = PIX_WHITE ) const;
 	// Draws rotated and scaled pixel data to the render target (much slower than BlitPixels)
 	// > Setting alphaMultiply < 1 is not much slower overall (~10% slower) 
 	void TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Matrix2D& m, float alphaMultiply = 1.0f ) const;
+	// Draws rotated and scaled pixel data to the render target using an affine transform and its (precalculated) inverse
+	// > Avoids the general matrix inversion when the caller already knows the inverse (e.g. rotation and scale)
+	void TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Affine2D& m, const Affine2D& inverse, float alphaMultiply = 1.0f, Pixel colourMultiply = PIX_WHITE ) const;
+	// Draws indexed pixel data to the render target, expanding each row through the palette
+	void BlitIndexedPixels( const IndexedPixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const;
+	// Draws rotated and scaled indexed pixel data to the render target using an affine transform and its (precalculated) inverse
+	void TransformIndexedPixels( const IndexedPixelData& srcImage, int srcFrameOffset, int srcWidth, int srcHeight, const Point2f& origin, const Affine2D& m, const Affine2D& inverse, float alphaMultiply = 1.0f ) const;
 	// Clears the render target using the given pixel colour
 	void ClearRenderTarget( Pixel colour ) const;
 	// Copies a background image of the correct size to the render target
 	void BlitBackground( PixelData& backgroundImage ) const;
+	// Multiplies pre-multiplied pixels by a colour in the same way as PlayGraphics::PreMultiplyAlpha
+	// > Fully transparent pixels are left alone, so their skip counts are kept
+	static void TintPixels( const uint32_t* srcPixels, uint32_t* destPixels, int count, Pixel colourMultiply );
+	// Multiplies a single pre-multiplied pixel by a colour
+	static uint32_t TintPixel( uint32_t src, Pixel colourMultiply )
+	{
+		if( src >= 0xFF000000 )
+			return src;
+		uint32_t red = ( ( ( src >> 16 ) & 0xFF ) * colourMultiply.r ) >> 8;
+		uint32_t green = ( ( ( src >> 8 ) & 0xFF ) * colourMultiply.g ) >> 8;
+		uint32_t blue = ( ( src & 0xFF ) * colourMultiply.b ) >> 8;
+		return ( src & 0xFF000000 ) | ( red << 16 ) | ( green << 8 ) | blue;
+	}
+	// Whether multiplying by the colour changes anything
+	static bool IsTint( Pixel colourMultiply ) { return ( colourMultiply.bits & 0x00FFFFFF ) != 0x00FFFFFF; }
 
 private:
 
+	// The part of a blit which lands on the render target
+	struct BlitClip
+	{
+		int srcX, srcY; // The first source pixel drawn
+		int destX, destY; // Where it's drawn on the render target
+		int width, height;
+	};
+
+	// Clips a blit to the render target, returning false if none of it is visible
+	bool ClipBlit( int blitX, int blitY, int blitWidth, int blitHeight, BlitClip& clip ) const;
+	// Blends a row of pre-multiplied source pixels over the render target
+	static void BlendRow( uint32_t* destPixels, const uint32_t* srcPixels, int count, float alphaMultiply );
+	// Looks up the pre-multiplied colour of each index in a row
+	static void ExpandIndices( const uint8_t* srcIndices, const Pixel* pPalette, uint32_t* destPixels, int count );
+	// Draws transformed pixels to the render target, reading each pre-multiplied source pixel with fetch( x, y )
+	template< typename SourceFetch >
+	void TransformSource( int srcWidth, int srcHeight, const Point2f& origin, const Affine2D& m, const Affine2D& inverse, float alphaMultiply, SourceFetch fetch ) const;
+
 	PixelData* m_pRenderTarget{ nullptr };
 
 };
 
 #endif
-#ifndef PLAY_PLAYGRAPHICS_H
-#define PLAY_PLAYGRAPHICS_H
+#ifndef PLAY_PLAYCAPTURE_H
+#define PLAY_PLAYCAPTURE_H
 //********************************************************************************************************************************
-// File:		PlayGraphics.h
-// Description:	Manages 2D graphics operations on a PixelData buffer 
+// File:		PlayCapture.h
+// Description:	Records presented frames to disk in the background
 // Platform:	Independent
-// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
+// Notes:		Frames are copied into a pool of recycled buffers and encoded on worker threads, so capturing never waits for the disk
 //********************************************************************************************************************************
 
-// Manages 2D graphics operations on a PixelData buffer 
-// > Singleton class accessed using PlayGraphics::Instance()
-class PlayGraphics
+// The formats frames can be captured in
+enum class CaptureFormat
 {
-public:
-	// Instance functions
+	PNG_SEQUENCE, // Numbered PNG files, e.g. "run_000000.png"
+	Y4M, // A single uncompressed YUV 4:2:0 video file, which most video tools can read
+};
+
+// Statistics about a capture
+struct CaptureStats
+{
+	// Frames copied into the pool
+	int captured{ 0 };
+	// Frames skipped because the encoders had fallen behind and there was no free buffer
+	int dropped{ 0 };
+	// Frames written to disk
+	int encoded{ 0 };
+	// Frames encoded but not written because the file couldn't be created or written to
+	int failed{ 0 };
+};
+
+// Records frames in the background
+// > Normally used through the PlayGraphics capture functions
+class PlayCapture
+{
+public:
+	// Starts the worker threads: path is the file name without an extension
+	PlayCapture( const std::string& path, CaptureFormat format, int width, int height, int framesPerSecond, int workerThreads, int poolSize );
+	// Finishes the capture if that hasn't been done already
+	~PlayCapture();
+
+	// Copies a frame into the next free buffer for encoding
+	// > Never waits for the encoders: the frame is dropped if there is no free buffer
+	void CaptureFrame( const PixelData& frame );
+	// Gets the statistics so far
+	CaptureStats GetStats();
+	// Waits for the frames already captured to be encoded, then stops the worker threads and closes the files
+	// > Returns the final statistics
+	CaptureStats Finish();
+
+	// Encodes a 32-bit ARGB image as a PNG file in memory (without the alpha channel)
+	static void EncodePNG( const PixelData& image, std::vector<uint8_t>& png );
+	// Converts a 32-bit ARGB image into YUV 4:2:0 planes using the BT.601 limited range coefficients
+	// > The U and V planes are (width + 1) / 2 by (height + 1) / 2
+	static void ConvertToYUV420( const PixelData& image, uint8_t* pY, uint8_t* pU, uint8_t* pV );
+
+private:
+	// The assignment operator is removed to prevent copying
+	PlayCapture& operator=( const PlayCapture& ) = delete;
+	// The copy constructor is removed to prevent copying
+	PlayCapture( const PlayCapture& ) = delete;
+
+	// The worker thread loop
+	void EncodeFrames();
+
+	// A frame waiting to be encoded
+	struct CapturedFrame
+	{
+		int index{ 0 };
+		PixelData* pBuffer{ nullptr };
+	};
+
+	std::string m_path;
+	CaptureFormat m_format{ CaptureFormat::PNG_SEQUENCE };
+	// The buffer pool, and the buffers in it which aren't waiting to be encoded
+	std::vector<PixelData> m_vPool;
+	std::vector<PixelData*> m_vFreeBuffers;
+	std::deque<CapturedFrame> m_queue;
+	std::vector<std::thread> m_vWorkers;
+	std::mutex m_mutex;
+	// Signalled when a frame is queued or the capture is stopping
+	std::condition_variable m_frameQueued;
+	// Signalled when a frame has been written to the video file, which must be done in order
+	std::condition_variable m_frameWritten;
+	std::ofstream m_videoFile;
+	int m_nextFrameToWrite{ 0 };
+	bool m_stopping{ false };
+	CaptureStats m_stats;
+};
+
+#endif
+
+#ifndef PLAY_PLAYGRAPHICS_H
+#define PLAY_PLAYGRAPHICS_H
+//********************************************************************************************************************************
+// File:		PlayGraphics.h
+// Description:	Manages 2D graphics operations on a PixelData buffer 
+// Platform:	Independent
+// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
+//********************************************************************************************************************************
+
+// Define PLAY_SPRITE_PACK before including Play.h to keep a baked copy of all the sprites in the sprite directory (SPRITE_PACK_FILENAME)
+// > The pack holds the decoded and pre-multiplied pixels, so later runs map it into memory instead of loading the PNGs
+// > It is rebuilt automatically whenever a PNG or .inf file is newer than it, or the PNGs in the directory change
+constexpr const char* SPRITE_PACK_FILENAME = "sprites.playpack";
+// Increased whenever the layout of the sprite pack changes, so that older packs are rebuilt
+constexpr uint32_t SPRITE_PACK_VERSION = 2;
+
+// Define PLAY_LAZY_SPRITES before including Play.h to only read the names, sizes and origins of the sprites at startup
+// > Each sprite's pixels are loaded on a background thread the first time it is drawn, and it isn't drawn until they are ready
+// > Call Prefetch during transitions to load the sprites which are about to be needed before they are drawn
+// > A sprite pack is already read on demand, so PLAY_SPRITE_PACK takes priority when both are defined
+
+// Define PLAY_LEAN_SPRITES before including Play.h to free each sprite's original pixels once they've been pre-multiplied
+// > Drawing only uses the pre-multiplied pixels, so this roughly halves the memory used by sprites
+// > Collisions use a mask with one bit per pixel instead, and fonts keep a table of their character widths
+// > The original pixels are decoded again if they're asked for (GetSpritePixelData, ColourSprite) and then kept
+// > Pages of a sprite pack which aren't used are never loaded anyway, so this has no effect with PLAY_SPRITE_PACK
+
+// Define PLAY_INDEXED_SPRITES before including Play.h to store all sprites with fewer than 256 colours as one byte per pixel
+// > Each byte indexes a palette of pre-multiplied colours, so drawing reads a quarter of the memory (faster with -mavx2 or /arch:AVX2)
+// > ColourSprite only has to colour the palette of an indexed sprite, rather than the whole sheet
+// > Indexed sprites are already small, so they're never evicted by SetSpriteMemoryBudget
+// > The sprite pack stores 32-bit pixels, so this has no effect with PLAY_SPRITE_PACK
+
+// Fonts exported from PlayFontTool (greyscale sheets with a frame for each printable character) are always stored indexed
+// > Each pixel is one byte indexing the font's grey levels, and the original pixels are freed once the character widths are read
+// > Fonts use about an eighth of the memory, and DrawString can draw them in any colour without calling ColourSprite
+// > PLAY_SPRITE_PACK keeps fonts as 32-bit pixels, which DrawString colours as they're drawn instead
+
+// How many of the most recently drawn strings are kept composited, ready to draw (see PlayGraphics::SetTextCacheSize)
+constexpr size_t TEXT_CACHE_SIZE = 64;
+
+// A hash of a sprite's name which ignores case, so sprites can be found without comparing strings
+struct SpriteHash
+{
+	uint64_t value{ 0 };
+};
+
+// Hashes a sprite name using FNV-1a on its upper case characters
+constexpr SpriteHash HashSpriteName( const char* name )
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for( ; *name; name++ )
+	{
+		char c = ( *name >= 'a' && *name <= 'z' ) ? static_cast<char>( *name - 'a' + 'A' ) : *name;
+		hash = ( hash ^ static_cast<uint8_t>( c ) ) * 0x100000001B3ull;
+	}
+	return { hash };
+}
+
+// Hashes a sprite name at compile time e.g. GetSpriteId( PLAY_SPRITE( "agent8_fall" ) )
+// > Matches only the whole name of a sprite, with or without the frame count at the end of its filename: unlike
+//   GetSpriteId( const char* ), part of a name (such as "agent8") finds nothing
+#define PLAY_SPRITE( name ) SpriteHash{ std::integral_constant< uint64_t, HashSpriteName( name ).value >::value }
+
+// Statistics about the memory used by sprites' pixels (see PlayGraphics::SetSpriteMemoryBudget)
+struct SpriteMemoryStats
+{
+	// The most memory the sprites should use, or 0 for no limit
+	size_t budget{ 0 };
+	// Bytes used by the sprites' pixels which are in memory, ready to draw (at the end of the last frame)
+	size_t residentBytes{ 0 };
+	// Bytes used by the compressed pixels of evicted sprites
+	size_t compressedBytes{ 0 };
+	// Draws of sprites which were ready
+	int hits{ 0 };
+	// Draws of sprites which had to be decompressed or loaded again first
+	int misses{ 0 };
+	// Sprites evicted to keep within the budget
+	int evictions{ 0 };
+	// Total time spent decompressing evicted sprites
+	double decompressMs{ 0.0 };
+	// Frames which share the pre-multiplied pixels of an identical frame in the same sprite, rather than having their own
+	int duplicateFrames{ 0 };
+	// Bytes saved by sharing identical frames
+	size_t duplicateBytesSaved{ 0 };
+	// Sprites stored as palette indices (PLAY_INDEXED_SPRITES)
+	int indexedSprites{ 0 };
+	// Bytes saved by storing sprites as palette indices
+	size_t indexedBytesSaved{ 0 };
+};
+
+// A whole file mapped into memory
+// > Pages which are written to are copied, so the file itself never changes
+class PlayFileMapping
+{
+public:
+	PlayFileMapping() = default;
+	~PlayFileMapping() { Close(); }
+	// The assignment operator is removed to prevent copying
+	PlayFileMapping& operator=( const PlayFileMapping& ) = delete;
+	// The copy constructor is removed to prevent copying
+	PlayFileMapping( const PlayFileMapping& ) = delete;
+
+	// Maps the file into memory, replacing any file already mapped
+	// > Returns false if the file can't be opened or is empty
+	bool Open( const std::string& fileAndPath );
+	// Unmaps the file: any pointers into it become invalid
+	void Close();
+	// Gets the start of the file in memory
+	uint8_t* GetData() const { return m_pData; }
+	// Gets the size of the file in bytes
+	size_t GetSize() const { return m_size; }
+
+private:
+	uint8_t* m_pData{ nullptr };
+	size_t m_size{ 0 };
+};
+
+// Manages 2D graphics operations on a PixelData buffer 
+// > Singleton class accessed using PlayGraphics::Instance()
+class PlayGraphics
+{
+public:
+	// Instance functions
 	//********************************************************************************************************************************
 
 	// Creates the PlayGraphics instance and generates sprites from all the PNGs in the directory indicated
@@ -1167,6 +1850,9 @@ public:
 	// Draws text using the in-built debug font
 	// > Returns the x position at the end of the text
 	int DrawDebugString( Point2f pos, const std::string& s, Pixel pix, bool centred = true );
+	// Draws text using the in-built debug font with a one pixel diagonal outline in a single pass
+	// > Matches drawing the string four times offset by (+/-1,+/-1) in the outline colour and then once on top
+	int DrawDebugStringOutlined( Point2f pos, const std::string& s, Pixel pix, Pixel outlinePix, bool centred = true );
 
 	// Sprite Loading functions
 	//********************************************************************************************************************************
@@ -1177,8 +1863,31 @@ public:
 	// Adds a sprite sheet dynamically from memory (custom asset pipelines)
 	// > All sprites are normally created by the PlayGraphics constructor
 	int AddSprite( const std::string& name, PixelData& pixelData, int hCount = 1, int vCount = 1 );
+	// Writes all the sprites as they are now to a sprite pack, which can be loaded instead of the PNGs (see PLAY_SPRITE_PACK)
+	// > Returns false if the file couldn't be written
+	bool WriteSpritePack( const std::string& fileAndPath ) const;
+	// Starts loading every sprite whose name contains any of the given text on a background thread (see PLAY_LAZY_SPRITES)
+	// > e.g. Prefetch( { "LEVEL2_", "BOSS" } ) while the level 1 outro is playing
+	void Prefetch( const std::vector< std::string >& names );
+	// Starts loading the sprite with the given id on a background thread (see PLAY_LAZY_SPRITES)
+	void Prefetch( int spriteId );
+	// Whether the sprite's pixels have been loaded (always true unless PLAY_LAZY_SPRITES is defined)
+	bool IsSpriteLoaded( int spriteId ) const;
+	// Loads the sprite's pixels on this thread if they haven't been loaded yet, waiting until they are ready
+	void LoadSpriteNow( int spriteId ) const;
+	// Sets the most memory the sprites' pre-multiplied pixels should use, in bytes (0, the default, for no limit)
+	// > Sprites not drawn for unusedFrames frames are evicted, least recently used first, until the rest fit in the budget
+	// > Evicted sprites are compressed in memory and decompressed the next time they are drawn, or if compress is false, 
+	//   dropped and loaded again from their sprite sheet in the background (coloured sprites and those without a sheet are kept)
+	// > The original pixels are never evicted: define PLAY_LEAN_SPRITES to free those as well
+	void SetSpriteMemoryBudget( size_t bytes, int unusedFrames = 60, bool compress = true );
+	// Evicts sprites if they're using more memory than the budget allows
+	// > Called once a frame by Play::PresentDrawingBuffer
+	void UpdateSpriteMemory();
+	// Gets the statistics about the memory used by sprites
+	SpriteMemoryStats GetSpriteMemoryStats() const;
 	// Updates a sprite sheet dynamically from memory (custom asset pipelines)
-	// > Left to caller to release old PixelData
+	// > Left to caller to release old PixelData, unless it came from a sprite pack
 	int UpdateSprite( const std::string& name, PixelData& pixelData, int hCount = 1, int vCount = 1 );
 	
 	// Loads a background image which is assumed to be the same size as the display buffer
@@ -1188,9 +1897,18 @@ public:
 	// Sprite Getters and Setters
 	//********************************************************************************************************************************
 
-	// Gets the sprite id of the first matching sprite whose filename contains the given text
+	// Gets the sprite id of the sprite with the given name, with or without the frame count at the end of its filename
+	// > Names are hashed into a table, so this doesn't have to compare against every sprite's name
+	// > Text which isn't a whole name is found with FindSpriteId the first time, and the answer is remembered until another sprite is added
 	// > Returns -1 if not found
 	int GetSpriteId( const char* spriteName ) const;
+	// Gets the sprite id for a name hashed with PLAY_SPRITE or HashSpriteName
+	// > Returns -1 if not found
+	int GetSpriteId( SpriteHash spriteName ) const;
+	// Gets the sprite id of the first sprite whose filename contains the given text
+	// > Slow: compares against every sprite's name, so use GetSpriteId where possible
+	// > Returns -1 if not found
+	int FindSpriteId( const char* text ) const;
 	// Gets the root filename of a specific sprite
 	const std::string& GetSpriteName( int spriteId );
 	// Gets the size of the sprite with the given id
@@ -1210,7 +1928,8 @@ public:
 	// Gets the number of sprites which have been loaded and created by PlayGraphics
 	int GetTotalLoadedSprites() const { return m_nTotalSprites; }
 	// Gets a (read only) pointer to a sprite's canvas buffer data
-	const PixelData* GetSpritePixelData( int spriteId ) const { return &vSpriteData[spriteId].canvasBuffer; }
+	// > Loads the sprite's pixels first if they haven't been loaded yet (or were freed by PLAY_LEAN_SPRITES)
+	const PixelData* GetSpritePixelData( int spriteId ) const { LoadSpriteCanvas( spriteId ); return &vSpriteData[spriteId].canvasBuffer; }
 
 	// Sprite Drawing functions
 	//********************************************************************************************************************************
@@ -1223,6 +1942,8 @@ public:
 	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale = 1.0f, float alphaMultiply = 1.0f ) const;
 	// Draw the sprite using a matrix transformation and transparency (slowest draw)
 	void DrawTransformed( int spriteId, const Matrix2D& transform, int frameIndex, float alphaMultiply = 1.0f ) const;
+	// Draw the sprite using an affine transformation and transparency (slowest draw)
+	void DrawTransformed( int spriteId, const Affine2D& transform, int frameIndex, float alphaMultiply = 1.0f ) const;
 	// Draws a previously loaded background image
 	void DrawBackground( int backgroundIndex = 0 );
 	// Multiplies the sprite image buffer by the colour values
@@ -1230,13 +1951,22 @@ public:
 	void ColourSprite( int spriteId, int r, int g, int b );
 
 	// Draws a string using a sprite-based font exported from PlayFontTool
-	int DrawString( int fontId, Point2f pos, std::string text ) const;
+	// > The text is multiplied by the colour as it's drawn, so the font itself doesn't need colouring with ColourSprite
+	// > Each string is composited into a single image the first time it's drawn, so drawing it again is a single blit
+	int DrawString( int fontId, Point2f pos, const std::string& text, Pixel colour = PIX_WHITE ) const;
 	// Draws a centred string using a sprite-based font exported from PlayFontTool
-	int DrawStringCentred( int fontId, Point2f pos, std::string text ) const;
+	int DrawStringCentred( int fontId, Point2f pos, const std::string& text, Pixel colour = PIX_WHITE ) const;
+	// Gets the total width of a string drawn using a sprite-based font
+	int GetStringWidth( int fontId, const std::string& text ) const;
+	// Sets how many of the most recently drawn strings are kept ready to draw (TEXT_CACHE_SIZE by default)
+	// > Setting it to 0 draws every string a character at a time
+	// > A cached string is positioned as a whole, so left of or above the drawing buffer it can be 1 pixel away from drawing
+	//   a character at a time (which rounds each character's negative position towards zero)
+	void SetTextCacheSize( size_t strings );
 	// Draws an individual text character using a sprite-based font 
-	int DrawChar( int fontId, Point2f pos, char c ) const;
+	int DrawChar( int fontId, Point2f pos, char c, Pixel colour = PIX_WHITE ) const;
 	// Draws a rotated text character using a sprite-based font 
-	int DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c ) const;
+	int DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c, Pixel colour = PIX_WHITE ) const;
 	// Gets the width of an individual text character from a sprite-based font
 	int GetFontCharWidth( int fontId, char c ) const;
 
@@ -1244,6 +1974,7 @@ public:
 	bool SpriteCollide( int s1Id, Point2f s1Pos, int s1FrameIndex, float s1Angle, int s1PixelColl[4], int s2Id, Point2f s2pos, int s2FrameIndex, float s2Angle, int s2PixelColl[4] ) const;
 
 	// Internal sprite structure for storing individual sprite data
+	// > The pixel members are mutable as they can be loaded, evicted and put back while drawing, without changing the sprite itself
 	struct Sprite
 	{
 		int id{ -1 }; // Fast way of finding the right sprite
@@ -1252,8 +1983,21 @@ public:
 		//int canvasWidth{ -1 }, canvasHeight{ -1 }; // The width and height of the entire sprite canvas
 		int hCount{ -1 }, vCount{ -1 }, totalCount{ -1 };  // The number of sprite images in the canvas horizontally and vertically
 		int originX{ 0 }, originY{ 0 }; // The origin and centre of rotation for the sprite (whole pixels only)
-		PixelData canvasBuffer; // The sprite image data
-		PixelData preMultAlpha; // The sprite data pre-multiplied with its own alpha
+		mutable PixelData canvasBuffer; // The sprite image data (the pixels may have been freed by PLAY_LEAN_SPRITES)
+		mutable PixelData preMultAlpha; // The sprite data pre-multiplied with its own alpha (no pixels if the sprite is indexed)
+		mutable std::vector< uint8_t > collisionMask; // One bit for each pixel in the canvas which isn't fully transparent (PLAY_LEAN_SPRITES)
+		mutable std::vector< uint8_t > glyphWidths; // The character widths from the first row of the canvas, in case it's a font (PLAY_LEAN_SPRITES)
+		mutable std::vector< int > frameTable; // Which of the unique frames stacked in preMultAlpha each frame uses (empty if no frames were identical)
+		bool packed{ false }; // Whether the pixel data is in the memory-mapped sprite pack, rather than allocated
+		std::string sourcePath, sourceFile; // The sprite sheet the pixels are loaded from the first time they're needed (PLAY_LAZY_SPRITES)
+		mutable bool loadRequested{ false }; // Whether the pixels have been queued to load on a background thread
+		mutable int lastUsedFrame{ 0 }; // The frame the sprite was last drawn in (see SetSpriteMemoryBudget)
+		mutable std::vector< uint8_t > compressedPixels; // The pre-multiplied pixels, compressed while the sprite is evicted
+		bool coloured{ false }; // Whether ColourSprite has changed the pre-multiplied pixels
+		mutable std::vector< uint8_t > indices; // The palette index of each pre-multiplied pixel, replacing them (PLAY_INDEXED_SPRITES)
+		mutable std::vector< Pixel > palette; // The original colour of each index (index 0 is fully transparent)
+		mutable std::vector< Pixel > preMultPalette; // The palette pre-multiplied with its own alpha and any ColourSprite colour
+		mutable bool font{ false }; // Whether the sprite is an indexed font, so its original pixels aren't needed after loading
 		Sprite() = default;
 	};
 
@@ -1262,6 +2006,29 @@ public:
 
 	// Gets a pointer to the drawing buffer's pixel data
 	PixelData* GetDrawingBuffer( void ) { return &m_playBuffer; }
+	// Sets how many drawing buffers to cycle through (1-3)
+	// > With more than one, each finished frame can be presented on another thread while the next one is drawn
+	// > None of the buffers may be in use by a present when this is called
+	void SetDrawingBufferCount( int count );
+	// Gets how many drawing buffers are being cycled through
+	int GetDrawingBufferCount() const { return static_cast<int>( m_vDrawingBuffers.size() ); }
+	// Switches drawing to the next buffer
+	// > Returns the finished buffer, which holds the frame to present
+	// > The new drawing buffer still holds an older frame, so the whole screen should be redrawn every frame
+	const PixelData* SwapDrawingBuffers();
+	// Starts recording every frame captured to disk, encoding on background threads so the game never waits
+	// > path is the file name without an extension: "Capture\\run" gives "Capture\\run_000000.png", ... or "Capture\\run.y4m"
+	// > poolSize frames can be waiting to be encoded; any frames captured while they are all in use are dropped
+	void BeginCapture( const std::string& path, CaptureFormat format, int framesPerSecond = FRAMES_PER_SECOND, int workerThreads = 2, int poolSize = 8 );
+	// Copies the drawing buffer into the capture, if one is running
+	void CaptureFrame() { if( m_pCapture ) m_pCapture->CaptureFrame( m_playBuffer ); }
+	// Stops recording once the frames already captured have been encoded
+	// > Returns the final statistics
+	CaptureStats EndCapture();
+	// Gets the statistics for the current capture
+	CaptureStats GetCaptureStats() const { return m_pCapture ? m_pCapture->GetStats() : CaptureStats(); }
+	// Whether a capture is running
+	bool IsCapturing() const { return m_pCapture != nullptr; }
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
 	void TimingBarBegin( Pixel pix );
 	// Sets the current timing bar segment to a specific colour
@@ -1295,23 +2062,100 @@ private:
 	// Internal functions relating to drawing
 	//********************************************************************************************************************************
 
+	// Calculates the pixel offset of an animation frame within the sprite's canvas
+	int GetFrameOffset( const Sprite& spr, int frameIndex ) const;
 	// Multiplies the sprite image by its own alpha transparency values to save repeating this calculation on every draw
 	// > A colour multiplication can also be applied at this stage, which affects all subseqent drawing operations on the sprite
-	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
+	void PreMultiplyAlpha( const Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply ) const;
+	// Loads the sprite sheets listed on all cores, then adds them in the order given
+	void LoadSpriteFiles( const std::vector< std::filesystem::path >& vSpriteFiles );
+	// Adds the sprite sheets listed in the order given, reading only their sizes and origins (see PLAY_LAZY_SPRITES)
+	void IndexSpriteFiles( const std::vector< std::filesystem::path >& vSpriteFiles );
+	// Works out the number of frames across and down a sprite sheet from the end of its filename
+	static void GetSpriteSheetFrames( const std::string& filename, int& hCount, int& vCount );
+	// Reads a sprite sheet's origin from its .inf file, if it has one
+	static void ReadSpriteInfo( const std::filesystem::path& pngPath, int& originX, int& originY );
+	// Adds the sprites from a sprite pack, as long as it is up to date with the sprite sheets listed
+	// > Returns false (without adding anything) if the pack is missing, out of date or invalid
+	bool LoadSpritePack( const std::string& fileAndPath, const std::vector< std::filesystem::path >& vSpriteFiles );
+	// Decodes a sprite sheet, pre-multiplies it and works out its frames without adding it to the sprites
+	// > Doesn't change the PlayGraphics, so several sheets can be decoded at once on different threads
+	Sprite DecodeSpriteSheet( const std::string& path, const std::string& filename ) const;
+	// Decodes a sprite sheet which has already been read into memory, in the same way
+	Sprite DecodeSpriteSheet( const std::string& filename, const std::vector<uint8_t>& bytes ) const;
+	// Stores frames of the sprite which are identical only once, stacking the unique frames in a column in preMultAlpha
+	// > Sets up the frame table, which is left empty if there are no identical frames
+	void DeduplicateFrames( Sprite& s ) const;
+	// Replaces the pre-multiplied pixels with palette indices if the sprite has fewer than 256 colours (PLAY_INDEXED_SPRITES)
+	// > Does nothing unless PLAY_INDEXED_SPRITES is defined
+	void IndexSprite( Sprite& s ) const;
+	// Whether a decoded sprite sheet looks like a font exported from PlayFontTool: greyscale, with a frame for each printable character
+	static bool IsFontSheet( const Sprite& s );
+	// Draws a frame of a sprite multiplied by a colour, without changing the sprite (see DrawString)
+	void DrawColoured( int spriteId, Point2f pos, int frameIndex, float angle, float scale, Pixel colour ) const;
+	// Whether the sprite's pixels are ready to draw, either pre-multiplied or indexed
+	static bool HasSpritePixels( const Sprite& s ) { return s.preMultAlpha.pPixels || !s.indices.empty(); }
+	// Describes the indexed pixels of a sprite for the blitter
+	static IndexedPixelData GetIndexedPixels( const Sprite& s ) { return { s.preMultAlpha.width, s.preMultAlpha.height, s.indices.data(), s.preMultPalette.data() }; }
+	// Frees the original pixels of a decoded sprite, keeping its collision mask and font widths instead (PLAY_LEAN_SPRITES)
+	// > Does nothing unless PLAY_LEAN_SPRITES is defined or the sprite is an indexed font, which can be loaded again if needed
+	void DiscardSpriteCanvas( Sprite& s ) const;
+	// Adds a sprite whose pre-multiplied buffer has already been created
+	int AddPreMultipliedSprite( const std::string& name, PixelData& pixelData, PixelData& preMultAlpha, int hCount, int vCount );
+	// Adds a decoded sprite, along with its origin, frame table and anything kept by DiscardSpriteCanvas
+	int AddDecodedSprite( Sprite& s );
+	// Calculates the pixel offset of an animation frame within the sprite's original canvas
+	static int GetCanvasFrameOffset( const Sprite& spr, int frameIndex );
+	// Loads the sprite's original pixels if they haven't been loaded yet, or were freed by PLAY_LEAN_SPRITES
+	void LoadSpriteCanvas( int spriteId ) const;
+	// Whether the pixel at the given index in the sprite's canvas isn't fully transparent
+	bool IsSpritePixelSolid( const Sprite& s, int pixelIndex ) const;
+
+	// Gets a sprite ready for drawing
+	// > Returns nullptr if its pixels haven't been loaded yet, after queueing them to load in the background
+	const Sprite* GetDrawableSprite( int spriteId ) const;
+	// Queues a sprite's pixels to load on a background thread, starting the threads if needed
+	void RequestSpriteLoad( const Sprite& s ) const;
+	// Gives the sprites whose pixels have finished loading in the background their pixels
+	void InstallLoadedSprites() const;
+	// Stops the background loading threads, freeing any pixels they loaded which haven't been installed
+	void StopSpriteLoader();
+	// Frees a sprite's pre-multiplied pixels, compressing them first if they are to be kept in memory
+	void EvictSprite( Sprite& s );
+	// Gives an evicted sprite its pre-multiplied pixels back from the compressed copy
+	void DecompressSprite( const Sprite& s ) const;
 
 	// Count of the total number of sprites loaded
 	int m_nTotalSprites{ 0 };
 	// Whether the singleton has been initialised yet
 	bool m_bInitialised{ false };
-
-	// Allocates a buffer for the debug font and copies the font pixel data to it
+	// A name (in upper case) and the id of the sprite it refers to
+	struct SpriteNameEntry
+	{
+		std::string name;
+		int id{ -1 };
+	};
+	// Sprite ids keyed by the hash of each sprite's name and its name without the frame count
+	// > The names are kept to check against, as different names can share a hash
+	std::unordered_multimap< uint64_t, SpriteNameEntry > m_spriteNameIndex;
+	// The answers to searches for text which isn't a whole name, cleared whenever a sprite is added
+	mutable std::unordered_multimap< uint64_t, SpriteNameEntry > m_spriteSearchCache;
+	// Adds a whole name to m_spriteNameIndex, unless an earlier sprite already has it
+	void IndexSpriteName( const std::string& name, int spriteId );
+	// Finds the entry for a name in one of the name tables, or returns -1
+	static int FindSpriteName( const std::unordered_multimap< uint64_t, SpriteNameEntry >& table, uint64_t hash, const char* name );
+
+	// Converts the 1bpp debug font image into one bitmask per glyph row (bit 0 is the leftmost pixel)
 	void DecompressDubugFont( void );
+	// Returns the row masks for a character after mapping it into the font's range, or nullptr if it has no glyph
+	const uint8_t* GetDebugGlyph( char c ) const;
 	// Returns the pixel width of a string using the debug font
 	int GetDebugStringWidth( const std::string& s );
 	// Draws the offset points from the origin in all octants
 	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix );
 	// Ends the current timing segment and calculates the duration
-	LARGE_INTEGER EndTimingSegment();
+	// > Returns the current time in nanoseconds
+	long long EndTimingSegment();
 
 	struct TimingSegment
 	{
@@ -1328,12 +2172,79 @@ private:
 	// The PlayBlitter used for drawing
 	PlayBlitter m_blitter;
 
+	// The sine and cosine of the last rotation drawn, as consecutive draws often share the same angle
+	struct RotationCache
+	{
+		float angle{ 0.0f };
+		float sinAngle{ 0.0f };
+		float cosAngle{ 1.0f };
+	};
+	mutable RotationCache m_rotationCache;
+
+	// The palette of the last indexed font drawn in a colour, as text is usually drawn a string at a time
+	struct TintCache
+	{
+		int spriteId{ -1 }; // Set back to -1 whenever a sprite's palette changes
+		uint32_t colour{ 0 };
+		Pixel palette[256];
+	};
+	mutable TintCache m_tintCache;
+
+	// A string composited into a single image using a font
+	struct TextRun
+	{
+		std::string key; // The font id and the string
+		int width{ 0 }; // The total width of the characters, which the last one may overhang
+		std::vector< Pixel > pixels; // Pre-multiplied with skip counts, in the same way as the font
+		PixelData image; // Points to the pixels
+		bool overlaps{ false }; // Characters' visible pixels overlap, so the string is drawn a character at a time and has no pixels
+	};
+
+	// Gets the composited string, adding it to the most recently used if it wasn't already there
+	// > Returns nullptr if the font hasn't been loaded yet
+	// > Strings whose characters overlap (e.g. kerned fonts) are only cached for their width, as blending each character
+	//   onto the next would round differently from blending them onto the drawing buffer one at a time
+	const TextRun* GetTextRun( int fontId, const std::string& text ) const;
+	// Forgets all the composited strings, after a font has changed
+	void ClearTextCache() const;
+
+	// The composited strings, most recently used first
+	mutable std::list< TextRun > m_textRuns;
+	mutable std::unordered_map< std::string, std::list< TextRun >::iterator > m_textRunIndex;
+	size_t m_textCacheSize{ TEXT_CACHE_SIZE };
+
 	// Buffer pointers
 	PixelData m_playBuffer;
-	uint8_t* m_pDebugFontBuffer{ nullptr };
+	std::vector< uint8_t > m_debugGlyphRows;
+	// The drawing buffers which m_playBuffer cycles through, and the one it is using
+	std::vector< PixelData > m_vDrawingBuffers;
+	int m_currentDrawingBuffer{ 0 };
+	// The capture in progress, if there is one
+	std::unique_ptr< PlayCapture > m_pCapture;
 
 	// A vector of all the loaded sprites
 	std::vector< Sprite > vSpriteData;
+
+	// The background threads which load sprites' pixels when lazy loading, and the sprites they're working on
+	struct SpriteLoader
+	{
+		std::vector< std::thread > vThreads;
+		std::mutex mutex;
+		std::condition_variable requested;
+		std::deque< Sprite > queue; // Copies of the sprites to load (without pixels)
+		std::vector< Sprite > vLoaded; // Loaded sprites waiting to be installed on the main thread
+		bool stopping{ false };
+	};
+	mutable SpriteLoader m_spriteLoader;
+
+	// The sprite memory budget and statistics
+	size_t m_spriteMemoryBudget{ 0 };
+	int m_spriteUnusedFrames{ 60 };
+	bool m_compressEvictedSprites{ true };
+	int m_spriteFrame{ 0 };
+	mutable SpriteMemoryStats m_spriteMemoryStats;
+	// The sprite pack which packed sprites point into
+	PlayFileMapping m_spritePack;
 	// A vector of all the loaded backgrounds
 	std::vector< PixelData > vBackgroundData;
 
@@ -1350,15 +2261,101 @@ private:
 //* Description:	Declaration for a simple audio manager class
 //********************************************************************************************************************************
 
+// The software mixer plays .wav sounds as 16-bit stereo at this rate
+constexpr int AUDIO_SAMPLE_RATE = 44100;
+// The number of sounds the mixer can play at once
+// > Playing another sound when they're all busy takes over the voice which has been playing the longest, preferring sounds which aren't looping
+constexpr int AUDIO_VOICES = 32;
+// The number of sample frames mixed at a time (about 12ms)
+constexpr int AUDIO_BLOCK_FRAMES = 512;
+// The number of commands which can be waiting for the mixer (a power of two)
+constexpr uint32_t AUDIO_COMMAND_QUEUE_SIZE = 256;
+
+// Statistics about the software mixer (see PlayAudio::GetMixerStats)
+struct AudioMixerStats
+{
+	// Voices playing at the end of the last block mixed
+	int voicesPlaying{ 0 };
+	// Sounds which took over a busy voice because none were free
+	int voicesStolen{ 0 };
+	// Commands dropped because the queue was full
+	int commandsDropped{ 0 };
+	// Blocks of audio mixed so far
+	int blocksMixed{ 0 };
+};
+
+// Receives the mixed audio
+// > Derive from this and pass it to PlayAudio::SetOutput to send the audio somewhere else
+// > Write is called on the audio thread, and should wait until it's time to mix the next block
+class PlayAudioOutput
+{
+public:
+	virtual ~PlayAudioOutput() = default;
+	// Takes a block of interleaved stereo samples at AUDIO_SAMPLE_RATE
+	virtual void Write( const int16_t* pSamples, int frames ) = 0;
+};
+
+// Discards the audio at the rate it would have been played (used by headless builds)
+class PlayNullAudioOutput : public PlayAudioOutput
+{
+public:
+	void Write( const int16_t* pSamples, int frames ) override;
+
+private:
+	// When the next block is due
+	std::chrono::steady_clock::time_point m_deadline;
+};
+
+// Writes the audio to a .wav file at the rate it would have been played (for checking the mix in tests)
+class PlayWavFileAudioOutput : public PlayNullAudioOutput
+{
+public:
+	explicit PlayWavFileAudioOutput( const std::string& fileAndPath );
+	// Fills in the sizes in the header and closes the file
+	~PlayWavFileAudioOutput() override;
+	void Write( const int16_t* pSamples, int frames ) override;
+
+private:
+	std::ofstream m_file;
+	uint32_t m_dataBytes{ 0 };
+};
+
+#ifndef PLAY_PLATFORM_HEADLESS
+// Plays the audio through the default device using waveOut
+class PlayWaveOutAudioOutput : public PlayAudioOutput
+{
+public:
+	PlayWaveOutAudioOutput();
+	~PlayWaveOutAudioOutput() override;
+	void Write( const int16_t* pSamples, int frames ) override;
+
+private:
+	// Blocks queued on the device at once
+	static constexpr int BUFFER_COUNT = 4;
+	HWAVEOUT m_hWaveOut{ nullptr };
+	// Signalled by the device each time it finishes a block
+	HANDLE m_hDoneEvent{ nullptr };
+	WAVEHDR m_headers[BUFFER_COUNT]{};
+	std::vector< int16_t > m_buffers[BUFFER_COUNT];
+	int m_nextBuffer{ 0 };
+	// Used instead if the device couldn't be opened
+	PlayNullAudioOutput m_nullOutput;
+};
+#endif
+
 // Encapsulates the functionality of a simple audio manager 
 // > A singleton class accessed using PlayAudio::Instance()
+// > .mp3 sounds are played by the MCI, and are silent in headless builds
+// > .wav sounds (8 or 16-bit PCM, or 32-bit float) are decoded when they're loaded and played by a software mixer on its own thread,
+//   so any number of them can overlap, including several of the same sound. Starting and stopping them never waits for the mixer.
+// > Use .wav for sound effects, and keep .mp3 for long music tracks that would be too large to hold decoded in memory
 class PlayAudio
 {
 public:
 	// Instance access functions 
 	//********************************************************************************************************************************
 
-	// Instantiates class and loads all the .MP3 sounds from the directory provided
+	// Instantiates class and loads all the .mp3 and .wav sounds from the directory provided
 	static PlayAudio& Instance( const char* path );
 	// Returns the PlaySpeaker instance
 	static PlayAudio& Instance();
@@ -1368,16 +2365,35 @@ public:
 	// Playing and stopping audio
 	//********************************************************************************************************************************
 
+	// Gets the id of a sound from its filename (without path or extension), or from any part of its path
+	// > Filenames are hashed into a table when the sounds are loaded; other text is searched for the first time and then remembered
+	// > Returns -1 if not found
+	int GetSoundId( const char* name ) const;
 	// Play a sound using part of all of its name
 	void StartAudio( const char* name, bool bLoop );
+	// Play a sound using its id, without looking up its name
+	// > A .wav sound is queued for the mixer, which starts it within a block
+	void StartAudio( int soundId, bool bLoop );
 	//  Stop the currently playing sound using part of all of its name
 	void StopAudio( const char* name ); 
+	// Stop the currently playing sound using its id
+	// > Stops every voice playing a .wav sound
+	void StopAudio( int soundId );
+
+	// Software mixer
+	//********************************************************************************************************************************
+
+	// Replaces where the mixer sends its audio (waveOut, or nowhere for headless builds)
+	// > Waits for the audio thread to stop, so only call this when setting up
+	void SetOutput( std::unique_ptr< PlayAudioOutput > pOutput );
+	// Gets the mixer's statistics
+	AudioMixerStats GetMixerStats() const;
 
 private:
 	// Constructor and destructor
 	//********************************************************************************************************************************
 
-	// Creates manager object and loads all the .MP3 sounds in the specified directory
+	// Creates manager object and loads all the .mp3 and .wav sounds in the specified directory
 	PlayAudio( const char* path ); 
 	// Destroys the manager and stops any sounds playing
 	~PlayAudio(); 
@@ -1386,8 +2402,73 @@ private:
 	// The copy operator is removed to prevent copying of a singleton class
 	PlayAudio( const PlayAudio& ) = delete;
 
-	// Vector of mp3 strings
-	std::vector< std::string > vSoundStrings;
+	// A loaded sound with the commands which control it built in advance, so playing it doesn't allocate
+	struct Sound
+	{
+		std::string filename;
+		std::string playCommand;
+		std::string loopCommand;
+		std::string stopCommand;
+		// Whether the sound is played by the mixer, and its interleaved stereo samples at AUDIO_SAMPLE_RATE
+		bool mixed{ false };
+		std::vector< int16_t > samples;
+	};
+
+	// A request from the game to the mixer
+	struct MixerCommand
+	{
+		enum { PLAY, LOOP, STOP } type{ PLAY };
+		int soundId{ -1 };
+	};
+
+	// A sound being played by the mixer
+	struct Voice
+	{
+		int soundId{ -1 };
+		size_t frame{ 0 };
+		bool loop{ false };
+		// When the voice was started, so the oldest can be taken over
+		uint32_t started{ 0 };
+	};
+
+	// Decodes a .wav file into interleaved stereo samples at AUDIO_SAMPLE_RATE
+	// > Returns false if it isn't a format the mixer understands
+	static bool DecodeWav( const std::vector< uint8_t >& bytes, std::vector< int16_t >& samples );
+	// Queues a command for the mixer without waiting
+	// > Commands are dropped (and counted) if the queue is full
+	void PushMixerCommand( MixerCommand command );
+	// Starts and stops the audio thread
+	void StartMixer();
+	void StopMixer();
+	// Mixes blocks and hands them to the output until the mixer is stopped
+	void MixerThread();
+	// Applies the waiting commands and mixes the next block of the playing voices
+	void MixBlock( int16_t* pOut );
+
+	// Vector of loaded sounds
+	std::vector< Sound > vSounds;
+	// Sound ids keyed by the hash of each sound's filename and of text already found (hashed like sprite names)
+	mutable std::unordered_map< uint64_t, int > m_soundIndex;
+
+	// Where the mixed audio goes
+	std::unique_ptr< PlayAudioOutput > m_pOutput;
+	std::thread m_mixerThread;
+	std::atomic< bool > m_stopMixer{ false };
+	// Commands from the game thread to the audio thread (single producer, single consumer)
+	// > Each index only ever increases, and is only written by one side
+	MixerCommand m_commands[AUDIO_COMMAND_QUEUE_SIZE];
+	std::atomic< uint32_t > m_commandHead{ 0 };
+	std::atomic< uint32_t > m_commandTail{ 0 };
+	// Only used by the audio thread
+	Voice m_voices[AUDIO_VOICES];
+	uint32_t m_voicesStarted{ 0 };
+	std::vector< int32_t > m_mixBuffer;
+	// Statistics, written by the audio thread apart from the dropped commands
+	std::atomic< int > m_voicesPlaying{ 0 };
+	std::atomic< int > m_voicesStolen{ 0 };
+	std::atomic< int > m_commandsDropped{ 0 };
+	std::atomic< int > m_blocksMixed{ 0 };
+
 	// Pointer to the singleton
 	static PlayAudio* s_pInstance;
 };
@@ -1399,10 +2480,62 @@ private:
 //********************************************************************************************************************************
 // File:		PlayInput.h
 // Description:	Manages keyboard and mouse input 
-// Platform:	Windows
-// Notes:		Obtains mouse data from PlayWindow via MouseData structure
+// Platform:	Windows or headless
+// Notes:		Obtains mouse data from PlayWindow via MouseData structure. Headless builds get their input from a script.
 //********************************************************************************************************************************
 
+#ifdef PLAY_PLATFORM_HEADLESS
+// The Windows virtual key codes, so games can use the same key names without windows.h
+// > Letters and numbers use their upper case character codes ('A' to 'Z' and '0' to '9') as they do on Windows
+constexpr int VK_LBUTTON = 0x01;
+constexpr int VK_RBUTTON = 0x02;
+constexpr int VK_BACK = 0x08;
+constexpr int VK_TAB = 0x09;
+constexpr int VK_RETURN = 0x0D;
+constexpr int VK_SHIFT = 0x10;
+constexpr int VK_CONTROL = 0x11;
+constexpr int VK_MENU = 0x12;
+constexpr int VK_PAUSE = 0x13;
+constexpr int VK_ESCAPE = 0x1B;
+constexpr int VK_SPACE = 0x20;
+constexpr int VK_PRIOR = 0x21;
+constexpr int VK_NEXT = 0x22;
+constexpr int VK_END = 0x23;
+constexpr int VK_HOME = 0x24;
+constexpr int VK_LEFT = 0x25;
+constexpr int VK_UP = 0x26;
+constexpr int VK_RIGHT = 0x27;
+constexpr int VK_DOWN = 0x28;
+constexpr int VK_INSERT = 0x2D;
+constexpr int VK_DELETE = 0x2E;
+constexpr int VK_NUMPAD0 = 0x60;
+constexpr int VK_NUMPAD1 = 0x61;
+constexpr int VK_NUMPAD2 = 0x62;
+constexpr int VK_NUMPAD3 = 0x63;
+constexpr int VK_NUMPAD4 = 0x64;
+constexpr int VK_NUMPAD5 = 0x65;
+constexpr int VK_NUMPAD6 = 0x66;
+constexpr int VK_NUMPAD7 = 0x67;
+constexpr int VK_NUMPAD8 = 0x68;
+constexpr int VK_NUMPAD9 = 0x69;
+constexpr int VK_F1 = 0x70;
+constexpr int VK_F2 = 0x71;
+constexpr int VK_F3 = 0x72;
+constexpr int VK_F4 = 0x73;
+constexpr int VK_F5 = 0x74;
+constexpr int VK_F6 = 0x75;
+constexpr int VK_F7 = 0x76;
+constexpr int VK_F8 = 0x77;
+constexpr int VK_F9 = 0x78;
+constexpr int VK_F10 = 0x79;
+constexpr int VK_F11 = 0x7A;
+constexpr int VK_F12 = 0x7B;
+constexpr int VK_LSHIFT = 0xA0;
+constexpr int VK_RSHIFT = 0xA1;
+constexpr int VK_LCONTROL = 0xA2;
+constexpr int VK_RCONTROL = 0xA3;
+#endif
+
 // Manages keyboard and mouse input 
 // > Singleton class accessed using PlayInput::Instance()
 class PlayInput
@@ -1440,6 +2573,11 @@ public:
 
 	MouseData* GetMouseData( void ) { return &m_mouseData; }
 
+#ifdef PLAY_PLATFORM_HEADLESS
+	// Sets whether a key is held down (used for scripted input as there's no keyboard)
+	void SetKeyState( int vKey, bool down );
+#endif
+
 private:
 
 	// Constructor / destructor
@@ -1456,6 +2594,10 @@ private:
 
 
 	MouseData m_mouseData;
+#ifdef PLAY_PLATFORM_HEADLESS
+	// The scripted state of each virtual key
+	bool m_keyDown[256]{};
+#endif
 	// Pointer to the singleton
 	static PlayInput* s_pInstance;
 
@@ -1545,12 +2687,26 @@ namespace Play
 	// PlayManager uses colour values from 0-100 for red, green, blue and alpha
 	struct Colour
 	{
-		Colour( float r, float g, float b ) : red( r ), green( g ), blue( b ) {}
-		Colour( int r, int g, int b ) : red( static_cast<float>( r ) ), green( static_cast<float>( g ) ), blue( static_cast<float>( b ) ) {}
+		constexpr Colour( float r, float g, float b ) : red( r ), green( g ), blue( b ) {}
+		constexpr Colour( int r, int g, int b ) : Colour( static_cast<float>( r ), static_cast<float>( g ), static_cast<float>( b ) ) {}
+		// Converts back from a pixel (such as the default colours below), so that ToPixel gives the same pixel again
+		constexpr Colour( Pixel pix ) : Colour( ( ( ( pix.bits >> 16 ) & 0xFF ) + 0.5f ) / 2.55f, ( ( ( pix.bits >> 8 ) & 0xFF ) + 0.5f ) / 2.55f, ( ( pix.bits & 0xFF ) + 0.5f ) / 2.55f ) {}
+		// Gets the equivalent pixel
+		constexpr Pixel ToPixel() const { return Pixel( red * 2.55f, green * 2.55f, blue * 2.55f ); }
 		float red, green, blue;
 	};
 
-	extern Colour cBlack, cRed, cGreen, cBlue, cMagenta, cCyan, cYellow, cOrange, cWhite, cGrey;
+	// A set of default colour definitions, converted to pixels at compile time so they can be passed straight to the drawing functions
+	inline constexpr Pixel cBlack = Colour( 0.0f, 0.0f, 0.0f ).ToPixel();
+	inline constexpr Pixel cRed = Colour( 100.0f, 0.0f, 0.0f ).ToPixel();
+	inline constexpr Pixel cGreen = Colour( 0.0f, 100.0f, 0.0f ).ToPixel();
+	inline constexpr Pixel cBlue = Colour( 0.0f, 0.0f, 100.0f ).ToPixel();
+	inline constexpr Pixel cMagenta = Colour( 100.0f, 0.0f, 100.0f ).ToPixel();
+	inline constexpr Pixel cCyan = Colour( 0.0f, 100.0f, 100.0f ).ToPixel();
+	inline constexpr Pixel cYellow = Colour( 100.0f, 100.0f, 0.0f ).ToPixel();
+	inline constexpr Pixel cOrange = Colour( 100.0f, 50.0f, 0.0f ).ToPixel();
+	inline constexpr Pixel cWhite = Colour( 100.0f, 100.0f, 100.0f ).ToPixel();
+	inline constexpr Pixel cGrey = Colour( 50.0f, 50.0f, 50.0f ).ToPixel();
 
 	// Manager creation and deletion
 	//**************************************************************************************************
@@ -1573,16 +2729,60 @@ namespace Play
 	int GetBufferWidth();
 	// Gets the height of the display buffer
 	int GetBufferHeight();
+	// Changes the frame rate the game loop is paced to (FRAMES_PER_SECOND by default)
+	void SetTargetFrameRate( int framesPerSecond );
+	// Gets the slack, overrun and jitter statistics for the game loop
+	const FrameStats& GetFrameStats();
+	// Sets how many drawing buffers are used (1-3). With 2 or 3, each frame is presented on a separate thread
+	// while the game updates and draws the next one
+	// > The drawing buffer then holds an older frame at the start of each frame, so clear or redraw the whole screen every frame
+	void SetDrawingBufferCount( int count );
+	// Starts recording every frame presented, either as numbered PNG files or as a single Y4M video
+	// > path is the file name without an extension, e.g. "Capture\\run". The frames are encoded on background threads
+	void BeginCapture( const char* path, CaptureFormat format = CaptureFormat::PNG_SEQUENCE );
+	// Stops recording once the frames already captured have been written
+	// > Returns how many frames were captured, dropped, written and failed to write
+	CaptureStats EndCapture();
+	// Limits the memory used by sprites' pixels, evicting those which haven't been drawn recently (see PlayGraphics::SetSpriteMemoryBudget)
+	void SetSpriteMemoryBudget( size_t bytes, int unusedFrames = 60, bool compress = true );
+
+	// Fixed timestep functions
+	//**************************************************************************************************
+
+	// Switches to a fixed number of simulation steps per second, independent of the frame rate (0 switches back)
+	// > Use BeginFixedUpdate and FixedStep in MainGameUpdate to run the steps, then draw once per frame as usual
+	// > At most maxStepsPerFrame steps are run in a frame: beyond that the game slows down rather than falling ever further behind
+	void SetFixedTimestep( int stepsPerSecond, int maxStepsPerFrame = 4 );
+	// Adds the frame's elapsed time to the fixed timestep accumulator
+	// > Returns the number of steps due this frame (zero or more)
+	int BeginFixedUpdate( float elapsedTime );
+	// Counts off the next fixed step due this frame, for use as the condition of a while loop around the game's update
+	// > Returns false when there are no more steps this frame
+	bool FixedStep();
+	// Gets the duration of a fixed step in seconds
+	float GetFixedStepTime();
+	// Gets how far the current frame is between the last step and the next (0-1)
+	// > DrawObject and the other GameObject drawing functions use this to interpolate between oldPos and pos
+	float GetInterpolationAlpha();
 
 	// PlayAudio functions
 	//**************************************************************************************************
 
-	// Plays an mp3 audio file from the "Data\Sounds" directory
+	// Plays an mp3 or wav audio file from the "Data\Sounds" directory
+	// > wav files are mixed in software, so several can play at once (including the same one) without stalling the frame
 	void PlayAudio( const char* mp3Filename );
-	// Loops an mp3 audio file from the "Data\Sounds" directory
+	// Loops an mp3 or wav audio file from the "Data\Sounds" directory
 	void StartAudioLoop( const char* mp3Filename );
-	// Stops a looping mp3 audio file started with Play::StartSoundLoop()
+	// Stops a looping audio file started with Play::StartSoundLoop()
 	void StopAudioLoop( const char* mp3Filename );
+	// Gets the id of an audio file, so it can be played without looking up its name each time
+	int GetAudioId( const char* mp3Filename );
+	// Plays an audio file using its id from Play::GetAudioId()
+	void PlayAudio( int audioId );
+	// Loops an audio file using its id from Play::GetAudioId()
+	void StartAudioLoop( int audioId );
+	// Stops a looping audio file using its id from Play::GetAudioId()
+	void StopAudioLoop( int audioId );
 
 	// Camera functions
 	//**************************************************************************************************
@@ -1601,16 +2801,24 @@ namespace Play
 	//**************************************************************************************************
 
 	// Clears the display buffer using the colour provided
-	void ClearDrawingBuffer( Colour col );
+	void ClearDrawingBuffer( Pixel col );
+	inline void ClearDrawingBuffer( Colour col ) { ClearDrawingBuffer( col.ToPixel() ); }
 	// Loads a PNG file as the background image for the window
 	int LoadBackground( const char* pngFilename );
 	// Draws the background image previously loaded with Play::LoadBackground() into the drawing buffer
 	void DrawBackground( int background = 0 );
 	// Draws text to the screen using the built-in debug font
-	void DrawDebugText( Point2D pos, const char* text, Colour col = cWhite, bool centred = true );
+	void DrawDebugText( Point2D pos, const char* text, Pixel col = cWhite, bool centred = true );
+	inline void DrawDebugText( Point2D pos, const char* text, Colour col, bool centred = true ) { DrawDebugText( pos, text, col.ToPixel(), centred ); }
 
-	// Gets the sprite id of the first matching sprite whose filename contains the given text
+	// Gets the sprite id of the sprite with the given name, with or without the frame count at the end of its filename
+	// > Text which isn't a whole name is matched against the filenames the first time, and the answer is remembered
 	int GetSpriteId( const char* spriteName );
+	// Gets the sprite id for a name hashed at compile time e.g. Play::GetSpriteId( PLAY_SPRITE( "agent8_fall" ) )
+	// > Only whole names match, not part of a name as with the overload above
+	int GetSpriteId( SpriteHash spriteName );
+	// Gets the sprite id of the first sprite whose filename contains the given text (slow: compares against every name)
+	int FindSpriteId( const char* text );
 	// Gets the pixel height of a sprite
 	int GetSpriteHeight( const char* spriteName );
 	// Gets the pixel width of a sprite
@@ -1625,7 +2833,8 @@ namespace Play
 	int GetSpriteFrames( int spriteId );
 	// Blends the sprite with the given colour (works best on white sprites)
 	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
-	void ColourSprite( const char* spriteName, Colour col );
+	void ColourSprite( const char* spriteName, Pixel col );
+	inline void ColourSprite( const char* spriteName, Colour col ) { ColourSprite( spriteName, col.ToPixel() ); }
 
 	// Centres the origin of the first sprite found matching the given name
 	void CentreSpriteOrigin( const char* spriteName );
@@ -1649,6 +2858,8 @@ namespace Play
 	Point2D GetSpriteOrigin( int spriteId );
 	// Gets a (read only) pointer to a sprite's canvas buffer data
 	const PixelData* GetSpritePixelData( int spriteId );
+	// Starts loading every sprite whose name contains any of the given text in the background (see PLAY_LAZY_SPRITES)
+	void PrefetchSprites( const std::vector< std::string >& names );
 
 	// Draws the first matching sprite whose filename contains the given text
 	void DrawSprite( const char* spriteName, Point2D pos, int frameIndex );
@@ -1664,27 +2875,38 @@ namespace Play
 	void DrawSpriteRotated( int spriteID, Point2D pos, int frame, float angle, float scale, float opacity = 1.0f );
 	// Draws the sprite using a tranformation matrix. Final rendering approach depends on the contents of the matrix
 	void DrawSpriteTransformed( int spriteID, const Matrix2D& transform, int frame, float opacity = 1.0f );
+	// Draws the sprite using an affine tranformation, which avoids the 3x3 matrix work entirely
+	void DrawSpriteTransformed( int spriteID, const Affine2D& transform, int frame, float opacity = 1.0f );
 	// Draws a single-pixel wide line between two points in the given colour
-	void DrawLine( Point2D start, Point2D end, Colour col );
+	void DrawLine( Point2D start, Point2D end, Pixel col );
+	inline void DrawLine( Point2D start, Point2D end, Colour col ) { DrawLine( start, end, col.ToPixel() ); }
 	// Draws a single-pixel wide circle in the given colour
-	void DrawCircle( Point2D pos, int radius, Colour col );
+	void DrawCircle( Point2D pos, int radius, Pixel col );
+	inline void DrawCircle( Point2D pos, int radius, Colour col ) { DrawCircle( pos, radius, col.ToPixel() ); }
 	// Draws a rectangle in the given colour
-	void DrawRect( Point2D topLeft, Point2D bottomRight, Colour col, bool fill = false );
+	void DrawRect( Point2D topLeft, Point2D bottomRight, Pixel col, bool fill = false );
+	inline void DrawRect( Point2D topLeft, Point2D bottomRight, Colour col, bool fill = false ) { DrawRect( topLeft, bottomRight, col.ToPixel(), fill ); }
 	// Draws a line between two points using a sprite
 	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
-	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour c = cWhite );
+	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Pixel c = cWhite );
+	inline void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour c ) { DrawSpriteLine( startPos, endPos, penSprite, c.ToPixel() ); }
 	// Draws a circle using a sprite
 	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
-	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour c = cWhite );
+	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Pixel c = cWhite );
+	inline void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour c ) { DrawSpriteCircle( pos, radius, penSprite, c.ToPixel() ); }
 	// Draws text using a sprite-based font exported from PlayFontTool
-	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify = LEFT );
+	// > The text is drawn in the given colour, without changing the font
+	void DrawFontText( const char* fontId, const std::string& text, Point2D pos, Align justify = LEFT, Pixel col = cWhite );
+	inline void DrawFontText( const char* fontId, const std::string& text, Point2D pos, Align justify, Colour col ) { DrawFontText( fontId, text, pos, justify, col.ToPixel() ); }
 	// Adds a sprite dynamically from memory (custom asset pipelines)
 
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
 	void BeginTimingBar( Pixel pix );
+	inline void BeginTimingBar( Colour col ) { BeginTimingBar( col.ToPixel() ); }
 	// Sets the current timing bar segment to a specific colour
 	// > Returns the number of timing segments
 	int ColourTimingBar( Pixel pix );
+	inline int ColourTimingBar( Colour col ) { return ColourTimingBar( col.ToPixel() ); }
 	// Draws the timing bar for the previous frame at the given position and size
 	void DrawTimingBar( Point2f pos, Point2f size );
 
@@ -1709,6 +2931,9 @@ namespace Play
 	// Performs a typical update of the object's position and animation
 	// > Cam only be called once per object per frame unless allowMultipleUpdatesPerFrame is set to true
 	void UpdateGameObject( GameObject& object, bool bWrap = false, int wrapBorderSize = 0, bool allowMultipleUpdatesPerFrame = false );
+	// Performs the same update as UpdateGameObject on every GameObject at once using the batch vector operations
+	// > Can only be called once per frame, and not for objects which have already been updated this frame
+	void UpdateAllGameObjects( bool bWrap = false, int wrapBorderSize = 0 );
 	// Deletes the GameObject with the corresponding id
 	//> Use GameObject.GetId() to find out its unique id
 	void DestroyGameObject( int id );
@@ -1717,6 +2942,9 @@ namespace Play
 	
 	// Checks whether the two objects are within each other's collision radii
 	bool IsColliding( GameObject& obj1, GameObject& obj2 );
+	// Collects the IDs of all of the GameObjects with the matching type which are colliding with the object
+	// > Uses the same test as IsColliding, but checks all of the objects at once using the batch vector operations
+	std::vector<int> CollectCollidingGameObjectIDs( GameObject& obj, int type );
 	// Checks whether any part of the object is visible within the DisplayBuffer
 	bool IsVisible( GameObject& obj );
 	// Checks whether the object is overlapping the edge of the screen and moving outwards 
@@ -1821,13 +3049,22 @@ struct ALLOC
 	size_t size = 0;
 	int id = 0;
 
-	ALLOC( void* a, const char* fn, int l, size_t s ) { address = a; line = l; size = s; id = g_allocId++; strcpy_s( file, fn ); };
+	ALLOC( void* a, const char* fn, int l, size_t s ) { address = a; line = l; size = s; id = g_allocId++; snprintf( file, MAX_FILENAME, "%s", fn ); };
 	ALLOC( void ) {};
 };
 
 ALLOC g_allocations[MAX_ALLOCATIONS];
 unsigned int g_allocCount = 0;
 
+// Serialises access to the allocations, as memory can also be allocated on other threads (such as the present thread)
+// > A spin lock, because it works before any static constructors have run and never allocates
+std::atomic_flag g_allocLock = ATOMIC_FLAG_INIT;
+struct AllocLock
+{
+	AllocLock() { while( g_allocLock.test_and_set( std::memory_order_acquire ) ) {} }
+	~AllocLock() { g_allocLock.clear( std::memory_order_release ); }
+};
+
 
 void CreateStaticObject( void );
 void PrintAllocation( const char* tagText, ALLOC& a );
@@ -1844,6 +3081,7 @@ void* operator new( size_t size, const char* file, int line )
 	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
 	CreateStaticObject();
 	void* p = malloc( size );
+	AllocLock lock;
 	g_allocations[g_allocCount++] = ALLOC{ p, file, line, size };
 	return p;
 }
@@ -1853,6 +3091,7 @@ void* operator new[]( size_t size, const char* file, int line )
 	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
 	CreateStaticObject();
 	void* p = malloc( size );
+	AllocLock lock;
 	g_allocations[g_allocCount++] = ALLOC{ p, file, line, size };
 	return p;
 }
@@ -1862,6 +3101,7 @@ void* operator new( size_t size )
 	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
 	CreateStaticObject();
 	void* p = malloc( size );
+	AllocLock lock;
 	g_allocations[g_allocCount++] = ALLOC{ p, "Unknown", 0, size };
 	return p;
 }
@@ -1871,6 +3111,7 @@ void* operator new[]( size_t size )
 	PLAY_ASSERT( g_allocCount < MAX_ALLOCATIONS );
 	CreateStaticObject();
 	void* p = malloc( size );
+	AllocLock lock;
 	g_allocations[g_allocCount++] = ALLOC{ p, "Unknown", 0, size };
 	return p;
 }
@@ -1883,8 +3124,8 @@ void* operator new[]( size_t size )
 // the new that was used to allocate it.
 void operator delete( void* p, const char* file, int line )
 {
-	UNREFERENCED_PARAMETER( line );
-	UNREFERENCED_PARAMETER( file );
+	(void)line;
+	(void)file;
 	operator delete( p );
 }
 
@@ -1892,6 +3133,7 @@ int g_id = -1;
 
 void operator delete( void* p )
 {
+	AllocLock lock;
 	for( unsigned int a = 0; a < g_allocCount; a++ )
 	{
 		if( g_allocations[a].address == p )
@@ -1909,13 +3151,14 @@ void operator delete( void* p )
 
 void operator delete[]( void* p, const char* file, int line )
 {
-	UNREFERENCED_PARAMETER( line );
-	UNREFERENCED_PARAMETER( file );
+	(void)line;
+	(void)file;
 	operator delete[]( p );
 }
 
 void operator delete[]( void* p )
 {
+	AllocLock lock;
 	for( unsigned int a = 0; a < g_allocCount; a++ )
 	{
 		if( g_allocations[a].address == p )
@@ -1973,13 +3216,15 @@ void PrintAllocation( const char* tagText, ALLOC& a )
 	if( a.address != nullptr )
 	{
 		char* lastSlash = strrchr( a.file, '\\' );
+		if( !lastSlash )
+			lastSlash = strrchr( a.file, '/' );
 		if( lastSlash )
 		{
-			strcpy_s( buffer, lastSlash + 1 );
-			strcpy_s( a.file, buffer );
+			snprintf( buffer, sizeof( buffer ), "%s", lastSlash + 1 );
+			snprintf( a.file, MAX_FILENAME, "%s", buffer );
 		}
 		// Format in such a way that VS can double click to jump to the allocation.
-		sprintf_s( buffer, "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, a.file, a.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
+		snprintf( buffer, sizeof( buffer ), "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, a.file, a.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
 		DebugOutput( buffer );
 	}
 }
@@ -1997,7 +3242,7 @@ void PrintAllocations( const char* tagText )
 		PrintAllocation( tagText, a );
 		bytes += static_cast<int>(a.size);
 	}
-	sprintf_s( buffer, "%s Total = %d bytes\n", tagText, bytes );
+	snprintf( buffer, sizeof( buffer ), "%s Total = %d bytes\n", tagText, bytes );
 	DebugOutput( buffer );
 	DebugOutput( "**************************************************\n" );
 
@@ -2008,1899 +3253,6552 @@ void PrintAllocations( const char* tagText )
 #endif
 
 //********************************************************************************************************************************
-// File:		PlayWindow.cpp
-// Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
-// Notes:		Uses a 32-bit ARGB display buffer
+// File:		PlayMaths.cpp
+// Description:	Batch versions of the fast trigonometry and vector functions
+// Platform:	Independent
+// Notes:		The batch sine and cosine use polynomials rather than the table as SSE2 can't gather from a table
 //********************************************************************************************************************************
 
-// Instruct Visual Studio to add these to the list of libraries to link
-#pragma comment(lib, "gdiplus.lib")
-#pragma comment(lib, "dwmapi.lib")
-
-PlayWindow* PlayWindow::s_pInstance = nullptr;
-
-// External functions which must be implemented by the user 
-extern void MainGameEntry( int argc, char* argv[] ); 
-extern bool MainGameUpdate( float ); // Called every frame
-extern int MainGameExit( void ); // Called on quit
+// Pi/2 split into three parts so the range reduction stays accurate (Cody-Waite)
+constexpr float PLAY_PIO2_HI = 1.5703125f;
+constexpr float PLAY_PIO2_MID = 4.837512969970703125e-4f;
+constexpr float PLAY_PIO2_LO = 7.54978995489188216e-8f;
 
-ULONG_PTR g_pGDIToken = 0;
-
-int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd )
+// Calculates the sine and cosine of one angle using the same polynomials as the SSE2 version
+static void SinCosPolynomial( float angle, float& sinOut, float& cosOut )
 {
-	// Initialize GDI+
-	Gdiplus::GdiplusStartupInput startupInput;
-	ULONG_PTR token;
-	Gdiplus::Status gdiStatus = Gdiplus::GdiplusStartup( &token, &startupInput, NULL );
-	PLAY_ASSERT( Gdiplus::Ok == gdiStatus );
-	g_pGDIToken = token;
-
-	MainGameEntry( __argc, __argv );
+	if( !( std::abs( angle ) <= PLAY_FAST_TRIG_RANGE ) )
+	{
+		sinOut = std::sin( angle );
+		cosOut = std::cos( angle );
+		return;
+	}
 
-	return PlayWindow::Instance().HandleWindows( hInstance, hPrevInstance, lpCmdLine, nShowCmd, L"PlayBuffer" );
-}
+	// Reduce the angle to the range -pi/4 to pi/4 and remember which quadrant it came from
+	float q = std::nearbyint( angle * ( 2.0f / PLAY_PI ) );
+	int quadrant = static_cast<int>( q );
+	float r = ( ( angle - q * PLAY_PIO2_HI ) - q * PLAY_PIO2_MID ) - q * PLAY_PIO2_LO;
+	float r2 = r * r;
 
-//********************************************************************************************************************************
-// Constructor / Destructor (Private)
-//********************************************************************************************************************************
+	float s = r + r * r2 * ( -1.6666667e-1f + r2 * ( 8.3333337e-3f + r2 * ( -1.9841270e-4f + r2 * 2.7557319e-6f ) ) );
+	float c = 1.0f + r2 * ( -0.5f + r2 * ( 4.1666668e-2f + r2 * ( -1.3888889e-3f + r2 * 2.4801587e-5f ) ) );
 
-PlayWindow::PlayWindow( PixelData* pDisplayBuffer, int nScale )
-{
-	PLAY_ASSERT( pDisplayBuffer );
-	PLAY_ASSERT( nScale > 0 );
-	m_pPlayBuffer = pDisplayBuffer;
-	m_scale = nScale;
+	if( quadrant & 1 ) std::swap( s, c );
+	sinOut = ( quadrant & 2 ) ? -s : s;
+	cosOut = ( ( quadrant + 1 ) & 2 ) ? -c : c;
 }
 
-PlayWindow::~PlayWindow( void )
+void FastSinCosBatch( const float* angles, float* sinOut, float* cosOut, int count )
 {
-	s_pInstance = nullptr;
-}
+	int i = 0;
 
-//********************************************************************************************************************************
-// Instance functions
-//********************************************************************************************************************************
+#ifdef PLAY_SSE2
+	const __m128 twoOverPi = _mm_set1_ps( 2.0f / PLAY_PI );
+	const __m128i one = _mm_set1_epi32( 1 );
+	const __m128i two = _mm_set1_epi32( 2 );
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	const __m128 range = _mm_set1_ps( PLAY_FAST_TRIG_RANGE );
 
-PlayWindow& PlayWindow::Instance()
-{
-	if( !s_pInstance )
-		PLAY_ASSERT_MSG( false, "Trying to use PlayBuffer without initialising it!" );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 angle = _mm_loadu_ps( angles + i );
 
-	return *s_pInstance;
-}
+		// Angles out of range (or NaN) can't be reduced to a quadrant, so the whole group goes through the scalar version
+		if( _mm_movemask_ps( _mm_cmpnle_ps( _mm_andnot_ps( signMask, angle ), range ) ) )
+		{
+			for( int j = i; j < i + 4; ++j )
+				SinCosPolynomial( angles[j], sinOut[j], cosOut[j] );
+			continue;
+		}
 
-PlayWindow& PlayWindow::Instance( PixelData* pDisplayBuffer, int nScale )
-{
-	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
-	s_pInstance = new PlayWindow( pDisplayBuffer, nScale );
-	return *s_pInstance;
-}
+		// Round to the nearest quadrant (the default rounding mode is round to nearest)
+		__m128i quadrant = _mm_cvtps_epi32( _mm_mul_ps( angle, twoOverPi ) );
+		__m128 q = _mm_cvtepi32_ps( quadrant );
+		__m128 r = _mm_sub_ps( angle, _mm_mul_ps( q, _mm_set1_ps( PLAY_PIO2_HI ) ) );
+		r = _mm_sub_ps( r, _mm_mul_ps( q, _mm_set1_ps( PLAY_PIO2_MID ) ) );
+		r = _mm_sub_ps( r, _mm_mul_ps( q, _mm_set1_ps( PLAY_PIO2_LO ) ) );
+		__m128 r2 = _mm_mul_ps( r, r );
+
+		__m128 s = _mm_add_ps( _mm_set1_ps( -1.9841270e-4f ), _mm_mul_ps( r2, _mm_set1_ps( 2.7557319e-6f ) ) );
+		s = _mm_add_ps( _mm_set1_ps( 8.3333337e-3f ), _mm_mul_ps( r2, s ) );
+		s = _mm_add_ps( _mm_set1_ps( -1.6666667e-1f ), _mm_mul_ps( r2, s ) );
+		s = _mm_add_ps( r, _mm_mul_ps( _mm_mul_ps( r, r2 ), s ) );
+
+		__m128 c = _mm_add_ps( _mm_set1_ps( -1.3888889e-3f ), _mm_mul_ps( r2, _mm_set1_ps( 2.4801587e-5f ) ) );
+		c = _mm_add_ps( _mm_set1_ps( 4.1666668e-2f ), _mm_mul_ps( r2, c ) );
+		c = _mm_add_ps( _mm_set1_ps( -0.5f ), _mm_mul_ps( r2, c ) );
+		c = _mm_add_ps( _mm_set1_ps( 1.0f ), _mm_mul_ps( r2, c ) );
+
+		// Swap sine and cosine in odd quadrants, then flip the signs using the quadrant bits
+		__m128 swap = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( quadrant, one ), one ) );
+		__m128 sinResult = _mm_or_ps( _mm_and_ps( swap, c ), _mm_andnot_ps( swap, s ) );
+		__m128 cosResult = _mm_or_ps( _mm_and_ps( swap, s ), _mm_andnot_ps( swap, c ) );
+		__m128 sinSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( quadrant, two ), 30 ) );
+		__m128 cosSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( _mm_add_epi32( quadrant, one ), two ), 30 ) );
+
+		_mm_storeu_ps( sinOut + i, _mm_xor_ps( sinResult, sinSign ) );
+		_mm_storeu_ps( cosOut + i, _mm_xor_ps( cosResult, cosSign ) );
+	}
+#endif
 
-void PlayWindow::Destroy()
-{
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayBuffer which hasn't been instanced!" );
-	delete s_pInstance;
-	s_pInstance = nullptr;
+	// Any remaining angles (or all of them without SSE2)
+	for( ; i < count; ++i )
+		SinCosPolynomial( angles[i], sinOut[i], cosOut[i] );
 }
 
-//********************************************************************************************************************************
-// Windows functions
-//********************************************************************************************************************************
-
-int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow, LPCWSTR windowName )
+void FastAtan2Batch( const float* y, const float* x, float* angleOut, int count )
 {
-	UNREFERENCED_PARAMETER( hPrevInstance );
-	UNREFERENCED_PARAMETER( lpCmdLine );
-
-	WNDCLASSEXW wcex;
-
-	wcex.cbSize = sizeof( WNDCLASSEX );
-
-	wcex.style = CS_HREDRAW | CS_VREDRAW;
-	wcex.lpfnWndProc = PlayWindow::WndProc;
-	wcex.cbClsExtra = 0;
-	wcex.cbWndExtra = 0;
-	wcex.hInstance = hInstance;
-	wcex.hIcon = LoadIcon( hInstance, IDI_APPLICATION );
-	wcex.hCursor = LoadCursor( nullptr, IDC_ARROW );
-	wcex.hbrBackground = (HBRUSH)( COLOR_WINDOW + 1 );
-	wcex.lpszMenuName = nullptr;
-	wcex.lpszClassName = windowName;
-	wcex.hIconSm = LoadIcon( wcex.hInstance, IDI_APPLICATION );
-
-	RegisterClassExW( &wcex );
+	int i = 0;
 
-	int	w = m_pPlayBuffer->width * m_scale;
-	int h = m_pPlayBuffer->height * m_scale;
+#ifdef PLAY_SSE2
+	const __m128 signMask = _mm_set1_ps( -0.0f );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 halfPi = _mm_set1_ps( PLAY_PI / 2 );
+	const __m128 pi = _mm_set1_ps( PLAY_PI );
 
-	UINT dwStyle = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
-	RECT rect = { 0, 0, w, h }; 
-	AdjustWindowRect( &rect, dwStyle, FALSE );
-	HWND hWnd = CreateWindowW( windowName, windowName, dwStyle, CW_USEDEFAULT, CW_USEDEFAULT, rect.right - rect.left, rect.bottom - rect.top, nullptr, nullptr, hInstance, nullptr );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 vy = _mm_loadu_ps( y + i );
+		__m128 vx = _mm_loadu_ps( x + i );
+		__m128 ax = _mm_andnot_ps( signMask, vx );
+		__m128 ay = _mm_andnot_ps( signMask, vy );
+		__m128 maxXY = _mm_max_ps( ax, ay );
+		__m128 minXY = _mm_min_ps( ax, ay );
 
-	if( !hWnd )
-		return FALSE;
+		// Avoid dividing zero by zero: the result is zero for the origin anyway
+		__m128 nonZero = _mm_cmpgt_ps( maxXY, zero );
+		__m128 a = _mm_and_ps( _mm_div_ps( minXY, _mm_or_ps( maxXY, _mm_andnot_ps( nonZero, _mm_set1_ps( 1.0f ) ) ) ), nonZero );
+		__m128 s = _mm_mul_ps( a, a );
 
-	m_hWindow = hWnd;
+		__m128 r = _mm_add_ps( _mm_set1_ps( -0.0851330f ), _mm_mul_ps( s, _mm_set1_ps( 0.0208351f ) ) );
+		r = _mm_add_ps( _mm_set1_ps( 0.1801410f ), _mm_mul_ps( s, r ) );
+		r = _mm_add_ps( _mm_set1_ps( -0.3302995f ), _mm_mul_ps( s, r ) );
+		r = _mm_add_ps( _mm_set1_ps( 0.9998660f ), _mm_mul_ps( s, r ) );
+		r = _mm_mul_ps( r, a );
 
-	ShowWindow( hWnd, nCmdShow );
-	UpdateWindow( hWnd );
+		// Use symmetry to find the right octant
+		__m128 steep = _mm_cmpgt_ps( ay, ax );
+		r = _mm_or_ps( _mm_and_ps( steep, _mm_sub_ps( halfPi, r ) ), _mm_andnot_ps( steep, r ) );
+		__m128 left = _mm_castsi128_ps( _mm_srai_epi32( _mm_castps_si128( vx ), 31 ) );
+		r = _mm_or_ps( _mm_and_ps( left, _mm_sub_ps( pi, r ) ), _mm_andnot_ps( left, r ) );
+		r = _mm_xor_ps( r, _mm_and_ps( vy, signMask ) );
 
-	HACCEL hAccelTable = LoadAccelerators( hInstance, windowName );
+		_mm_storeu_ps( angleOut + i, r );
+	}
+#endif
 
-	LARGE_INTEGER frequency;        
-	double elapsedTime = 0.0;
-	static LARGE_INTEGER lastDrawTime;
-	LARGE_INTEGER now;
+	// Any remaining values (or all of them without SSE2)
+	for( ; i < count; ++i )
+		angleOut[i] = FastAtan2( y[i], x[i] );
+}
 
-	MSG msg{};
-	bool quit = false;
+// The AoS functions treat an array of Vector2f as pairs of floats
+static_assert( sizeof( Vector2f ) == 2 * sizeof( float ), "Vector2f must be two packed floats" );
 
-	// Set up counters for timing the frame
-	QueryPerformanceCounter( &lastDrawTime );
-	QueryPerformanceFrequency( &frequency );
+void BatchAddScaled( Vector2f* v, const Vector2f* add, float scale, int count )
+{
+	// Interleaved x and y are scaled the same way so both can be treated as a single array of floats
+	BatchAddScaled( reinterpret_cast<float*>( v ), nullptr, reinterpret_cast<const float*>( add ), nullptr, scale, count * 2 );
+}
 
-	// Standard windows message loop
-	while( !quit )
+void BatchAddScaled( float* x, float* y, const float* addX, const float* addY, float scale, int count )
+{
+	for( int pass = 0; pass < 2; ++pass )
 	{
-		// Hangle windows messages
-		if( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
-		{
-			if( msg.message == WM_QUIT )
-				break;
-
-			if( !TranslateAccelerator( msg.hwnd, hAccelTable, &msg ) )
-			{
-				TranslateMessage( &msg );
-				DispatchMessage( &msg );
-			}
-		}
-
-		do
-		{
-			QueryPerformanceCounter( &now );
-			elapsedTime = ( now.QuadPart - lastDrawTime.QuadPart ) * 1000.0 / frequency.QuadPart;
+		float* out = pass == 0 ? x : y;
+		const float* add = pass == 0 ? addX : addY;
+		if( !out ) continue;
 
-		} while( elapsedTime < 1000.0f / FRAMES_PER_SECOND );
-
-		// Call the main game update function (only while we have the input focus in release mode)
-#ifndef _DEBUG
-		if( GetFocus() == m_hWindow )
+		int i = 0;
+#ifdef PLAY_AVX
+		const __m256 scale8 = _mm256_set1_ps( scale );
+		for( ; i + 8 <= count; i += 8 )
+			_mm256_storeu_ps( out + i, _mm256_add_ps( _mm256_loadu_ps( out + i ), _mm256_mul_ps( _mm256_loadu_ps( add + i ), scale8 ) ) );
 #endif
-			quit = MainGameUpdate( static_cast<float>( elapsedTime ) / 1000.0f );
-		
-		lastDrawTime = now;
-
-		DwmFlush(); // Waits for DWM compositor to finish
+#ifdef PLAY_SSE2
+		const __m128 scale4 = _mm_set1_ps( scale );
+		for( ; i + 4 <= count; i += 4 )
+			_mm_storeu_ps( out + i, _mm_add_ps( _mm_loadu_ps( out + i ), _mm_mul_ps( _mm_loadu_ps( add + i ), scale4 ) ) );
+#endif
+		for( ; i < count; ++i )
+			out[i] += add[i] * scale;
 	}
+}
 
-	// Call the main game cleanup function
-	MainGameExit();
-
-	PLAY_ASSERT( g_pGDIToken );
-	Gdiplus::GdiplusShutdown( g_pGDIToken );
+void BatchTransform( const Vector2f* in, Vector2f* out, const Matrix2D& m, int count )
+{
+	BatchTransform( in, out, Affine2D( m ), count );
+}
 
-	return static_cast<int>( msg.wParam );
+void BatchTransform( const float* inX, const float* inY, float* outX, float* outY, const Matrix2D& m, int count )
+{
+	BatchTransform( inX, inY, outX, outY, Affine2D( m ), count );
 }
 
-LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam )
+void BatchTransform( const Vector2f* in, Vector2f* out, const Affine2D& m, int count )
 {
-	switch( message )
+	const float* src = reinterpret_cast<const float*>( in );
+	float* dst = reinterpret_cast<float*>( out );
+	int i = 0;
+
+	// Each register holds whole points as x,y pairs: duplicate the x and y values and multiply by matching pairs of matrix columns
+#ifdef PLAY_AVX
+	const __m256 col0 = _mm256_setr_ps( m.m00, m.m01, m.m00, m.m01, m.m00, m.m01, m.m00, m.m01 );
+	const __m256 col1 = _mm256_setr_ps( m.m10, m.m11, m.m10, m.m11, m.m10, m.m11, m.m10, m.m11 );
+	const __m256 trans8 = _mm256_setr_ps( m.tx, m.ty, m.tx, m.ty, m.tx, m.ty, m.tx, m.ty );
+	for( ; i + 4 <= count; i += 4 )
 	{
-		case WM_PAINT:
-			PAINTSTRUCT ps;
-			BeginPaint( hWnd, &ps );
-			EndPaint( hWnd, &ps );
-			break;
-
-		case WM_DESTROY:
-			PostQuitMessage( 0 );
-			break;
-		case WM_LBUTTONDOWN:
-			if( s_pInstance->m_pMouseData )
-				s_pInstance->m_pMouseData->left = true;
-			break;
-		case WM_LBUTTONUP:
-			if( s_pInstance->m_pMouseData )
-				s_pInstance->m_pMouseData->left = false;
-			break;
-		case WM_RBUTTONDOWN:
-			if( s_pInstance->m_pMouseData )
-				s_pInstance->m_pMouseData->right = true;
-			break;
-		case WM_RBUTTONUP:
-			if( s_pInstance->m_pMouseData )
-				s_pInstance->m_pMouseData->right = false;
-			break;
-		case WM_MOUSEMOVE:
-			if( s_pInstance->m_pMouseData )
-			{
-				s_pInstance->m_pMouseData->pos.x = static_cast<float>( GET_X_LPARAM( lParam ) / s_pInstance->m_scale );
-				s_pInstance->m_pMouseData->pos.y = static_cast<float>( GET_Y_LPARAM( lParam ) / s_pInstance->m_scale );
-			}
-			break;
-		case WM_MOUSELEAVE:
-			s_pInstance->m_pMouseData->pos.x = -1;
-			s_pInstance->m_pMouseData->pos.y = -1;
-			break;
-		default:
-			return DefWindowProc( hWnd, message, wParam, lParam );
+		__m256 p = _mm256_loadu_ps( src + i * 2 );
+		__m256 xx = _mm256_moveldup_ps( p );
+		__m256 yy = _mm256_movehdup_ps( p );
+		_mm256_storeu_ps( dst + i * 2, _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( xx, col0 ), _mm256_mul_ps( yy, col1 ) ), trans8 ) );
 	}
-	return 0;
+#endif
+#ifdef PLAY_SSE2
+	const __m128 row0 = _mm_setr_ps( m.m00, m.m01, m.m00, m.m01 );
+	const __m128 row1 = _mm_setr_ps( m.m10, m.m11, m.m10, m.m11 );
+	const __m128 trans4 = _mm_setr_ps( m.tx, m.ty, m.tx, m.ty );
+	for( ; i + 2 <= count; i += 2 )
+	{
+		__m128 p = _mm_loadu_ps( src + i * 2 );
+		__m128 xx = _mm_shuffle_ps( p, p, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+		__m128 yy = _mm_shuffle_ps( p, p, _MM_SHUFFLE( 3, 3, 1, 1 ) );
+		_mm_storeu_ps( dst + i * 2, _mm_add_ps( _mm_add_ps( _mm_mul_ps( xx, row0 ), _mm_mul_ps( yy, row1 ) ), trans4 ) );
+	}
+#endif
+	for( ; i < count; ++i )
+		out[i] = m.Transform( in[i] );
 }
 
-double PlayWindow::Present( void )
+void BatchTransform( const float* inX, const float* inY, float* outX, float* outY, const Affine2D& m, int count )
 {
-	LARGE_INTEGER frequency;
-	LARGE_INTEGER before;
-	LARGE_INTEGER after;
-	QueryPerformanceCounter( &before );
-	QueryPerformanceFrequency( &frequency );
-
-	// Set up a BitmapInfo structure to represent the pixel format of the display buffer
-	BITMAPINFOHEADER bitmap_info_header
+	int i = 0;
+#ifdef PLAY_AVX
+	for( ; i + 8 <= count; i += 8 )
 	{
-			sizeof( BITMAPINFOHEADER ),								// size of its own data,
-			m_pPlayBuffer->width, m_pPlayBuffer->height,		// width and height
-			1, 32, BI_RGB,				// planes must always be set to 1 (docs), 32-bit pixel data, uncompressed 
-			0, 0, 0, 0, 0				// rest can be set to 0 as this is uncompressed and has no palette
-	};
-
-	BITMAPINFO bitmap_info{ bitmap_info_header, { 0,0,0,0 } };	// No palette data required for this bitmap
-
-	HDC hDC = GetDC( m_hWindow );
-
-	// Copy the display buffer to the window: GDI only implements up scaling using simple pixel duplication, but that's what we want
-	// Note that GDI+ DrawImage would do the same thing, but it's much slower! 
-	StretchDIBits( hDC, 0, 0, m_pPlayBuffer->width * m_scale, m_pPlayBuffer->height * m_scale, 0, m_pPlayBuffer->height + 1, m_pPlayBuffer->width, -m_pPlayBuffer->height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY ); // We flip h because Bitmaps store pixel data upside down.
-	
-	ReleaseDC( m_hWindow, hDC );
-
-	QueryPerformanceCounter( &after );
-
-	double elapsedTime = ( after.QuadPart - before.QuadPart ) * 1000.0 / frequency.QuadPart;
+		__m256 x = _mm256_loadu_ps( inX + i );
+		__m256 y = _mm256_loadu_ps( inY + i );
+		__m256 rx = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( x, _mm256_set1_ps( m.m00 ) ), _mm256_mul_ps( y, _mm256_set1_ps( m.m10 ) ) ), _mm256_set1_ps( m.tx ) );
+		__m256 ry = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( x, _mm256_set1_ps( m.m01 ) ), _mm256_mul_ps( y, _mm256_set1_ps( m.m11 ) ) ), _mm256_set1_ps( m.ty ) );
+		_mm256_storeu_ps( outX + i, rx );
+		_mm256_storeu_ps( outY + i, ry );
+	}
+#endif
+#ifdef PLAY_SSE2
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps( inX + i );
+		__m128 y = _mm_loadu_ps( inY + i );
+		__m128 rx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( m.m00 ) ), _mm_mul_ps( y, _mm_set1_ps( m.m10 ) ) ), _mm_set1_ps( m.tx ) );
+		__m128 ry = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( m.m01 ) ), _mm_mul_ps( y, _mm_set1_ps( m.m11 ) ) ), _mm_set1_ps( m.ty ) );
+		_mm_storeu_ps( outX + i, rx );
+		_mm_storeu_ps( outY + i, ry );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		float x = inX[i];
+		float y = inY[i];
+		outX[i] = x * m.m00 + y * m.m10 + m.tx;
+		outY[i] = x * m.m01 + y * m.m11 + m.ty;
+	}
+}
 
-	return elapsedTime;
+#ifdef PLAY_SSE2
+// Loads four interleaved points and separates them into x and y registers
+static inline void LoadDeinterleaved( const float* src, __m128& x, __m128& y )
+{
+	__m128 a = _mm_loadu_ps( src );
+	__m128 b = _mm_loadu_ps( src + 4 );
+	x = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+	y = _mm_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) );
 }
 
-//********************************************************************************************************************************
-// Loading functions
-//********************************************************************************************************************************
+// Interleaves x and y registers and stores them as four points
+static inline void StoreInterleaved( float* dst, __m128 x, __m128 y )
+{
+	_mm_storeu_ps( dst, _mm_unpacklo_ps( x, y ) );
+	_mm_storeu_ps( dst + 4, _mm_unpackhi_ps( x, y ) );
+}
 
-int PlayWindow::ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+// Calculates the reciprocal of the length of each vector, or zero for zero length vectors
+static inline __m128 InverseLength( __m128 x, __m128 y )
 {
-	// Convert filename from single to wide string for GDI+ compatibility
-	size_t newsize = strlen( fileAndPath.c_str() ) + 1;
-	wchar_t* wcstring = new wchar_t[newsize];
-	size_t convertedChars = 0;
-	mbstowcs_s( &convertedChars, wcstring, newsize, fileAndPath.c_str(), _TRUNCATE );
+	__m128 lengthSqr = _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) );
+	__m128 nonZero = _mm_cmpgt_ps( lengthSqr, _mm_setzero_ps() );
+	return _mm_and_ps( _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( lengthSqr ) ), nonZero );
+}
+#endif
 
-	HBITMAP hBitmap = NULL;
+#ifdef PLAY_AVX
+// Calculates the reciprocal of the length of each vector, or zero for zero length vectors
+static inline __m256 InverseLength( __m256 x, __m256 y )
+{
+	__m256 lengthSqr = _mm256_add_ps( _mm256_mul_ps( x, x ), _mm256_mul_ps( y, y ) );
+	__m256 nonZero = _mm256_cmp_ps( lengthSqr, _mm256_setzero_ps(), _CMP_GT_OQ );
+	return _mm256_and_ps( _mm256_div_ps( _mm256_set1_ps( 1.0f ), _mm256_sqrt_ps( lengthSqr ) ), nonZero );
+}
+#endif
 
-	// Use GDI+ to load file into Bitmap structure
-	Gdiplus::Bitmap* bitmap = Gdiplus::Bitmap::FromFile( wcstring, false );
-	int status = bitmap->GetLastStatus();
+// Calculates the reciprocal of the length of a vector, or zero for a zero length vector
+static inline float InverseLength( float x, float y )
+{
+	float lengthSqr = x * x + y * y;
+	return lengthSqr > 0.0f ? 1.0f / std::sqrt( lengthSqr ) : 0.0f;
+}
 
-	if( status != Gdiplus::Ok )
-		return -status;
+void BatchLength( const Vector2f* v, float* lengthOut, int count )
+{
+	int i = 0;
+#ifdef PLAY_SSE2
+	const float* src = reinterpret_cast<const float*>( v );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x, y;
+		LoadDeinterleaved( src + i * 2, x, y );
+		_mm_storeu_ps( lengthOut + i, _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+		lengthOut[i] = std::sqrt( v[i].x * v[i].x + v[i].y * v[i].y );
+}
 
-	bitmap->GetHBITMAP( Gdiplus::Color( 255, 255, 255 ), &hBitmap );
+void BatchLength( const float* x, const float* y, float* lengthOut, int count )
+{
+	int i = 0;
+#ifdef PLAY_AVX
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256 vx = _mm256_loadu_ps( x + i );
+		__m256 vy = _mm256_loadu_ps( y + i );
+		_mm256_storeu_ps( lengthOut + i, _mm256_sqrt_ps( _mm256_add_ps( _mm256_mul_ps( vx, vx ), _mm256_mul_ps( vy, vy ) ) ) );
+	}
+#endif
+#ifdef PLAY_SSE2
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 vx = _mm_loadu_ps( x + i );
+		__m128 vy = _mm_loadu_ps( y + i );
+		_mm_storeu_ps( lengthOut + i, _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( vx, vx ), _mm_mul_ps( vy, vy ) ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+		lengthOut[i] = std::sqrt( x[i] * x[i] + y[i] * y[i] );
+}
 
-	width = bitmap->GetWidth();
-	height = bitmap->GetHeight();
+void BatchNormalize( Vector2f* v, int count )
+{
+	int i = 0;
+#ifdef PLAY_SSE2
+	float* data = reinterpret_cast<float*>( v );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x, y;
+		LoadDeinterleaved( data + i * 2, x, y );
+		__m128 inverse = InverseLength( x, y );
+		StoreInterleaved( data + i * 2, _mm_mul_ps( x, inverse ), _mm_mul_ps( y, inverse ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		float inverse = InverseLength( v[i].x, v[i].y );
+		v[i].x *= inverse;
+		v[i].y *= inverse;
+	}
+}
 
-	delete bitmap;
-	delete[] wcstring;
+void BatchNormalize( float* x, float* y, int count )
+{
+	int i = 0;
+#ifdef PLAY_AVX
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256 vx = _mm256_loadu_ps( x + i );
+		__m256 vy = _mm256_loadu_ps( y + i );
+		__m256 inverse = InverseLength( vx, vy );
+		_mm256_storeu_ps( x + i, _mm256_mul_ps( vx, inverse ) );
+		_mm256_storeu_ps( y + i, _mm256_mul_ps( vy, inverse ) );
+	}
+#endif
+#ifdef PLAY_SSE2
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 vx = _mm_loadu_ps( x + i );
+		__m128 vy = _mm_loadu_ps( y + i );
+		__m128 inverse = InverseLength( vx, vy );
+		_mm_storeu_ps( x + i, _mm_mul_ps( vx, inverse ) );
+		_mm_storeu_ps( y + i, _mm_mul_ps( vy, inverse ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		float inverse = InverseLength( x[i], y[i] );
+		x[i] *= inverse;
+		y[i] *= inverse;
+	}
+}
 
-	return 1;
+void BatchDistanceSqr( const Vector2f* points, const Point2f& target, float* distSqrOut, int count )
+{
+	int i = 0;
+#ifdef PLAY_SSE2
+	const float* src = reinterpret_cast<const float*>( points );
+	const __m128 tx = _mm_set1_ps( target.x );
+	const __m128 ty = _mm_set1_ps( target.y );
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x, y;
+		LoadDeinterleaved( src + i * 2, x, y );
+		x = _mm_sub_ps( x, tx );
+		y = _mm_sub_ps( y, ty );
+		_mm_storeu_ps( distSqrOut + i, _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		float dx = points[i].x - target.x;
+		float dy = points[i].y - target.y;
+		distSqrOut[i] = dx * dx + dy * dy;
+	}
 }
 
-int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage )
+void BatchDistanceSqr( const float* x, const float* y, const Point2f& target, float* distSqrOut, int count )
 {
-	// Convert filename from single to wide string for GDI+ compatibility
-	size_t newsize = strlen( fileAndPath.c_str() ) + 1;
-	wchar_t* wcstring = new wchar_t[newsize];
-	size_t convertedChars = 0;
-	mbstowcs_s( &convertedChars, wcstring, newsize, fileAndPath.c_str(), _TRUNCATE );
+	int i = 0;
+#ifdef PLAY_AVX
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256 dx = _mm256_sub_ps( _mm256_loadu_ps( x + i ), _mm256_set1_ps( target.x ) );
+		__m256 dy = _mm256_sub_ps( _mm256_loadu_ps( y + i ), _mm256_set1_ps( target.y ) );
+		_mm256_storeu_ps( distSqrOut + i, _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ) );
+	}
+#endif
+#ifdef PLAY_SSE2
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 dx = _mm_sub_ps( _mm_loadu_ps( x + i ), _mm_set1_ps( target.x ) );
+		__m128 dy = _mm_sub_ps( _mm_loadu_ps( y + i ), _mm_set1_ps( target.y ) );
+		_mm_storeu_ps( distSqrOut + i, _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ) );
+	}
+#endif
+	for( ; i < count; ++i )
+	{
+		float dx = x[i] - target.x;
+		float dy = y[i] - target.y;
+		distSqrOut[i] = dx * dx + dy * dy;
+	}
+}
+
+//********************************************************************************************************************************
+// File:		PlayWindow.cpp
+// Description:	Platform specific code to provide a window to draw into
+// Platform:	Windows
+// Notes:		Uses a 32-bit ARGB display buffer
+//********************************************************************************************************************************
+
+#ifndef PLAY_PLATFORM_HEADLESS
+// Instruct Visual Studio to add these to the list of libraries to link
+#pragma comment(lib, "dwmapi.lib")
+#endif
 
-	HBITMAP hBitmap = NULL;
+PlayWindow* PlayWindow::s_pInstance = nullptr;
 
-	// Use GDI+ to load file into Bitmap structure
-	Gdiplus::Bitmap* bitmap = Gdiplus::Bitmap::FromFile( wcstring, false );
-	int status = bitmap->GetLastStatus();
+// External functions which must be implemented by the user 
+extern void MainGameEntry( int argc, char* argv[] ); 
+extern bool MainGameUpdate( float ); // Called every frame
+extern int MainGameExit( void ); // Called on quit
 
-	if( status != Gdiplus::Ok )
-		return -status;
+#ifndef PLAY_PLATFORM_HEADLESS
 
-	bitmap->GetHBITMAP( Gdiplus::Color( 255, 255, 255 ), &hBitmap );
+int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd )
+{
+	MainGameEntry( __argc, __argv );
 
-	// Create BitmapData structure to pull the data into
-	Gdiplus::BitmapData* bitmapData = new Gdiplus::BitmapData;
+	return PlayWindow::Instance().HandleWindows( hInstance, hPrevInstance, lpCmdLine, nShowCmd, L"PlayBuffer" );
+}
 
-	destImage.width = bitmap->GetWidth();
-	destImage.height = bitmap->GetHeight();
+#endif
 
-	// Lock the bitmap in advance of reading its data
-	Gdiplus::Rect rect( 0, 0, destImage.width, destImage.height );
-	bitmap->LockBits( &rect, Gdiplus::ImageLockModeRead, PixelFormat32bppARGB, bitmapData );
+//********************************************************************************************************************************
+// Constructor / Destructor (Private)
+//********************************************************************************************************************************
 
-	// Get a pointer to the actual bit data
-	Pixel* sourcePixels = static_cast<Pixel*>( bitmapData->Scan0 );
+PlayWindow::PlayWindow( PixelData* pDisplayBuffer, int nScale )
+{
+	PLAY_ASSERT( pDisplayBuffer );
+	PLAY_ASSERT( nScale > 0 );
+	m_pPlayBuffer = pDisplayBuffer;
+	m_scale = nScale;
+#ifdef PLAY_PLATFORM_HEADLESS
+	m_pPresenter = std::make_unique<PlayMemoryPresenter>();
+#endif
+}
 
-	destImage.pPixels = new Pixel[destImage.width * destImage.height];
-	memset( destImage.pPixels, 0, sizeof( Pixel ) * destImage.width * destImage.height );
+PlayWindow::~PlayWindow( void )
+{
+	if( m_presentThread.joinable() )
+	{
+		{
+			std::lock_guard<std::mutex> lock( m_presentMutex );
+			m_stopPresentThread = true;
+		}
+		m_presentCondition.notify_all();
+		m_presentThread.join();
+	}
+	s_pInstance = nullptr;
+}
 
-	Pixel* destPixels = destImage.pPixels;
+//********************************************************************************************************************************
+// Instance functions
+//********************************************************************************************************************************
 
-	// Copy the data across
-	for( int b = 0; b < destImage.width * destImage.height; b++ )
-		*destPixels++ = *sourcePixels++;
+PlayWindow& PlayWindow::Instance()
+{
+	if( !s_pInstance )
+		PLAY_ASSERT_MSG( false, "Trying to use PlayBuffer without initialising it!" );
 
-	//Unlock the bitmap
-	bitmap->UnlockBits( bitmapData );
+	return *s_pInstance;
+}
 
-	delete bitmap;
-	delete bitmapData;
-	delete[] wcstring;
+PlayWindow& PlayWindow::Instance( PixelData* pDisplayBuffer, int nScale )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
+	s_pInstance = new PlayWindow( pDisplayBuffer, nScale );
+	return *s_pInstance;
+}
 
-	return 1;
+void PlayWindow::Destroy()
+{
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayBuffer which hasn't been instanced!" );
+	delete s_pInstance;
+	s_pInstance = nullptr;
 }
 
 //********************************************************************************************************************************
-// Miscellaneous functions
+// Frame scheduler functions
 //********************************************************************************************************************************
 
-void AssertFailMessage( const char* message, const char* file, long line )
+PlayFrameScheduler::PlayFrameScheduler( int framesPerSecond )
 {
-	// file - the file in which the assertion failed ( __FILE__ )
-	// line - the line of code where the assertion failed ( __LINE__ )
-	std::filesystem::path p = file;
-	std::string s = p.filename().string() + " : LINE " + std::to_string( line );
-	s += "\n" + std::string( message );
-	int wide_count = MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, NULL, 0 );
-	wchar_t* wide = new wchar_t[wide_count];
-	MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, wide, wide_count );
-	MessageBox( NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING );
-	delete[] wide;
+	SetTargetFrameRate( framesPerSecond );
+	Reset();
 }
 
-void DebugOutput( const char* s )
+void PlayFrameScheduler::SetTargetFrameRate( int framesPerSecond )
 {
-	OutputDebugStringA( s );
+	PLAY_ASSERT_MSG( framesPerSecond > 0, "The target frame rate must be positive!" );
+	m_framesPerSecond = framesPerSecond;
+	m_period = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( 1.0 / framesPerSecond ) );
+	m_deadline = m_lastFrame + m_period;
 }
 
-void DebugOutput( std::string s )
+void PlayFrameScheduler::Reset()
 {
-	OutputDebugStringA( s.c_str() );
+	m_lastFrame = Clock::now();
+	m_deadline = m_lastFrame + m_period;
 }
 
-void TracePrintf( const char* file, int line, const char* fmt, ... )
+void PlayFrameScheduler::UpdateSleepEstimate( double sleptMs )
 {
-	constexpr size_t kMaxBufferSize = 512u;
-	char buffer[kMaxBufferSize];
+	// Exponentially weighted, so the estimate follows changes in the timer resolution
+	constexpr double weight = 0.1;
+	double difference = sleptMs - m_sleepMeanMs;
+	m_sleepMeanMs += weight * difference;
+	m_sleepVarianceMs = ( 1.0 - weight ) * ( m_sleepVarianceMs + weight * difference * difference );
+}
 
-	va_list args;
-	va_start( args, fmt );
-	// format should be double click-able in VS 
-	int len = sprintf_s( buffer, kMaxBufferSize, "%s(%d): ", file, line );
-	vsprintf_s( buffer + len, kMaxBufferSize - len, fmt, args );
-	DebugOutput( buffer );
-	va_end( args );
+double PlayFrameScheduler::WaitForNextFrame()
+{
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+
+	Clock::time_point now = Clock::now();
+	double slackMs = Milliseconds( m_deadline - now ).count();
+
+	// Sleep in short steps while there's comfortably more time left than a sleep could take
+	for( ;; )
+	{
+		double remainingMs = Milliseconds( m_deadline - now ).count();
+		double wakeUpMs = m_sleepMeanMs + 2.0 * std::sqrt( m_sleepVarianceMs );
+		if( remainingMs <= wakeUpMs + m_spinMarginMs )
+			break;
+
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		Clock::time_point after = Clock::now();
+		UpdateSleepEstimate( Milliseconds( after - now ).count() );
+		now = after;
+	}
+
+	// Spin for the rest
+	while( now < m_deadline )
+		now = Clock::now();
+
+	// Update the statistics
+	constexpr double weight = 0.05;
+	m_stats.slackMs = slackMs;
+	m_stats.overrunMs = slackMs < 0.0 ? -slackMs : 0.0;
+	m_stats.jitterMs = slackMs < 0.0 ? 0.0 : Milliseconds( now - m_deadline ).count();
+	m_stats.averageSlackMs += weight * ( m_stats.slackMs - m_stats.averageSlackMs );
+	m_stats.averageJitterMs += weight * ( m_stats.jitterMs - m_stats.averageJitterMs );
+	m_stats.maxOverrunMs = std::max( m_stats.maxOverrunMs, m_stats.overrunMs );
+	m_stats.maxJitterMs = std::max( m_stats.maxJitterMs, m_stats.jitterMs );
+	m_stats.overrunFrames += slackMs < 0.0 ? 1 : 0;
+	m_stats.frames++;
+
+	// Keep a steady cadence after a short overrun, but start afresh if a whole frame has been lost rather than rushing to catch up
+	m_deadline += m_period;
+	if( m_deadline < now )
+		m_deadline = now + m_period;
+
+	double elapsedTime = std::chrono::duration<double>( now - m_lastFrame ).count();
+	m_lastFrame = now;
+	return elapsedTime;
 }
 
 //********************************************************************************************************************************
-// File:		PlayBlitter.cpp
-// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
-// Platform:	Independent
+// Present functions
 //********************************************************************************************************************************
 
+double PlayWindow::Present( void )
+{
+	// Nothing to present to until the window has been created
+	if( !m_pPresenter )
+		return 0.0;
 
-PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
+	WaitForPresents();
+	m_lastPresentTime = m_pPresenter->Present( *m_pPlayBuffer, m_scale );
+	return m_lastPresentTime;
+}
+
+void PlayWindow::PresentAsync( const PixelData* pFrame, int maxFramesInFlight )
 {
-	m_pRenderTarget = pRenderTarget;
+	PLAY_ASSERT_MSG( maxFramesInFlight > 0, "At least one frame must be allowed in flight!" );
+
+	if( !m_presentThread.joinable() )
+		m_presentThread = std::thread( &PlayWindow::PresentThread, this );
+
+	std::unique_lock<std::mutex> lock( m_presentMutex );
+	m_presentCondition.wait( lock, [&] { return m_presentQueue.size() < static_cast<size_t>( maxFramesInFlight ); } );
+	m_presentQueue.push_back( pFrame );
+	lock.unlock();
+	m_presentCondition.notify_all();
 }
 
+void PlayWindow::WaitForPresents()
+{
+	std::unique_lock<std::mutex> lock( m_presentMutex );
+	m_presentCondition.wait( lock, [&] { return m_presentQueue.empty(); } );
+}
 
-void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix ) const
+void PlayWindow::SetPresenter( std::unique_ptr<PlayPresenter> pPresenter )
 {
-	if( srcPix.a == 0x00 || posX < 0 || posX >= m_pRenderTarget->width || posY < 0 || posY >= m_pRenderTarget->height )
-		return;
+	WaitForPresents();
+	std::lock_guard<std::mutex> lock( m_presentMutex );
+	m_pPresenter = std::move( pPresenter );
+}
 
-	Pixel* destPix = &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX];
+void PlayWindow::PresentThread()
+{
+	std::unique_lock<std::mutex> lock( m_presentMutex );
 
-	if( srcPix.a == 0xFF ) // Completely opaque pixel - no need to blend
+	for( ;; )
 	{
-		*destPix = srcPix.bits;
+		m_presentCondition.wait( lock, [&] { return m_stopPresentThread || !m_presentQueue.empty(); } );
+		if( m_stopPresentThread )
+			return;
+
+		// Present without holding the lock, so the game can queue its next frame in the meantime
+		const PixelData* pFrame = m_presentQueue.front();
+		PlayPresenter* pPresenter = m_pPresenter.get();
+		lock.unlock();
+		if( pPresenter )
+			m_lastPresentTime = pPresenter->Present( *pFrame, m_scale );
+		lock.lock();
+
+		m_presentQueue.pop_front();
+		m_presentCondition.notify_all();
 	}
-	else
-	{
-		Pixel blendPix = *destPix;
-		float srcAlpha = srcPix.a / 255.0f;
-		float oneMinusSrcAlpha = 1.0f - srcAlpha;
+}
 
-		blendPix.a = 0xFF;
-		blendPix.r = static_cast<uint8_t>( ( srcAlpha * srcPix.r ) + ( oneMinusSrcAlpha * blendPix.r ) );
-		blendPix.g = static_cast<uint8_t>( ( srcAlpha * srcPix.g ) + ( oneMinusSrcAlpha * blendPix.g ) );
-		blendPix.b = static_cast<uint8_t>( ( srcAlpha * srcPix.b ) + ( oneMinusSrcAlpha * blendPix.b ) );
+//********************************************************************************************************************************
+// Scaling functions
+//********************************************************************************************************************************
 
-		*destPix = blendPix.bits;
+// Duplicates each pixel in a row scale times
+static void ExpandRow( const Pixel* pSrc, Pixel* pRow, int srcWidth, int scale )
+{
+	int x = 0;
+#ifdef PLAY_SSE2
+	// pRow is 16-byte aligned, and four source pixels always expand to a whole number of 16-byte blocks
+	__m128i* pOut = reinterpret_cast<__m128i*>( pRow );
+	switch( scale )
+	{
+		case 2:
+			for( ; x + 4 <= srcWidth; x += 4 )
+			{
+				__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+				_mm_store_si128( pOut++, _mm_unpacklo_epi32( v, v ) );
+				_mm_store_si128( pOut++, _mm_unpackhi_epi32( v, v ) );
+			}
+			break;
+		case 3:
+			for( ; x + 4 <= srcWidth; x += 4 )
+			{
+				__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 0, 0 ) ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 2, 2, 1, 1 ) ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 3, 3, 3, 2 ) ) );
+			}
+			break;
+		case 4:
+			for( ; x + 4 <= srcWidth; x += 4 )
+			{
+				__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 2, 2, 2, 2 ) ) );
+				_mm_store_si128( pOut++, _mm_shuffle_epi32( v, _MM_SHUFFLE( 3, 3, 3, 3 ) ) );
+			}
+			break;
+		default:
+			// Write each pixel four copies at a time, overlapping the start of the next one (the row has room to spare at the end)
+			for( ; x < srcWidth; x++ )
+			{
+				__m128i v = _mm_set1_epi32( static_cast<int>( pSrc[x].bits ) );
+				Pixel* pCopies = pRow + x * scale;
+				for( int i = 0; i < scale; i += 4 )
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pCopies + i ), v );
+			}
+			break;
+	}
+#endif
+	for( ; x < srcWidth; x++ )
+	{
+		for( int i = 0; i < scale; i++ )
+			pRow[x * scale + i] = pSrc[x];
 	}
-
-	return;
 }
 
-void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const
+// Copies a row of pixels to memory which won't be read again soon
+static void StreamRow( Pixel* pDest, const Pixel* pSrc, int width )
 {
-	//Implementation of Bresenham's Line Drawing Algorithm
-	int dx = abs( endX - startX );
-	int sx = 1;
-	if( endX < startX ) { sx = -1; }
+	int x = 0;
+#ifdef PLAY_SSE2
+	// Non-temporal stores need 16-byte alignment, so copy single pixels until the destination is aligned
+	for( ; x < width && ( reinterpret_cast<uintptr_t>( pDest + x ) & 15 ) != 0; x++ )
+		pDest[x] = pSrc[x];
 
-	int dy = -abs( endY - startY );
-	int sy = 1;
-	if( endY < startY ) { sy = -1; }
+	for( ; x + 4 <= width; x += 4 )
+		_mm_stream_si128( reinterpret_cast<__m128i*>( pDest + x ), _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc + x ) ) );
+#endif
+	for( ; x < width; x++ )
+		pDest[x] = pSrc[x];
+}
 
-	int err = dx + dy;
+void UpscaleNearest( const PixelData& src, Pixel* pDest, int destPitch, int scale )
+{
+	PLAY_ASSERT_MSG( scale > 0, "The scale must be a positive whole number!" );
 
-	if( dx == 0 && dy == 0 ) return;
+	int destWidth = src.width * scale;
 
-	int x = startX;
-	int y = startY;
+	// Each row is expanded once into a small cached buffer and then streamed out scale times
+	// > It has room to spare at the end, and is aligned to 16 bytes for the SSE2 stores
+	thread_local std::vector<Pixel> vRow;
+	vRow.resize( static_cast<size_t>( destWidth ) + 8 );
+	Pixel* pRow = vRow.data() + ( ( 16 - ( reinterpret_cast<uintptr_t>( vRow.data() ) & 15 ) ) & 15 ) / sizeof( Pixel );
 
-	while( true )
+	for( int y = 0; y < src.height; y++ )
 	{
-		DrawPixel( x, y, pix );
-
-		if( x == endX && y == endY )
-			break;
-
-		int e2 = 2 * err;
-		if( e2 >= dy )
-		{
-			err += dy;
-			x += sx;
-		}
-		if( e2 <= dx )
+		const Pixel* pSrc = src.pPixels + static_cast<size_t>( y ) * src.width;
+		if( scale > 1 )
 		{
-			err += dx;
-			y += sy;
+			ExpandRow( pSrc, pRow, src.width, scale );
+			pSrc = pRow;
 		}
+
+		for( int i = 0; i < scale; i++ )
+			StreamRow( pDest + ( static_cast<size_t>( y ) * scale + i ) * destPitch, pSrc, destWidth );
 	}
+
+#ifdef PLAY_SSE2
+	_mm_sfence(); // Make the non-temporal stores visible to other threads before anything else reads the output
+#endif
 }
 
-//********************************************************************************************************************************
-// Function:	BlitPixels - draws image data with and without a global alpha multiply
-// Parameters:	srcPixelData = the pixel data you want to draw
-//				srcOffset = the horizontal pixel offset for the required animation frame within the PixelData
-//				blitX, blitY = the position you want to draw the sprite within the buffer
-//				blitWidth, blitHeight = the width and height of the animation frame
-//				alphaMultiply = additional transparancy applied to the whole sprite
-// Notes:		Alpha multiply approach is ~50% slower
-//********************************************************************************************************************************
-void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const
+// Blends two pixels together, with weight 0-256 of the second
+static inline uint32_t LerpPixel( uint32_t a, uint32_t b, uint32_t weight )
 {
-	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
-
-	// Nothing within the display buffer to draw
-	if( blitX > m_pRenderTarget->width || blitX + blitWidth < 0 || blitY > m_pRenderTarget->height || blitY + blitHeight < 0 )
-		return;
-
-	// Work out if we need to clip to the display buffer (and by how much)
-	int xClipStart = -blitX;
-	if( xClipStart < 0 ) { xClipStart = 0; }
-
-	int xClipEnd = ( blitX + blitWidth ) - m_pRenderTarget->width;
-	if( xClipEnd < 0 ) { xClipEnd = 0; }
-
-	int yClipStart = -blitY;
-	if( yClipStart < 0 ) { yClipStart = 0; }
-
-	int yClipEnd = ( blitY + blitHeight ) - m_pRenderTarget->height;
-	if( yClipEnd < 0 ) { yClipEnd = 0; }
-
-	// Set up the source and destination pointers based on clipping
-	int destOffset = ( m_pRenderTarget->width * ( blitY + yClipStart ) ) + ( blitX + xClipStart );
-	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + destOffset;
-
-	int srcClipOffset = ( srcPixelData.width * yClipStart ) + xClipStart;
-	uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + srcClipOffset;
-
-	// Work out in advance how much we need to add to src and dest to reach the next row 
-	int destInc = m_pRenderTarget->width - blitWidth + xClipEnd + xClipStart;
-	int srcInc = srcPixelData.width - blitWidth + xClipEnd + xClipStart;
+	uint32_t rb = ( ( ( a & 0x00FF00FF ) * ( 256 - weight ) + ( b & 0x00FF00FF ) * weight ) >> 8 ) & 0x00FF00FF;
+	uint32_t ag = ( ( ( a >> 8 ) & 0x00FF00FF ) * ( 256 - weight ) + ( ( b >> 8 ) & 0x00FF00FF ) * weight ) & 0xFF00FF00;
+	return rb | ag;
+}
 
-	//Work out final pixel in destination.
-	int destColOffset = ( m_pRenderTarget->width * ( blitHeight - yClipEnd - yClipStart - 1 ) ) + ( blitWidth - xClipEnd - xClipStart );
-	uint32_t* destColEnd = destPixels + destColOffset;
+// A bilinear filter tap: the two source pixels to blend and the weight (0-256) of the second
+struct ScaleTap
+{
+	int first, second, weight;
+};
 
-	//How many pixels per row in sprite.
-	int endRow = blitWidth - xClipEnd - xClipStart;
+// Works out the filter taps for one axis of a sharp bilinear scale
+static void BuildSharpBilinearTaps( int srcSize, int destSize, std::vector<ScaleTap>& vTaps )
+{
+	// Only blend across the edges of the pixels after duplicating them by the largest whole number scale
+	float prescale = std::max( 1.0f, std::floor( static_cast<float>( destSize ) / srcSize ) );
+	float region = 0.5f - 0.5f / prescale;
 
-	if( alphaMultiply < 1.0f )
+	vTaps.resize( destSize );
+	for( int d = 0; d < destSize; d++ )
 	{
-		// *******************************************************************************************************************************************************
-		// A basic (unoptimized) approach which separates the channels and performs a 'typical' alpha blending operation: (src * srcAlpha)+(dest * (1-srcAlpha))
-		// Has the advantage that a global alpha multiplication can be easily added over the top, so we use this method when a global multiply is required
-		// *******************************************************************************************************************************************************
+		float texel = ( d + 0.5f ) * srcSize / destSize;
+		float floored = std::floor( texel );
+		float centreDistance = texel - floored - 0.5f;
+		float position = floored + ( centreDistance - std::clamp( centreDistance, -region, region ) ) * prescale;
 
-		// Slightly more optimised iterations without the additions in the loop
-		while( destPixels < destColEnd )
+		int first = static_cast<int>( std::floor( position ) );
+		int weight = static_cast<int>( ( position - first ) * 256.0f + 0.5f );
+		if( weight >= 256 )
 		{
-			uint32_t* destRowEnd = destPixels + endRow;
-
-			while( destPixels < destRowEnd )
-			{
-				uint32_t src = *srcPixels++;
-				uint32_t dest = *destPixels;
-
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
-					int constAlpha = static_cast<int>( 255 * alphaMultiply );
-
-					// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
-					int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
-					int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
-					int destBlue = constAlpha * ( src & 0xFF );
-
-					int invSrcAlpha = 0xFF - srcAlpha;
-
-					// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
-					destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
-					destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
-					destBlue += invSrcAlpha * ( dest & 0xFF );
+			first++;
+			weight = 0;
+		}
+		vTaps[d] = { std::clamp( first, 0, srcSize - 1 ), std::clamp( first + 1, 0, srcSize - 1 ), weight };
+	}
+}
 
-					// Bring back to the range 0-255
-					destRed >>= 8;
-					destGreen >>= 8;
-					destBlue >>= 8;
+void UpscaleSharpBilinear( const PixelData& src, Pixel* pDest, int destWidth, int destHeight, int destPitch )
+{
+	std::vector<ScaleTap> vColumnTaps, vRowTaps;
+	BuildSharpBilinearTaps( src.width, destWidth, vColumnTaps );
+	BuildSharpBilinearTaps( src.height, destHeight, vRowTaps );
 
-					// Put ARGB components back together again
-					*destPixels++ = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
-				}
-				else
-				{
-					// If this is a fully transparent pixel then the low bits store how many there are in a row
-					// This means we can skip to the next pixel which isn't fully transparent
-					uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
-					src = src & 0x00FFFFFF;
-					if( skip > src ) skip = src;
-
-					srcPixels += skip;
-					++destPixels += skip;
-				}
-			}
-			// Increase buffers by pre-calculated amounts
-			destPixels += destInc;
-			srcPixels += srcInc;
-		}
+	// Blend the two source rows for each output row first, reusing the result while the row taps stay the same
+	std::vector<Pixel> vBlendedRow( src.width + 4 );
+	ScaleTap lastRowTap{ -1, -1, -1 };
 
-	}
-	else
+	for( int y = 0; y < destHeight; y++ )
 	{
-		// *******************************************************************************************************************************************************
-		// An optimized approach which uses pre-multiplied alpha, parallel channel multiplication and pixel skipping to achieve the same 'typical' alpha 
-		// blending operation (src * srcAlpha)+(dest * (1-srcAlpha)). Not easy to apply a global alpha multiplication over the top, but used everywhere else.
-		// *******************************************************************************************************************************************************
-
-		// Slightly more optimised iterations without the additions in the loop
-		while( destPixels < destColEnd )
+		const ScaleTap& rowTap = vRowTaps[y];
+		if( rowTap.first != lastRowTap.first || rowTap.second != lastRowTap.second || rowTap.weight != lastRowTap.weight )
 		{
-			uint32_t* destRowEnd = destPixels + endRow;
-
-			while( destPixels < destRowEnd )
+			const Pixel* pFirst = src.pPixels + static_cast<size_t>( rowTap.first ) * src.width;
+			const Pixel* pSecond = src.pPixels + static_cast<size_t>( rowTap.second ) * src.width;
+			int x = 0;
+#ifdef PLAY_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i firstWeight = _mm_set1_epi16( static_cast<short>( 256 - rowTap.weight ) );
+			const __m128i secondWeight = _mm_set1_epi16( static_cast<short>( rowTap.weight ) );
+			for( ; x + 4 <= src.width; x += 4 )
 			{
-				uint32_t src = *srcPixels++;
-				uint32_t dest = *destPixels;
-
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
-					// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
-					// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
-					// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
-					// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
-					// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
-					// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
-					dest = ( ( ( dest >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
-					// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
-					*destPixels++ = ( src + dest ) | 0xFF000000;
-				}
-				else
-				{
-					// If this is a fully transparent pixel then the low bits store how many there are in a row
-					// This means we can skip to the next pixel which isn't fully transparent
-					uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
-					src = src & 0x00FFFFFF;
-					if( skip > src ) skip = src;
-
-					srcPixels += skip;
-					++destPixels += skip;
-				}
+				// Widen the channels to 16 bits: the weighted sum is at most 255 * 256, which fits
+				__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pFirst + x ) );
+				__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSecond + x ) );
+				__m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( a, zero ), firstWeight ), _mm_mullo_epi16( _mm_unpacklo_epi8( b, zero ), secondWeight ) );
+				__m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( a, zero ), firstWeight ), _mm_mullo_epi16( _mm_unpackhi_epi8( b, zero ), secondWeight ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( vBlendedRow.data() + x ), _mm_packus_epi16( _mm_srli_epi16( lo, 8 ), _mm_srli_epi16( hi, 8 ) ) );
 			}
-			// Increase buffers by pre-calculated amounts
-			destPixels += destInc;
-			srcPixels += srcInc;
+#endif
+			for( ; x < src.width; x++ )
+				vBlendedRow[x].bits = LerpPixel( pFirst[x].bits, pSecond[x].bits, rowTap.weight );
+
+			lastRowTap = rowTap;
 		}
 
+		Pixel* pOut = pDest + static_cast<size_t>( y ) * destPitch;
+		for( int x = 0; x < destWidth; x++ )
+		{
+			// Most columns lie inside an enlarged pixel, so only the ones on the edges need blending
+			const ScaleTap& tap = vColumnTaps[x];
+			pOut[x] = tap.weight == 0 ? vBlendedRow[tap.first] : Pixel( LerpPixel( vBlendedRow[tap.first].bits, vBlendedRow[tap.second].bits, tap.weight ) );
+		}
 	}
-
-	return;
 }
 
-//********************************************************************************************************************************
-// Function:	TransformPixels - draws the image data transforming each screen pixel into image space
-// Parameters:	srcPixelData = the pixel data you want to draw
-//				srcFrameOffset = the horizontal pixel offset for the required animation frame within the PixelData
-//				srcDrawWidth, srcDrawHeight = the width and height of the source image frame
-//				srcOrigin = the centre of rotation for the source image
-//				alphaMultiply = additional transparancy applied to the whole sprite
-// Notes:		Much slower than BlitPixels, alphaMultiply is a negligable overhead compared to the rotation
-//********************************************************************************************************************************
-void PlayBlitter::TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Matrix2D& transform, float alphaMultiply ) const
-{ 
-	static float inf = std::numeric_limits<float>::infinity();
-	float tgt_minx{ inf }, tgt_miny{ inf }, tgt_maxx{ -inf }, tgt_maxy{ -inf };
+double PlayMemoryPresenter::Present( const PixelData& frame, int scale )
+{
+	std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
 
-	float x[2] = { -srcOrigin.x, srcDrawWidth - srcOrigin.x };
-	float y[2] = { -srcOrigin.y, srcDrawHeight - srcOrigin.y };
-	Point2f vertices[4] = { { x[0], y[0] }, { x[1], y[0] }, { x[1], y[1] }, { x[0], y[1] } };
+	int width = m_outputWidth > 0 ? m_outputWidth : frame.width * scale;
+	int height = m_outputHeight > 0 ? m_outputHeight : frame.height * scale;
 
-	//calculate the extremes of the rotated corners.
-	for( int i = 0; i < 4; i++ )
+	if( !m_frame.pPixels || m_frame.width != width || m_frame.height != height )
 	{
-		vertices[i] = transform.Transform( vertices[i] );
-		tgt_minx = floor( tgt_minx < vertices[i].x ? tgt_minx : vertices[i].x );
-		tgt_maxx = ceil( tgt_maxx > vertices[i].x ? tgt_maxx : vertices[i].x );
-		tgt_miny = floor( tgt_miny < vertices[i].y ? tgt_miny : vertices[i].y );
-		tgt_maxy = ceil( tgt_maxy > vertices[i].y ? tgt_maxy : vertices[i].y );
+		delete[] m_frame.pPixels;
+		m_frame.width = width;
+		m_frame.height = height;
+		m_frame.pPixels = new Pixel[static_cast<size_t>( width ) * height];
 	}
 
-	if( Determinant( transform ) == 0.0f ) return;
-	Matrix2D invTransform = transform;
-	invTransform.Inverse();
+	if( width == frame.width * scale && height == frame.height * scale )
+		UpscaleNearest( frame, m_frame.pPixels, width, scale );
+	else
+		UpscaleSharpBilinear( frame, m_frame.pPixels, width, height, width );
 
-	int tgt_draw_width = static_cast<int>(tgt_maxx - tgt_minx);
-	int tgt_draw_height = static_cast<int>(tgt_maxy - tgt_miny);
-	int tgt_buffer_width = m_pRenderTarget->width;
-	int tgt_buffer_height = m_pRenderTarget->height;
+	return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - before ).count();
+}
 
-	if( tgt_miny < 0 ) { tgt_draw_height += (int)tgt_miny; tgt_miny = 0; }
-	if( tgt_maxy > (float)tgt_buffer_height ) { tgt_draw_height -= (int)tgt_maxy - tgt_buffer_height; tgt_maxy = (float)tgt_buffer_height; }
-	if( tgt_minx < 0 ) { tgt_draw_width += (int)tgt_minx; tgt_minx = 0; }
-	if( tgt_maxx > (float)tgt_buffer_width ) { tgt_draw_width -= (int)tgt_maxx - tgt_buffer_width;  tgt_maxx = (float)tgt_buffer_width; }
+#ifdef PLAY_PLATFORM_HEADLESS
+const PixelData& PlayWindow::GetPresentedFrame()
+{
+	WaitForPresents();
+	PlayMemoryPresenter* pPresenter = dynamic_cast<PlayMemoryPresenter*>( m_pPresenter.get() );
+	PLAY_ASSERT_MSG( pPresenter, "The presented frame is only available from the memory presenter!" );
+	return pPresenter->GetFrame();
+}
+#endif // PLAY_PLATFORM_HEADLESS
 
-	Point2f tgt_pixel_start{ tgt_minx, tgt_miny };
-	Point2f src_pixel_start = invTransform.Transform( tgt_pixel_start ) + srcOrigin;
+#ifndef PLAY_PLATFORM_HEADLESS
 
-	float src_posx = src_pixel_start.x;
-	float src_posy = src_pixel_start.y;
+//********************************************************************************************************************************
+// Windows functions
+//********************************************************************************************************************************
 
-	int tgt_posx = static_cast<int>( tgt_pixel_start.x );
-	int tgt_posy = static_cast<int>( tgt_pixel_start.y );
+int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow, LPCWSTR windowName )
+{
+	UNREFERENCED_PARAMETER( hPrevInstance );
+	UNREFERENCED_PARAMETER( lpCmdLine );
 
-	float src_xincx = invTransform.row[0].x;
-	float src_xincy = invTransform.row[0].y;
-	float src_yincx = invTransform.row[1].x;
-	float src_yincy = invTransform.row[1].y;
-	float src_xresetx = src_xincx * tgt_draw_width;
-	float src_xresety = src_xincy * tgt_draw_width;
+	WNDCLASSEXW wcex;
 
-	int tgt_start_pixel_index = tgt_posx + ( tgt_posy * tgt_buffer_width );
-	uint32_t* tgt_pixel = (uint32_t*)m_pRenderTarget->pPixels + tgt_start_pixel_index;
-	uint32_t* tgt_column_end = tgt_pixel + (tgt_draw_height * tgt_buffer_width );
+	wcex.cbSize = sizeof( WNDCLASSEX );
 
-	// Iterate through each pixel on the screen in turn
-	while( tgt_pixel < tgt_column_end )
-	{
-		uint32_t* tgt_row_end = tgt_pixel + tgt_draw_width;
+	wcex.style = CS_HREDRAW | CS_VREDRAW;
+	wcex.lpfnWndProc = PlayWindow::WndProc;
+	wcex.cbClsExtra = 0;
+	wcex.cbWndExtra = 0;
+	wcex.hInstance = hInstance;
+	wcex.hIcon = LoadIcon( hInstance, IDI_APPLICATION );
+	wcex.hCursor = LoadCursor( nullptr, IDC_ARROW );
+	wcex.hbrBackground = (HBRUSH)( COLOR_WINDOW + 1 );
+	wcex.lpszMenuName = nullptr;
+	wcex.lpszClassName = windowName;
+	wcex.hIconSm = LoadIcon( wcex.hInstance, IDI_APPLICATION );
 
-		while( tgt_pixel < tgt_row_end )
-		{
-			int roundX = static_cast<int>( src_posx + 0.5f );
-			int roundY = static_cast<int>( src_posy + 0.5f );
+	RegisterClassExW( &wcex );
 
-			if( roundX >= 0 && roundY >= 0 && roundX < srcDrawWidth && roundY < srcDrawHeight )
-			{
-				int src_pixel_index = roundX + ( roundY * srcPixelData.width );
-				uint32_t src = *( (uint32_t*)srcPixelData.pPixels + src_pixel_index + srcFrameOffset );
+	int	w = m_pPlayBuffer->width * m_scale;
+	int h = m_pPlayBuffer->height * m_scale;
 
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
-					int constAlpha = static_cast<int>( 255 * alphaMultiply );
+	UINT dwStyle = WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU;
+	RECT rect = { 0, 0, w, h }; 
+	AdjustWindowRect( &rect, dwStyle, FALSE );
+	HWND hWnd = CreateWindowW( windowName, windowName, dwStyle, CW_USEDEFAULT, CW_USEDEFAULT, rect.right - rect.left, rect.bottom - rect.top, nullptr, nullptr, hInstance, nullptr );
 
-					// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
-					int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
-					int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
-					int destBlue = constAlpha * ( src & 0xFF );
+	if( !hWnd )
+		return FALSE;
 
-					uint32_t dest = *tgt_pixel;
-					int invSrcAlpha = 0xFF - srcAlpha;
+	m_hWindow = hWnd;
+	if( !m_pPresenter )
+		m_pPresenter = std::make_unique<PlayGDIPresenter>( hWnd );
 
-					// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
-					destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
-					destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
-					destBlue += invSrcAlpha * ( dest & 0xFF );
+	ShowWindow( hWnd, nCmdShow );
+	UpdateWindow( hWnd );
 
-					// Bring back to the range 0-255
-					destRed >>= 8;
-					destGreen >>= 8;
-					destBlue >>= 8;
+	HACCEL hAccelTable = LoadAccelerators( hInstance, windowName );
 
-					// Put ARGB components back together again
-					*tgt_pixel = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
-				}
-			}
+	MSG msg{};
+	bool quit = false;
 
-			tgt_pixel++;
-			src_posx += src_xincx;
-			src_posy += src_xincy;
-		}
+	// Ask for 1ms timer resolution so the scheduler can sleep accurately
+	timeBeginPeriod( 1 );
+	m_scheduler.Reset();
 
-		tgt_pixel += tgt_buffer_width - tgt_draw_width;
+	// Standard windows message loop
+	while( !quit )
+	{
+		// Hangle windows messages
+		if( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
+		{
+			if( msg.message == WM_QUIT )
+				break;
 
-		src_posx -= src_xresetx;
-		src_posy -= src_xresety;
+			if( !TranslateAccelerator( msg.hwnd, hAccelTable, &msg ) )
+			{
+				TranslateMessage( &msg );
+				DispatchMessage( &msg );
+			}
+		}
 
-		src_posx += src_yincx;
-		src_posy += src_yincy;
+		double elapsedTime = m_scheduler.WaitForNextFrame();
+
+		// Call the main game update function (only while we have the input focus in release mode)
+#ifndef _DEBUG
+		if( GetFocus() == m_hWindow )
+#endif
+			quit = MainGameUpdate( static_cast<float>( elapsedTime ) );
 	}
-}
 
+	timeEndPeriod( 1 );
+	WaitForPresents();
 
-void PlayBlitter::ClearRenderTarget( Pixel colour ) const
-{
-	Pixel* pBuffEnd = m_pRenderTarget->pPixels + ( m_pRenderTarget->width * m_pRenderTarget->height );
-	for( Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits );
-	m_pRenderTarget->preMultiplied = false;
-}
+	// Call the main game cleanup function
+	MainGameExit();
 
-void PlayBlitter::BlitBackground( PixelData& backgroundImage ) const
-{
-	PLAY_ASSERT_MSG( backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!" );
-	// Takes about 1ms for 720p screen on i7-8550U
-	memcpy( m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof( Pixel ) * m_pRenderTarget->width * m_pRenderTarget->height );
+	return static_cast<int>( msg.wParam );
 }
 
-
-//********************************************************************************************************************************
-// File:		PlayGraphics.cpp
-// Description:	Manages 2D graphics operations on a PixelData buffer 
-// Platform:	Independent
-// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
-//********************************************************************************************************************************
-
-
-PlayGraphics* PlayGraphics::s_pInstance = nullptr;
-
-//********************************************************************************************************************************
-// Constructor / Destructor (Private)
-//********************************************************************************************************************************
-
-PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path )
+LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam )
 {
-	// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
-	m_playBuffer.width = bufferWidth;
-	m_playBuffer.height = bufferHeight;
-	m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
-	m_playBuffer.preMultiplied = false;
-	PLAY_ASSERT( m_playBuffer.pPixels );
+	switch( message )
+	{
+		case WM_PAINT:
+			PAINTSTRUCT ps;
+			BeginPaint( hWnd, &ps );
+			EndPaint( hWnd, &ps );
+			break;
 
-	memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+		case WM_DESTROY:
+			PostQuitMessage( 0 );
+			break;
+		case WM_LBUTTONDOWN:
+			if( s_pInstance->m_pMouseData )
+				s_pInstance->m_pMouseData->left = true;
+			break;
+		case WM_LBUTTONUP:
+			if( s_pInstance->m_pMouseData )
+				s_pInstance->m_pMouseData->left = false;
+			break;
+		case WM_RBUTTONDOWN:
+			if( s_pInstance->m_pMouseData )
+				s_pInstance->m_pMouseData->right = true;
+			break;
+		case WM_RBUTTONUP:
+			if( s_pInstance->m_pMouseData )
+				s_pInstance->m_pMouseData->right = false;
+			break;
+		case WM_MOUSEMOVE:
+			if( s_pInstance->m_pMouseData )
+			{
+				s_pInstance->m_pMouseData->pos.x = static_cast<float>( GET_X_LPARAM( lParam ) / s_pInstance->m_scale );
+				s_pInstance->m_pMouseData->pos.y = static_cast<float>( GET_Y_LPARAM( lParam ) / s_pInstance->m_scale );
+			}
+			break;
+		case WM_MOUSELEAVE:
+			s_pInstance->m_pMouseData->pos.x = -1;
+			s_pInstance->m_pMouseData->pos.y = -1;
+			break;
+		default:
+			return DefWindowProc( hWnd, message, wParam, lParam );
+	}
+	return 0;
+}
 
-	// Make the display buffer the render target for the blitter
-	m_blitter.SetRenderTarget( &m_playBuffer );
+double PlayGDIPresenter::Present( const PixelData& frame, int scale )
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER before;
+	LARGE_INTEGER after;
+	QueryPerformanceCounter( &before );
+	QueryPerformanceFrequency( &frequency );
 
-	// Iterate through the directory
-	PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+	int width = frame.width * scale;
+	int height = frame.height * scale;
 
-	for( const auto& p : std::filesystem::directory_iterator( path ) )
+	// Scale the frame up ourselves, so GDI only has to copy it
+	const PixelData* pSource = &frame;
+	if( scale > 1 )
 	{
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename = p.path().string();
-		for( char& c : filename ) c = static_cast<char>( toupper( c ) );
-
-		// Only attempt to load PNG files
-		if( filename.find( ".PNG" ) != std::string::npos )
+		if( m_scaled.width != width || m_scaled.height != height )
 		{
-			std::ifstream png_infile;
-			png_infile.open( filename, std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
+			delete[] m_scaled.pPixels;
+			m_scaled.width = width;
+			m_scaled.height = height;
+			m_scaled.pPixels = new Pixel[static_cast<size_t>( width ) * height];
+		}
+		UpscaleNearest( frame, m_scaled.pPixels, width, scale );
+		pSource = &m_scaled;
+	}
 
-			// If the PNG was opened okay
-			if( png_infile )
-			{
-				int spriteId = LoadSpriteSheet( p.path().parent_path().string() + "\\", p.path().stem().string() );
+	// Set up a BitmapInfo structure to represent the pixel format of the display buffer
+	BITMAPINFOHEADER bitmap_info_header
+	{
+			sizeof( BITMAPINFOHEADER ),								// size of its own data,
+			width, -height,				// width and height (negative as our pixel data is stored top down)
+			1, 32, BI_RGB,				// planes must always be set to 1 (docs), 32-bit pixel data, uncompressed 
+			0, 0, 0, 0, 0				// rest can be set to 0 as this is uncompressed and has no palette
+	};
 
-				// Now we check for .inf file for each sprite and load origins
-				int originX = 0, originY = 0;
+	BITMAPINFO bitmap_info{ bitmap_info_header, { 0,0,0,0 } };	// No palette data required for this bitmap
 
-				std::string info_filename = filename.replace( filename.find( ".PNG" ), 4, ".INF" );
+	HDC hDC = GetDC( m_hWindow );
 
-				if( std::filesystem::exists( info_filename ) )
-				{
-					std::ifstream info_infile;
-					info_infile.open( info_filename, std::ios::in );
+	// Copy the scaled frame to the window
+	SetDIBitsToDevice( hDC, 0, 0, width, height, 0, 0, 0, height, pSource->pPixels, &bitmap_info, DIB_RGB_COLORS );
+	
+	ReleaseDC( m_hWindow, hDC );
 
-					PLAY_ASSERT_MSG( info_infile.is_open(), std::string( "Unable to load existing .inf file: " + info_filename ).c_str() );
-					if( info_infile.is_open() )
-					{
-						std::string type;
-						info_infile >> type;
-						info_infile >> originX;
-						info_infile >> originY;
-					}
+	QueryPerformanceCounter( &after );
 
-					info_infile.close();
-				}
+	double elapsedTime = ( after.QuadPart - before.QuadPart ) * 1000.0 / frequency.QuadPart;
 
-				SetSpriteOrigin( spriteId, { originX, originY } );
-			}
+	DwmFlush(); // Waits for DWM compositor to finish
 
-			png_infile.close();
-		}
-	}
+	return elapsedTime;
 }
 
-PlayGraphics::~PlayGraphics()
+//********************************************************************************************************************************
+// Miscellaneous functions
+//********************************************************************************************************************************
+
+void AssertFailMessage( const char* message, const char* file, long line )
 {
-	for( Sprite& s : vSpriteData )
-	{
-		if( s.canvasBuffer.pPixels )
-			delete[] s.canvasBuffer.pPixels;
+	// file - the file in which the assertion failed ( __FILE__ )
+	// line - the line of code where the assertion failed ( __LINE__ )
+	std::filesystem::path p = file;
+	std::string s = p.filename().string() + " : LINE " + std::to_string( line );
+	s += "\n" + std::string( message );
+	int wide_count = MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, NULL, 0 );
+	wchar_t* wide = new wchar_t[wide_count];
+	MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, wide, wide_count );
+	MessageBox( NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING );
+	delete[] wide;
+}
 
-		if( s.preMultAlpha.pPixels )
-			delete[] s.preMultAlpha.pPixels;
-	}
+void DebugOutput( const char* s )
+{
+	OutputDebugStringA( s );
+}
 
-	for( PixelData& pBgBuffer : vBackgroundData )
-		delete[] pBgBuffer.pPixels;
+void DebugOutput( std::string s )
+{
+	OutputDebugStringA( s.c_str() );
+}
 
-	if( m_pDebugFontBuffer )
-		delete[] m_pDebugFontBuffer;
+void TracePrintf( const char* file, int line, const char* fmt, ... )
+{
+	constexpr size_t kMaxBufferSize = 512u;
+	char buffer[kMaxBufferSize];
 
-	delete[] m_playBuffer.pPixels;
+	va_list args;
+	va_start( args, fmt );
+	// format should be double click-able in VS 
+	int len = sprintf_s( buffer, kMaxBufferSize, "%s(%d): ", file, line );
+	vsprintf_s( buffer + len, kMaxBufferSize - len, fmt, args );
+	DebugOutput( buffer );
+	va_end( args );
 }
 
+#endif // PLAY_PLATFORM_HEADLESS
+
 //********************************************************************************************************************************
-// Instance functions
+// File:		PlayWindowHeadless.cpp
+// Description:	Platform specific code to run the game without a window
+// Platform:	Headless (anything with a C++17 standard library)
+// Notes:		Presents into memory and reads input from a script
 //********************************************************************************************************************************
 
-PlayGraphics& PlayGraphics::Instance()
-{
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayGraphics without initialising it!" );
-	return *s_pInstance;
-}
+#ifdef PLAY_PLATFORM_HEADLESS
 
-PlayGraphics& PlayGraphics::Instance( int bufferWidth, int bufferHeight, const char* path )
+int main( int argc, char* argv[] )
 {
-	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
-	s_pInstance = new PlayGraphics( bufferWidth, bufferHeight, path );
-	return *s_pInstance;
-}
+	MainGameEntry( argc, argv );
 
-void PlayGraphics::Destroy()
-{
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayGraphics when it hasn't been instanced!" );
-	delete s_pInstance;
-	s_pInstance = nullptr;
+	return PlayWindow::Instance().HandleHeadless( PlayWindow::ReadHeadlessSettings( argc, argv ) );
 }
 
 //********************************************************************************************************************************
-// Loading functions
+// Headless functions
 //********************************************************************************************************************************
 
-int PlayGraphics::LoadSpriteSheet( const std::string& path, const std::string& filename )
+HeadlessSettings PlayWindow::ReadHeadlessSettings( int argc, char* argv[] )
 {
-	PixelData canvasBuffer;
-	std::string spriteName = filename;
-	int hCount = 1;
-	int vCount = 1;
-
-	// Switch everything to uppercase to avoid need to check case each time
-	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
-
-	// Look for the final number in the filename to pull out the number of frames across the width
-	size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
-	size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
+	HeadlessSettings settings;
 
-	if( frameWidthEnd == spriteName.length() - 1 )
+	for( int i = 1; i < argc; i++ )
 	{
-		// Grab the number of frames
-		std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+		std::string arg( argv[i] );
+		if( arg == "--frames" && i + 1 < argc )
+			settings.maxFrames = std::stoi( argv[++i] );
+		else if( arg == "--unlocked" )
+			settings.unlocked = true;
+		else if( arg == "--input" && i + 1 < argc )
+			settings.inputScript = argv[++i];
+	}
 
-		// Make sure the number is valid 
-		size_t num = widthString.find_first_of( "0123456789" );
-		PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+	return settings;
+}
 
-		hCount = stoi( widthString );
+int PlayWindow::HandleHeadless( const HeadlessSettings& settings )
+{
+	// Read the scripted input events
+	if( !settings.inputScript.empty() )
+	{
+		std::ifstream script( settings.inputScript );
+		PLAY_ASSERT_MSG( script.is_open(), std::string( "Unable to open input script: " + settings.inputScript ).c_str() );
 
-		if( spriteName[frameWidthStart] == 'X' )
+		std::string line;
+		while( std::getline( script, line ) )
 		{
-			//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
-			vCount = hCount;
+			std::istringstream in( line );
+			ScriptedInput event;
+			std::string type;
 
-			// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
-			std::string truncated = spriteName.substr( 0, frameWidthStart );
-			frameWidthEnd = truncated.find_last_of( "0123456789" );
-			frameWidthStart = truncated.find_last_not_of( "0123456789" );
+			// Anything without a frame number and type (such as a blank line or comment) is ignored
+			if( !( in >> event.frame >> type ) )
+				continue;
 
-			if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
+			if( type == "key" )
 			{
-				// Grab the number of images in the height
-				widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
-
-				// Make sure the number is valid
-				num = widthString.find_first_of( "0123456789" );
-				PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
-
-				hCount = stoi( widthString );
+				// A single character is a character key, anything else is a virtual key code (decimal or hex)
+				std::string key;
+				int down = 0;
+				in >> key >> down;
+				event.type = ScriptedInput::KEY;
+				event.key = key.length() == 1 ? toupper( key[0] ) : std::stoi( key, nullptr, 0 );
+				event.down = down != 0;
+			}
+			else if( type == "mouse" )
+			{
+				int left = 0, right = 0;
+				in >> event.mouse.pos.x >> event.mouse.pos.y >> left >> right;
+				event.type = ScriptedInput::MOUSE;
+				event.mouse.left = left != 0;
+				event.mouse.right = right != 0;
+			}
+			else if( type == "quit" )
+			{
+				event.type = ScriptedInput::QUIT;
 			}
 			else
 			{
-				PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+				PLAY_ASSERT_MSG( false, std::string( "Unknown input script event: " + line ).c_str() );
+				continue;
 			}
+
+			m_vScriptedInput.push_back( event );
 		}
-		else
-		{
-			vCount = 1;
-		}
+
+		std::stable_sort( m_vScriptedInput.begin(), m_vScriptedInput.end(), []( const ScriptedInput& a, const ScriptedInput& b ) { return a.frame < b.frame; } );
 	}
 
-	std::string fileAndPath( path + spriteName + ".PNG" );
-	PlayWindow::LoadPNGImage( fileAndPath, canvasBuffer ); // Allocates memory as we don't know the size
-	
-	return AddSprite( filename, canvasBuffer, hCount, vCount );
-}
+	bool quit = false;
+	m_scheduler.Reset();
 
-int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
-{
-	// Switch everything to uppercase to avoid need to check case each time
-	std::string spriteName = name;
-	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+	while( !quit && ( settings.maxFrames == 0 || m_frameCount < settings.maxFrames ) )
+	{
+		if( !ApplyScriptedInput() )
+			break;
 
-	Sprite s;
-	s.id = m_nTotalSprites++;
-	s.name = spriteName;
-	s.originX = s.originY = 0;
-	s.hCount = hCount;
-	s.vCount = vCount;
-	s.canvasBuffer = pixelData; // copy including pointer to pixel data
+		// Unlocked games run flat out, but are given the same elapsed time as a locked game so they behave the same way
+		float elapsedTime = 1.0f / m_scheduler.GetTargetFrameRate();
 
-	s.totalCount = s.hCount * s.vCount;
-	s.width = s.canvasBuffer.width / s.hCount;
-	s.height = s.canvasBuffer.height / s.vCount;
+		if( !settings.unlocked )
+			elapsedTime = static_cast<float>( m_scheduler.WaitForNextFrame() );
 
-	// Create a separate buffer with the pre-multiplyied alpha
-	s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
-	s.preMultAlpha.width = s.canvasBuffer.width;
-	s.preMultAlpha.height = s.canvasBuffer.height;
-	memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
-	s.canvasBuffer.preMultiplied = true;
+		quit = MainGameUpdate( elapsedTime );
+		m_frameCount++;
+	}
 
-	// Add the sprite to our vector
-	vSpriteData.push_back( s );
+	WaitForPresents();
 
-	return s.id;
+	// Call the main game cleanup function (which usually destroys this PlayWindow)
+	MainGameExit();
+
+	return 0;
 }
 
-int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+bool PlayWindow::ApplyScriptedInput()
 {
-	// Switch everything to uppercase to avoid need to check case each time
-	std::string spriteName = name;
-	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
-
-	for( Sprite& s : vSpriteData )
+	while( m_nextScriptedInput < m_vScriptedInput.size() && m_vScriptedInput[m_nextScriptedInput].frame <= m_frameCount )
 	{
-		if( s.name.find( spriteName ) != std::string::npos )
-		{
-			// delete the old premultiplied buffer
-			delete s.preMultAlpha.pPixels;
-
-			s.hCount = hCount;
-			s.vCount = vCount;
-			s.canvasBuffer = pixelData; // copy including pointer to pixel data
-
-			s.totalCount = s.hCount * s.vCount;
-			s.width = s.canvasBuffer.width / s.hCount;
-			s.height = s.canvasBuffer.height / s.vCount;
-
-			// Create a new buffer with the pre-multiplyied alpha
-			s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
-			s.preMultAlpha.width = s.canvasBuffer.width;
-			s.preMultAlpha.height = s.canvasBuffer.height;
-			memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
-			PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
-			s.canvasBuffer.preMultiplied = true;
+		const ScriptedInput& event = m_vScriptedInput[m_nextScriptedInput++];
 
-			return s.id;
+		switch( event.type )
+		{
+			case ScriptedInput::KEY:
+				PlayInput::Instance().SetKeyState( event.key, event.down );
+				break;
+			case ScriptedInput::MOUSE:
+				if( m_pMouseData )
+					*m_pMouseData = event.mouse;
+				break;
+			case ScriptedInput::QUIT:
+				return false;
 		}
 	}
 
-	return -1;
+	return true;
 }
 
+//********************************************************************************************************************************
+// Miscellaneous functions
+//********************************************************************************************************************************
 
-int PlayGraphics::LoadBackground( const char* fileAndPath )
+void AssertFailMessage( const char* message, const char* file, long line )
 {
-	// The background image may not be the right size for the background so we make sure the buffer is 
-	PixelData backgroundImage;
-	Pixel* pSrc, * pDest;
-
-	Pixel* correctSizeBuffer = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
-	PLAY_ASSERT( correctSizeBuffer );
-
-	std::string pngFile( fileAndPath );
-	PLAY_ASSERT_MSG( std::filesystem::exists( fileAndPath ), "The background png does not exist at the given location." );
-	PlayWindow::LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
-
-	pSrc = backgroundImage.pPixels;
-	pDest = correctSizeBuffer;
-
-	//Copy the image to our background buffer clipping where necessary
-	for( int h = 0; h < std::min( backgroundImage.height, m_playBuffer.height ); h++ )
-	{
-		for( int w = 0; w < std::min( backgroundImage.width, m_playBuffer.width ); w++ )
-			*pDest++ = *pSrc++;
+	// file - the file in which the assertion failed ( __FILE__ )
+	// line - the line of code where the assertion failed ( __LINE__ )
+	std::filesystem::path p = file;
+	std::string s = "Assertion Failure: " + p.filename().string() + " : LINE " + std::to_string( line );
+	s += "\n" + std::string( message ) + "\n";
+	DebugOutput( s );
+}
 
-		// Skip pixels if we're clipping
-		pDest += std::max( m_playBuffer.width - backgroundImage.width, 0 );
-		pSrc += std::max( backgroundImage.width - m_playBuffer.width, 0 );
-	}
+void DebugOutput( const char* s )
+{
+	fputs( s, stderr );
+}
 
-	// Free up the loading buffer
-	delete backgroundImage.pPixels;
-	backgroundImage.pPixels = correctSizeBuffer;
+void DebugOutput( std::string s )
+{
+	fputs( s.c_str(), stderr );
+}
 
-	vBackgroundData.push_back( backgroundImage );
+void TracePrintf( const char* file, int line, const char* fmt, ... )
+{
+	constexpr size_t kMaxBufferSize = 512u;
+	char buffer[kMaxBufferSize];
 
-	return static_cast<int>( vBackgroundData.size() ) - 1;
+	va_list args;
+	va_start( args, fmt );
+	int len = snprintf( buffer, kMaxBufferSize, "%s(%d): ", file, line );
+	vsnprintf( buffer + len, kMaxBufferSize - len, fmt, args );
+	DebugOutput( buffer );
+	va_end( args );
 }
 
+#endif // PLAY_PLATFORM_HEADLESS
 
 //********************************************************************************************************************************
-// Sprite Getters and Setters
+// File:		PlayPNG.cpp
+// Description:	Decodes PNG images for PlayWindow::LoadPNGImage
+// Platform:	Independent
+// Notes:		The image is inflated, unfiltered and converted a few rows at a time, so each row is handed over while it is still
+//				in the cache and the whole decompressed image is never held in memory
 //********************************************************************************************************************************
-int PlayGraphics::GetSpriteId( const char* name ) const
-{
-	std::string tofind( name );
-	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
-
-	for( const Sprite& s : vSpriteData )
-	{
-		if( s.name.find( tofind ) != std::string::npos )
-			return s.id;
-	}
-	PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
-	return -1;
-}
 
-const std::string& PlayGraphics::GetSpriteName( int spriteId )
-{
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get name of invalid sprite id" );
-	return vSpriteData[spriteId].name;
-}
+// The number of bits looked up at once when decoding Huffman codes: longer codes are decoded a bit at a time
+constexpr int INFLATE_FAST_BITS = 9;
+// How much of the inflated output is kept for back references
+constexpr size_t INFLATE_WINDOW_SIZE = 32768;
+
+// Inflate (RFC 1951) based on the canonical Huffman decoding approach used by zlib's puff.c, with a lookup table for short codes
+struct InflateState
+{
+	const uint8_t* pIn{ nullptr };
+	size_t inSize{ 0 };
+	size_t inPos{ 0 };
+	uint32_t bitBuffer{ 0 };
+	int bitCount{ 0 };
+	bool error{ false };
+	std::vector<uint8_t>* pOut{ nullptr };
+	// Called once the output grows past flushSize to consume what has been inflated so far
+	// > It returns how many bytes from the start of the output are no longer needed, apart from the window for back references
+	size_t ( *pFlush )( const std::vector<uint8_t>& out, void* pContext ){ nullptr };
+	void* pFlushContext{ nullptr };
+	size_t flushSize{ 0 };
+};
 
-Vector2f PlayGraphics::GetSpriteSize( int spriteId ) const
+// A canonical Huffman code: the number of codes of each length and the symbols in code order
+// > fast holds the symbol and code length (symbol << 4 | length) for every code that fits in INFLATE_FAST_BITS, indexed by the next bits
+struct InflateHuffman
 {
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get width of invalid sprite id" );
-	return { vSpriteData[spriteId].width, vSpriteData[spriteId].height };
-}
+	short count[16];
+	short symbol[288];
+	uint16_t fast[1 << INFLATE_FAST_BITS];
+};
 
-int PlayGraphics::GetSpriteFrames( int spriteId ) const
+static int InflateBits( InflateState& s, int need )
 {
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get frames of invalid sprite id" );
-	return vSpriteData[spriteId].totalCount;
+	uint32_t value = s.bitBuffer;
+	while( s.bitCount < need )
+	{
+		if( s.inPos >= s.inSize )
+		{
+			s.error = true;
+			return 0;
+		}
+		value |= static_cast<uint32_t>( s.pIn[s.inPos++] ) << s.bitCount;
+		s.bitCount += 8;
+	}
+	s.bitBuffer = need < 32 ? value >> need : 0;
+	s.bitCount -= need;
+	return static_cast<int>( value & ( ( 1u << need ) - 1 ) );
 }
 
-Vector2f PlayGraphics::GetSpriteOrigin( int spriteId ) const
+static int InflateDecode( InflateState& s, const InflateHuffman& h )
 {
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get origin with invalid sprite id" );
-	return { vSpriteData[spriteId].originX, vSpriteData[spriteId].originY };
-}
+	// Top up the bit buffer so most codes can be found with a single lookup
+	while( s.bitCount <= 24 && s.inPos < s.inSize )
+	{
+		s.bitBuffer |= static_cast<uint32_t>( s.pIn[s.inPos++] ) << s.bitCount;
+		s.bitCount += 8;
+	}
 
-void PlayGraphics::SetSpriteOrigin( int spriteId, Vector2f newOrigin, bool relative )
-{
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to set origin with invalid sprite id" );
-	if( relative )
+	uint16_t entry = h.fast[s.bitBuffer & ( ( 1u << INFLATE_FAST_BITS ) - 1 )];
+	int length = entry & 15;
+	if( entry != 0 && length <= s.bitCount )
 	{
-		vSpriteData[spriteId].originX += static_cast<int>( newOrigin.x );
-		vSpriteData[spriteId].originY += static_cast<int>( newOrigin.y );
+		s.bitBuffer >>= length;
+		s.bitCount -= length;
+		return entry >> 4;
 	}
-	else
+
+	int code = 0, first = 0, index = 0;
+	for( int len = 1; len < 16; len++ )
 	{
-		vSpriteData[spriteId].originX = static_cast<int>( newOrigin.x );
-		vSpriteData[spriteId].originY = static_cast<int>( newOrigin.y );
+		code |= InflateBits( s, 1 );
+		int count = h.count[len];
+		if( code - count < first )
+			return h.symbol[index + ( code - first )];
+		index += count;
+		first = ( first + count ) << 1;
+		code <<= 1;
 	}
+	s.error = true;
+	return -1;
 }
 
-void PlayGraphics::CentreSpriteOrigin( int spriteId )
+static void InflateBuild( InflateHuffman& h, const short* lengths, int n )
 {
-	SetSpriteOrigin( spriteId, GetSpriteSize( spriteId ) / 2 );
-}
+	memset( h.count, 0, sizeof( h.count ) );
+	for( int symbol = 0; symbol < n; symbol++ )
+		h.count[lengths[symbol]]++;
+	h.count[0] = 0;
 
-void PlayGraphics::CentreAllSpriteOrigins( void )
-{
-	for( Sprite& s : vSpriteData )
-		CentreSpriteOrigin( s.id );
-}
+	short offsets[16] = { 0 };
+	for( int len = 1; len < 15; len++ )
+		offsets[len + 1] = offsets[len] + h.count[len];
 
-void PlayGraphics::SetSpriteOrigins( const char* rootName, Vector2f newOrigin, bool relative )
-{
-	std::string tofind( rootName );
-	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+	for( int symbol = 0; symbol < n; symbol++ )
+	{
+		if( lengths[symbol] != 0 )
+			h.symbol[offsets[lengths[symbol]]++] = static_cast<short>( symbol );
+	}
 
-	for( Sprite& s : vSpriteData )
+	// Deflate stores codes starting from their top bit, so each short code's bits are reversed to match the order they are read in
+	memset( h.fast, 0, sizeof( h.fast ) );
+	int code = 0, index = 0;
+	for( int len = 1; len <= INFLATE_FAST_BITS; len++ )
 	{
-		if( s.name.find( tofind ) != std::string::npos )
+		for( int i = 0; i < h.count[len]; i++, code++, index++ )
 		{
-			if( relative )
-			{
-				s.originX += static_cast<int>( newOrigin.x );
-				s.originY += static_cast<int>( newOrigin.y );
-			}
-			else
-			{
-				s.originX = static_cast<int>( newOrigin.x );
-				s.originY = static_cast<int>( newOrigin.y );
-			}
+			if( code >= ( 1 << len ) )
+				return; // Over-subscribed: leave it to the slow decoder to report the error
+
+			int reversed = 0;
+			for( int bit = 0; bit < len; bit++ )
+				reversed |= ( ( code >> bit ) & 1 ) << ( len - 1 - bit );
+
+			for( int entry = reversed; entry < ( 1 << INFLATE_FAST_BITS ); entry += 1 << len )
+				h.fast[entry] = static_cast<uint16_t>( ( h.symbol[index] << 4 ) | len );
 		}
+		code <<= 1;
 	}
 }
 
-//********************************************************************************************************************************
-// Drawing functions
-//********************************************************************************************************************************
-
-void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const
+// Passes the finished output to the flush function and discards whatever it no longer needs
+static bool InflateFlush( InflateState& s )
 {
-	const Sprite& spr = vSpriteData[spriteId];
-	int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
-	int desty = static_cast<int>( pos.y + 0.5f ) - spr.originY;
-	frameIndex = frameIndex % spr.totalCount;
-	int frameX = frameIndex % spr.hCount;
-	int frameY = frameIndex / spr.hCount;
-	int pixelX = frameX * spr.width;
-	int pixelY = frameY * spr.height;
-	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
-
-	m_blitter.BlitPixels( spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, alphaMultiply );
-};
+	std::vector<uint8_t>& out = *s.pOut;
+	size_t consumed = s.pFlush( out, s.pFlushContext );
+	if( consumed > out.size() )
+		return false;
 
-void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply ) const
-{
-	Matrix2D trans =  MatrixScale( scale, scale ) * MatrixRotation( angle );
-	trans.row[2] = { pos.x, pos.y, 1.0f };
-	DrawTransformed( spriteId, trans, frameIndex, alphaMultiply );
+	if( consumed > INFLATE_WINDOW_SIZE )
+	{
+		size_t discard = consumed - INFLATE_WINDOW_SIZE;
+		out.erase( out.begin(), out.begin() + discard );
+	}
+	return true;
 }
 
-void PlayGraphics::DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, float alphaMultiply ) const
+static bool InflateCodes( InflateState& s, const InflateHuffman& lengthCode, const InflateHuffman& distanceCode )
 {
-	const Sprite& spr = vSpriteData[spriteId];
-	frameIndex = frameIndex % spr.totalCount;
-	int frameX = frameIndex % spr.hCount;
-	int frameY = frameIndex / spr.hCount;
-	int pixelX = frameX * spr.width;
-	int pixelY = frameY * spr.height;
-	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
-
-	Vector2f origin = { spr.originX, spr.originY };
-	m_blitter.TransformPixels( spr.preMultAlpha, frameOffset, spr.width, spr.height, origin, trans, alphaMultiply );
-}
+	static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
 
+	std::vector<uint8_t>& out = *s.pOut;
+	for( ;; )
+	{
+		if( s.pFlush && out.size() >= s.flushSize && !InflateFlush( s ) )
+			return false;
 
-void PlayGraphics::DrawBackground( int backgroundId )
-{
-	PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
-	PLAY_ASSERT_MSG( vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
-	m_blitter.BlitBackground( vBackgroundData[backgroundId] );
-}
+		int symbol = InflateDecode( s, lengthCode );
+		if( s.error )
+			return false;
 
-void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
-{
-	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to colour invalid sprite id" );
+		if( symbol < 256 )
+		{
+			out.push_back( static_cast<uint8_t>( symbol ) );
+		}
+		else if( symbol == 256 )
+		{
+			return true;
+		}
+		else
+		{
+			// A length and distance pair copying earlier output
+			symbol -= 257;
+			if( symbol >= 29 )
+				return false;
+			int length = lengthBase[symbol] + InflateBits( s, lengthExtra[symbol] );
 
-	Sprite& s = vSpriteData[spriteId];
-	uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
+			symbol = InflateDecode( s, distanceCode );
+			if( symbol < 0 || symbol >= 30 )
+				return false;
+			size_t distance = distanceBase[symbol] + InflateBits( s, distanceExtra[symbol] );
+			if( s.error || distance > out.size() )
+				return false;
 
-	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
-	s.canvasBuffer.preMultiplied = true;
+			// The copy can overlap the bytes it is writing, so it goes a byte at a time
+			size_t to = out.size();
+			out.resize( to + length );
+			uint8_t* pTo = out.data() + to;
+			const uint8_t* pFrom = pTo - distance;
+			for( int i = 0; i < length; i++ )
+				pTo[i] = pFrom[i];
+		}
+	}
 }
 
-int PlayGraphics::DrawString( int fontId, Point2f pos, std::string text ) const
+// Decompresses a zlib stream (RFC 1950) into the output
+// > If the state has a flush function, it is called as the output grows and once more at the end
+static bool InflateZlib( InflateState& s )
 {
-	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+	if( s.inSize < 2 || ( s.pIn[0] & 0x0F ) != 8 )
+		return false;
 
-	int width = 0;
+	s.inPos = 2; // Skip the zlib header (the Adler-32 checksum at the end is also ignored)
+	std::vector<uint8_t>& out = *s.pOut;
 
-	for( char c : text )
+	int last = 0;
+	do
 	{
-		Draw( fontId, { pos.x + width, pos.y }, c - 32 );
-		width += GetFontCharWidth( fontId, c );
-	}
-	return width;
-}
+		last = InflateBits( s, 1 );
+		int type = InflateBits( s, 2 );
+		if( s.error )
+			return false;
 
-int PlayGraphics::DrawStringCentred( int fontId, Point2f pos, std::string text ) const
-{
-	int totalWidth = 0;
+		if( type == 0 )
+		{
+			// Stored block: discard the remaining bits in the current byte (giving back any whole bytes read ahead) and copy the data
+			s.inPos -= s.bitCount / 8;
+			s.bitBuffer = 0;
+			s.bitCount = 0;
+			if( s.inPos + 4 > s.inSize )
+				return false;
+			size_t length = s.pIn[s.inPos] | ( s.pIn[s.inPos + 1] << 8 );
+			s.inPos += 4;
+			if( s.inPos + length > s.inSize )
+				return false;
+			out.insert( out.end(), s.pIn + s.inPos, s.pIn + s.inPos + length );
+			s.inPos += length;
+			if( s.pFlush && out.size() >= s.flushSize && !InflateFlush( s ) )
+				return false;
+		}
+		else if( type == 1 )
+		{
+			// Fixed Huffman codes, built the first time they are needed
+			struct FixedCodes
+			{
+				FixedCodes()
+				{
+					short lengths[288];
+					for( int i = 0; i < 144; i++ ) lengths[i] = 8;
+					for( int i = 144; i < 256; i++ ) lengths[i] = 9;
+					for( int i = 256; i < 280; i++ ) lengths[i] = 7;
+					for( int i = 280; i < 288; i++ ) lengths[i] = 8;
+					InflateBuild( lengthCode, lengths, 288 );
+					for( int i = 0; i < 30; i++ ) lengths[i] = 5;
+					InflateBuild( distanceCode, lengths, 30 );
+				}
+				InflateHuffman lengthCode, distanceCode;
+			};
+			static const FixedCodes fixed;
+			if( !InflateCodes( s, fixed.lengthCode, fixed.distanceCode ) )
+				return false;
+		}
+		else if( type == 2 )
+		{
+			// Dynamic Huffman codes, which are themselves Huffman coded
+			static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			int nLengths = InflateBits( s, 5 ) + 257;
+			int nDistances = InflateBits( s, 5 ) + 1;
+			int nCodes = InflateBits( s, 4 ) + 4;
+			if( nLengths > 286 || nDistances > 30 )
+				return false;
 
-	for( char c : text )
-		totalWidth += GetFontCharWidth( fontId, c );
+			short lengths[320] = { 0 };
+			for( int i = 0; i < nCodes; i++ )
+				lengths[order[i]] = static_cast<short>( InflateBits( s, 3 ) );
 
-	pos.x -= totalWidth / 2;
+			InflateHuffman lengthCode, distanceCode;
+			InflateBuild( lengthCode, lengths, 19 );
 
-	DrawString( fontId, pos, text );
-	return totalWidth;
-}
+			int index = 0;
+			while( index < nLengths + nDistances )
+			{
+				int symbol = InflateDecode( s, lengthCode );
+				if( s.error )
+					return false;
 
-int PlayGraphics::DrawChar( int fontId, Point2f pos, char c ) const
-{
-	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-	Draw( fontId, { pos.x, pos.y }, c - 32 );
-	return GetFontCharWidth( fontId, c );
-}
+				if( symbol < 16 )
+				{
+					lengths[index++] = static_cast<short>( symbol );
+					continue;
+				}
 
-int PlayGraphics::DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c ) const
-{
-	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-	DrawRotated( fontId, { pos.x, pos.y }, c - 32, angle, scale );
-	return GetFontCharWidth( fontId, c );
+				short repeatLength = 0;
+				int repeat = 0;
+				if( symbol == 16 )
+				{
+					if( index == 0 )
+						return false;
+					repeatLength = lengths[index - 1];
+					repeat = 3 + InflateBits( s, 2 );
+				}
+				else if( symbol == 17 )
+				{
+					repeat = 3 + InflateBits( s, 3 );
+				}
+				else
+				{
+					repeat = 11 + InflateBits( s, 7 );
+				}
+
+				if( index + repeat > nLengths + nDistances )
+					return false;
+				while( repeat-- )
+					lengths[index++] = repeatLength;
+			}
+
+			if( lengths[256] == 0 )
+				return false;
+
+			InflateBuild( lengthCode, lengths, nLengths );
+			InflateBuild( distanceCode, lengths + nLengths, nDistances );
+			if( !InflateCodes( s, lengthCode, distanceCode ) )
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	} while( !last );
+
+	return !s.pFlush || InflateFlush( s );
+}
+
+// Reads a big-endian 32-bit value as used throughout PNG files
+static uint32_t ReadPNGUint32( const uint8_t* p )
+{
+	return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( static_cast<uint32_t>( p[1] ) << 16 ) | ( static_cast<uint32_t>( p[2] ) << 8 ) | p[3];
+}
+
+// Unfilters and converts the rows of a PNG image as they are inflated
+struct PNGRowDecoder
+{
+	int width{ 0 };
+	int height{ 0 };
+	int bitDepth{ 0 };
+	int colourType{ 0 };
+	size_t filterStep{ 0 };
+	size_t rowBytes{ 0 };
+	Pixel palette[256];
+	int transparentKey[3]{ -1, -1, -1 };
+
+	// The position in the inflated output of the next row, and the number of rows done
+	size_t nextRow{ 0 };
+	int rowsDone{ 0 };
+	// The previous row after unfiltering, which the Up, Average and Paeth filters refer to
+	std::vector<uint8_t> previous;
+	std::vector<uint8_t> current;
+	PixelData* pDestImage{ nullptr };
+	const PlayWindow::PNGRowFunction* pRowFunction{ nullptr };
+
+	// Unfilters and converts every complete row in the output, returning how many bytes have been used
+	static size_t Flush( const std::vector<uint8_t>& out, void* pContext )
+	{
+		PNGRowDecoder& d = *static_cast<PNGRowDecoder*>( pContext );
+		if( d.rowsDone == d.height )
+			return out.size(); // Anything after the last row is ignored
+
+		while( d.rowsDone < d.height && out.size() - d.nextRow >= d.rowBytes + 1 )
+		{
+			d.DecodeRow( &out[d.nextRow] );
+			d.nextRow += d.rowBytes + 1;
+		}
+
+		// The output is about to have the used bytes removed from the front, so start counting from the new front
+		size_t used = d.nextRow;
+		d.nextRow = used > INFLATE_WINDOW_SIZE ? INFLATE_WINDOW_SIZE : used;
+		return used;
+	}
+
+	void DecodeRow( const uint8_t* pFiltered )
+	{
+		Unfilter( pFiltered );
+
+		Pixel* pDest = pDestImage->pPixels + static_cast<size_t>( rowsDone ) * width;
+		ConvertRow( current.data(), pDest, width );
+		if( pRowFunction && *pRowFunction )
+			( *pRowFunction )( rowsDone, pDest );
+
+		current.swap( previous );
+		rowsDone++;
+	}
+
+	// Decodes an interlaced image once it has all been inflated, where each of the seven Adam7 passes is a smaller image of its own
+	// > The rows are only passed to the row function once the last pass has filled them in
+	bool DecodeInterlaced( const std::vector<uint8_t>& out, size_t bitsPerPixel )
+	{
+		static const int startX[7] = { 0, 4, 0, 2, 0, 1, 0 };
+		static const int startY[7] = { 0, 0, 4, 0, 2, 0, 1 };
+		static const int stepX[7] = { 8, 8, 4, 4, 2, 2, 1 };
+		static const int stepY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+
+		std::vector<Pixel> passRow( width );
+		size_t pos = 0;
+		for( int pass = 0; pass < 7; pass++ )
+		{
+			// A pass with no pixels has no rows at all, not even filter bytes
+			int passWidth = ( width - startX[pass] + stepX[pass] - 1 ) / stepX[pass];
+			int passHeight = ( height - startY[pass] + stepY[pass] - 1 ) / stepY[pass];
+			if( passWidth <= 0 || passHeight <= 0 )
+				continue;
+
+			rowBytes = ( bitsPerPixel * passWidth + 7 ) / 8;
+			previous.assign( rowBytes, 0 );
+			current.resize( rowBytes );
+			for( int y = 0; y < passHeight; y++ )
+			{
+				if( out.size() - pos < rowBytes + 1 )
+					return false;
+				Unfilter( &out[pos] );
+				pos += rowBytes + 1;
+
+				ConvertRow( current.data(), passRow.data(), passWidth );
+				Pixel* pDest = pDestImage->pPixels + static_cast<size_t>( startY[pass] + y * stepY[pass] ) * width + startX[pass];
+				for( int x = 0; x < passWidth; x++ )
+					pDest[x * stepX[pass]] = passRow[x];
+				current.swap( previous );
+			}
+		}
+
+		if( pRowFunction && *pRowFunction )
+		{
+			for( int y = 0; y < height; y++ )
+				( *pRowFunction )( y, pDestImage->pPixels + static_cast<size_t>( y ) * width );
+		}
+		rowsDone = height;
+		return true;
+	}
+
+	// Undoes the filtering of a row of rowBytes into current, using previous as the row above
+	void Unfilter( const uint8_t* pFiltered )
+	{
+		uint8_t filter = pFiltered[0];
+		const uint8_t* pIn = pFiltered + 1;
+		uint8_t* pCur = current.data();
+		const uint8_t* pPrev = previous.data(); // All zeros for the first row
+
+		size_t i = 0;
+		switch( filter )
+		{
+			case 0:
+				memcpy( pCur, pIn, rowBytes );
+				break;
+			case 1:
+				for( ; i < filterStep; i++ ) pCur[i] = pIn[i];
+				for( ; i < rowBytes; i++ ) pCur[i] = static_cast<uint8_t>( pIn[i] + pCur[i - filterStep] );
+				break;
+			case 2:
+				for( ; i < rowBytes; i++ ) pCur[i] = static_cast<uint8_t>( pIn[i] + pPrev[i] );
+				break;
+			case 3:
+				for( ; i < filterStep; i++ ) pCur[i] = static_cast<uint8_t>( pIn[i] + ( pPrev[i] >> 1 ) );
+				for( ; i < rowBytes; i++ ) pCur[i] = static_cast<uint8_t>( pIn[i] + ( ( pCur[i - filterStep] + pPrev[i] ) >> 1 ) );
+				break;
+			case 4:
+				for( ; i < filterStep; i++ ) pCur[i] = static_cast<uint8_t>( pIn[i] + pPrev[i] );
+				for( ; i < rowBytes; i++ )
+				{
+					int a = pCur[i - filterStep], b = pPrev[i], c = pPrev[i - filterStep];
+					int p = a + b - c;
+					int pa = std::abs( p - a ), pb = std::abs( p - b ), pc = std::abs( p - c );
+					int predictor = ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ? b : c );
+					pCur[i] = static_cast<uint8_t>( pIn[i] + predictor );
+				}
+				break;
+			default:
+				memset( pCur, 0, rowBytes );
+				break;
+		}
+	}
+
+	// Converts count pixels of an unfiltered row to 32-bit ARGB
+	void ConvertRow( const uint8_t* pRow, Pixel* pDest, int count ) const
+	{
+		// The common formats are converted directly
+		if( bitDepth == 8 && colourType == 6 )
+		{
+			for( int x = 0; x < count; x++, pRow += 4 )
+				pDest[x].bits = Pixel::Pack( pRow[3], pRow[0], pRow[1], pRow[2] );
+			return;
+		}
+		if( bitDepth == 8 && colourType == 2 && transparentKey[0] < 0 )
+		{
+			for( int x = 0; x < count; x++, pRow += 3 )
+				pDest[x].bits = Pixel::Pack( 0xFF, pRow[0], pRow[1], pRow[2] );
+			return;
+		}
+
+		int maxSample = ( 1 << bitDepth ) - 1;
+
+		// Returns a sample at its full bit depth
+		auto sample = [&]( int index ) -> int
+		{
+			if( bitDepth == 8 ) return pRow[index];
+			if( bitDepth == 16 ) return ( pRow[index * 2] << 8 ) | pRow[index * 2 + 1];
+			int bit = index * bitDepth;
+			return ( pRow[bit >> 3] >> ( 8 - bitDepth - ( bit & 7 ) ) ) & maxSample;
+		};
+		// Scales a sample to 8 bits
+		auto to8 = [&]( int value ) -> int
+		{
+			return bitDepth == 16 ? value >> 8 : ( bitDepth == 8 ? value : value * 255 / maxSample );
+		};
+
+		for( int x = 0; x < count; x++ )
+		{
+			switch( colourType )
+			{
+				case 0:
+				{
+					int grey = sample( x );
+					int alpha = grey == transparentKey[0] ? 0 : 0xFF;
+					*pDest++ = Pixel( alpha, to8( grey ), to8( grey ), to8( grey ) );
+					break;
+				}
+				case 2:
+				{
+					int r = sample( x * 3 ), g = sample( x * 3 + 1 ), b = sample( x * 3 + 2 );
+					int alpha = ( r == transparentKey[0] && g == transparentKey[1] && b == transparentKey[2] ) ? 0 : 0xFF;
+					*pDest++ = Pixel( alpha, to8( r ), to8( g ), to8( b ) );
+					break;
+				}
+				case 3:
+					*pDest++ = palette[sample( x ) & 0xFF];
+					break;
+				case 4:
+				{
+					int grey = to8( sample( x * 2 ) );
+					*pDest++ = Pixel( to8( sample( x * 2 + 1 ) ), grey, grey, grey );
+					break;
+				}
+				case 6:
+					*pDest++ = Pixel( to8( sample( x * 4 + 3 ) ), to8( sample( x * 4 ) ), to8( sample( x * 4 + 1 ) ), to8( sample( x * 4 + 2 ) ) );
+					break;
+			}
+		}
+	}
+};
+
+// Whether the bit depth is one the PNG specification allows for the colour type
+static bool IsValidPNGFormat( int colourType, int bitDepth )
+{
+	switch( colourType )
+	{
+		case 0: return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16; // Greyscale
+		case 3: return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8; // Palette
+		case 2: case 4: case 6: return bitDepth == 8 || bitDepth == 16; // RGB, greyscale + alpha, RGBA
+		default: return false;
+	}
+}
+
+// Decodes a PNG file held in memory into 32-bit ARGB pixels (not premultiplied), or just reads its size if there is no destination
+// > Supports every colour type and bit depth (16-bit channels are reduced to 8-bit), and Adam7 interlacing
+// > Returns 1 on success or PLAY_ERROR
+static int DecodePNG( const uint8_t* pFile, size_t size, int& width, int& height, PixelData* pDestImage, const PlayWindow::PNGRowFunction* pRowFunction )
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	if( size < 33 || memcmp( pFile, signature, 8 ) != 0 )
+		return PLAY_ERROR;
+
+	PNGRowDecoder decoder;
+	for( Pixel& p : decoder.palette ) p.bits = 0xFF000000;
+	int interlace = 0;
+	std::vector<uint8_t> compressed;
+	const uint8_t* pCompressed = nullptr;
+	size_t compressedSize = 0;
+
+	// Read the chunks we need
+	size_t pos = 8;
+	while( pos + 12 <= size )
+	{
+		uint32_t length = ReadPNGUint32( &pFile[pos] );
+		const uint8_t* pType = &pFile[pos + 4];
+		const uint8_t* pChunk = &pFile[pos + 8];
+		if( pos + 12 + length > size )
+			return PLAY_ERROR;
+
+		if( memcmp( pType, "IHDR", 4 ) == 0 )
+		{
+			if( length < 13 || !IsValidPNGFormat( pChunk[9], pChunk[8] ) || pChunk[12] > 1 )
+				return PLAY_ERROR;
+			width = static_cast<int>( ReadPNGUint32( pChunk ) );
+			height = static_cast<int>( ReadPNGUint32( pChunk + 4 ) );
+			decoder.bitDepth = pChunk[8];
+			decoder.colourType = pChunk[9];
+			interlace = pChunk[12];
+			if( !pDestImage )
+				return 1;
+		}
+		else if( memcmp( pType, "PLTE", 4 ) == 0 )
+		{
+			for( uint32_t i = 0; i < length / 3 && i < 256; i++ )
+				decoder.palette[i] = Pixel( pChunk[i * 3], pChunk[i * 3 + 1], pChunk[i * 3 + 2] );
+		}
+		else if( memcmp( pType, "tRNS", 4 ) == 0 )
+		{
+			if( decoder.colourType == 3 )
+			{
+				for( uint32_t i = 0; i < length && i < 256; i++ )
+					decoder.palette[i].a = pChunk[i];
+			}
+			else
+			{
+				for( uint32_t i = 0; i < length / 2 && i < 3; i++ )
+					decoder.transparentKey[i] = ( pChunk[i * 2] << 8 ) | pChunk[i * 2 + 1];
+			}
+		}
+		else if( memcmp( pType, "IDAT", 4 ) == 0 )
+		{
+			// A single IDAT chunk (the usual case) is inflated where it is, otherwise they are joined together
+			if( !pCompressed )
+			{
+				pCompressed = pChunk;
+				compressedSize = length;
+			}
+			else
+			{
+				if( compressed.empty() )
+					compressed.assign( pCompressed, pCompressed + compressedSize );
+				compressed.insert( compressed.end(), pChunk, pChunk + length );
+				pCompressed = compressed.data();
+				compressedSize = compressed.size();
+			}
+		}
+		else if( memcmp( pType, "IEND", 4 ) == 0 )
+		{
+			break;
+		}
+
+		pos += 12 + length;
+	}
+
+	// Also rejects files without an IHDR chunk, which leave the bit depth at zero
+	if( width <= 0 || height <= 0 || !pCompressed || !IsValidPNGFormat( decoder.colourType, decoder.bitDepth ) )
+		return PLAY_ERROR;
+
+	const int channelsForType[7] = { 1, 0, 3, 1, 2, 0, 4 };
+	int channels = decoder.colourType <= 6 ? channelsForType[decoder.colourType] : 0;
+	if( channels == 0 )
+		return PLAY_ERROR;
+
+	// Filtering works on whole bytes per pixel (at least one), rows are packed to the nearest byte
+	size_t bitsPerPixel = static_cast<size_t>( channels ) * decoder.bitDepth;
+	decoder.width = width;
+	decoder.height = height;
+	decoder.filterStep = std::max<size_t>( 1, bitsPerPixel / 8 );
+	decoder.rowBytes = ( bitsPerPixel * width + 7 ) / 8;
+	decoder.previous.assign( decoder.rowBytes, 0 );
+	decoder.current.resize( decoder.rowBytes );
+	decoder.pRowFunction = pRowFunction;
+
+	pDestImage->width = width;
+	pDestImage->height = height;
+	pDestImage->pPixels = new Pixel[static_cast<size_t>( width ) * height];
+	decoder.pDestImage = pDestImage;
+
+	// Rows are decoded whenever another 64K or so has been inflated
+	std::vector<uint8_t> out;
+	size_t flushSize = INFLATE_WINDOW_SIZE + std::max<size_t>( 65536, decoder.rowBytes + 1 );
+	out.reserve( flushSize + 65536 );
+
+	InflateState s;
+	s.pIn = pCompressed;
+	s.inSize = compressedSize;
+	s.pOut = &out;
+	s.pFlush = &PNGRowDecoder::Flush;
+	s.pFlushContext = &decoder;
+	s.flushSize = flushSize;
+
+	// The passes of an interlaced image each cover the whole image, so it is inflated in one go and then decoded
+	if( interlace )
+		s.pFlush = nullptr;
+
+	bool decoded = InflateZlib( s ) && ( !interlace || decoder.DecodeInterlaced( out, bitsPerPixel ) );
+	if( !decoded || decoder.rowsDone < height )
+	{
+		delete[] pDestImage->pPixels;
+		pDestImage->pPixels = nullptr;
+		return PLAY_ERROR;
+	}
+
+	return 1;
+}
+
+// Reads a whole file into memory
+static bool ReadFileBytes( const std::string& fileAndPath, std::vector<uint8_t>& bytes )
+{
+	std::ifstream file( fileAndPath, std::ios::binary | std::ios::ate );
+	if( !file )
+		return false;
+
+	bytes.resize( static_cast<size_t>( file.tellg() ) );
+	file.seekg( 0 );
+	file.read( reinterpret_cast<char*>( bytes.data() ), bytes.size() );
+	return static_cast<bool>( file );
+}
+
+int PlayWindow::ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+{
+	// Only the start of the file is needed for the header
+	uint8_t bytes[33];
+	std::ifstream file( fileAndPath, std::ios::binary );
+	if( !file.read( reinterpret_cast<char*>( bytes ), sizeof( bytes ) ) )
+		return PLAY_ERROR;
+
+	return DecodePNG( bytes, sizeof( bytes ), width, height, nullptr, nullptr );
+}
+
+int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage, const PNGRowFunction& rowFunction )
+{
+	std::vector<uint8_t> bytes;
+	int result = ReadFileBytes( fileAndPath, bytes ) ? DecodePNGImage( bytes, destImage, rowFunction ) : PLAY_ERROR;
+	PLAY_ASSERT_MSG( result > 0, std::string( "Unable to load PNG file: " + fileAndPath ).c_str() );
+	return result;
+}
+
+int PlayWindow::DecodePNGImage( const std::vector<uint8_t>& bytes, PixelData& destImage, const PNGRowFunction& rowFunction )
+{
+	int width = 0, height = 0;
+	return DecodePNG( bytes.data(), bytes.size(), width, height, &destImage, &rowFunction );
+}
+
+//********************************************************************************************************************************
+// File:		PlayFileBatch.cpp
+// Description:	Reads batches of whole files into memory for loading assets
+// Platform:	Independent, using io_uring on Linux
+// Notes:		Submitting every read at once lets the kernel and the drive overlap them, which matters most on cold caches and
+//				network drives. A small ring is driven directly through the system calls, so liburing isn't needed.
+//********************************************************************************************************************************
+
+#ifdef PLAY_IO_URING
+
+// The maximum number of reads in flight at once
+constexpr unsigned int FILE_BATCH_QUEUE_DEPTH = 64;
+
+// A minimal io_uring: just enough to submit reads and collect their results
+class FileBatchRing
+{
+public:
+	FileBatchRing() = default;
+	~FileBatchRing() { Close(); }
+	// The assignment operator is removed to prevent copying
+	FileBatchRing& operator=( const FileBatchRing& ) = delete;
+	// The copy constructor is removed to prevent copying
+	FileBatchRing( const FileBatchRing& ) = delete;
+
+	// Creates the ring
+	// > Returns false if io_uring isn't available, e.g. on an older kernel or when blocked by a sandbox
+	bool Open( unsigned int entries )
+	{
+		io_uring_params params;
+		memset( &params, 0, sizeof( params ) );
+		m_fd = static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) );
+		if( m_fd < 0 )
+			return false;
+
+		// Older kernels map the submission and completion rings separately
+		m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+		m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+		bool singleMap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+		if( singleMap )
+			m_sqRingSize = m_cqRingSize = std::max( m_sqRingSize, m_cqRingSize );
+
+		m_pSQRing = Map( m_sqRingSize, IORING_OFF_SQ_RING );
+		m_pCQRing = singleMap ? m_pSQRing : Map( m_cqRingSize, IORING_OFF_CQ_RING );
+		m_sqeSize = params.sq_entries * sizeof( io_uring_sqe );
+		m_pSQEs = reinterpret_cast<io_uring_sqe*>( Map( m_sqeSize, IORING_OFF_SQES ) );
+		if( !m_pSQRing || !m_pCQRing || !m_pSQEs )
+		{
+			Close();
+			return false;
+		}
+
+		m_pSQTail = reinterpret_cast<unsigned*>( m_pSQRing + params.sq_off.tail );
+		m_sqMask = *reinterpret_cast<unsigned*>( m_pSQRing + params.sq_off.ring_mask );
+		m_pSQArray = reinterpret_cast<unsigned*>( m_pSQRing + params.sq_off.array );
+		m_pCQHead = reinterpret_cast<unsigned*>( m_pCQRing + params.cq_off.head );
+		m_pCQTail = reinterpret_cast<unsigned*>( m_pCQRing + params.cq_off.tail );
+		m_cqMask = *reinterpret_cast<unsigned*>( m_pCQRing + params.cq_off.ring_mask );
+		m_pCQEs = reinterpret_cast<io_uring_cqe*>( m_pCQRing + params.cq_off.cqes );
+		return true;
+	}
+
+	// Unmaps the rings and closes the ring file
+	void Close()
+	{
+		if( m_pSQEs )
+			munmap( reinterpret_cast<void*>( m_pSQEs ), m_sqeSize );
+		if( m_pCQRing && m_pCQRing != m_pSQRing )
+			munmap( m_pCQRing, m_cqRingSize );
+		if( m_pSQRing )
+			munmap( m_pSQRing, m_sqRingSize );
+		if( m_fd >= 0 )
+			close( m_fd );
+
+		m_pSQEs = nullptr;
+		m_pSQRing = m_pCQRing = nullptr;
+		m_fd = -1;
+	}
+
+	// Queues a read into pVec's buffer, which is sent to the kernel by the next Submit
+	// > userData is handed back with the result
+	void QueueRead( int fd, iovec* pVec, uint64_t offset, uint64_t userData )
+	{
+		unsigned tail = *m_pSQTail; // Only this thread writes the tail
+		unsigned index = tail & m_sqMask;
+		io_uring_sqe& sqe = m_pSQEs[index];
+		memset( &sqe, 0, sizeof( sqe ) );
+		sqe.opcode = IORING_OP_READV;
+		sqe.fd = fd;
+		sqe.addr = reinterpret_cast<uint64_t>( pVec );
+		sqe.len = 1;
+		sqe.off = offset;
+		sqe.user_data = userData;
+		m_pSQArray[index] = index;
+
+		// The entry must be complete before the kernel can see the new tail
+		__atomic_store_n( m_pSQTail, tail + 1, __ATOMIC_RELEASE );
+		m_queued++;
+	}
+
+	// Sends the queued reads to the kernel, then waits until at least minComplete results have arrived
+	// > Returns false if the kernel refuses
+	bool Submit( unsigned int minComplete )
+	{
+		for( ;; )
+		{
+			int submitted = static_cast<int>( syscall( __NR_io_uring_enter, m_fd, m_queued, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0 ) );
+			if( submitted >= 0 )
+			{
+				m_queued -= static_cast<unsigned int>( submitted );
+				return true;
+			}
+			if( errno != EINTR && errno != EAGAIN && errno != EBUSY )
+				return false;
+		}
+	}
+
+	// Calls function( userData, result ) for every read which has finished, where result is the bytes read or -errno
+	template< typename F > void ForEachResult( F function )
+	{
+		unsigned head = *m_pCQHead; // Only this thread writes the head
+		while( head != __atomic_load_n( m_pCQTail, __ATOMIC_ACQUIRE ) )
+		{
+			const io_uring_cqe& cqe = m_pCQEs[head & m_cqMask];
+			function( cqe.user_data, cqe.res );
+			head++;
+		}
+
+		// Hands the entries back to the kernel
+		__atomic_store_n( m_pCQHead, head, __ATOMIC_RELEASE );
+	}
+
+private:
+	uint8_t* Map( size_t size, off_t offset )
+	{
+		void* p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset );
+		return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>( p );
+	}
+
+	int m_fd{ -1 };
+	uint8_t* m_pSQRing{ nullptr };
+	uint8_t* m_pCQRing{ nullptr };
+	io_uring_sqe* m_pSQEs{ nullptr };
+	size_t m_sqRingSize{ 0 }, m_cqRingSize{ 0 }, m_sqeSize{ 0 };
+	unsigned* m_pSQTail{ nullptr };
+	unsigned* m_pSQArray{ nullptr };
+	unsigned m_sqMask{ 0 };
+	unsigned* m_pCQHead{ nullptr };
+	unsigned* m_pCQTail{ nullptr };
+	unsigned m_cqMask{ 0 };
+	io_uring_cqe* m_pCQEs{ nullptr };
+	unsigned int m_queued{ 0 };
+};
+
+// Reads the files through io_uring on this thread, handing each one to a pool of worker threads as soon as it has arrived
+// > Returns false, without calling the function, if io_uring isn't available
+static bool ReadFileBatchRing( const std::vector<std::string>& vFiles, const FileBatchFunction& function )
+{
+	FileBatchRing ring;
+	if( !ring.Open( FILE_BATCH_QUEUE_DEPTH ) )
+		return false;
+
+	struct FileRead
+	{
+		int fd{ -1 };
+		std::vector<uint8_t> bytes;
+		size_t done{ 0 };
+		iovec vec{};
+		bool arrived{ false };
+	};
+	std::vector<FileRead> vReads( vFiles.size() );
+
+	// The workers process the files which have arrived while this thread waits for the rest
+	std::mutex mutex;
+	std::condition_variable arrived;
+	std::deque<int> queue;
+	bool allArrived = false;
+	unsigned int cores = std::max( 1u, std::thread::hardware_concurrency() ); // Zero if it can't be worked out
+	int threadCount = static_cast<int>( std::max( 1u, cores - 1 ) );
+	std::vector<std::thread> vThreads;
+	for( int t = 0; t < std::min( threadCount, static_cast<int>( vFiles.size() ) ); t++ )
+	{
+		vThreads.emplace_back( [&]()
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			for( ;; )
+			{
+				arrived.wait( lock, [&]() { return allArrived || !queue.empty(); } );
+				if( queue.empty() )
+					return;
+
+				int index = queue.front();
+				queue.pop_front();
+				lock.unlock();
+				function( index, vReads[index].bytes );
+				lock.lock();
+			}
+		} );
+	}
+
+	auto Arrived = [&]( int index )
+	{
+		if( vReads[index].fd >= 0 )
+			close( vReads[index].fd );
+		vReads[index].arrived = true;
+		std::lock_guard<std::mutex> lock( mutex );
+		queue.push_back( index );
+		arrived.notify_one();
+	};
+
+	// Reads are limited to 1GB at a time, so large files may take several
+	auto QueueRead = [&]( int index )
+	{
+		FileRead& read = vReads[index];
+		read.vec.iov_base = read.bytes.data() + read.done;
+		read.vec.iov_len = std::min( read.bytes.size() - read.done, static_cast<size_t>( 1 ) << 30 );
+		ring.QueueRead( read.fd, &read.vec, read.done, static_cast<uint64_t>( index ) );
+	};
+
+	size_t nextFile = 0;
+	unsigned int inFlight = 0;
+	bool ok = true;
+	while( ok && ( nextFile < vFiles.size() || inFlight > 0 ) )
+	{
+		// Keep the ring full, opening the files as they're needed so they don't all have to be open at once
+		while( nextFile < vFiles.size() && inFlight < FILE_BATCH_QUEUE_DEPTH )
+		{
+			int index = static_cast<int>( nextFile++ );
+			FileRead& read = vReads[index];
+			struct stat status;
+			read.fd = open( vFiles[index].c_str(), O_RDONLY | O_CLOEXEC );
+			if( read.fd < 0 || fstat( read.fd, &status ) != 0 || status.st_size == 0 )
+			{
+				Arrived( index );
+				continue;
+			}
+
+			read.bytes.resize( static_cast<size_t>( status.st_size ) );
+			QueueRead( index );
+			inFlight++;
+		}
+
+		ok = ring.Submit( inFlight > 0 ? 1 : 0 );
+
+		ring.ForEachResult( [&]( uint64_t userData, int result )
+		{
+			int index = static_cast<int>( userData );
+			FileRead& read = vReads[index];
+			if( result == -EINTR || result == -EAGAIN )
+			{
+				QueueRead( index );
+				return;
+			}
+
+			if( result > 0 )
+				read.done += static_cast<size_t>( result );
+			if( result > 0 && read.done < read.bytes.size() )
+			{
+				QueueRead( index );
+				return;
+			}
+
+			// Finished, failed or the file was shortened while it was being read
+			read.bytes.resize( result < 0 ? 0 : read.done );
+			inFlight--;
+			Arrived( index );
+		} );
+	}
+
+	// If the kernel stops accepting reads part way through, the files which haven't arrived are read normally instead
+	if( !ok )
+	{
+		DebugOutput( "ReadFileBatch: io_uring refused reads, reading the remaining files without it\n" );
+		ring.Close();
+		for( size_t index = 0; index < vFiles.size(); index++ )
+		{
+			FileRead& read = vReads[index];
+			if( read.arrived )
+				continue;
+
+			// A read the kernel had already accepted may still write into its buffer, so that buffer is deliberately never freed
+			std::vector<uint8_t>* pAbandoned = new std::vector<uint8_t>();
+			pAbandoned->swap( read.bytes );
+			if( !ReadFileBytes( vFiles[index], read.bytes ) )
+				read.bytes.clear();
+			Arrived( static_cast<int>( index ) );
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		allArrived = true;
+	}
+	arrived.notify_all();
+	for( std::thread& thread : vThreads )
+		thread.join();
+
+	return true;
+}
+
+#endif // PLAY_IO_URING
+
+void ReadFileBatch( const std::vector<std::string>& vFiles, const FileBatchFunction& function )
+{
+#ifdef PLAY_IO_URING
+	if( ReadFileBatchRing( vFiles, function ) )
+		return;
+#endif // PLAY_IO_URING
+
+	ParallelFor( static_cast<int>( vFiles.size() ), [&]( int index )
+	{
+		std::vector<uint8_t> bytes;
+		if( !ReadFileBytes( vFiles[index], bytes ) )
+			bytes.clear();
+		function( index, bytes );
+	} );
+}
+
+//********************************************************************************************************************************
+// File:		PlayBlitter.cpp
+// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
+// Platform:	Independent
+//********************************************************************************************************************************
+
+
+PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
+{
+	m_pRenderTarget = pRenderTarget;
+}
+
+
+void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix ) const
+{
+	if( srcPix.a == 0x00 || posX < 0 || posX >= m_pRenderTarget->width || posY < 0 || posY >= m_pRenderTarget->height )
+		return;
+
+	Pixel* destPix = &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX];
+
+	if( srcPix.a == 0xFF ) // Completely opaque pixel - no need to blend
+	{
+		*destPix = srcPix.bits;
+	}
+	else
+	{
+		Pixel blendPix = *destPix;
+		float srcAlpha = srcPix.a / 255.0f;
+		float oneMinusSrcAlpha = 1.0f - srcAlpha;
+
+		blendPix.a = 0xFF;
+		blendPix.r = static_cast<uint8_t>( ( srcAlpha * srcPix.r ) + ( oneMinusSrcAlpha * blendPix.r ) );
+		blendPix.g = static_cast<uint8_t>( ( srcAlpha * srcPix.g ) + ( oneMinusSrcAlpha * blendPix.g ) );
+		blendPix.b = static_cast<uint8_t>( ( srcAlpha * srcPix.b ) + ( oneMinusSrcAlpha * blendPix.b ) );
+
+		*destPix = blendPix.bits;
+	}
+
+	return;
+}
+
+void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const
+{
+	//Implementation of Bresenham's Line Drawing Algorithm
+	int dx = abs( endX - startX );
+	int sx = 1;
+	if( endX < startX ) { sx = -1; }
+
+	int dy = -abs( endY - startY );
+	int sy = 1;
+	if( endY < startY ) { sy = -1; }
+
+	int err = dx + dy;
+
+	if( dx == 0 && dy == 0 ) return;
+
+	int x = startX;
+	int y = startY;
+
+	while( true )
+	{
+		DrawPixel( x, y, pix );
+
+		if( x == endX && y == endY )
+			break;
+
+		int e2 = 2 * err;
+		if( e2 >= dy )
+		{
+			err += dy;
+			x += sx;
+		}
+		if( e2 <= dx )
+		{
+			err += dx;
+			y += sy;
+		}
+	}
+}
+
+void PlayBlitter::DrawRowMask( int posX, int posY, uint32_t mask, Pixel pix ) const
+{
+	if( mask == 0 || pix.a == 0x00 || posY < 0 || posY >= m_pRenderTarget->height )
+		return;
+
+	Pixel* pRow = &m_pRenderTarget->pPixels[posY * m_pRenderTarget->width];
+	int x = posX;
+
+	while( mask )
+	{
+		// Skip to the start of the next run of set bits and measure its length
+		while( ( mask & 0x01 ) == 0 ) { mask >>= 1; x++; }
+		int runStart = x;
+		while( mask & 0x01 ) { mask >>= 1; x++; }
+
+		int start = runStart < 0 ? 0 : runStart;
+		int end = x > m_pRenderTarget->width ? m_pRenderTarget->width : x;
+
+		if( pix.a == 0xFF )
+		{
+			for( int px = start; px < end; px++ )
+				pRow[px] = pix.bits;
+		}
+		else
+		{
+			for( int px = start; px < end; px++ )
+				DrawPixel( px, posY, pix );
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	BlitPixels - draws image data with and without a global alpha multiply
+// Parameters:	srcPixelData = the pixel data you want to draw
+//				srcOffset = the horizontal pixel offset for the required animation frame within the PixelData
+//				blitX, blitY = the position you want to draw the sprite within the buffer
+//				blitWidth, blitHeight = the width and height of the animation frame
+//				alphaMultiply = additional transparancy applied to the whole sprite
+// Notes:		Alpha multiply approach is ~50% slower
+//********************************************************************************************************************************
+bool PlayBlitter::ClipBlit( int blitX, int blitY, int blitWidth, int blitHeight, BlitClip& clip ) const
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+
+	// Nothing within the display buffer to draw
+	if( blitX > m_pRenderTarget->width || blitX + blitWidth < 0 || blitY > m_pRenderTarget->height || blitY + blitHeight < 0 )
+		return false;
+
+	// Work out if we need to clip to the display buffer (and by how much)
+	int xClipStart = -blitX;
+	if( xClipStart < 0 ) { xClipStart = 0; }
+
+	int xClipEnd = ( blitX + blitWidth ) - m_pRenderTarget->width;
+	if( xClipEnd < 0 ) { xClipEnd = 0; }
+
+	int yClipStart = -blitY;
+	if( yClipStart < 0 ) { yClipStart = 0; }
+
+	int yClipEnd = ( blitY + blitHeight ) - m_pRenderTarget->height;
+	if( yClipEnd < 0 ) { yClipEnd = 0; }
+
+	clip.srcX = xClipStart;
+	clip.srcY = yClipStart;
+	clip.destX = blitX + xClipStart;
+	clip.destY = blitY + yClipStart;
+	clip.width = blitWidth - xClipEnd - xClipStart;
+	clip.height = blitHeight - yClipEnd - yClipStart;
+	return clip.width > 0 && clip.height > 0;
+}
+
+void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel colourMultiply ) const
+{
+	BlitClip clip;
+	if( !ClipBlit( blitX, blitY, blitWidth, blitHeight, clip ) )
+		return;
+
+	// Set up the source and destination pointers based on clipping
+	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + ( m_pRenderTarget->width * clip.destY ) + clip.destX;
+	const uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + ( srcPixelData.width * clip.srcY ) + clip.srcX;
+
+	// Coloured pixels are worked out a piece of a row at a time, in the same way as indexed ones
+	constexpr int TINT_WIDTH = 256;
+	uint32_t tinted[TINT_WIDTH];
+	bool tint = IsTint( colourMultiply );
+
+	for( int y = 0; y < clip.height; y++ )
+	{
+		if( !tint )
+		{
+			BlendRow( destPixels, srcPixels, clip.width, alphaMultiply );
+		}
+		else
+		{
+			for( int x = 0; x < clip.width; x += TINT_WIDTH )
+			{
+				int count = std::min( TINT_WIDTH, clip.width - x );
+				TintPixels( srcPixels + x, tinted, count, colourMultiply );
+				BlendRow( destPixels + x, tinted, count, alphaMultiply );
+			}
+		}
+		destPixels += m_pRenderTarget->width;
+		srcPixels += srcPixelData.width;
+	}
+}
+
+void PlayBlitter::TintPixels( const uint32_t* srcPixels, uint32_t* destPixels, int count, Pixel colourMultiply )
+{
+	for( int i = 0; i < count; i++ )
+		destPixels[i] = TintPixel( srcPixels[i], colourMultiply );
+}
+
+void PlayBlitter::BlitIndexedPixels( const IndexedPixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const
+{
+	BlitClip clip;
+	if( !ClipBlit( blitX, blitY, blitWidth, blitHeight, clip ) )
+		return;
+
+	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + ( m_pRenderTarget->width * clip.destY ) + clip.destX;
+	const uint8_t* srcIndices = srcImage.pIndices + srcOffset + ( srcImage.width * clip.srcY ) + clip.srcX;
+
+	// Each row is expanded a piece at a time into a buffer which stays in the cache, then blended like any other pixels
+	constexpr int EXPAND_WIDTH = 256;
+	uint32_t expanded[EXPAND_WIDTH];
+
+	for( int y = 0; y < clip.height; y++ )
+	{
+		for( int x = 0; x < clip.width; x += EXPAND_WIDTH )
+		{
+			int count = std::min( EXPAND_WIDTH, clip.width - x );
+			ExpandIndices( srcIndices + x, srcImage.pPalette, expanded, count );
+			BlendRow( destPixels + x, expanded, count, alphaMultiply );
+		}
+		destPixels += m_pRenderTarget->width;
+		srcIndices += srcImage.width;
+	}
+}
+
+void PlayBlitter::ExpandIndices( const uint8_t* srcIndices, const Pixel* pPalette, uint32_t* destPixels, int count )
+{
+	int i = 0;
+#ifdef PLAY_AVX2
+	const int* pTable = reinterpret_cast<const int*>( pPalette );
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m256i indices = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( srcIndices + i ) ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( destPixels + i ), _mm256_i32gather_epi32( pTable, indices, 4 ) );
+	}
+#endif
+	for( ; i < count; i++ )
+		destPixels[i] = pPalette[srcIndices[i]].bits;
+}
+
+void PlayBlitter::BlendRow( uint32_t* destPixels, const uint32_t* srcPixels, int count, float alphaMultiply )
+{
+	uint32_t* destRowEnd = destPixels + count;
+
+	if( alphaMultiply < 1.0f )
+	{
+		// *******************************************************************************************************************************************************
+		// A basic (unoptimized) approach which separates the channels and performs a 'typical' alpha blending operation: (src * srcAlpha)+(dest * (1-srcAlpha))
+		// Has the advantage that a global alpha multiplication can be easily added over the top, so we use this method when a global multiply is required
+		// *******************************************************************************************************************************************************
+
+		while( destPixels < destRowEnd )
+		{
+			uint32_t src = *srcPixels++;
+			uint32_t dest = *destPixels;
+
+			// If this isn't a fully transparent pixel 
+			if( src < 0xFF000000 )
+			{
+				int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
+				int constAlpha = static_cast<int>( 255 * alphaMultiply );
+
+				// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
+				int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
+				int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
+				int destBlue = constAlpha * ( src & 0xFF );
+
+				int invSrcAlpha = 0xFF - srcAlpha;
+
+				// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
+				destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
+				destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
+				destBlue += invSrcAlpha * ( dest & 0xFF );
+
+				// Bring back to the range 0-255
+				destRed >>= 8;
+				destGreen >>= 8;
+				destBlue >>= 8;
+
+				// Put ARGB components back together again
+				*destPixels++ = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+			}
+			else
+			{
+				// If this is a fully transparent pixel then the low bits store how many there are in a row
+				// This means we can skip to the next pixel which isn't fully transparent
+				uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
+				src = src & 0x00FFFFFF;
+				if( skip > src ) skip = src;
+
+				srcPixels += skip;
+				++destPixels += skip;
+			}
+		}
+	}
+	else
+	{
+		// *******************************************************************************************************************************************************
+		// An optimized approach which uses pre-multiplied alpha, parallel channel multiplication and pixel skipping to achieve the same 'typical' alpha 
+		// blending operation (src * srcAlpha)+(dest * (1-srcAlpha)). Not easy to apply a global alpha multiplication over the top, but used everywhere else.
+		// *******************************************************************************************************************************************************
+
+		while( destPixels < destRowEnd )
+		{
+			uint32_t src = *srcPixels++;
+			uint32_t dest = *destPixels;
+
+			// If this isn't a fully transparent pixel 
+			if( src < 0xFF000000 )
+			{
+				// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
+				// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
+				// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
+				// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
+				// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
+				// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
+				// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
+				dest = ( ( ( dest >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
+				// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
+				*destPixels++ = ( src + dest ) | 0xFF000000;
+			}
+			else
+			{
+				// If this is a fully transparent pixel then the low bits store how many there are in a row
+				// This means we can skip to the next pixel which isn't fully transparent
+				uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
+				src = src & 0x00FFFFFF;
+				if( skip > src ) skip = src;
+
+				srcPixels += skip;
+				++destPixels += skip;
+			}
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	TransformPixels - draws the image data transforming each screen pixel into image space
+// Parameters:	srcPixelData = the pixel data you want to draw
+//				srcFrameOffset = the horizontal pixel offset for the required animation frame within the PixelData
+//				srcDrawWidth, srcDrawHeight = the width and height of the source image frame
+//				srcOrigin = the centre of rotation for the source image
+//				alphaMultiply = additional transparancy applied to the whole sprite
+// Notes:		Much slower than BlitPixels, alphaMultiply is a negligable overhead compared to the rotation
+//				The matrix version just converts to the affine version and inverts it
+//********************************************************************************************************************************
+void PlayBlitter::TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Matrix2D& transform, float alphaMultiply ) const
+{
+	Affine2D affine( transform );
+	if( affine.Determinant() == 0.0f ) return;
+	TransformPixels( srcPixelData, srcFrameOffset, srcDrawWidth, srcDrawHeight, srcOrigin, affine, affine.Inverted(), alphaMultiply );
+}
+
+void PlayBlitter::TransformPixels( const PixelData& srcPixelData, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Affine2D& transform, const Affine2D& invTransform, float alphaMultiply, Pixel colourMultiply ) const
+{
+	const uint32_t* src_frame = (const uint32_t*)srcPixelData.pPixels + srcFrameOffset;
+	int src_width = srcPixelData.width;
+	if( IsTint( colourMultiply ) )
+		TransformSource( srcDrawWidth, srcDrawHeight, srcOrigin, transform, invTransform, alphaMultiply,
+			[src_frame, src_width, colourMultiply]( int x, int y ) { return TintPixel( src_frame[x + ( y * src_width )], colourMultiply ); } );
+	else
+		TransformSource( srcDrawWidth, srcDrawHeight, srcOrigin, transform, invTransform, alphaMultiply,
+			[src_frame, src_width]( int x, int y ) { return src_frame[x + ( y * src_width )]; } );
+}
+
+void PlayBlitter::TransformIndexedPixels( const IndexedPixelData& srcImage, int srcFrameOffset, int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Affine2D& transform, const Affine2D& invTransform, float alphaMultiply ) const
+{
+	const uint8_t* src_frame = srcImage.pIndices + srcFrameOffset;
+	const Pixel* src_palette = srcImage.pPalette;
+	int src_width = srcImage.width;
+	TransformSource( srcDrawWidth, srcDrawHeight, srcOrigin, transform, invTransform, alphaMultiply,
+		[src_frame, src_palette, src_width]( int x, int y ) { return src_palette[src_frame[x + ( y * src_width )]].bits; } );
+}
+
+template< typename SourceFetch >
+void PlayBlitter::TransformSource( int srcDrawWidth, int srcDrawHeight, const Point2f& srcOrigin, const Affine2D& transform, const Affine2D& invTransform, float alphaMultiply, SourceFetch fetch ) const
+{ 
+	static float inf = std::numeric_limits<float>::infinity();
+	float tgt_minx{ inf }, tgt_miny{ inf }, tgt_maxx{ -inf }, tgt_maxy{ -inf };
+
+	float x[2] = { -srcOrigin.x, srcDrawWidth - srcOrigin.x };
+	float y[2] = { -srcOrigin.y, srcDrawHeight - srcOrigin.y };
+	Point2f vertices[4] = { { x[0], y[0] }, { x[1], y[0] }, { x[1], y[1] }, { x[0], y[1] } };
+
+	//calculate the extremes of the rotated corners.
+	for( int i = 0; i < 4; i++ )
+	{
+		vertices[i] = transform.Transform( vertices[i] );
+		tgt_minx = tgt_minx < vertices[i].x ? tgt_minx : vertices[i].x;
+		tgt_maxx = tgt_maxx > vertices[i].x ? tgt_maxx : vertices[i].x;
+		tgt_miny = tgt_miny < vertices[i].y ? tgt_miny : vertices[i].y;
+		tgt_maxy = tgt_maxy > vertices[i].y ? tgt_maxy : vertices[i].y;
+	}
+
+	tgt_minx = floor( tgt_minx );
+	tgt_maxx = ceil( tgt_maxx );
+	tgt_miny = floor( tgt_miny );
+	tgt_maxy = ceil( tgt_maxy );
+
+	int tgt_draw_width = static_cast<int>(tgt_maxx - tgt_minx);
+	int tgt_draw_height = static_cast<int>(tgt_maxy - tgt_miny);
+	int tgt_buffer_width = m_pRenderTarget->width;
+	int tgt_buffer_height = m_pRenderTarget->height;
+
+	if( tgt_miny < 0 ) { tgt_draw_height += (int)tgt_miny; tgt_miny = 0; }
+	if( tgt_maxy > (float)tgt_buffer_height ) { tgt_draw_height -= (int)tgt_maxy - tgt_buffer_height; tgt_maxy = (float)tgt_buffer_height; }
+	if( tgt_minx < 0 ) { tgt_draw_width += (int)tgt_minx; tgt_minx = 0; }
+	if( tgt_maxx > (float)tgt_buffer_width ) { tgt_draw_width -= (int)tgt_maxx - tgt_buffer_width;  tgt_maxx = (float)tgt_buffer_width; }
+
+	// Nothing within the render target to draw
+	if( tgt_draw_width <= 0 || tgt_draw_height <= 0 )
+		return;
+
+	Point2f tgt_pixel_start{ tgt_minx, tgt_miny };
+	Point2f src_pixel_start = invTransform.Transform( tgt_pixel_start ) + srcOrigin;
+
+	// The constant alpha multiplier is the same for every pixel
+	int constAlpha = static_cast<int>( 255 * alphaMultiply );
+
+	auto BlendPixel = [&]( uint32_t* tgt_pixel, uint32_t src )
+	{
+		// If this isn't a fully transparent pixel 
+		if( src >= 0xFF000000 )
+			return;
+
+		int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
+
+		// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
+		int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
+		int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
+		int destBlue = constAlpha * ( src & 0xFF );
+
+		uint32_t dest = *tgt_pixel;
+		int invSrcAlpha = 0xFF - srcAlpha;
+
+		// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
+		destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
+		destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
+		destBlue += invSrcAlpha * ( dest & 0xFF );
+
+		// Bring back to the range 0-255
+		destRed >>= 8;
+		destGreen >>= 8;
+		destBlue >>= 8;
+
+		// Put ARGB components back together again
+		*tgt_pixel = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+	};
+
+	int tgt_posx = static_cast<int>( tgt_pixel_start.x );
+	int tgt_posy = static_cast<int>( tgt_pixel_start.y );
+
+	int tgt_start_pixel_index = tgt_posx + ( tgt_posy * tgt_buffer_width );
+	uint32_t* tgt_pixel = (uint32_t*)m_pRenderTarget->pPixels + tgt_start_pixel_index;
+	uint32_t* tgt_column_end = tgt_pixel + (tgt_draw_height * tgt_buffer_width );
+
+	// The source position at each corner of the drawn area. As it's an affine transform every position in between lies within them,
+	// > so if the corners and the steps are all well inside +/-32767 then 16.16 fixed point can't overflow anywhere in the loop
+	constexpr float FIXED_LIMIT = 8192.0f;
+	bool fitsFixed = std::abs( invTransform.m00 ) < FIXED_LIMIT && std::abs( invTransform.m01 ) < FIXED_LIMIT &&
+		std::abs( invTransform.m10 ) < FIXED_LIMIT && std::abs( invTransform.m11 ) < FIXED_LIMIT;
+	for( int corner = 0; corner < 4; corner++ )
+	{
+		float dx = static_cast<float>( ( corner & 1 ) ? tgt_draw_width : 0 );
+		float dy = static_cast<float>( ( corner & 2 ) ? tgt_draw_height : 0 );
+		float srcx = src_pixel_start.x + invTransform.m00 * dx + invTransform.m10 * dy;
+		float srcy = src_pixel_start.y + invTransform.m01 * dx + invTransform.m11 * dy;
+		fitsFixed = fitsFixed && std::abs( srcx ) < FIXED_LIMIT && std::abs( srcy ) < FIXED_LIMIT;
+	}
+
+	// Step through the source image in floating point when the transform is too large (or not finite) for fixed point
+	if( !fitsFixed )
+	{
+		float src_posx = src_pixel_start.x + 0.5f;
+		float src_posy = src_pixel_start.y + 0.5f;
+
+		for( int y = 0; tgt_pixel < tgt_column_end; y++ )
+		{
+			for( int x = 0; x < tgt_draw_width; x++ )
+			{
+				// Checked before the conversion to int, which would be undefined for positions far outside the source
+				float posx = floor( src_posx + invTransform.m00 * x + invTransform.m10 * y );
+				float posy = floor( src_posy + invTransform.m01 * x + invTransform.m11 * y );
+
+				if( posx >= 0.0f && posy >= 0.0f && posx < srcDrawWidth && posy < srcDrawHeight )
+					BlendPixel( tgt_pixel + x, fetch( static_cast<int>( posx ), static_cast<int>( posy ) ) );
+			}
+			tgt_pixel += tgt_buffer_width;
+		}
+		return;
+	}
+
+	// Step through the source image in 16.16 fixed point, with the half pixel for rounding added in advance
+	Affine2Dfx inv_fx = AffineToFixed( invTransform );
+	int32_t src_posx = ToFixed16( src_pixel_start.x ) + 0x8000;
+	int32_t src_posy = ToFixed16( src_pixel_start.y ) + 0x8000;
+
+	int32_t src_xincx = inv_fx.m00;
+	int32_t src_xincy = inv_fx.m01;
+	int32_t src_yincx = inv_fx.m10;
+	int32_t src_yincy = inv_fx.m11;
+	int32_t src_xresetx = src_xincx * tgt_draw_width;
+	int32_t src_xresety = src_xincy * tgt_draw_width;
+
+	// Iterate through each pixel on the screen in turn
+	while( tgt_pixel < tgt_column_end )
+	{
+		uint32_t* tgt_row_end = tgt_pixel + tgt_draw_width;
+
+		while( tgt_pixel < tgt_row_end )
+		{
+			// An arithmetic shift rounds towards negative infinity, so pixels just off the left/top edge correctly fail the test below
+			int roundX = src_posx >> 16;
+			int roundY = src_posy >> 16;
+
+			if( roundX >= 0 && roundY >= 0 && roundX < srcDrawWidth && roundY < srcDrawHeight )
+				BlendPixel( tgt_pixel, fetch( roundX, roundY ) );
+
+			tgt_pixel++;
+			src_posx += src_xincx;
+			src_posy += src_xincy;
+		}
+
+		tgt_pixel += tgt_buffer_width - tgt_draw_width;
+
+		src_posx -= src_xresetx;
+		src_posy -= src_xresety;
+
+		src_posx += src_yincx;
+		src_posy += src_yincy;
+	}
+}
+
+
+void PlayBlitter::ClearRenderTarget( Pixel colour ) const
+{
+	Pixel* pBuffEnd = m_pRenderTarget->pPixels + ( m_pRenderTarget->width * m_pRenderTarget->height );
+	for( Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits );
+	m_pRenderTarget->preMultiplied = false;
+}
+
+void PlayBlitter::BlitBackground( PixelData& backgroundImage ) const
+{
+	PLAY_ASSERT_MSG( backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!" );
+	// Takes about 1ms for 720p screen on i7-8550U
+	memcpy( m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof( Pixel ) * m_pRenderTarget->width * m_pRenderTarget->height );
+}
+
+
+//********************************************************************************************************************************
+// File:		PlayGraphics.cpp
+// Description:	Manages 2D graphics operations on a PixelData buffer 
+// Platform:	Independent
+// Notes:		Uses PNG format. The end of the filename indicates the number of frames e.g. "bat_4.png" or "tiles_10x10.png"
+//********************************************************************************************************************************
+
+
+PlayGraphics* PlayGraphics::s_pInstance = nullptr;
+
+//********************************************************************************************************************************
+// Constructor / Destructor (Private)
+//********************************************************************************************************************************
+
+PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path )
+{
+	// A working buffer for our display. Each pixel is stored as an unsigned 32-bit integer: alpha<<24 | red<<16 | green<<8 | blue
+	m_playBuffer.width = bufferWidth;
+	m_playBuffer.height = bufferHeight;
+	m_playBuffer.pPixels = new Pixel[static_cast<size_t>( bufferWidth ) * bufferHeight];
+	m_playBuffer.preMultiplied = false;
+	PLAY_ASSERT( m_playBuffer.pPixels );
+
+	memset( m_playBuffer.pPixels, 0, sizeof( uint32_t ) * bufferWidth * bufferHeight );
+
+	// Make the display buffer the render target for the blitter
+	m_blitter.SetRenderTarget( &m_playBuffer );
+	m_vDrawingBuffers.push_back( m_playBuffer );
+
+	// Iterate through the directory
+	std::string platformPath = PlatformPath( path );
+	PLAY_ASSERT_MSG( std::filesystem::exists( platformPath ), "PlayBuffer: Drectory provided does not exist." );
+
+	// List the sprite sheets first, so they keep the directory order (and their ids) whatever order they finish loading in
+	std::vector< std::filesystem::path > vSpriteFiles;
+	for( const auto& p : std::filesystem::directory_iterator( platformPath ) )
+	{
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string filename = p.path().string();
+		for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+
+		// Only attempt to load PNG files
+		if( filename.find( ".PNG" ) != std::string::npos )
+			vSpriteFiles.push_back( p.path() );
+	}
+
+#ifdef PLAY_SPRITE_PACK
+	// Use the sprite pack if it's up to date, otherwise load the PNGs and bake a new one
+	std::string packFile = platformPath + SPRITE_PACK_FILENAME;
+	if( !LoadSpritePack( packFile, vSpriteFiles ) )
+	{
+		LoadSpriteFiles( vSpriteFiles );
+		// The pack is only a cache, so the game carries on without it (e.g. from a read-only directory)
+		if( !WriteSpritePack( packFile ) )
+			DebugOutput( "PlayGraphics: Unable to write sprite pack " + packFile + "\n" );
+	}
+#elif defined( PLAY_LAZY_SPRITES )
+	IndexSpriteFiles( vSpriteFiles );
+#else
+	LoadSpriteFiles( vSpriteFiles );
+#endif
+
+	SpriteMemoryStats stats = GetSpriteMemoryStats();
+	if( stats.duplicateFrames > 0 )
+		DebugOutput( "PlayGraphics: " + std::to_string( stats.duplicateFrames ) + " duplicate sprite frames shared, saving " + std::to_string( stats.duplicateBytesSaved / 1024 ) + "KB\n" );
+	if( stats.indexedSprites > 0 )
+		DebugOutput( "PlayGraphics: " + std::to_string( stats.indexedSprites ) + " sprites indexed, saving " + std::to_string( stats.indexedBytesSaved / 1024 ) + "KB\n" );
+}
+
+void PlayGraphics::LoadSpriteFiles( const std::vector< std::filesystem::path >& vSpriteFiles )
+{
+	// Read the sheets as a batch, decoding them and reading their origins on all cores as they arrive
+	// > The files are opened using their real names as file names are case sensitive on some platforms
+	std::vector< std::string > vFiles;
+	for( const std::filesystem::path& pngPath : vSpriteFiles )
+		vFiles.push_back( pngPath.string() );
+
+	std::vector< Sprite > vLoaded( vSpriteFiles.size() );
+	ReadFileBatch( vFiles, [&]( int index, std::vector<uint8_t>& bytes )
+	{
+		if( bytes.empty() )
+			return;
+
+		const std::filesystem::path& pngPath = vSpriteFiles[index];
+		Sprite& s = vLoaded[index];
+		s = DecodeSpriteSheet( pngPath.stem().string(), bytes );
+		s.sourcePath = pngPath.parent_path().string() + "\\";
+		s.sourceFile = pngPath.stem().string();
+		ReadSpriteInfo( pngPath, s.originX, s.originY );
+		DiscardSpriteCanvas( s );
+	} );
+
+	// Add them in directory order
+	vSpriteData.reserve( vLoaded.size() );
+	for( Sprite& s : vLoaded )
+	{
+		if( HasSpritePixels( s ) )
+			AddDecodedSprite( s );
+	}
+}
+
+void PlayGraphics::IndexSpriteFiles( const std::vector< std::filesystem::path >& vSpriteFiles )
+{
+	vSpriteData.reserve( vSpriteFiles.size() );
+	for( const std::filesystem::path& pngPath : vSpriteFiles )
+	{
+		// Only the header is read, to get the size of the sprite sheet
+		std::string fileAndPath = pngPath.string();
+		PixelData canvasBuffer, preMultAlpha;
+		if( PlayWindow::ReadPNGImage( fileAndPath, canvasBuffer.width, canvasBuffer.height ) <= 0 )
+			continue;
+		preMultAlpha.width = canvasBuffer.width;
+		preMultAlpha.height = canvasBuffer.height;
+
+		std::string filename = pngPath.stem().string();
+		int hCount, vCount;
+		GetSpriteSheetFrames( filename, hCount, vCount );
+
+		int originX = 0, originY = 0;
+		ReadSpriteInfo( pngPath, originX, originY );
+
+		int spriteId = AddPreMultipliedSprite( filename, canvasBuffer, preMultAlpha, hCount, vCount );
+		SetSpriteOrigin( spriteId, { originX, originY } );
+		vSpriteData[spriteId].sourcePath = pngPath.parent_path().string() + "\\";
+		vSpriteData[spriteId].sourceFile = filename;
+	}
+}
+
+void PlayGraphics::ReadSpriteInfo( const std::filesystem::path& pngPath, int& originX, int& originY )
+{
+	// Now we check for .inf file for each sprite and load origins
+	std::string info_filename = std::filesystem::path( pngPath ).replace_extension( ".inf" ).string();
+	if( !std::filesystem::exists( info_filename ) )
+		info_filename = std::filesystem::path( pngPath ).replace_extension( ".INF" ).string();
+
+	if( std::filesystem::exists( info_filename ) )
+	{
+		std::ifstream info_infile;
+		info_infile.open( info_filename, std::ios::in );
+
+		PLAY_ASSERT_MSG( info_infile.is_open(), std::string( "Unable to load existing .inf file: " + info_filename ).c_str() );
+		if( info_infile.is_open() )
+		{
+			std::string type;
+			info_infile >> type;
+			info_infile >> originX;
+			info_infile >> originY;
+		}
+
+		info_infile.close();
+	}
+}
+
+PlayGraphics::~PlayGraphics()
+{
+	StopSpriteLoader();
+
+	for( Sprite& s : vSpriteData )
+	{
+		if( s.packed )
+			continue; // Freed when the sprite pack is unmapped
+
+		if( s.canvasBuffer.pPixels )
+			delete[] s.canvasBuffer.pPixels;
+
+		if( s.preMultAlpha.pPixels )
+			delete[] s.preMultAlpha.pPixels;
+	}
+
+	for( PixelData& pBgBuffer : vBackgroundData )
+		delete[] pBgBuffer.pPixels;
+
+	for( PixelData& buffer : m_vDrawingBuffers )
+		delete[] buffer.pPixels;
+}
+
+void PlayGraphics::SetDrawingBufferCount( int count )
+{
+	PLAY_ASSERT_MSG( count >= 1 && count <= 3, "The drawing buffer count must be between 1 and 3!" );
+
+	// Keep the current picture in the first buffer so nothing is lost
+	if( m_currentDrawingBuffer != 0 )
+	{
+		memcpy( m_vDrawingBuffers[0].pPixels, m_playBuffer.pPixels, sizeof( Pixel ) * m_playBuffer.width * m_playBuffer.height );
+		m_currentDrawingBuffer = 0;
+		m_playBuffer.pPixels = m_vDrawingBuffers[0].pPixels;
+	}
+
+	while( static_cast<int>( m_vDrawingBuffers.size() ) > count )
+	{
+		delete[] m_vDrawingBuffers.back().pPixels;
+		m_vDrawingBuffers.pop_back();
+	}
+
+	while( static_cast<int>( m_vDrawingBuffers.size() ) < count )
+	{
+		PixelData buffer = m_playBuffer;
+		size_t pixels = static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height;
+		buffer.pPixels = new Pixel[pixels];
+		std::fill( buffer.pPixels, buffer.pPixels + pixels, Pixel( 0x00000000 ) );
+		m_vDrawingBuffers.push_back( buffer );
+	}
+}
+
+const PixelData* PlayGraphics::SwapDrawingBuffers()
+{
+	const PixelData* pFinished = &m_vDrawingBuffers[m_currentDrawingBuffer];
+
+	// m_playBuffer is always the render target, it just borrows the pixels of the current buffer
+	m_currentDrawingBuffer = ( m_currentDrawingBuffer + 1 ) % static_cast<int>( m_vDrawingBuffers.size() );
+	m_playBuffer.pPixels = m_vDrawingBuffers[m_currentDrawingBuffer].pPixels;
+
+	return pFinished;
+}
+
+void PlayGraphics::BeginCapture( const std::string& path, CaptureFormat format, int framesPerSecond, int workerThreads, int poolSize )
+{
+	PLAY_ASSERT_MSG( !m_pCapture, "A capture is already running!" );
+	m_pCapture = std::make_unique< PlayCapture >( path, format, m_playBuffer.width, m_playBuffer.height, framesPerSecond, workerThreads, poolSize );
+}
+
+CaptureStats PlayGraphics::EndCapture()
+{
+	if( !m_pCapture )
+		return CaptureStats();
+
+	CaptureStats stats = m_pCapture->Finish();
+	m_pCapture.reset();
+	return stats;
+}
+
+//********************************************************************************************************************************
+// Instance functions
+//********************************************************************************************************************************
+
+PlayGraphics& PlayGraphics::Instance()
+{
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayGraphics without initialising it!" );
+	return *s_pInstance;
+}
+
+PlayGraphics& PlayGraphics::Instance( int bufferWidth, int bufferHeight, const char* path )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
+	s_pInstance = new PlayGraphics( bufferWidth, bufferHeight, path );
+	return *s_pInstance;
+}
+
+void PlayGraphics::Destroy()
+{
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayGraphics when it hasn't been instanced!" );
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
+
+//********************************************************************************************************************************
+// Loading functions
+//********************************************************************************************************************************
+
+int PlayGraphics::LoadSpriteSheet( const std::string& path, const std::string& filename )
+{
+	Sprite s = DecodeSpriteSheet( path, filename );
+	DiscardSpriteCanvas( s );
+	return AddDecodedSprite( s );
+}
+
+void PlayGraphics::GetSpriteSheetFrames( const std::string& filename, int& hCount, int& vCount )
+{
+	std::string spriteName = filename;
+	hCount = 1;
+	vCount = 1;
+
+	// Switch everything to uppercase to avoid need to check case each time
+	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+	// Look for the final number in the filename to pull out the number of frames across the width
+	size_t frameWidthEnd = spriteName.find_last_of( "0123456789" );
+	size_t frameWidthStart = spriteName.find_last_not_of( "0123456789" );
+
+	if( frameWidthEnd == spriteName.length() - 1 )
+	{
+		// Grab the number of frames
+		std::string widthString = spriteName.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+		// Make sure the number is valid 
+		size_t num = widthString.find_first_of( "0123456789" );
+		PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+
+		hCount = stoi( widthString );
+
+		if( spriteName[frameWidthStart] == 'X' )
+		{
+			//Two dimensional sprite sheet so the width was actually the height: copy it over and work out the real width
+			vCount = hCount;
+
+			// Cut off the last number we just found plus an "x", then check for another number indicating a frame height (optional)
+			std::string truncated = spriteName.substr( 0, frameWidthStart );
+			frameWidthEnd = truncated.find_last_of( "0123456789" );
+			frameWidthStart = truncated.find_last_not_of( "0123456789" );
+
+			if( frameWidthEnd == truncated.length() - 1 && frameWidthStart != std::string::npos )
+			{
+				// Grab the number of images in the height
+				widthString = truncated.substr( frameWidthStart + 1, frameWidthEnd - frameWidthStart );
+
+				// Make sure the number is valid
+				num = widthString.find_first_of( "0123456789" );
+				PLAY_ASSERT_MSG( num == 0, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+
+				hCount = stoi( widthString );
+			}
+			else
+			{
+				PLAY_ASSERT_MSG( false, std::string( "Incorrectly named sprite: " + filename ).c_str() );
+			}
+		}
+		else
+		{
+			vCount = 1;
+		}
+	}
+}
+
+PlayGraphics::Sprite PlayGraphics::DecodeSpriteSheet( const std::string& path, const std::string& filename ) const
+{
+	// Switch everything to uppercase to avoid need to check case each time
+	std::string spriteName = filename;
+	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+	// Try the name as given first as file names are case sensitive on some platforms
+	std::string platformPath = PlatformPath( path );
+	std::string fileAndPath( platformPath + filename + ".png" );
+	if( !std::filesystem::exists( fileAndPath ) )
+		fileAndPath = platformPath + filename + ".PNG";
+	if( !std::filesystem::exists( fileAndPath ) )
+		fileAndPath = platformPath + spriteName + ".PNG";
+
+	std::vector<uint8_t> bytes;
+	bool read = ReadFileBytes( fileAndPath, bytes );
+	PLAY_ASSERT_MSG( read, std::string( "Unable to load PNG file: " + fileAndPath ).c_str() );
+
+	// Remember where it came from so the pixels can be loaded again
+	Sprite s = DecodeSpriteSheet( filename, bytes );
+	s.sourcePath = path;
+	s.sourceFile = filename;
+	return s;
+}
+
+PlayGraphics::Sprite PlayGraphics::DecodeSpriteSheet( const std::string& filename, const std::vector<uint8_t>& bytes ) const
+{
+	int hCount = 1;
+	int vCount = 1;
+	GetSpriteSheetFrames( filename, hCount, vCount );
+
+	// Each row is pre-multiplied as soon as it has been decoded, rather than in a second pass over the whole image
+	PixelData canvasBuffer;
+	PixelData preMultAlpha;
+	int result = PlayWindow::DecodePNGImage( bytes, canvasBuffer, [&]( int y, Pixel* pRow ) // Allocates memory as we don't know the size
+	{
+		if( !preMultAlpha.pPixels )
+		{
+			preMultAlpha.width = canvasBuffer.width;
+			preMultAlpha.height = canvasBuffer.height;
+			preMultAlpha.pPixels = new Pixel[static_cast<size_t>( canvasBuffer.width ) * canvasBuffer.height];
+		}
+		PreMultiplyAlpha( pRow, preMultAlpha.pPixels + static_cast<size_t>( y ) * canvasBuffer.width, canvasBuffer.width, 1, canvasBuffer.width / hCount, 1.0f, 0x00FFFFFF );
+	} );
+	PLAY_ASSERT_MSG( result > 0, std::string( "Unable to load PNG file: " + filename ).c_str() );
+
+	Sprite s;
+	s.name = filename;
+	s.hCount = hCount;
+	s.vCount = vCount;
+	s.canvasBuffer = canvasBuffer;
+	s.preMultAlpha = preMultAlpha;
+	if( result > 0 )
+	{
+		DeduplicateFrames( s );
+		IndexSprite( s );
+	}
+	return s;
+}
+
+void PlayGraphics::IndexSprite( Sprite& s ) const
+{
+#ifndef PLAY_SPRITE_PACK
+	const PixelData& canvas = s.canvasBuffer;
+	PixelData& preMult = s.preMultAlpha;
+	size_t pixelCount = static_cast<size_t>( preMult.width ) * preMult.height;
+	if( !canvas.pPixels || !preMult.pPixels || s.width <= 0 || s.height <= 0 )
+		return;
+
+	bool font = IsFontSheet( s );
+#ifndef PLAY_INDEXED_SPRITES
+	if( !font )
+		return;
+#endif
+
+	// Small sprites would be bigger once they had their palettes
+	constexpr size_t PALETTE_SIZE = 256;
+	if( ( sizeof( Pixel ) - 1 ) * pixelCount <= 2 * sizeof( Pixel ) * PALETTE_SIZE )
+		return;
+
+	// Which pixels of the canvas each row of the pre-multiplied pixels came from
+	std::vector< const Pixel* > vSourceRows( preMult.height );
+	for( int y = 0; y < preMult.height; y++ )
+	{
+		if( s.frameTable.empty() )
+		{
+			vSourceRows[y] = canvas.pPixels + static_cast<size_t>( y ) * canvas.width;
+			continue;
+		}
+
+		int unique = y / s.height;
+		int frame = static_cast<int>( std::find( s.frameTable.begin(), s.frameTable.end(), unique ) - s.frameTable.begin() );
+		vSourceRows[y] = canvas.pPixels + GetCanvasFrameOffset( s, frame ) + static_cast<size_t>( y % s.height ) * canvas.width;
+	}
+
+	// Give each colour an index, using a small hash table and giving up as soon as there are too many
+	// > Every fully transparent pixel looks the same when drawn, so they all share index 0
+	std::vector< Pixel > palette( 1, Pixel( 0 ) );
+	std::vector< uint8_t > indices( pixelCount );
+	uint32_t tableColours[2 * PALETTE_SIZE];
+	uint8_t tableIndices[2 * PALETTE_SIZE];
+	bool tableUsed[2 * PALETTE_SIZE] = { false };
+
+	uint8_t* pIndex = indices.data();
+	for( int y = 0; y < preMult.height; y++ )
+	{
+		const Pixel* pRow = vSourceRows[y];
+		for( int x = 0; x < preMult.width; x++ )
+		{
+			uint32_t colour = pRow[x].bits;
+			if( colour <= 0x00FFFFFF )
+			{
+				*pIndex++ = 0;
+				continue;
+			}
+
+			size_t slot = ( ( colour * 0x9E3779B1u ) >> 23 ) & ( 2 * PALETTE_SIZE - 1 );
+			while( tableUsed[slot] && tableColours[slot] != colour )
+				slot = ( slot + 1 ) & ( 2 * PALETTE_SIZE - 1 );
+
+			if( !tableUsed[slot] )
+			{
+				if( palette.size() == PALETTE_SIZE )
+					return;
+
+				tableUsed[slot] = true;
+				tableColours[slot] = colour;
+				tableIndices[slot] = static_cast<uint8_t>( palette.size() );
+				palette.push_back( colour );
+			}
+			*pIndex++ = tableIndices[slot];
+		}
+	}
+
+	palette.resize( PALETTE_SIZE, Pixel( 0 ) );
+	s.preMultPalette.resize( PALETTE_SIZE );
+	PreMultiplyAlpha( palette.data(), s.preMultPalette.data(), static_cast<int>( PALETTE_SIZE ), 1, 1, 1.0f, 0x00FFFFFF );
+	s.palette = std::move( palette );
+	s.indices = std::move( indices );
+	s.font = font;
+
+	// The dimensions are kept to describe the indices
+	delete[] preMult.pPixels;
+	preMult.pPixels = nullptr;
+#else
+	(void)s;
+#endif
+}
+
+bool PlayGraphics::IsFontSheet( const Sprite& s )
+{
+	// Space to tilde
+	if( s.totalCount < '~' - ' ' + 1 )
+		return false;
+
+	// The character widths are hidden in fully transparent pixels, so only the visible pixels need to be grey
+	const PixelData& canvas = s.canvasBuffer;
+	size_t pixelCount = static_cast<size_t>( canvas.width ) * canvas.height;
+	for( size_t i = 0; i < pixelCount; i++ )
+	{
+		Pixel pix = canvas.pPixels[i];
+		if( pix.a != 0 && ( pix.r != pix.g || pix.g != pix.b ) )
+			return false;
+	}
+	return true;
+}
+
+void PlayGraphics::DiscardSpriteCanvas( Sprite& s ) const
+{
+#ifndef PLAY_SPRITE_PACK
+#ifndef PLAY_LEAN_SPRITES
+	// Fonts are always drawn from their indices, so only need their original pixels if they can be loaded again
+	if( !s.font || s.sourceFile.empty() )
+		return;
+#endif
+	const PixelData& canvas = s.canvasBuffer;
+	if( !canvas.pPixels )
+		return;
+
+	size_t pixelCount = static_cast<size_t>( canvas.width ) * canvas.height;
+	s.collisionMask.assign( ( pixelCount + 7 ) / 8, 0 );
+	for( size_t i = 0; i < pixelCount; i++ )
+	{
+		if( canvas.pPixels[i].bits > 0x00FFFFFF )
+			s.collisionMask[i >> 3] |= static_cast<uint8_t>( 1 << ( i & 7 ) );
+	}
+
+	// Fonts exported from PlayFontTool hide each character's width in the first row, starting from the space character
+	s.glyphWidths.resize( std::min( canvas.width, 256 - 32 ) );
+	for( size_t i = 0; i < s.glyphWidths.size(); i++ )
+		s.glyphWidths[i] = canvas.pPixels[i].b;
+
+	delete[] s.canvasBuffer.pPixels;
+	s.canvasBuffer.pPixels = nullptr;
+#else
+	(void)s;
+#endif
+}
+
+void PlayGraphics::DeduplicateFrames( Sprite& s ) const
+{
+	const PixelData& canvas = s.canvasBuffer;
+	s.width = canvas.width / s.hCount;
+	s.height = canvas.height / s.vCount;
+	s.totalCount = s.hCount * s.vCount;
+	if( s.totalCount < 2 || s.width == 0 || s.height == 0 || !canvas.pPixels || !s.preMultAlpha.pPixels )
+		return;
+
+	// Frames are compared using the original pixels, so identical frames stay identical after ColourSprite
+	auto FramesMatch = [&]( int frameA, int frameB )
+	{
+		const Pixel* pA = canvas.pPixels + GetCanvasFrameOffset( s, frameA );
+		const Pixel* pB = canvas.pPixels + GetCanvasFrameOffset( s, frameB );
+		for( int y = 0; y < s.height; y++, pA += canvas.width, pB += canvas.width )
+		{
+			if( memcmp( pA, pB, sizeof( Pixel ) * s.width ) != 0 )
+				return false;
+		}
+		return true;
+	};
+
+	std::vector< int > frameTable( s.totalCount );
+	std::vector< int > vUniqueFrames;
+	std::vector< uint64_t > vUniqueHashes;
+	for( int frame = 0; frame < s.totalCount; frame++ )
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const Pixel* pRow = canvas.pPixels + GetCanvasFrameOffset( s, frame );
+		for( int y = 0; y < s.height; y++, pRow += canvas.width )
+		{
+			for( int x = 0; x < s.width; x++ )
+				hash = ( hash ^ pRow[x].bits ) * 1099511628211ull;
+		}
+
+		int unique = 0;
+		while( unique < static_cast<int>( vUniqueFrames.size() ) && !( vUniqueHashes[unique] == hash && FramesMatch( vUniqueFrames[unique], frame ) ) )
+			unique++;
+
+		if( unique == static_cast<int>( vUniqueFrames.size() ) )
+		{
+			vUniqueFrames.push_back( frame );
+			vUniqueHashes.push_back( hash );
+		}
+		frameTable[frame] = unique;
+	}
+
+	if( vUniqueFrames.size() == frameTable.size() )
+		return;
+
+	// Stack the unique frames in a column
+	PixelData stacked = s.preMultAlpha;
+	stacked.width = s.width;
+	stacked.height = s.height * static_cast<int>( vUniqueFrames.size() );
+	stacked.pPixels = new Pixel[static_cast<size_t>( stacked.width ) * stacked.height];
+	for( size_t unique = 0; unique < vUniqueFrames.size(); unique++ )
+	{
+		const Pixel* pSource = s.preMultAlpha.pPixels + GetCanvasFrameOffset( s, vUniqueFrames[unique] );
+		Pixel* pDest = stacked.pPixels + unique * s.width * s.height;
+		for( int y = 0; y < s.height; y++ )
+			memcpy( pDest + static_cast<size_t>( y ) * s.width, pSource + static_cast<size_t>( y ) * s.preMultAlpha.width, sizeof( Pixel ) * s.width );
+	}
+
+	delete[] s.preMultAlpha.pPixels;
+	s.preMultAlpha = stacked;
+	s.frameTable = std::move( frameTable );
+}
+
+int PlayGraphics::AddDecodedSprite( Sprite& s )
+{
+	int spriteId = AddPreMultipliedSprite( s.name, s.canvasBuffer, s.preMultAlpha, s.hCount, s.vCount );
+	SetSpriteOrigin( spriteId, { s.originX, s.originY } );
+
+	Sprite& added = vSpriteData[spriteId];
+	added.frameTable = std::move( s.frameTable );
+	added.indices = std::move( s.indices );
+	added.palette = std::move( s.palette );
+	added.preMultPalette = std::move( s.preMultPalette );
+	added.font = s.font;
+	added.collisionMask = std::move( s.collisionMask );
+	added.glyphWidths = std::move( s.glyphWidths );
+	added.sourcePath = s.sourcePath;
+	added.sourceFile = s.sourceFile;
+	return spriteId;
+}
+
+int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+{
+	// Create a separate buffer with the pre-multiplyied alpha
+	PixelData preMultAlpha;
+	preMultAlpha.pPixels = new Pixel[static_cast<size_t>( pixelData.width ) * pixelData.height];
+	preMultAlpha.width = pixelData.width;
+	preMultAlpha.height = pixelData.height;
+	PreMultiplyAlpha( pixelData.pPixels, preMultAlpha.pPixels, pixelData.width, pixelData.height, pixelData.width / hCount, 1.0f, 0x00FFFFFF );
+
+	Sprite s;
+	s.name = name;
+	s.hCount = hCount;
+	s.vCount = vCount;
+	s.canvasBuffer = pixelData;
+	s.preMultAlpha = preMultAlpha;
+	DeduplicateFrames( s );
+	IndexSprite( s );
+	return AddDecodedSprite( s );
+}
+
+int PlayGraphics::AddPreMultipliedSprite( const std::string& name, PixelData& pixelData, PixelData& preMultAlpha, int hCount, int vCount )
+{
+	// Switch everything to uppercase to avoid need to check case each time
+	std::string spriteName = name;
+	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+	Sprite s;
+	s.id = m_nTotalSprites++;
+	s.name = spriteName;
+	s.originX = s.originY = 0;
+	s.hCount = hCount;
+	s.vCount = vCount;
+	s.canvasBuffer = pixelData; // copy including pointer to pixel data
+	s.preMultAlpha = preMultAlpha;
+
+	s.totalCount = s.hCount * s.vCount;
+	s.width = s.canvasBuffer.width / s.hCount;
+	s.height = s.canvasBuffer.height / s.vCount;
+	s.canvasBuffer.preMultiplied = true;
+
+	// Add the sprite to our vector
+	vSpriteData.push_back( s );
+
+	// Index the whole name, and the name without a frame count (e.g. "_4" or "_10x10") if it has one
+	// > The first sprite with a name keeps it, just as the first match is found by FindSpriteId
+	IndexSpriteName( spriteName, s.id );
+	size_t countStart = spriteName.find_last_of( '_' );
+	if( countStart != std::string::npos && countStart + 1 < spriteName.length() && isdigit( spriteName[countStart + 1] ) && isdigit( spriteName.back() )
+		&& spriteName.find_first_not_of( "0123456789X", countStart + 1 ) == std::string::npos )
+		IndexSpriteName( spriteName.substr( 0, countStart ), s.id );
+
+	// The new sprite may be a better answer to an earlier search
+	m_spriteSearchCache.clear();
+
+	return s.id;
+}
+
+int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, int hCount, int vCount )
+{
+	// Switch everything to uppercase to avoid need to check case each time
+	std::string spriteName = name;
+	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+
+	for( Sprite& s : vSpriteData )
+	{
+		if( s.name.find( spriteName ) != std::string::npos )
+		{
+			// delete the old premultiplied buffer
+			if( !s.packed )
+				delete[] s.preMultAlpha.pPixels;
+			s.packed = false;
+			s.sourceFile.clear(); // Never replaced by pixels loaded lazily
+			s.collisionMask.clear();
+			s.glyphWidths.clear();
+			s.compressedPixels.clear();
+			s.coloured = false;
+
+			s.hCount = hCount;
+			s.vCount = vCount;
+			s.canvasBuffer = pixelData; // copy including pointer to pixel data
+
+			s.totalCount = s.hCount * s.vCount;
+			s.width = s.canvasBuffer.width / s.hCount;
+			s.height = s.canvasBuffer.height / s.vCount;
+
+			// Create a new buffer with the pre-multiplyied alpha
+			s.preMultAlpha.pPixels = new Pixel[static_cast<size_t>( s.canvasBuffer.width ) * s.canvasBuffer.height];
+			s.preMultAlpha.width = s.canvasBuffer.width;
+			s.preMultAlpha.height = s.canvasBuffer.height;
+			memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
+			PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
+			s.canvasBuffer.preMultiplied = true;
+			s.frameTable.clear();
+			s.indices.clear();
+			s.palette.clear();
+			s.preMultPalette.clear();
+			s.font = false;
+			m_tintCache.spriteId = -1;
+			ClearTextCache();
+			DeduplicateFrames( s );
+			IndexSprite( s );
+
+			return s.id;
+		}
+	}
+
+	return -1;
+}
+
+//********************************************************************************************************************************
+// Sprite packs
+//********************************************************************************************************************************
+
+// The start of a sprite pack: it is followed by an entry for each sprite, the sprite names, then the pixel data
+// > The pixel data for each sprite is the canvas followed by the pre-multiplied canvas, each starting on a 64 byte boundary
+struct SpritePackHeader
+{
+	char magic[8]; // "PLAYPACK"
+	uint32_t version;
+	uint32_t spriteCount;
+	uint64_t fileSize;
+};
+
+// The description of one sprite in a sprite pack
+struct SpritePackEntry
+{
+	uint64_t nameOffset;
+	uint32_t nameLength;
+	int32_t canvasWidth, canvasHeight;
+	int32_t hCount, vCount;
+	int32_t originX, originY;
+	uint64_t canvasOffset;
+	int32_t preMultWidth, preMultHeight; // A column of the unique frames when the sprite has a frame table
+	uint64_t preMultOffset;
+	uint64_t frameTableOffset; // Zero when every frame has its own pixels
+};
+
+bool PlayFileMapping::Open( const std::string& fileAndPath )
+{
+	Close();
+
+#ifndef PLAY_PLATFORM_HEADLESS
+	HANDLE hFile = CreateFileA( fileAndPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( hFile == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( hFile, &size ) || size.QuadPart == 0 )
+	{
+		CloseHandle( hFile );
+		return false;
+	}
+
+	// The view keeps the mapping and the file open, so the handles can be closed straight away
+	HANDLE hMapping = CreateFileMappingA( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	CloseHandle( hFile );
+	if( !hMapping )
+		return false;
+
+	void* pData = MapViewOfFile( hMapping, FILE_MAP_COPY, 0, 0, 0 );
+	CloseHandle( hMapping );
+	if( !pData )
+		return false;
+
+	m_size = static_cast<size_t>( size.QuadPart );
+#else
+	int file = ::open( fileAndPath.c_str(), O_RDONLY );
+	if( file < 0 )
+		return false;
+
+	struct stat info;
+	if( fstat( file, &info ) != 0 || info.st_size == 0 )
+	{
+		::close( file );
+		return false;
+	}
+
+	// The mapping keeps the file open, so it can be closed straight away
+	void* pData = mmap( nullptr, static_cast<size_t>( info.st_size ), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+	::close( file );
+	if( pData == MAP_FAILED )
+		return false;
+
+	m_size = static_cast<size_t>( info.st_size );
+#endif
+
+	m_pData = static_cast<uint8_t*>( pData );
+	return true;
+}
+
+void PlayFileMapping::Close()
+{
+	if( !m_pData )
+		return;
+
+#ifndef PLAY_PLATFORM_HEADLESS
+	UnmapViewOfFile( m_pData );
+#else
+	munmap( m_pData, m_size );
+#endif
+
+	m_pData = nullptr;
+	m_size = 0;
+}
+
+bool PlayGraphics::WriteSpritePack( const std::string& fileAndPath ) const
+{
+	auto Align = []( uint64_t offset ) { return ( offset + 63 ) & ~static_cast<uint64_t>( 63 ); };
+
+	// Every sprite's pixels are needed
+	for( int i = 0; i < m_nTotalSprites; i++ )
+		LoadSpriteCanvas( i );
+
+	SpritePackHeader header;
+	memcpy( header.magic, "PLAYPACK", 8 );
+	header.version = SPRITE_PACK_VERSION;
+	header.spriteCount = static_cast<uint32_t>( vSpriteData.size() );
+
+	// Work out where everything goes
+	std::vector< SpritePackEntry > vEntries( vSpriteData.size() );
+	uint64_t offset = sizeof( SpritePackHeader ) + sizeof( SpritePackEntry ) * vEntries.size();
+	for( size_t i = 0; i < vSpriteData.size(); i++ )
+	{
+		const Sprite& s = vSpriteData[i];
+		SpritePackEntry& entry = vEntries[i];
+		entry.nameOffset = offset;
+		entry.nameLength = static_cast<uint32_t>( s.name.size() );
+		entry.canvasWidth = s.canvasBuffer.width;
+		entry.canvasHeight = s.canvasBuffer.height;
+		entry.hCount = s.hCount;
+		entry.vCount = s.vCount;
+		entry.originX = s.originX;
+		entry.originY = s.originY;
+		entry.preMultWidth = s.preMultAlpha.width;
+		entry.preMultHeight = s.preMultAlpha.height;
+		offset += s.name.size();
+	}
+
+	offset = ( offset + 3 ) & ~static_cast<uint64_t>( 3 );
+	uint64_t frameTablesOffset = offset;
+	for( size_t i = 0; i < vSpriteData.size(); i++ )
+	{
+		vEntries[i].frameTableOffset = vSpriteData[i].frameTable.empty() ? 0 : offset;
+		offset += sizeof( int32_t ) * vSpriteData[i].frameTable.size();
+	}
+
+	for( size_t i = 0; i < vSpriteData.size(); i++ )
+	{
+		uint64_t canvasBytes = sizeof( Pixel ) * static_cast<uint64_t>( vEntries[i].canvasWidth ) * vEntries[i].canvasHeight;
+		uint64_t preMultBytes = sizeof( Pixel ) * static_cast<uint64_t>( vEntries[i].preMultWidth ) * vEntries[i].preMultHeight;
+		vEntries[i].canvasOffset = Align( offset );
+		vEntries[i].preMultOffset = Align( vEntries[i].canvasOffset + canvasBytes );
+		offset = vEntries[i].preMultOffset + preMultBytes;
+	}
+	header.fileSize = offset;
+
+	// Write to a temporary file first so that a half-written pack is never used
+	std::string tempFile = fileAndPath + ".tmp";
+	bool written = false;
+	{
+		std::ofstream file( tempFile, std::ios::binary | std::ios::trunc );
+		if( !file )
+			return false;
+
+		file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+		file.write( reinterpret_cast<const char*>( vEntries.data() ), sizeof( SpritePackEntry ) * vEntries.size() );
+		for( const Sprite& s : vSpriteData )
+			file.write( s.name.data(), s.name.size() );
+
+		// Pads the file with zeros up to the given offset
+		auto PadTo = [&file]( uint64_t to )
+		{
+			static const char zeros[64] = { 0 };
+			file.write( zeros, static_cast<std::streamsize>( to - static_cast<uint64_t>( file.tellp() ) ) );
+		};
+
+		PadTo( frameTablesOffset );
+		for( const Sprite& s : vSpriteData )
+		{
+			std::vector< int32_t > frameTable( s.frameTable.begin(), s.frameTable.end() );
+			file.write( reinterpret_cast<const char*>( frameTable.data() ), sizeof( int32_t ) * frameTable.size() );
+		}
+
+		for( size_t i = 0; i < vSpriteData.size(); i++ )
+		{
+			const Sprite& s = vSpriteData[i];
+			PadTo( vEntries[i].canvasOffset );
+			file.write( reinterpret_cast<const char*>( s.canvasBuffer.pPixels ), sizeof( Pixel ) * static_cast<std::streamsize>( s.canvasBuffer.width ) * s.canvasBuffer.height );
+			PadTo( vEntries[i].preMultOffset );
+			file.write( reinterpret_cast<const char*>( s.preMultAlpha.pPixels ), sizeof( Pixel ) * static_cast<std::streamsize>( s.preMultAlpha.width ) * s.preMultAlpha.height );
+		}
+
+		file.close();
+		written = !file.fail();
+	}
+
+	std::error_code error;
+	if( written )
+		std::filesystem::rename( tempFile, fileAndPath, error );
+
+	// Don't leave a partly written pack behind (e.g. when the disk is full)
+	if( !written || error )
+	{
+		std::filesystem::remove( tempFile, error );
+		return false;
+	}
+	return true;
+}
+
+bool PlayGraphics::LoadSpritePack( const std::string& fileAndPath, const std::vector< std::filesystem::path >& vSpriteFiles )
+{
+	std::error_code error;
+	std::filesystem::file_time_type packTime = std::filesystem::last_write_time( fileAndPath, error );
+	if( error )
+		return false;
+
+	// The pack is out of date if any of the sprite sheets or origin files have changed since it was written
+	for( const std::filesystem::path& pngPath : vSpriteFiles )
+	{
+		if( std::filesystem::last_write_time( pngPath, error ) > packTime || error )
+			return false;
+
+		for( const char* extension : { ".inf", ".INF" } )
+		{
+			std::filesystem::path infoPath = std::filesystem::path( pngPath ).replace_extension( extension );
+			if( std::filesystem::exists( infoPath, error ) && std::filesystem::last_write_time( infoPath, error ) > packTime )
+				return false;
+		}
+	}
+
+	if( !m_spritePack.Open( fileAndPath ) )
+		return false;
+
+	const uint8_t* pData = m_spritePack.GetData();
+	size_t size = m_spritePack.GetSize();
+	const SpritePackHeader& header = *reinterpret_cast<const SpritePackHeader*>( pData );
+	const SpritePackEntry* pEntries = reinterpret_cast<const SpritePackEntry*>( pData + sizeof( SpritePackHeader ) );
+
+	// Check the pack was written by this version for exactly these sprite sheets, in the same order, before using any of it
+	bool valid = size >= sizeof( SpritePackHeader ) && memcmp( header.magic, "PLAYPACK", 8 ) == 0 && header.version == SPRITE_PACK_VERSION &&
+		header.fileSize == size && header.spriteCount == vSpriteFiles.size() &&
+		sizeof( SpritePackHeader ) + sizeof( SpritePackEntry ) * static_cast<uint64_t>( header.spriteCount ) <= size;
+
+	for( uint32_t i = 0; valid && i < header.spriteCount; i++ )
+	{
+		const SpritePackEntry& entry = pEntries[i];
+		uint64_t canvasBytes = sizeof( Pixel ) * static_cast<uint64_t>( std::max( entry.canvasWidth, 0 ) ) * std::max( entry.canvasHeight, 0 );
+		uint64_t preMultBytes = sizeof( Pixel ) * static_cast<uint64_t>( std::max( entry.preMultWidth, 0 ) ) * std::max( entry.preMultHeight, 0 );
+		valid = entry.canvasWidth > 0 && entry.canvasHeight > 0 && entry.hCount > 0 && entry.vCount > 0 &&
+			entry.nameOffset + entry.nameLength <= size && entry.canvasOffset + canvasBytes <= size && entry.preMultOffset + preMultBytes <= size &&
+			entry.canvasOffset % 64 == 0 && entry.preMultOffset % 64 == 0;
+
+		// Without a frame table the pre-multiplied pixels match the canvas, otherwise they're a column of whole frames which the table indexes
+		if( valid && entry.frameTableOffset == 0 )
+		{
+			valid = entry.preMultWidth == entry.canvasWidth && entry.preMultHeight == entry.canvasHeight;
+		}
+		else if( valid )
+		{
+			int frameHeight = entry.canvasHeight / entry.vCount;
+			uint64_t frameCount = static_cast<uint64_t>( entry.hCount ) * entry.vCount;
+			valid = frameHeight > 0 && entry.preMultWidth == entry.canvasWidth / entry.hCount && entry.preMultHeight > 0 && entry.preMultHeight % frameHeight == 0 &&
+				entry.frameTableOffset % 4 == 0 && entry.frameTableOffset + sizeof( int32_t ) * frameCount <= size;
+
+			const int32_t* pFrameTable = reinterpret_cast<const int32_t*>( pData + entry.frameTableOffset );
+			for( uint64_t frame = 0; valid && frame < frameCount; frame++ )
+				valid = pFrameTable[frame] >= 0 && pFrameTable[frame] < entry.preMultHeight / frameHeight;
+		}
+
+		if( valid )
+		{
+			std::string spriteName = vSpriteFiles[i].stem().string();
+			for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
+			valid = spriteName == std::string( reinterpret_cast<const char*>( pData + entry.nameOffset ), entry.nameLength );
+		}
+	}
+
+	if( !valid )
+	{
+		m_spritePack.Close();
+		return false;
+	}
+
+	// Point the sprites straight at their pixels in the pack
+	vSpriteData.reserve( header.spriteCount );
+	for( uint32_t i = 0; i < header.spriteCount; i++ )
+	{
+		const SpritePackEntry& entry = pEntries[i];
+		PixelData canvasBuffer, preMultAlpha;
+		canvasBuffer.width = entry.canvasWidth;
+		canvasBuffer.height = entry.canvasHeight;
+		canvasBuffer.pPixels = reinterpret_cast<Pixel*>( m_spritePack.GetData() + entry.canvasOffset );
+		preMultAlpha.width = entry.preMultWidth;
+		preMultAlpha.height = entry.preMultHeight;
+		preMultAlpha.pPixels = reinterpret_cast<Pixel*>( m_spritePack.GetData() + entry.preMultOffset );
+
+		int spriteId = AddPreMultipliedSprite( std::string( reinterpret_cast<const char*>( pData + entry.nameOffset ), entry.nameLength ), canvasBuffer, preMultAlpha, entry.hCount, entry.vCount );
+		vSpriteData[spriteId].packed = true;
+		SetSpriteOrigin( spriteId, { entry.originX, entry.originY } );
+		if( entry.frameTableOffset != 0 )
+		{
+			const int32_t* pFrameTable = reinterpret_cast<const int32_t*>( pData + entry.frameTableOffset );
+			vSpriteData[spriteId].frameTable.assign( pFrameTable, pFrameTable + vSpriteData[spriteId].totalCount );
+		}
+	}
+
+	return true;
+}
+
+//********************************************************************************************************************************
+// Lazy loading
+//********************************************************************************************************************************
+
+void PlayGraphics::Prefetch( const std::vector< std::string >& names )
+{
+	for( std::string name : names )
+	{
+		// Switch everything to uppercase to avoid need to check case each time
+		for( char& c : name ) c = static_cast<char>( toupper( c ) );
+
+		for( const Sprite& s : vSpriteData )
+		{
+			if( s.name.find( name ) != std::string::npos )
+				Prefetch( s.id );
+		}
+	}
+}
+
+void PlayGraphics::Prefetch( int spriteId )
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to prefetch invalid sprite id" );
+	if( !IsSpriteLoaded( spriteId ) )
+		RequestSpriteLoad( vSpriteData[spriteId] );
+}
+
+bool PlayGraphics::IsSpriteLoaded( int spriteId ) const
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to use invalid sprite id" );
+	const Sprite& s = vSpriteData[spriteId];
+	if( HasSpritePixels( s ) )
+		return true;
+
+	// It may have finished loading since it was last checked
+	if( s.loadRequested )
+		InstallLoadedSprites();
+
+	return HasSpritePixels( s );
+}
+
+void PlayGraphics::LoadSpriteNow( int spriteId ) const
+{
+	if( IsSpriteLoaded( spriteId ) )
+		return;
+
+	if( !vSpriteData[spriteId].compressedPixels.empty() )
+	{
+		DecompressSprite( vSpriteData[spriteId] );
+		return;
+	}
+
+	// Loading it here is quicker than waiting for its turn in the queue; any copy loaded in the background is thrown away
+	const Sprite& s = vSpriteData[spriteId];
+	Sprite loaded = DecodeSpriteSheet( s.sourcePath, s.sourceFile );
+	DiscardSpriteCanvas( loaded );
+	loaded.id = spriteId;
+	{
+		std::lock_guard< std::mutex > lock( m_spriteLoader.mutex );
+		m_spriteLoader.vLoaded.push_back( loaded );
+	}
+	InstallLoadedSprites();
+}
+
+void PlayGraphics::LoadSpriteCanvas( int spriteId ) const
+{
+	LoadSpriteNow( spriteId );
+	if( vSpriteData[spriteId].canvasBuffer.pPixels )
+		return;
+
+	// Freed by PLAY_LEAN_SPRITES, so decode the sheet again and keep the original pixels from now on
+	const Sprite& s = vSpriteData[spriteId];
+	PLAY_ASSERT_MSG( !s.sourceFile.empty(), std::string( "Unable to reload the pixels of sprite: " + s.name ).c_str() );
+	Sprite loaded = DecodeSpriteSheet( s.sourcePath, s.sourceFile );
+	s.canvasBuffer.pPixels = loaded.canvasBuffer.pPixels;
+	delete[] loaded.preMultAlpha.pPixels;
+}
+
+const PlayGraphics::Sprite* PlayGraphics::GetDrawableSprite( int spriteId ) const
+{
+	const Sprite& s = vSpriteData[spriteId];
+	s.lastUsedFrame = m_spriteFrame;
+	if( HasSpritePixels( s ) )
+	{
+		m_spriteMemoryStats.hits++;
+		return &s;
+	}
+
+	m_spriteMemoryStats.misses++;
+	if( IsSpriteLoaded( spriteId ) )
+		return &s;
+
+	if( !s.compressedPixels.empty() )
+	{
+		DecompressSprite( s );
+		return &s;
+	}
+
+	RequestSpriteLoad( s );
+	return nullptr;
+}
+
+void PlayGraphics::RequestSpriteLoad( const Sprite& s ) const
+{
+	if( s.loadRequested )
+		return;
+	s.loadRequested = true;
+
+	std::lock_guard< std::mutex > lock( m_spriteLoader.mutex );
+
+	// The threads are only started once something needs loading, leaving the cores free for the game until then
+	if( m_spriteLoader.vThreads.empty() )
+	{
+		unsigned int threadCount = std::max( 1u, std::thread::hardware_concurrency() / 2 );
+		for( unsigned int t = 0; t < threadCount; t++ )
+		{
+			m_spriteLoader.vThreads.emplace_back( [this]()
+			{
+				std::unique_lock< std::mutex > lock( m_spriteLoader.mutex );
+				for( ;; )
+				{
+					m_spriteLoader.requested.wait( lock, [this]() { return m_spriteLoader.stopping || !m_spriteLoader.queue.empty(); } );
+					if( m_spriteLoader.stopping )
+						return;
+
+					Sprite request = m_spriteLoader.queue.front();
+					m_spriteLoader.queue.pop_front();
+
+					// Decoding doesn't touch the sprites, so it doesn't need the lock
+					lock.unlock();
+					Sprite loaded = DecodeSpriteSheet( request.sourcePath, request.sourceFile );
+					DiscardSpriteCanvas( loaded );
+					loaded.id = request.id;
+					lock.lock();
+
+					m_spriteLoader.vLoaded.push_back( loaded );
+				}
+			} );
+		}
+	}
+
+	// The copy has no pixels, and the workers never look at vSpriteData which may grow while they're loading
+	m_spriteLoader.queue.push_back( s );
+	m_spriteLoader.requested.notify_one();
+}
+
+void PlayGraphics::InstallLoadedSprites() const
+{
+	std::vector< Sprite > vLoaded;
+	{
+		std::lock_guard< std::mutex > lock( m_spriteLoader.mutex );
+		vLoaded.swap( m_spriteLoader.vLoaded );
+	}
+
+	for( Sprite& loaded : vLoaded )
+	{
+		const Sprite& s = vSpriteData[loaded.id];
+		if( HasSpritePixels( s ) || s.sourceFile.empty() || !s.compressedPixels.empty() )
+		{
+			// Already loaded on the main thread, replaced using UpdateSprite, or evicted since (keeping any colouring)
+			delete[] loaded.canvasBuffer.pPixels;
+			delete[] loaded.preMultAlpha.pPixels;
+			continue;
+		}
+
+		// Only the pre-multiplied pixels are evicted, so the originals may still be here
+		if( s.canvasBuffer.pPixels )
+			delete[] loaded.canvasBuffer.pPixels;
+		else
+			s.canvasBuffer = loaded.canvasBuffer;
+		s.canvasBuffer.preMultiplied = true;
+		s.preMultAlpha = loaded.preMultAlpha;
+		s.frameTable = std::move( loaded.frameTable );
+		s.indices = std::move( loaded.indices );
+		s.palette = std::move( loaded.palette );
+		s.preMultPalette = std::move( loaded.preMultPalette );
+		s.font = loaded.font;
+		s.collisionMask = std::move( loaded.collisionMask );
+		s.glyphWidths = std::move( loaded.glyphWidths );
+	}
+}
+
+void PlayGraphics::StopSpriteLoader()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_spriteLoader.mutex );
+		m_spriteLoader.stopping = true;
+	}
+	m_spriteLoader.requested.notify_all();
+
+	for( std::thread& thread : m_spriteLoader.vThreads )
+		thread.join();
+	m_spriteLoader.vThreads.clear();
+
+	for( Sprite& loaded : m_spriteLoader.vLoaded )
+	{
+		delete[] loaded.canvasBuffer.pPixels;
+		delete[] loaded.preMultAlpha.pPixels;
+	}
+	m_spriteLoader.vLoaded.clear();
+}
+
+//********************************************************************************************************************************
+// Sprite memory budget
+//********************************************************************************************************************************
+
+// Compresses a block of memory in the LZ4 block format: each sequence is a token (literal length << 4 | match length - 4),
+// any extra length bytes, the literals, then a two byte offset back to the match and any extra match length bytes
+// > Speed matters more than size here: pre-multiplied sprites are mostly long runs of transparent pixels
+static void LZCompress( const uint8_t* pSrc, size_t size, std::vector<uint8_t>& out )
+{
+	constexpr int HASH_BITS = 14;
+	constexpr size_t MIN_MATCH = 4;
+	std::vector<uint32_t> vTable( 1 << HASH_BITS, 0 );
+
+	auto WriteLength = [&]( size_t length )
+	{
+		for( ; length >= 255; length -= 255 )
+			out.push_back( 255 );
+		out.push_back( static_cast<uint8_t>( length ) );
+	};
+
+	auto WriteSequence = [&]( size_t literalStart, size_t literalLength, size_t offset, size_t matchLength )
+	{
+		size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+		out.push_back( static_cast<uint8_t>( ( std::min<size_t>( literalLength, 15 ) << 4 ) | std::min<size_t>( matchCode, 15 ) ) );
+		if( literalLength >= 15 )
+			WriteLength( literalLength - 15 );
+		out.insert( out.end(), pSrc + literalStart, pSrc + literalStart + literalLength );
+		if( matchLength == 0 )
+			return; // The last sequence is just literals
+
+		out.push_back( static_cast<uint8_t>( offset ) );
+		out.push_back( static_cast<uint8_t>( offset >> 8 ) );
+		if( matchCode >= 15 )
+			WriteLength( matchCode - 15 );
+	};
+
+	out.clear();
+	size_t anchor = 0;
+	size_t pos = 0;
+	while( pos + MIN_MATCH <= size )
+	{
+		uint32_t value;
+		memcpy( &value, pSrc + pos, sizeof( value ) );
+		uint32_t hash = ( value * 2654435761u ) >> ( 32 - HASH_BITS );
+		size_t candidate = vTable[hash];
+		vTable[hash] = static_cast<uint32_t>( pos );
+
+		if( candidate >= pos || pos - candidate > 0xFFFF || memcmp( pSrc + candidate, pSrc + pos, MIN_MATCH ) != 0 )
+		{
+			pos++;
+			continue;
+		}
+
+		size_t matchLength = MIN_MATCH;
+		while( pos + matchLength < size && pSrc[candidate + matchLength] == pSrc[pos + matchLength] )
+			matchLength++;
+
+		WriteSequence( anchor, pos - anchor, pos - candidate, matchLength );
+		pos += matchLength;
+		anchor = pos;
+	}
+
+	if( anchor < size )
+		WriteSequence( anchor, size - anchor, 0, 0 );
+}
+
+// Decompresses a block written by LZCompress into exactly destSize bytes
+// > Returns false if the data is corrupt
+static bool LZDecompress( const uint8_t* pSrc, size_t size, uint8_t* pDest, size_t destSize )
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	auto ReadLength = [&]( size_t& length )
+	{
+		uint8_t b;
+		do
+		{
+			if( in >= size )
+				return false;
+			b = pSrc[in++];
+			length += b;
+		} while( b == 255 );
+		return true;
+	};
+
+	while( in < size )
+	{
+		uint8_t token = pSrc[in++];
+		size_t length = token >> 4;
+		if( length == 15 && !ReadLength( length ) )
+			return false;
+		if( length > size - in || length > destSize - out )
+			return false;
+		memcpy( pDest + out, pSrc + in, length );
+		in += length;
+		out += length;
+
+		if( in == size )
+			break; // The last sequence is just literals
+
+		if( size - in < 2 )
+			return false;
+		size_t offset = pSrc[in] | ( pSrc[in + 1] << 8 );
+		in += 2;
+		length = ( token & 15 ) + 4;
+		if( ( token & 15 ) == 15 && !ReadLength( length ) )
+			return false;
+		if( offset == 0 || offset > out || length > destSize - out )
+			return false;
+
+		// Matches can overlap the bytes they're creating, e.g. runs of the same pixel
+		uint8_t* pMatch = pDest + out - offset;
+		if( offset >= length )
+			memcpy( pDest + out, pMatch, length );
+		else
+			for( size_t i = 0; i < length; i++ )
+				pDest[out + i] = pMatch[i];
+		out += length;
+	}
+
+	return out == destSize;
+}
+
+void PlayGraphics::SetSpriteMemoryBudget( size_t bytes, int unusedFrames, bool compress )
+{
+	PLAY_ASSERT_MSG( unusedFrames >= 1, "Sprites must be unused for at least one frame before they can be evicted" );
+	m_spriteMemoryBudget = bytes;
+	m_spriteUnusedFrames = unusedFrames;
+	m_compressEvictedSprites = compress;
+	m_spriteMemoryStats.budget = bytes;
+}
+
+void PlayGraphics::UpdateSpriteMemory()
+{
+	m_spriteFrame++;
+	if( m_spriteMemoryBudget == 0 )
+		return;
+
+	// Work out what's in memory, and which sprites could be evicted
+	size_t residentBytes = 0;
+	size_t compressedBytes = 0;
+	std::vector< Sprite* > vCandidates;
+	for( Sprite& s : vSpriteData )
+	{
+		compressedBytes += s.compressedPixels.size();
+		if( s.packed || !s.preMultAlpha.pPixels )
+			continue;
+
+		residentBytes += sizeof( Pixel ) * static_cast<size_t>( s.preMultAlpha.width ) * s.preMultAlpha.height;
+		bool canReload = !s.sourceFile.empty() && !s.coloured;
+		if( m_spriteFrame - s.lastUsedFrame >= m_spriteUnusedFrames && ( m_compressEvictedSprites || canReload ) )
+			vCandidates.push_back( &s );
+	}
+
+	// Least recently used first
+	if( residentBytes > m_spriteMemoryBudget )
+	{
+		std::sort( vCandidates.begin(), vCandidates.end(), []( const Sprite* a, const Sprite* b ) { return a->lastUsedFrame < b->lastUsedFrame; } );
+		for( Sprite* pSprite : vCandidates )
+		{
+			if( residentBytes <= m_spriteMemoryBudget )
+				break;
+
+			residentBytes -= sizeof( Pixel ) * static_cast<size_t>( pSprite->preMultAlpha.width ) * pSprite->preMultAlpha.height;
+			EvictSprite( *pSprite );
+			compressedBytes += pSprite->compressedPixels.size();
+			m_spriteMemoryStats.evictions++;
+		}
+	}
+
+	m_spriteMemoryStats.residentBytes = residentBytes;
+	m_spriteMemoryStats.compressedBytes = compressedBytes;
+}
+
+SpriteMemoryStats PlayGraphics::GetSpriteMemoryStats() const
+{
+	SpriteMemoryStats stats = m_spriteMemoryStats;
+	for( const Sprite& s : vSpriteData )
+	{
+		if( s.frameTable.empty() )
+			continue;
+
+		int uniqueFrames = s.preMultAlpha.height / s.height;
+		stats.duplicateFrames += s.totalCount - uniqueFrames;
+		stats.duplicateBytesSaved += sizeof( Pixel ) * static_cast<size_t>( s.totalCount - uniqueFrames ) * s.width * s.height;
+	}
+
+	for( const Sprite& s : vSpriteData )
+	{
+		if( s.indices.empty() )
+			continue;
+
+		stats.indexedSprites++;
+		stats.indexedBytesSaved += ( sizeof( Pixel ) - 1 ) * s.indices.size() - sizeof( Pixel ) * ( s.palette.size() + s.preMultPalette.size() );
+	}
+	return stats;
+}
+
+void PlayGraphics::EvictSprite( Sprite& s )
+{
+	if( m_compressEvictedSprites )
+	{
+		LZCompress( reinterpret_cast<const uint8_t*>( s.preMultAlpha.pPixels ), sizeof( Pixel ) * static_cast<size_t>( s.preMultAlpha.width ) * s.preMultAlpha.height, s.compressedPixels );
+		s.compressedPixels.shrink_to_fit();
+	}
+
+	delete[] s.preMultAlpha.pPixels;
+	s.preMultAlpha.pPixels = nullptr;
+	s.loadRequested = false; // So the next draw asks for it to be loaded again
+}
+
+void PlayGraphics::DecompressSprite( const Sprite& s ) const
+{
+	auto start = std::chrono::steady_clock::now();
+
+	size_t pixelCount = static_cast<size_t>( s.preMultAlpha.width ) * s.preMultAlpha.height;
+	s.preMultAlpha.pPixels = new Pixel[pixelCount];
+	bool decompressed = LZDecompress( s.compressedPixels.data(), s.compressedPixels.size(), reinterpret_cast<uint8_t*>( s.preMultAlpha.pPixels ), sizeof( Pixel ) * pixelCount );
+	PLAY_ASSERT_MSG( decompressed, std::string( "Unable to decompress evicted sprite: " + s.name ).c_str() );
+	s.compressedPixels.clear();
+	s.compressedPixels.shrink_to_fit();
+
+	m_spriteMemoryStats.decompressMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+int PlayGraphics::LoadBackground( const char* fileAndPath )
+{
+	// The background image may not be the right size for the background so we make sure the buffer is 
+	PixelData backgroundImage;
+	Pixel* pSrc, * pDest;
+
+	Pixel* correctSizeBuffer = new Pixel[static_cast<size_t>( m_playBuffer.width ) * m_playBuffer.height];
+	PLAY_ASSERT( correctSizeBuffer );
+
+	std::string pngFile = PlatformPath( fileAndPath );
+	PLAY_ASSERT_MSG( std::filesystem::exists( pngFile ), "The background png does not exist at the given location." );
+	PlayWindow::LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
+
+	pSrc = backgroundImage.pPixels;
+	pDest = correctSizeBuffer;
+
+	//Copy the image to our background buffer clipping where necessary
+	for( int h = 0; h < std::min( backgroundImage.height, m_playBuffer.height ); h++ )
+	{
+		for( int w = 0; w < std::min( backgroundImage.width, m_playBuffer.width ); w++ )
+			*pDest++ = *pSrc++;
+
+		// Skip pixels if we're clipping
+		pDest += std::max( m_playBuffer.width - backgroundImage.width, 0 );
+		pSrc += std::max( backgroundImage.width - m_playBuffer.width, 0 );
+	}
+
+	// Free up the loading buffer
+	delete backgroundImage.pPixels;
+	backgroundImage.pPixels = correctSizeBuffer;
+
+	vBackgroundData.push_back( backgroundImage );
+
+	return static_cast<int>( vBackgroundData.size() ) - 1;
+}
+
+
+//********************************************************************************************************************************
+// Sprite Getters and Setters
+//********************************************************************************************************************************
+void PlayGraphics::IndexSpriteName( const std::string& name, int spriteId )
+{
+	uint64_t hash = HashSpriteName( name.c_str() ).value;
+	if( FindSpriteName( m_spriteNameIndex, hash, name.c_str() ) < 0 )
+		m_spriteNameIndex.emplace( hash, SpriteNameEntry{ name, spriteId } );
+}
+
+int PlayGraphics::FindSpriteName( const std::unordered_multimap< uint64_t, SpriteNameEntry >& table, uint64_t hash, const char* name )
+{
+	auto range = table.equal_range( hash );
+	for( auto it = range.first; it != range.second; ++it )
+	{
+		// Compare ignoring case without making an upper case copy of the name
+		const std::string& entry = it->second.name;
+		size_t i = 0;
+		while( i < entry.length() && name[i] && entry[i] == toupper( name[i] ) )
+			i++;
+		if( i == entry.length() && !name[i] )
+			return it->second.id;
+	}
+	return -1;
+}
+
+int PlayGraphics::GetSpriteId( const char* name ) const
+{
+	uint64_t hash = HashSpriteName( name ).value;
+	int spriteId = FindSpriteName( m_spriteNameIndex, hash, name );
+	if( spriteId >= 0 )
+		return spriteId;
+
+	spriteId = FindSpriteName( m_spriteSearchCache, hash, name );
+	if( spriteId >= 0 )
+		return spriteId;
+
+	// Not a whole name, so search for the text within the names and remember the answer until another sprite is added
+	spriteId = FindSpriteId( name );
+	if( spriteId >= 0 )
+	{
+		std::string text( name );
+		for( char& c : text ) c = static_cast<char>( toupper( c ) );
+		m_spriteSearchCache.emplace( hash, SpriteNameEntry{ text, spriteId } );
+	}
+	return spriteId;
+}
+
+int PlayGraphics::GetSpriteId( SpriteHash name ) const
+{
+	// Only the hash is known, so the first whole name with it is used
+	auto it = m_spriteNameIndex.find( name.value );
+	if( it != m_spriteNameIndex.end() )
+		return it->second.id;
+
+	PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
+	return -1;
+}
+
+int PlayGraphics::FindSpriteId( const char* text ) const
+{
+	std::string tofind( text );
+	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+
+	for( const Sprite& s : vSpriteData )
+	{
+		if( s.name.find( tofind ) != std::string::npos )
+			return s.id;
+	}
+	PLAY_ASSERT_MSG( false, "The sprite name is invalid!" );
+	return -1;
+}
+
+const std::string& PlayGraphics::GetSpriteName( int spriteId )
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get name of invalid sprite id" );
+	return vSpriteData[spriteId].name;
+}
+
+Vector2f PlayGraphics::GetSpriteSize( int spriteId ) const
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get width of invalid sprite id" );
+	return { vSpriteData[spriteId].width, vSpriteData[spriteId].height };
+}
+
+int PlayGraphics::GetSpriteFrames( int spriteId ) const
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get frames of invalid sprite id" );
+	return vSpriteData[spriteId].totalCount;
+}
+
+Vector2f PlayGraphics::GetSpriteOrigin( int spriteId ) const
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to get origin with invalid sprite id" );
+	return { vSpriteData[spriteId].originX, vSpriteData[spriteId].originY };
+}
+
+void PlayGraphics::SetSpriteOrigin( int spriteId, Vector2f newOrigin, bool relative )
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to set origin with invalid sprite id" );
+	if( relative )
+	{
+		vSpriteData[spriteId].originX += static_cast<int>( newOrigin.x );
+		vSpriteData[spriteId].originY += static_cast<int>( newOrigin.y );
+	}
+	else
+	{
+		vSpriteData[spriteId].originX = static_cast<int>( newOrigin.x );
+		vSpriteData[spriteId].originY = static_cast<int>( newOrigin.y );
+	}
+}
+
+void PlayGraphics::CentreSpriteOrigin( int spriteId )
+{
+	SetSpriteOrigin( spriteId, GetSpriteSize( spriteId ) / 2 );
+}
+
+void PlayGraphics::CentreAllSpriteOrigins( void )
+{
+	for( Sprite& s : vSpriteData )
+		CentreSpriteOrigin( s.id );
+}
+
+void PlayGraphics::SetSpriteOrigins( const char* rootName, Vector2f newOrigin, bool relative )
+{
+	std::string tofind( rootName );
+	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
+
+	for( Sprite& s : vSpriteData )
+	{
+		if( s.name.find( tofind ) != std::string::npos )
+		{
+			if( relative )
+			{
+				s.originX += static_cast<int>( newOrigin.x );
+				s.originY += static_cast<int>( newOrigin.y );
+			}
+			else
+			{
+				s.originX = static_cast<int>( newOrigin.x );
+				s.originY = static_cast<int>( newOrigin.y );
+			}
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// Drawing functions
+//********************************************************************************************************************************
+
+int PlayGraphics::GetFrameOffset( const Sprite& spr, int frameIndex ) const
+{
+	frameIndex = frameIndex % spr.totalCount;
+
+	// Frames which were identical share one copy in a column of unique frames
+	if( !spr.frameTable.empty() )
+		return spr.frameTable[frameIndex] * spr.width * spr.height;
+
+	return GetCanvasFrameOffset( spr, frameIndex );
+}
+
+int PlayGraphics::GetCanvasFrameOffset( const Sprite& spr, int frameIndex )
+{
+	int frameX = frameIndex % spr.hCount;
+	int frameY = frameIndex / spr.hCount;
+	int pixelX = frameX * spr.width;
+	int pixelY = frameY * spr.height;
+	return pixelX + ( spr.canvasBuffer.width * pixelY );
+}
+
+void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const
+{
+	const Sprite* pSpr = GetDrawableSprite( spriteId );
+	if( !pSpr ) return;
+
+	const Sprite& spr = *pSpr;
+	int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
+	int desty = static_cast<int>( pos.y + 0.5f ) - spr.originY;
+
+	if( !spr.indices.empty() )
+		m_blitter.BlitIndexedPixels( GetIndexedPixels( spr ), GetFrameOffset( spr, frameIndex ), destx, desty, spr.width, spr.height, alphaMultiply );
+	else
+		m_blitter.BlitPixels( spr.preMultAlpha, GetFrameOffset( spr, frameIndex ), destx, desty, spr.width, spr.height, alphaMultiply );
+};
+
+void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply ) const
+{
+	const Sprite* pSpr = GetDrawableSprite( spriteId );
+	if( scale == 0.0f || !pSpr ) return;
+
+	// Only recalculate the sine and cosine when the angle changes
+	if( angle != m_rotationCache.angle )
+	{
+		m_rotationCache.angle = angle;
+		PlaySinCos( angle, m_rotationCache.sinAngle, m_rotationCache.cosAngle );
+	}
+
+	float s = m_rotationCache.sinAngle;
+	float c = m_rotationCache.cosAngle;
+
+	const Sprite& spr = *pSpr;
+	Vector2f origin = { spr.originX, spr.originY };
+	if( !spr.indices.empty() )
+		m_blitter.TransformIndexedPixels( GetIndexedPixels( spr ), GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin,
+			AffineRotationScale( s, c, scale, pos ), AffineRotationScaleInverse( s, c, scale, pos ), alphaMultiply );
+	else
+		m_blitter.TransformPixels( spr.preMultAlpha, GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin,
+			AffineRotationScale( s, c, scale, pos ), AffineRotationScaleInverse( s, c, scale, pos ), alphaMultiply );
+}
+
+void PlayGraphics::DrawTransformed( int spriteId, const Matrix2D& trans, int frameIndex, float alphaMultiply ) const
+{
+	DrawTransformed( spriteId, Affine2D( trans ), frameIndex, alphaMultiply );
+}
+
+void PlayGraphics::DrawTransformed( int spriteId, const Affine2D& trans, int frameIndex, float alphaMultiply ) const
+{
+	const Sprite* pSpr = GetDrawableSprite( spriteId );
+	if( trans.Determinant() == 0.0f || !pSpr ) return;
+
+	const Sprite& spr = *pSpr;
+	Vector2f origin = { spr.originX, spr.originY };
+	if( !spr.indices.empty() )
+		m_blitter.TransformIndexedPixels( GetIndexedPixels( spr ), GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin, trans, trans.Inverted(), alphaMultiply );
+	else
+		m_blitter.TransformPixels( spr.preMultAlpha, GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin, trans, trans.Inverted(), alphaMultiply );
+}
+
+
+void PlayGraphics::DrawBackground( int backgroundId )
+{
+	PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
+	PLAY_ASSERT_MSG( vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
+	m_blitter.BlitBackground( vBackgroundData[backgroundId] );
+}
+
+void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < m_nTotalSprites, "Trying to colour invalid sprite id" );
+	uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
+
+	// An indexed sprite is coloured by colouring its palette, which doesn't need the original pixels
+	LoadSpriteNow( spriteId );
+	Sprite& s = vSpriteData[spriteId];
+	if( !s.indices.empty() )
+	{
+		PreMultiplyAlpha( s.palette.data(), s.preMultPalette.data(), static_cast<int>( s.palette.size() ), 1, 1, 1.0f, col );
+		s.coloured = col != 0x00FFFFFF;
+		m_tintCache.spriteId = -1;
+		ClearTextCache();
+		return;
+	}
+
+	LoadSpriteCanvas( spriteId );
+
+	if( s.frameTable.empty() )
+	{
+		PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
+	}
+	else
+	{
+		// Identical frames share their pre-multiplied pixels, so each unique frame is coloured once from the first frame using it
+		std::vector< bool > vColoured( s.preMultAlpha.height / s.height, false );
+		for( int frame = 0; frame < s.totalCount; frame++ )
+		{
+			int unique = s.frameTable[frame];
+			if( vColoured[unique] )
+				continue;
+			vColoured[unique] = true;
+
+			const Pixel* pSource = s.canvasBuffer.pPixels + GetCanvasFrameOffset( s, frame );
+			Pixel* pDest = s.preMultAlpha.pPixels + static_cast<size_t>( unique ) * s.width * s.height;
+			for( int y = 0; y < s.height; y++ )
+				PreMultiplyAlpha( pSource + static_cast<size_t>( y ) * s.canvasBuffer.width, pDest + static_cast<size_t>( y ) * s.width, s.width, 1, s.width, 1.0f, col );
+		}
+	}
+	s.canvasBuffer.preMultiplied = true;
+	s.coloured = col != 0x00FFFFFF;
+	ClearTextCache();
+}
+
+int PlayGraphics::DrawString( int fontId, Point2f pos, const std::string& text, Pixel colour ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+
+	const TextRun* pRun = m_textCacheSize > 0 ? GetTextRun( fontId, text ) : nullptr;
+	if( pRun && !pRun->overlaps )
+	{
+		// The font's origin is applied here rather than kept in the run, as it can change without the font's pixels changing
+		const Sprite& font = vSpriteData[fontId];
+		int destx = static_cast<int>( pos.x + 0.5f ) - font.originX;
+		int desty = static_cast<int>( pos.y + 0.5f ) - font.originY;
+		m_blitter.BlitPixels( pRun->image, 0, destx, desty, pRun->image.width, pRun->image.height, 1.0f, colour );
+		return pRun->width;
+	}
+
+	int width = 0;
+
+	for( char c : text )
+	{
+		DrawColoured( fontId, { pos.x + width, pos.y }, c - 32, 0.0f, 1.0f, colour );
+		width += GetFontCharWidth( fontId, c );
+	}
+	return width;
+}
+
+int PlayGraphics::DrawStringCentred( int fontId, Point2f pos, const std::string& text, Pixel colour ) const
+{
+	int totalWidth = GetStringWidth( fontId, text );
+
+	pos.x -= totalWidth / 2;
+
+	DrawString( fontId, pos, text, colour );
+	return totalWidth;
+}
+
+int PlayGraphics::GetStringWidth( int fontId, const std::string& text ) const
+{
+	const TextRun* pRun = m_textCacheSize > 0 ? GetTextRun( fontId, text ) : nullptr;
+	if( pRun )
+		return pRun->width;
+
+	int totalWidth = 0;
+
+	for( char c : text )
+		totalWidth += GetFontCharWidth( fontId, c );
+
+	return totalWidth;
+}
+
+void PlayGraphics::SetTextCacheSize( size_t strings )
+{
+	m_textCacheSize = strings;
+	while( m_textRuns.size() > m_textCacheSize )
+	{
+		m_textRunIndex.erase( m_textRuns.back().key );
+		m_textRuns.pop_back();
+	}
+}
+
+void PlayGraphics::ClearTextCache() const
+{
+	m_textRuns.clear();
+	m_textRunIndex.clear();
+}
+
+const PlayGraphics::TextRun* PlayGraphics::GetTextRun( int fontId, const std::string& text ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+	const Sprite* pFont = GetDrawableSprite( fontId );
+	if( !pFont )
+		return nullptr;
+
+	std::string key( reinterpret_cast<const char*>( &fontId ), sizeof( fontId ) );
+	key += text;
+
+	auto found = m_textRunIndex.find( key );
+	if( found != m_textRunIndex.end() )
+	{
+		m_textRuns.splice( m_textRuns.begin(), m_textRuns, found->second );
+		return &m_textRuns.front();
+	}
+
+	// Work out where each character goes, and how far the last one overhangs the total width
+	const Sprite& font = *pFont;
+	std::vector< int > vCharX( text.size() );
+	int width = 0, imageWidth = 0;
+	for( size_t i = 0; i < text.size(); i++ )
+	{
+		vCharX[i] = width;
+		imageWidth = std::max( imageWidth, width + font.width );
+		width += GetFontCharWidth( fontId, text[i] );
+	}
+
+	TextRun run;
+	run.key = key;
+	run.width = width;
+	run.image.width = imageWidth;
+	run.image.height = font.height;
+	run.pixels.assign( static_cast<size_t>( imageWidth ) * font.height, Pixel( 0xFF000000 ) );
+
+	// Copy the visible pixels of each character, so neighbouring characters' transparent pixels don't hide them
+	for( size_t i = 0; i < text.size() && !run.overlaps; i++ )
+	{
+		int frameIndex = text[i] - 32;
+		if( frameIndex < 0 || frameIndex >= font.totalCount )
+			continue;
+
+		int frameOffset = GetFrameOffset( font, frameIndex );
+		for( int y = 0; y < font.height; y++ )
+		{
+			Pixel* pDest = run.pixels.data() + static_cast<size_t>( y ) * imageWidth + vCharX[i];
+			size_t srcIndex = static_cast<size_t>( frameOffset ) + static_cast<size_t>( y ) * font.preMultAlpha.width;
+			for( int x = 0; x < font.width; x++ )
+			{
+				Pixel src = font.indices.empty() ? font.preMultAlpha.pPixels[srcIndex + x] : font.preMultPalette[font.indices[srcIndex + x]];
+				if( src.bits >= 0xFF000000 )
+					continue;
+				if( pDest[x].bits < 0xFF000000 )
+					run.overlaps = true;
+				pDest[x] = src;
+			}
+		}
+	}
+
+	// Store how many transparent pixels follow each transparent pixel, as PreMultiplyAlpha does
+	for( int y = 0; y < font.height; y++ )
+	{
+		Pixel* pRow = run.pixels.data() + static_cast<size_t>( y ) * imageWidth;
+		uint32_t repeats = 0;
+		for( int x = imageWidth - 1; x >= 0; x-- )
+		{
+			if( pRow[x].bits >= 0xFF000000 )
+				pRow[x] = 0xFF000000 | repeats++;
+			else
+				repeats = 0;
+		}
+	}
+	if( run.overlaps )
+	{
+		run.pixels.clear();
+		run.pixels.shrink_to_fit();
+	}
+	run.image.pPixels = run.pixels.data();
+	run.image.preMultiplied = true;
+
+	m_textRuns.push_front( std::move( run ) );
+	m_textRunIndex[key] = m_textRuns.begin();
+	while( m_textRuns.size() > m_textCacheSize )
+	{
+		m_textRunIndex.erase( m_textRuns.back().key );
+		m_textRuns.pop_back();
+	}
+	return &m_textRuns.front();
+}
+
+int PlayGraphics::DrawChar( int fontId, Point2f pos, char c, Pixel colour ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+	DrawColoured( fontId, { pos.x, pos.y }, c - 32, 0.0f, 1.0f, colour );
+	return GetFontCharWidth( fontId, c );
+}
+
+int PlayGraphics::DrawCharRotated( int fontId, Point2f pos, float angle, float scale, char c, Pixel colour ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+	DrawColoured( fontId, { pos.x, pos.y }, c - 32, angle, scale, colour );
+	return GetFontCharWidth( fontId, c );
+}
+
+void PlayGraphics::DrawColoured( int spriteId, Point2f pos, int frameIndex, float angle, float scale, Pixel colour ) const
+{
+	bool rotated = angle != 0.0f || scale != 1.0f;
+	if( !PlayBlitter::IsTint( colour ) )
+	{
+		if( rotated )
+			DrawRotated( spriteId, pos, frameIndex, angle, scale );
+		else
+			Draw( spriteId, pos, frameIndex );
+		return;
+	}
+
+	const Sprite* pSpr = GetDrawableSprite( spriteId );
+	if( scale == 0.0f || !pSpr ) return;
+	const Sprite& spr = *pSpr;
+
+	// An indexed sprite is coloured by colouring a copy of its palette
+	IndexedPixelData indexed = GetIndexedPixels( spr );
+	if( !spr.indices.empty() )
+	{
+		if( m_tintCache.spriteId != spriteId || m_tintCache.colour != colour.bits )
+		{
+			m_tintCache.spriteId = spriteId;
+			m_tintCache.colour = colour.bits;
+			PlayBlitter::TintPixels( &spr.preMultPalette[0].bits, &m_tintCache.palette[0].bits, static_cast<int>( spr.preMultPalette.size() ), colour );
+		}
+		indexed.pPalette = m_tintCache.palette;
+	}
+
+	if( !rotated )
+	{
+		int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
+		int desty = static_cast<int>( pos.y + 0.5f ) - spr.originY;
+		if( !spr.indices.empty() )
+			m_blitter.BlitIndexedPixels( indexed, GetFrameOffset( spr, frameIndex ), destx, desty, spr.width, spr.height, 1.0f );
+		else
+			m_blitter.BlitPixels( spr.preMultAlpha, GetFrameOffset( spr, frameIndex ), destx, desty, spr.width, spr.height, 1.0f, colour );
+		return;
+	}
+
+	if( angle != m_rotationCache.angle )
+	{
+		m_rotationCache.angle = angle;
+		PlaySinCos( angle, m_rotationCache.sinAngle, m_rotationCache.cosAngle );
+	}
+
+	float s = m_rotationCache.sinAngle;
+	float c = m_rotationCache.cosAngle;
+	Vector2f origin = { spr.originX, spr.originY };
+	if( !spr.indices.empty() )
+		m_blitter.TransformIndexedPixels( indexed, GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin,
+			AffineRotationScale( s, c, scale, pos ), AffineRotationScaleInverse( s, c, scale, pos ) );
+	else
+		m_blitter.TransformPixels( spr.preMultAlpha, GetFrameOffset( spr, frameIndex ), spr.width, spr.height, origin,
+			AffineRotationScale( s, c, scale, pos ), AffineRotationScaleInverse( s, c, scale, pos ), 1.0f, colour );
+}
+
+int PlayGraphics::GetFontCharWidth( int fontId, char c ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+	LoadSpriteNow( fontId ); // Text can't be laid out without the widths
+	const Sprite& s = vSpriteData[fontId];
+	if( !s.canvasBuffer.pPixels )
+		return static_cast<size_t>( c - 32 ) < s.glyphWidths.size() ? s.glyphWidths[c - 32] : 0;
+	return (s.canvasBuffer.pPixels + ( c - 32 ))->b; // character width hidden in pixel data
+}
+
+
+
+
+//********************************************************************************************************************************
+// Function:	SpriteCollide: function that checks by pixel if two sprites collide
+// Parameters:	s1Xpos, s1Ypos, s2Xpos, s2Ypos = the origin of rotation for both sprites.
+//				s1Id, s2Id = the ids of both sprites
+//				s1angle, s2angle = the angle of rotation for both sprites, clockwise. 0 = unrotated.
+//				s1Pixelcoll, s2Pixelcoll = the top left and bottom right co-ordinates defining the collision rectangle of both sprites
+//				
+// Returns: true if a single pixel or more overlap between the two sprites and false if not.
+// Notes:	rounding errors may cause it not to be pixel perfect.	
+//********************************************************************************************************************************
+bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float angle_1, int s1PixelColl[4], int id_2, Point2f pos_2, int frame_2, float angle_2, int s2PixelColl[4] ) const
+{
+	//transform all co-ordinates of sprite2 into the frame of sprite 1.
+
+	//To do this we'll set up three co-ordinate systems.
+	//X,Y are screen, u,v are sprite 1 and a,b are sprite 2.
+	//The input is position of centre of rotation in screen and position of centre of rotation in sprite1 and sprite2.
+
+	//We define the origin of the sprite1 as the beginning of its buffer.
+	//First I calculate the offset vector for sprite one in the screen.
+	//in sprite offsetu = rotOffX, offsetv = rotOffY.
+	//When I refer to origin of the sprite I mean the 0,0 pixel.
+
+
+	//Next define corners of sprite
+	LoadSpriteNow( id_1 );
+	LoadSpriteNow( id_2 );
+	const Sprite& s1 = vSpriteData[id_1];
+	const Sprite& s2 = vSpriteData[id_2];
+
+	//Convert collision box locations from relative to sprite origin to relative to sprite top left. Hence TL.
+	int s1PixelCollTL[4]{ 0 };
+	int s2PixelCollTL[4]{ 0 };
+
+	for( int i{ 0 }; i < 2; i++ )
+	{
+		s1PixelCollTL[2 * i] = s1PixelColl[2 * i] + s1.originX;
+		s1PixelCollTL[2 * i + 1] = s1PixelColl[2 * i + 1] + s1.originY;
+		s2PixelCollTL[2 * i] = s2PixelColl[2 * i] + s2.originX;
+		s2PixelCollTL[2 * i + 1] = s2PixelColl[2 * i + 1] + s2.originY;
+	}
+
+	//in screen
+	float cosAngle1, sinAngle1;
+	PlaySinCos( angle_1, sinAngle1, cosAngle1 );
+	float offsetSprite1X = cosAngle1 * s1.originX - sinAngle1 * s1.originY;
+	float offsetSprite1Y = cosAngle1 * s1.originY + sinAngle1 * s1.originX;
+
+	//Next I calculate the sprite origin in the screen.
+	float originSprite1X = pos_1.x - offsetSprite1X;
+	float originSprite1Y = pos_1.y - offsetSprite1Y;
+
+	//Repeat for other sprite.
+	float cosAngle2, sinAngle2;
+	PlaySinCos( angle_2, sinAngle2, cosAngle2 );
+	float offsetSprite2X = cosAngle2 * s2.originX - sinAngle2 * s2.originY;
+	float offsetSprite2Y = cosAngle2 * s2.originY + sinAngle2 * s2.originX;
+
+	//Next I calculate the sprite origin in the screen.
+	float originSprite2X = pos_2.x - offsetSprite2X;
+	float originSprite2Y = pos_2.y - offsetSprite2Y;
+
+	//calculate the difference between two sprite origins in screen
+	float originDiffX = originSprite2X - originSprite1X;
+	float originDiffY = originSprite2Y - originSprite1Y;
+
+	//calculation of the difference between two sprite origins in frame of sprite 1.
+	float originDiffu = originDiffX * cosAngle1 + originDiffY * sinAngle1;
+	float originDiffv = originDiffY * cosAngle1 - originDiffX * sinAngle1;
+
+	int s2Width = s2.width;
+	int s2Height = s2.height;
+	int s1Width = s1.width;
+
+	float cosAngleDiff, sinAngleDiff;
+	PlaySinCos( angle_2 - angle_1, sinAngleDiff, cosAngleDiff );
+	//top left, top right, bottom right, bottom left.
+	float s2Cu[4]
+	{
+		0,
+		s2Width * cosAngleDiff,
+		s2Width * cosAngleDiff - s2Height * sinAngleDiff,
+		-s2Height * sinAngleDiff
+	};
+
+	float s2Cv[4]
+	{
+		0,
+		s2Width * sinAngleDiff,
+		s2Width * sinAngleDiff + s2Height * cosAngleDiff,
+		s2Height * cosAngleDiff
+	};
+
+
+	float minCu{ std::numeric_limits<float>::infinity() };
+	float minCv{ std::numeric_limits<float>::infinity() };
+	float maxCu{ -std::numeric_limits<float>::infinity() };
+	float maxCv{ -std::numeric_limits<float>::infinity() };
+
+	//calculate the extremes of the rotated sprite2.
+	for( int i = 0; i < 4; i++ )
+	{
+		minCu = std::min( s2Cu[i], minCu );
+		minCv = std::min( s2Cv[i], minCv );
+		maxCu = std::max( s2Cu[i], maxCu );
+		maxCv = std::max( s2Cv[i], maxCv );
+	}
+
+	//calculate the maximum and minimum positions in the sprite1 frame of the sprite2 corners.
+	float maxu = (originDiffu)+( maxCu );
+	float maxv = (originDiffv)+( maxCv );
+	float minu = (originDiffu)+( minCu );
+	float minv = (originDiffv)+( minCv );
+
+	if( minu > s1PixelCollTL[2] || minv > s1PixelCollTL[3] || maxu < s1PixelCollTL[0] || maxv < s1PixelCollTL[1] )
+	{
+		return false;
+	}
+	else
+	{
+		//wrap both frame indexes just in case.
+		frame_1 = frame_1 % s1.totalCount;
+		frame_2 = frame_2 % s2.totalCount;
+
+		//clip so we loop through sprite 1.
+		//Restrict the range we look in for pixel based collisions.
+		minv = ( minv < s1PixelCollTL[1] ) ? static_cast<float>( s1PixelCollTL[1] ) : minv;
+		maxv = ( maxv > s1PixelCollTL[3] ) ? static_cast<float>( s1PixelCollTL[3] ) : maxv;
+		minu = ( minu < s1PixelCollTL[0] ) ? static_cast<float>( s1PixelCollTL[0] ) : minu;
+		maxu = ( maxu > s1PixelCollTL[2] ) ? static_cast<float>( s1PixelCollTL[2] ) : maxu;
+
+		//Set up the starting position in sprite 2 frame. We know the box corners in u, v relative to the sprite 2 origin but we need to get them in a,b.
+		float minCa = ( minu - originDiffu ) * cosAngleDiff + ( minv - originDiffv ) * sinAngleDiff;
+		float minCb = -( minu - originDiffu ) * sinAngleDiff + ( minv - originDiffv ) * cosAngleDiff;
+
+		//rounding at this point
+		int iminu = static_cast<int>( minu );
+		int iminv = static_cast<int>( minv );
+		int imaxu = static_cast<int>( maxu );
+		int imaxv = static_cast<int>( maxv );
+
+		float startinga = minCa;
+		float startingb = minCb;
+
+		float rowstarta = startinga;
+		float rowstartb = startingb;
+
+		//Set up starting pixel indices for both the sprite 1 canvas and sprite 2 canvas (the canvas pixels may have been freed, leaving just the collision mask)
+		//starting index for the sprite 1 canvas is the minu and minv.
+		int sprite1Index = s1Width * frame_1 + iminu + iminv * s1.canvasBuffer.width;
+
+		//The base index for the sprite2 will just be start of the correct frame in the canvas buffer.
+		int sprite2BaseIndex = s2Width * frame_2;
+		//Define the number which we need to add to get down a row in sprite1.
+		int sprite1ChangeRow = s1.canvasBuffer.width - ( imaxu - iminu );
+
+		//Start of double for loop.
+		//Go through the overlapping region (warning may go out of the buffer of sprite 2.)
+		for( int v{ iminv }; v < imaxv; v++ )
+		{
+			//store a and b to be the start of the row.
+			float a = rowstarta;
+			float b = rowstartb;
+
+			for( int u{ iminu }; u < imaxu; u++ )
+			{
+
+				//Edit this part to add a collision box.
+				//If we are in sprite 2 then extract the look at the pixels.
+				if( a >= s2PixelCollTL[0] && b >= s2PixelCollTL[1] && a < s2PixelCollTL[2] && b < s2PixelCollTL[3] )
+				{
+					int sprite2Pixel = static_cast<int>( a ) + static_cast<int>( b ) * s2.canvasBuffer.width;
+
+					//If both pixels at that position are opaque then there is a collision. 
+					if( IsSpritePixelSolid( s2, sprite2BaseIndex + sprite2Pixel ) && IsSpritePixelSolid( s1, sprite1Index ) )
+					{
+						return true;
+					}
+
+				}
+				//add change in for going along u. go along a row.
+				a += cosAngleDiff;
+				b += -sinAngleDiff;
+
+				sprite1Index++;
+
+			}
+			//increment for row of sprite 1.
+			sprite1Index += sprite1ChangeRow;
+
+			//work out start of next row based on start of previous row. 
+			rowstarta += sinAngleDiff;
+			rowstartb += cosAngleDiff;
+		}
+	}
+	return false;
+}
+
+bool PlayGraphics::IsSpritePixelSolid( const Sprite& s, int pixelIndex ) const
+{
+	if( s.canvasBuffer.pPixels )
+		return s.canvasBuffer.pPixels[pixelIndex].bits > 0x00FFFFFF;
+
+	return ( s.collisionMask[pixelIndex >> 3] >> ( pixelIndex & 7 ) ) & 1;
+}
+
+
+//********************************************************************************************************************************
+// Function:	PreMultiplyAlpha - calculates the (src*srcAlpha) alpha blending calculation in advance as it doesn't change
+// Parameters:	s = the sprite to pre-calculate data for
+// Notes:		Also inverts the alpha ready for the (dest*(1-srcAlpha)) calculation and stores information in the new
+//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped)
+//********************************************************************************************************************************
+void PlayGraphics::PreMultiplyAlpha( const Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF ) const
+{
+	const Pixel* pSourcePixels = source;
+	Pixel* pDestPixels = dest;
+
+	// Iterate through all the pixels in the entire canvas
+	for( int bh = 0; bh < height; bh++ )
+	{
+		for( int bw = 0; bw < width; bw++ )
+		{
+			Pixel src = *pSourcePixels;
+
+			// Separate the channels and calculate src*srcAlpha
+			int srcAlpha = static_cast<int>( ( src.bits >> 24 ) * alphaMultiply );
+
+			int destRed = ( srcAlpha * ( ( src.bits >> 16 ) & 0xFF ) ) >> 8;
+			int destGreen = ( srcAlpha * ( ( src.bits >> 8 ) & 0xFF ) ) >> 8;
+			int destBlue = ( srcAlpha * ( src.bits & 0xFF ) ) >> 8;
+
+			destRed = ( destRed * ( ( colourMultiply.bits >> 16 ) & 0xFF ) ) >> 8;
+			destGreen = ( destGreen * ( ( colourMultiply.bits >> 8 ) & 0xFF ) ) >> 8;
+			destBlue = ( destBlue * ( colourMultiply.bits & 0xFF ) ) >> 8;
+
+			srcAlpha = 0xFF - srcAlpha; // invert the alpha ready to multiply with the destination pixels
+			*pDestPixels = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+
+			if( srcAlpha == 0xFF ) // Completely transparent pixel
+			{
+				int repeats = 0;
+
+				// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
+				// > Any pixels after the last whole frame (if the width doesn't divide exactly) are still inside the row
+				int maxSkip = std::min( maxSkipWidth - ( bw % maxSkipWidth ), width - bw );
+
+				for( int zw = 1; zw < maxSkip; zw++ )
+				{
+					if( ( pSourcePixels + zw )->bits >> 24 == 0x00 ) // Another transparent pixel
+						repeats++;
+					else
+						break;
+				}
+
+				*pDestPixels = 0xFF000000 | repeats; // Doesn't matter what the colour was so we use it to store the skip value
+			}
+
+			pDestPixels++;
+			pSourcePixels++;
+		}
+	}
 }
 
-int PlayGraphics::GetFontCharWidth( int fontId, char c ) const
+//********************************************************************************************************************************
+// Basic drawing functions
+//********************************************************************************************************************************
+
+
+
+void PlayGraphics::DrawPixel( Point2f pos, Pixel srcPix )
 {
-	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-	return (vSpriteData[fontId].canvasBuffer.pPixels + ( c - 32 ))->b; // character width hidden in pixel data
+	// Convert floating point co-ordinates to pixels
+	m_blitter.DrawPixel( static_cast<int>( pos.x + 0.5f ), static_cast<int>( pos.y + 0.5f ), srcPix );
+}
+
+void PlayGraphics::DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
+{
+	// Convert floating point co-ordinates to pixels
+	int x1 = static_cast<int>( startPos.x + 0.5f );
+	int y1 = static_cast<int>( startPos.y + 0.5f );
+	int x2 = static_cast<int>( endPos.x + 0.5f );
+	int y2 = static_cast<int>( endPos.y + 0.5f );
+
+	m_blitter.DrawLine( x1, y1, x2, y2, pix );
+}
+
+
+
+
+void PlayGraphics::DrawRect( Point2f topLeft, Point2f bottomRight, Pixel pix, bool fill )
+{
+	// Convert floating point co-ordinates to pixels
+	int x1 = static_cast<int>( topLeft.x + 0.5f );
+	int x2 = static_cast<int>( bottomRight.x + 0.5f );
+	int y1 = static_cast<int>( topLeft.y + 0.5f );
+	int y2 = static_cast<int>( bottomRight.y + 0.5f );
+
+	if( fill )
+	{
+		for( int x = x1; x < x2; x++ )
+		{
+			for( int y = y1; y < y2; y++ )
+				m_blitter.DrawPixel( x, y, pix );
+		}
+	}
+	else
+	{
+		m_blitter.DrawLine( x1, y1, x2, y1, pix );
+		m_blitter.DrawLine( x2, y1, x2, y2, pix );
+		m_blitter.DrawLine( x2, y2, x1, y2, pix );
+		m_blitter.DrawLine( x1, y2, x1, y1, pix );
+	}
+}
+
+// Private function called by DrawCircle
+void PlayGraphics::DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix )
+{
+	DrawPixel( { posX + offX , posY + offY }, pix );
+	DrawPixel( { posX - offX , posY + offY }, pix );
+	DrawPixel( { posX + offX , posY - offY }, pix );
+	DrawPixel( { posX - offX , posY - offY }, pix );
+	DrawPixel( { posX - offY , posY + offX }, pix );
+	DrawPixel( { posX + offY , posY - offX }, pix );
+	DrawPixel( { posX - offY , posY - offX }, pix );
+	DrawPixel( { posX + offY , posY + offX }, pix );
 }
 
+void PlayGraphics::DrawCircle( Point2f pos, int radius, Pixel pix )
+{
+	// Convert floating point co-ordinates to pixels
+	int x = static_cast<int>( pos.x + 0.5f );
+	int y = static_cast<int>( pos.y + 0.5f );
+
+	int dx = 0;
+	int dy = radius;
+
+	int d = 3 - 2 * radius;
+	DrawCircleOctants( x, y, dx, dy, pix );
+
+	while( dy >= dx )
+	{
+		dx++;
+		if( d > 0 )
+		{
+			dy--;
+			d = static_cast<int>( d + 4 * ( dx - dy ) + 10 );
+		}
+		else
+		{
+			d = static_cast<int>( d + 4 * dx + 6 );
+		}
+		DrawCircleOctants( x, y, dx, dy, pix );
+	}
+};
 
+void PlayGraphics::DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+{
+	if( !pixelData->preMultiplied )
+	{
+		PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
+		pixelData->preMultiplied = true;
+	}
+	m_blitter.BlitPixels( *pixelData, 0, static_cast<int>(pos.x), static_cast<int>(pos.y), pixelData->width, pixelData->height, alpha );
+}
 
 
 //********************************************************************************************************************************
-// Function:	SpriteCollide: function that checks by pixel if two sprites collide
-// Parameters:	s1Xpos, s1Ypos, s2Xpos, s2Ypos = the origin of rotation for both sprites.
-//				s1Id, s2Id = the ids of both sprites
-//				s1angle, s2angle = the angle of rotation for both sprites, clockwise. 0 = unrotated.
-//				s1Pixelcoll, s2Pixelcoll = the top left and bottom right co-ordinates defining the collision rectangle of both sprites
-//				
-// Returns: true if a single pixel or more overlap between the two sprites and false if not.
-// Notes:	rounding errors may cause it not to be pixel perfect.	
+// Debug font functions
 //********************************************************************************************************************************
-bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float angle_1, int s1PixelColl[4], int id_2, Point2f pos_2, int frame_2, float angle_2, int s2PixelColl[4] ) const
+
+// Settings for the embedded debug font
+#define FONT_IMAGE_WIDTH	96
+#define FONT_IMAGE_HEIGHT	36
+#define FONT_CHAR_WIDTH		6
+#define FONT_CHAR_HEIGHT	12
+
+// A 96x36 font image @ 1bpp containing basic ASCII characters from 0x30 (0) to 0x5F (underscore) at 6x12 pixels each
+static const uint32_t debugFontData[] =
 {
-	//transform all co-ordinates of sprite2 into the frame of sprite 1.
+	0x87304178, 0x0800861F, 0xFFFFFFE1, 0x7BBFBE79, 0xF7FE79EF, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EF, 0xFFEE3DFE, 0x6BB86080,	0x1078860F, 0xE3DFFEFE, 
+	0x5BB7FEFB, 0xE7BE7BEF, 0xFFBFFF41, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFDFFEDF, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFEE3DDF, 0x7BB7FEFB, 0xE7BE7BEF, 0xFFFFFFFF, 0x7BB7BEF9, 0xE7BE7BEF,	0xFFFFFFDF, 0x87B001F8, 0x187E87EF, 0xFFFFFFDF, 
+	0x86106104, 0x00007A30, 0x1E7C5061, 0x79E79E79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E,	0x59E79F79, 0xF7DF7B7F, 0x597DA79E, 0x58005F78, 0x30D0037F, 0x477DA79E, 
+	0x59E79F79, 0xF7DE7B7F, 0x597DA79E, 0x59E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x41E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x7DE79F79,	0xF7DE7B7F, 0x5E7DA79E, 0x7DE79E79, 0xF7DE7B7F, 0x5E7DA79E, 0x81E06104, 0x07C17A38, 0xDE01A7A1, 
+	0x06106101, 0xE79E79E0, 0x337F3FFF, 0x79E79EED, 0xE79E79EF, 0xB77FBFFF, 0x79E79FED, 0xE79E79EF,	0xB7BFBFFF, 0x79E79FED, 0xE79A79EF, 0xB7BFBFFF, 0x79E75FED, 0xE79AB5EF, 0x77DFBFFF, 0x05E0E1ED, 0xE79ACC0E, 0xF7DFBFFF, 
+	0x7DE77EED, 0xE79AB7ED, 0xF7EFBFFF, 0x7DE7BEED, 0xE79A7BEB, 0xF7EFBFFF,	0x7DE7BEED, 0xE79A7BE7, 0xF7F7BFFF, 0x7DA7BEED, 0xE79A7BE7, 0xF7F7BCFF, 0x7DD79EED, 0xEB5A7BE7, 0xF7FBBCFF, 0x7C27A1EE, 0x1CE57810, 0x33FB3EC0
+};
+
+void PlayGraphics::DecompressDubugFont( void )
+{
+	const int glyphCount = ( FONT_IMAGE_WIDTH / FONT_CHAR_WIDTH ) * ( FONT_IMAGE_HEIGHT / FONT_CHAR_HEIGHT );
+	m_debugGlyphRows.assign( glyphCount * FONT_CHAR_HEIGHT, 0 );
+
+	for( int y = 0; y < FONT_IMAGE_HEIGHT; y++ )
+	{
+		for( int x = 0; x < FONT_IMAGE_WIDTH; x++ )
+		{
+			int bufferIndex = ( y * FONT_IMAGE_WIDTH ) + x;
+			int dataIndex = bufferIndex / 32;
+			int dataShift = 31 - ( bufferIndex % 32 );
+
+			// A clear bit in the 1bpp image is a pixel
+			if( ( ( debugFontData[dataIndex] >> dataShift ) & 0x01 ) == 0 )
+			{
+				int glyph = ( ( y / FONT_CHAR_HEIGHT ) * ( FONT_IMAGE_WIDTH / FONT_CHAR_WIDTH ) ) + ( x / FONT_CHAR_WIDTH );
+				m_debugGlyphRows[( glyph * FONT_CHAR_HEIGHT ) + ( y % FONT_CHAR_HEIGHT )] |= 1 << ( x % FONT_CHAR_WIDTH );
+			}
+		}
+	}
+}
+
+const uint8_t* PlayGraphics::GetDebugGlyph( char c ) const
+{
+	// Limited character set in the font (0x30-0x5F) so includes translation of useful chars outside that range
+	switch( c )
+	{
+		case 0x2C: c = 0x5E; break; // Map full stop to comma (nearly the same!)
+		case 0x2D: c = 0x3B; break; // Map minus to semi-colon (rarely used)
+		case 0x28: c = 0x5B; break; // Map brackets to square brackets
+		case 0x29: c = 0x5D; break; // Map brackets to square brackets
+		case 0x2E: c = 0x5E; break; // Map full stop to carot (never used)
+	}
+
+	if( c < 0x30 || c > 0x5F )
+		return nullptr;
+
+	return &m_debugGlyphRows[( c - 0x30 ) * FONT_CHAR_HEIGHT];
+}
+
+int PlayGraphics::DrawDebugCharacter( Point2f pos, char c, Pixel pix )
+{
+	if( m_debugGlyphRows.empty() )
+		DecompressDubugFont();
+
+	const uint8_t* pRows = GetDebugGlyph( c );
+	if( pRows == nullptr )
+		return FONT_CHAR_WIDTH;
+
+	// Round once for the whole glyph then fill each row's runs of pixels directly
+	int x = static_cast<int>( floorf( pos.x + 0.5f ) );
+	int y = static_cast<int>( floorf( pos.y + 0.5f ) );
+
+	for( int row = 0; row < FONT_CHAR_HEIGHT; row++ )
+		m_blitter.DrawRowMask( x, y + row, pRows[row], pix );
+
+	return FONT_CHAR_WIDTH;
+}
+
+int PlayGraphics::DrawDebugString( Point2f pos, const std::string& s, Pixel pix, bool centred )
+{
+	if( m_debugGlyphRows.empty() )
+		DecompressDubugFont();
+
+	if( centred )
+		pos.x -= GetDebugStringWidth( s ) / 2;
+
+	pos.y -= 6; // half the height of the debug font
+
+	for( char c : s )
+		pos.x += DrawDebugCharacter( pos, static_cast<char>( toupper( c ) ), pix ) + 1;
+
+	// Return horizontal position at the end of the string so strings can be concatenated easily
+	return static_cast<int>( pos.x );
+}
+
+int PlayGraphics::DrawDebugStringOutlined( Point2f pos, const std::string& s, Pixel pix, Pixel outlinePix, bool centred )
+{
+	if( m_debugGlyphRows.empty() )
+		DecompressDubugFont();
+
+	if( centred )
+		pos.x -= GetDebugStringWidth( s ) / 2;
+
+	pos.y -= 6; // half the height of the debug font
+
+	for( char c : s )
+	{
+		const uint8_t* pRows = GetDebugGlyph( static_cast<char>( toupper( c ) ) );
+
+		if( pRows )
+		{
+			int x = static_cast<int>( floorf( pos.x + 0.5f ) );
+			int y = static_cast<int>( floorf( pos.y + 0.5f ) );
+
+			// The outline spans one extra row and column on every side, so its masks start at x - 1
+			// > A diagonal neighbour is set when the glyph row above or below has a pixel one column either side
+			for( int row = -1; row <= FONT_CHAR_HEIGHT; row++ )
+			{
+				uint32_t above = row > 0 ? pRows[row - 1] : 0;
+				uint32_t below = row < FONT_CHAR_HEIGHT - 1 ? pRows[row + 1] : 0;
+				uint32_t glyph = ( row >= 0 && row < FONT_CHAR_HEIGHT ) ? pRows[row] << 1 : 0;
+				uint32_t outline = ( above | below ) << 1;
+				outline = ( outline << 1 ) | ( outline >> 1 );
+
+				m_blitter.DrawRowMask( x - 1, y + row, outline & ~glyph, outlinePix );
+				m_blitter.DrawRowMask( x - 1, y + row, glyph, pix );
+			}
+		}
+
+		pos.x += FONT_CHAR_WIDTH + 1;
+	}
+
+	return static_cast<int>( pos.x );
+}
+
+int PlayGraphics::GetDebugStringWidth( const std::string& s )
+{
+	return static_cast<int>( s.length() ) * ( FONT_CHAR_WIDTH + 1 );
+}
+
+//********************************************************************************************************************************
+// Timing bar functions
+//********************************************************************************************************************************
+
+long long PlayGraphics::EndTimingSegment()
+{
+	int size = static_cast<int>( m_vTimings.size() );
+
+	long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+	if( size > 0 )
+	{
+		m_vTimings[size - 1].end = now;
+		m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin ) / 1000000.0f;
+	}
+
+	return now;
+}
+
+int PlayGraphics::SetTimingBarColour( Pixel pix )
+{
+	TimingSegment newData;
+	newData.pix = pix;
+	newData.begin = EndTimingSegment();
+
+	m_vTimings.push_back( newData );
+
+	return static_cast<int>( m_vTimings.size() );
+};
+
+void PlayGraphics::DrawTimingBar( Point2f pos, Point2f size )
+{
+	EndTimingSegment();
+
+	int startPixel{ 0 };
+	int endPixel{ 0 };
+	for( const TimingSegment& t : m_vPrevTimings )
+	{
+		endPixel += static_cast<int>( ( size.width * t.millisecs ) / 16.667f );
+		DrawRect( { pos.x + startPixel, pos.y }, { pos.x + endPixel, pos.y + size.height }, t.pix, true );
+		startPixel = endPixel;
+	}
 
-	//To do this we'll set up three co-ordinate systems.
-	//X,Y are screen, u,v are sprite 1 and a,b are sprite 2.
-	//The input is position of centre of rotation in screen and position of centre of rotation in sprite1 and sprite2.
+	DrawRect( { pos.x, pos.y }, { pos.x + size.width, pos.y + size.height }, PIX_BLACK, false );
+	DrawRect( { pos.x - 1, pos.y - 1 }, { pos.x + size.width + 1 , pos.y + size.height + 1 }, PIX_WHITE, false );
+}
 
-	//We define the origin of the sprite1 as the beginning of its buffer.
-	//First I calculate the offset vector for sprite one in the screen.
-	//in sprite offsetu = rotOffX, offsetv = rotOffY.
-	//When I refer to origin of the sprite I mean the 0,0 pixel.
+float PlayGraphics::GetTimingSegmentDuration( int id ) const
+{
+	PLAY_ASSERT_MSG( static_cast<size_t>(id) < m_vTimings.size(), "Invalid id for timing data." );
+	return m_vTimings[id].millisecs;
+}
 
+void PlayGraphics::TimingBarBegin( Pixel pix )
+{
+	EndTimingSegment();
+	m_vPrevTimings = m_vTimings;
+	m_vTimings.clear();
+	SetTimingBarColour( pix );
+}
+//********************************************************************************************************************************
+// File:		PlayCapture.cpp
+// Description:	Records presented frames to disk in the background
+// Platform:	Independent
+// Notes:		The PNG encoder only uses fixed Huffman codes, which keeps it fast enough to keep up with the game on a couple of threads
+//********************************************************************************************************************************
 
-	//Next define corners of sprite
-	const Sprite& s1 = vSpriteData[id_1];
-	const Sprite& s2 = vSpriteData[id_2];
+PlayCapture::PlayCapture( const std::string& path, CaptureFormat format, int width, int height, int framesPerSecond, int workerThreads, int poolSize )
+	: m_path( PlatformPath( path ) ), m_format( format )
+{
+	PLAY_ASSERT_MSG( workerThreads > 0 && poolSize > 0, "A capture needs at least one worker thread and one buffer!" );
 
-	//Convert collision box locations from relative to sprite origin to relative to sprite top left. Hence TL.
-	int s1PixelCollTL[4]{ 0 };
-	int s2PixelCollTL[4]{ 0 };
+	// A directory that can't be created is reported when the first frame fails to write
+	std::filesystem::path directory = std::filesystem::path( m_path ).parent_path();
+	std::error_code error;
+	if( !directory.empty() )
+		std::filesystem::create_directories( directory, error );
 
-	for( int i{ 0 }; i < 2; i++ )
+	if( m_format == CaptureFormat::Y4M )
 	{
-		s1PixelCollTL[2 * i] = s1PixelColl[2 * i] + s1.originX;
-		s1PixelCollTL[2 * i + 1] = s1PixelColl[2 * i + 1] + s1.originY;
-		s2PixelCollTL[2 * i] = s2PixelColl[2 * i] + s2.originX;
-		s2PixelCollTL[2 * i + 1] = s2PixelColl[2 * i + 1] + s2.originY;
+		m_videoFile.open( m_path + ".y4m", std::ios::binary );
+		PLAY_ASSERT_MSG( m_videoFile.is_open(), "Unable to create the capture file!" );
+		// C420jpeg puts the chroma samples in the centre of each 2x2 block of pixels, which is where averaging them puts them
+		m_videoFile << "YUV4MPEG2 W" << width << " H" << height << " F" << framesPerSecond << ":1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
 	}
 
-	//in screen
-	float cosAngle1 = cos( angle_1 );
-	float sinAngle1 = sin( angle_1 );
-	float offsetSprite1X = cosAngle1 * s1.originX - sinAngle1 * s1.originY;
-	float offsetSprite1Y = cosAngle1 * s1.originY + sinAngle1 * s1.originX;
-
-	//Next I calculate the sprite origin in the screen.
-	float originSprite1X = pos_1.x - offsetSprite1X;
-	float originSprite1Y = pos_1.y - offsetSprite1Y;
-
-	//Repeat for other sprite.
-	float cosAngle2 = cos( angle_2 );
-	float sinAngle2 = sin( angle_2 );
-	float offsetSprite2X = cosAngle2 * s2.originX - sinAngle2 * s2.originY;
-	float offsetSprite2Y = cosAngle2 * s2.originY + sinAngle2 * s2.originX;
-
-	//Next I calculate the sprite origin in the screen.
-	float originSprite2X = pos_2.x - offsetSprite2X;
-	float originSprite2Y = pos_2.y - offsetSprite2Y;
+	m_vPool.resize( poolSize );
+	for( PixelData& buffer : m_vPool )
+	{
+		buffer.width = width;
+		buffer.height = height;
+		buffer.pPixels = new Pixel[static_cast<size_t>( width ) * height];
+		m_vFreeBuffers.push_back( &buffer );
+	}
 
-	//calculate the difference between two sprite origins in screen
-	float originDiffX = originSprite2X - originSprite1X;
-	float originDiffY = originSprite2Y - originSprite1Y;
+	for( int n = 0; n < workerThreads; n++ )
+		m_vWorkers.emplace_back( &PlayCapture::EncodeFrames, this );
+}
 
-	//calculation of the difference between two sprite origins in frame of sprite 1.
-	float originDiffu = originDiffX * cosAngle1 + originDiffY * sinAngle1;
-	float originDiffv = originDiffY * cosAngle1 - originDiffX * sinAngle1;
+PlayCapture::~PlayCapture()
+{
+	Finish();
 
-	int s2Width = s2.width;
-	int s2Height = s2.height;
-	int s1Width = s1.width;
+	for( PixelData& buffer : m_vPool )
+		delete[] buffer.pPixels;
+}
 
-	float cosAngleDiff = cos( angle_2 - angle_1 );
-	float sinAngleDiff = sin( angle_2 - angle_1 );
-	//top left, top right, bottom right, bottom left.
-	float s2Cu[4]
+void PlayCapture::CaptureFrame( const PixelData& frame )
+{
+	PixelData* pBuffer = nullptr;
 	{
-		0,
-		s2Width * cosAngleDiff,
-		s2Width * cosAngleDiff - s2Height * sinAngleDiff,
-		-s2Height * sinAngleDiff
-	};
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( m_stopping )
+			return;
 
-	float s2Cv[4]
-	{
-		0,
-		s2Width * sinAngleDiff,
-		s2Width * sinAngleDiff + s2Height * cosAngleDiff,
-		s2Height * cosAngleDiff
-	};
+		if( m_vFreeBuffers.empty() )
+		{
+			m_stats.dropped++;
+			return;
+		}
 
+		pBuffer = m_vFreeBuffers.back();
+		m_vFreeBuffers.pop_back();
+	}
 
-	float minCu{ std::numeric_limits<float>::infinity() };
-	float minCv{ std::numeric_limits<float>::infinity() };
-	float maxCu{ -std::numeric_limits<float>::infinity() };
-	float maxCv{ -std::numeric_limits<float>::infinity() };
+	PLAY_ASSERT_MSG( frame.width == pBuffer->width && frame.height == pBuffer->height, "The captured frame has changed size!" );
+	// The copy is made outside the lock so the workers can carry on with the frames they have
+	memcpy( pBuffer->pPixels, frame.pPixels, sizeof( Pixel ) * frame.width * frame.height );
 
-	//calculate the extremes of the rotated sprite2.
-	for( int i = 0; i < 4; i++ )
 	{
-		minCu = std::min( s2Cu[i], minCu );
-		minCv = std::min( s2Cv[i], minCv );
-		maxCu = std::max( s2Cu[i], maxCu );
-		maxCv = std::max( s2Cv[i], maxCv );
+		std::lock_guard<std::mutex> lock( m_mutex );
+		CapturedFrame captured;
+		captured.index = m_stats.captured++;
+		captured.pBuffer = pBuffer;
+		m_queue.push_back( captured );
 	}
+	m_frameQueued.notify_one();
+}
 
-	//calculate the maximum and minimum positions in the sprite1 frame of the sprite2 corners.
-	float maxu = (originDiffu)+( maxCu );
-	float maxv = (originDiffv)+( maxCv );
-	float minu = (originDiffu)+( minCu );
-	float minv = (originDiffv)+( minCv );
+CaptureStats PlayCapture::GetStats()
+{
+	std::lock_guard<std::mutex> lock( m_mutex );
+	return m_stats;
+}
 
-	if( minu > s1PixelCollTL[2] || minv > s1PixelCollTL[3] || maxu < s1PixelCollTL[0] || maxv < s1PixelCollTL[1] )
+CaptureStats PlayCapture::Finish()
+{
 	{
-		return false;
+		std::lock_guard<std::mutex> lock( m_mutex );
+		m_stopping = true;
 	}
-	else
-	{
-		//wrap both frame indexes just in case.
-		frame_1 = frame_1 % s1.totalCount;
-		frame_2 = frame_2 % s2.totalCount;
+	m_frameQueued.notify_all();
 
-		//clip so we loop through sprite 1.
-		//Restrict the range we look in for pixel based collisions.
-		minv = ( minv < s1PixelCollTL[1] ) ? static_cast<float>( s1PixelCollTL[1] ) : minv;
-		maxv = ( maxv > s1PixelCollTL[3] ) ? static_cast<float>( s1PixelCollTL[3] ) : maxv;
-		minu = ( minu < s1PixelCollTL[0] ) ? static_cast<float>( s1PixelCollTL[0] ) : minu;
-		maxu = ( maxu > s1PixelCollTL[2] ) ? static_cast<float>( s1PixelCollTL[2] ) : maxu;
+	for( std::thread& worker : m_vWorkers )
+		worker.join();
+	m_vWorkers.clear();
 
-		//Set up the starting position in sprite 2 frame. We know the box corners in u, v relative to the sprite 2 origin but we need to get them in a,b.
-		float minCa = ( minu - originDiffu ) * cosAngleDiff + ( minv - originDiffv ) * sinAngleDiff;
-		float minCb = -( minu - originDiffu ) * sinAngleDiff + ( minv - originDiffv ) * cosAngleDiff;
+	if( m_videoFile.is_open() )
+		m_videoFile.close();
 
-		//rounding at this point
-		int iminu = static_cast<int>( minu );
-		int iminv = static_cast<int>( minv );
-		int imaxu = static_cast<int>( maxu );
-		int imaxv = static_cast<int>( maxv );
+	return GetStats();
+}
 
-		float startinga = minCa;
-		float startingb = minCb;
+void PlayCapture::EncodeFrames()
+{
+	std::vector<uint8_t> encoded;
 
-		float rowstarta = startinga;
-		float rowstartb = startingb;
+	for( ;; )
+	{
+		CapturedFrame frame;
+		{
+			std::unique_lock<std::mutex> lock( m_mutex );
+			m_frameQueued.wait( lock, [this] { return m_stopping || !m_queue.empty(); } );
+			// The queue is always emptied before stopping
+			if( m_queue.empty() )
+				return;
+			frame = m_queue.front();
+			m_queue.pop_front();
+		}
 
-		//Set up starting and finishing pointers for both the sprite 1 buffer and sprite 2 buffer 
-		//starting pointer for the sprite 1 buffer is the minu and minv.
-		int sprite1Offset = s1Width * frame_1 + iminu + iminv * s1.canvasBuffer.width;
-		Pixel* sprite1Src = s1.canvasBuffer.pPixels + sprite1Offset;
+		const PixelData& image = *frame.pBuffer;
+		if( m_format == CaptureFormat::PNG_SEQUENCE )
+			EncodePNG( image, encoded );
+		else
+		{
+			size_t lumaSize = static_cast<size_t>( image.width ) * image.height;
+			size_t chromaSize = static_cast<size_t>( ( image.width + 1 ) / 2 ) * ( ( image.height + 1 ) / 2 );
+			encoded.resize( 6 + lumaSize + 2 * chromaSize );
+			memcpy( encoded.data(), "FRAME\n", 6 );
+			ConvertToYUV420( image, encoded.data() + 6, encoded.data() + 6 + lumaSize, encoded.data() + 6 + lumaSize + chromaSize );
+		}
 
-		//The base pointer for the sprite2 will just be start of the correct frame in the canvas buffer.
-		int sprite2Offset = s2Width * frame_2;
-		Pixel* sprite2Base = s2.canvasBuffer.pPixels + sprite2Offset;
-		//Define the number which we need to add to get down a row in sprite1.
-		int sprite1ChangeRow = s1.canvasBuffer.width - ( imaxu - iminu );
+		// The buffer can be reused as soon as it has been encoded
+		{
+			std::lock_guard<std::mutex> lock( m_mutex );
+			m_vFreeBuffers.push_back( frame.pBuffer );
+		}
 
-		//Start of double for loop.
-		//Go through the overlapping region (warning may go out of the buffer of sprite 2.)
-		for( int v{ iminv }; v < imaxv; v++ )
+		std::string filename = m_path;
+		bool written = false;
+		if( m_format == CaptureFormat::PNG_SEQUENCE )
 		{
-			//store a and b to be the start of the row.
-			float a = rowstarta;
-			float b = rowstartb;
+			char suffix[16];
+			snprintf( suffix, sizeof( suffix ), "_%06d.png", frame.index );
+			filename += suffix;
+			std::ofstream file( filename, std::ios::binary );
+			file.write( reinterpret_cast<const char*>( encoded.data() ), encoded.size() );
+			written = file.good();
+		}
+		else
+		{
+			// Frames are converted in parallel, but must be written to the video in order
+			std::unique_lock<std::mutex> lock( m_mutex );
+			m_frameWritten.wait( lock, [&] { return m_nextFrameToWrite == frame.index; } );
+			lock.unlock();
+			m_videoFile.write( reinterpret_cast<const char*>( encoded.data() ), encoded.size() );
+			written = m_videoFile.good();
+			lock.lock();
+			m_nextFrameToWrite++;
+			m_frameWritten.notify_all();
+		}
 
-			for( int u{ iminu }; u < imaxu; u++ )
-			{
+		std::lock_guard<std::mutex> lock( m_mutex );
+		if( written )
+		{
+			m_stats.encoded++;
+			continue;
+		}
 
-				//Edit this part to add a collision box.
-				//If we are in sprite 2 then extract the look at the pixels.
-				if( a >= s2PixelCollTL[0] && b >= s2PixelCollTL[1] && a < s2PixelCollTL[2] && b < s2PixelCollTL[3] )
-				{
-					int sprite2Pixel = static_cast<int>( a ) + static_cast<int>( b ) * s2.canvasBuffer.width;
-					Pixel sprite2Src = *( sprite2Base + sprite2Pixel );
+		// Only the first failure is reported, as the rest of the frames will usually fail for the same reason
+		if( m_stats.failed++ == 0 )
+			DebugOutput( "PlayCapture: Unable to write " + filename + "\n" );
+	}
+}
 
-					//If both pixels at that position are opaque then there is a collision. 
-					if( sprite2Src.bits > 0x00FFFFFF && (*sprite1Src).bits > 0x00FFFFFF )
-					{
-						return true;
-					}
+//********************************************************************************************************************************
+// PNG encoding
+//********************************************************************************************************************************
 
-				}
-				//add change in for going along u. go along a row.
-				a += cosAngleDiff;
-				b += -sinAngleDiff;
+// The lookup tables used by the PNG encoder
+struct PNGEncoderTables
+{
+	PNGEncoderTables()
+	{
+		for( uint32_t n = 0; n < 256; n++ )
+		{
+			uint32_t c = n;
+			for( int k = 0; k < 8; k++ )
+				c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+			crc[n] = c;
+		}
 
-				sprite1Src++;
+		// The fixed Huffman codes from the deflate specification, bit-reversed as deflate writes them from the top bit down
+		for( int symbol = 0; symbol < 288; symbol++ )
+		{
+			uint32_t code;
+			if( symbol < 144 ) { code = 0x30 + symbol; literalLength[symbol] = 8; }
+			else if( symbol < 256 ) { code = 0x190 + symbol - 144; literalLength[symbol] = 9; }
+			else if( symbol < 280 ) { code = symbol - 256; literalLength[symbol] = 7; }
+			else { code = 0xC0 + symbol - 280; literalLength[symbol] = 8; }
+
+			literalCode[symbol] = 0;
+			for( int bit = 0; bit < literalLength[symbol]; bit++ )
+				literalCode[symbol] |= ( ( code >> bit ) & 1 ) << ( literalLength[symbol] - 1 - bit );
+		}
 
-			}
-			//increment for row of sprite 1.
-			sprite1Src += sprite1ChangeRow;
+		for( int code = 0; code < 29; code++ )
+			for( int length = lengthBase[code]; length < ( code == 28 ? 259 : lengthBase[code + 1] ); length++ )
+				lengthCode[length] = static_cast<uint8_t>( code );
 
-			//work out start of next row based on start of previous row. 
-			rowstarta += sinAngleDiff;
-			rowstartb += cosAngleDiff;
-		}
+		// Distance codes are all 5 bits long
+		for( int code = 0; code < 30; code++ )
+			for( int bit = 0; bit < 5; bit++ )
+				distanceCode[code] |= ( ( code >> bit ) & 1 ) << ( 4 - bit );
 	}
-	return false;
+
+	static constexpr uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static constexpr uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static constexpr uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static constexpr uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	uint32_t crc[256]{};
+	uint16_t literalCode[288]{};
+	uint8_t literalLength[288]{};
+	uint8_t lengthCode[259]{};
+	uint8_t distanceCode[30]{};
+};
+
+// Gets the encoder tables, which are built the first time they are needed
+static const PNGEncoderTables& GetPNGEncoderTables()
+{
+	static const PNGEncoderTables tables;
+	return tables;
 }
 
+// Appends a 32-bit value in the big-endian byte order used by PNG files
+static void WritePNGUint32( std::vector<uint8_t>& out, uint32_t value )
+{
+	out.push_back( static_cast<uint8_t>( value >> 24 ) );
+	out.push_back( static_cast<uint8_t>( value >> 16 ) );
+	out.push_back( static_cast<uint8_t>( value >> 8 ) );
+	out.push_back( static_cast<uint8_t>( value ) );
+}
 
+// Appends a PNG chunk, adding its length and CRC
+static void WritePNGChunk( std::vector<uint8_t>& png, const char* type, const uint8_t* pData, size_t size )
+{
+	const PNGEncoderTables& tables = GetPNGEncoderTables();
+	WritePNGUint32( png, static_cast<uint32_t>( size ) );
+	size_t start = png.size();
+	png.insert( png.end(), type, type + 4 );
+	png.insert( png.end(), pData, pData + size );
 
+	uint32_t crc = 0xFFFFFFFFu;
+	for( size_t n = start; n < png.size(); n++ )
+		crc = tables.crc[( crc ^ png[n] ) & 0xFF] ^ ( crc >> 8 );
+	WritePNGUint32( png, crc ^ 0xFFFFFFFFu );
+}
 
-//********************************************************************************************************************************
-// Function:	PreMultiplyAlpha - calculates the (src*srcAlpha) alpha blending calculation in advance as it doesn't change
-// Parameters:	s = the sprite to pre-calculate data for
-// Notes:		Also inverts the alpha ready for the (dest*(1-srcAlpha)) calculation and stores information in the new
-//				buffer which provides the number of fully-transparent pixels in a row (so they can be skipped)
-//********************************************************************************************************************************
-void PlayGraphics::PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply = 1.0f, Pixel colourMultiply = 0x00FFFFFF )
+// Compresses data into a zlib stream made of a single block of fixed Huffman codes
+// > Repeats are found with a hash table of the last position each three byte sequence was seen at, trading some size for speed
+static void DeflateFixed( const std::vector<uint8_t>& in, std::vector<uint8_t>& out )
 {
-	Pixel* pSourcePixels = source;
-	Pixel* pDestPixels = dest;
+	const PNGEncoderTables& tables = GetPNGEncoderTables();
+	constexpr int HASH_BITS = 15;
+	constexpr size_t WINDOW_SIZE = 32768;
 
-	// Iterate through all the pixels in the entire canvas
-	for( int bh = 0; bh < height; bh++ )
+	out.clear();
+	out.reserve( in.size() / 4 + 64 );
+	out.push_back( 0x78 ); // Deflate with a 32K window
+	out.push_back( 0x01 ); // No preset dictionary, fastest compression level
+
+	uint32_t bitBuffer = 0;
+	int bitCount = 0;
+	auto WriteBits = [&]( uint32_t value, int count )
 	{
-		for( int bw = 0; bw < width; bw++ )
+		bitBuffer |= value << bitCount;
+		bitCount += count;
+		while( bitCount >= 8 )
 		{
-			Pixel src = *pSourcePixels;
+			out.push_back( static_cast<uint8_t>( bitBuffer ) );
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	};
+	auto WriteSymbol = [&]( int symbol ) { WriteBits( tables.literalCode[symbol], tables.literalLength[symbol] ); };
 
-			// Separate the channels and calculate src*srcAlpha
-			int srcAlpha = static_cast<int>( ( src.bits >> 24 ) * alphaMultiply );
+	WriteBits( 1, 1 ); // The final block
+	WriteBits( 1, 2 ); // Fixed Huffman codes
 
-			int destRed = ( srcAlpha * ( ( src.bits >> 16 ) & 0xFF ) ) >> 8;
-			int destGreen = ( srcAlpha * ( ( src.bits >> 8 ) & 0xFF ) ) >> 8;
-			int destBlue = ( srcAlpha * ( src.bits & 0xFF ) ) >> 8;
+	static thread_local std::vector<int32_t> head;
+	head.assign( size_t( 1 ) << HASH_BITS, -1 );
+	auto Hash = [&]( size_t pos ) { return ( ( in[pos] | ( in[pos + 1] << 8 ) | ( in[pos + 2] << 16 ) ) * 2654435761u ) >> ( 32 - HASH_BITS ); };
 
-			destRed = ( destRed * ( ( colourMultiply.bits >> 16 ) & 0xFF ) ) >> 8;
-			destGreen = ( destGreen * ( ( colourMultiply.bits >> 8 ) & 0xFF ) ) >> 8;
-			destBlue = ( destBlue * ( colourMultiply.bits & 0xFF ) ) >> 8;
+	size_t size = in.size();
+	size_t pos = 0;
+	while( pos < size )
+	{
+		size_t matchLength = 0;
+		size_t distance = 0;
 
-			srcAlpha = 0xFF - srcAlpha; // invert the alpha ready to multiply with the destination pixels
-			*pDestPixels = ( srcAlpha << 24 ) | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+		if( pos + 3 <= size )
+		{
+			uint32_t hash = Hash( pos );
+			int32_t candidate = head[hash];
+			head[hash] = static_cast<int32_t>( pos );
 
-			if( srcAlpha == 0xFF ) // Completely transparent pixel
+			if( candidate >= 0 && pos - candidate <= WINDOW_SIZE )
 			{
-				int repeats = 0;
+				size_t maxLength = std::min<size_t>( 258, size - pos );
+				const uint8_t* a = &in[pos];
+				const uint8_t* b = &in[candidate];
+				while( matchLength < maxLength && a[matchLength] == b[matchLength] )
+					matchLength++;
+				distance = pos - candidate;
+			}
+		}
 
-				// We can only skip to the end of the row because the sprite frames are arranged on a continuous canvas
-				int maxSkip = maxSkipWidth - ( bw % maxSkipWidth );
+		if( matchLength < 3 )
+		{
+			WriteSymbol( in[pos++] );
+			continue;
+		}
 
-				for( int zw = 1; zw < maxSkip; zw++ )
-				{
-					if( ( pSourcePixels + zw )->bits >> 24 == 0x00 ) // Another transparent pixel
-						repeats++;
-					else
-						break;
-				}
+		int lengthCode = tables.lengthCode[matchLength];
+		WriteSymbol( 257 + lengthCode );
+		WriteBits( static_cast<uint32_t>( matchLength - tables.lengthBase[lengthCode] ), tables.lengthExtra[lengthCode] );
 
-				*pDestPixels = 0xFF000000 | repeats; // Doesn't matter what the colour was so we use it to store the skip value
-			}
+		int distanceCode = 29;
+		while( tables.distanceBase[distanceCode] > distance )
+			distanceCode--;
+		WriteBits( tables.distanceCode[distanceCode], 5 );
+		WriteBits( static_cast<uint32_t>( distance - tables.distanceBase[distanceCode] ), tables.distanceExtra[distanceCode] );
 
-			pDestPixels++;
-			pSourcePixels++;
+		// Remember the positions inside the match too, so later repeats of them can be found
+		size_t end = pos + matchLength;
+		for( pos++; pos < end; pos++ )
+			if( pos + 3 <= size )
+				head[Hash( pos )] = static_cast<int32_t>( pos );
+	}
+
+	WriteSymbol( 256 ); // End of block
+	if( bitCount > 0 )
+		out.push_back( static_cast<uint8_t>( bitBuffer ) );
+
+	uint32_t a = 1, b = 0;
+	for( size_t n = 0; n < size; )
+	{
+		// The sums can be left to grow for 5552 bytes before they need reducing
+		size_t blockEnd = std::min( size, n + 5552 );
+		for( ; n < blockEnd; n++ )
+		{
+			a += in[n];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	WritePNGUint32( out, ( b << 16 ) | a );
+}
+
+void PlayCapture::EncodePNG( const PixelData& image, std::vector<uint8_t>& png )
+{
+	// Each row starts with a filter type: the Sub filter stores each byte as the difference from the same channel of the pixel to its left
+	static thread_local std::vector<uint8_t> filtered;
+	static thread_local std::vector<uint8_t> compressed;
+	size_t rowBytes = 1 + 3 * static_cast<size_t>( image.width );
+	filtered.resize( rowBytes * image.height );
+
+	for( int y = 0; y < image.height; y++ )
+	{
+		const Pixel* pSource = image.pPixels + static_cast<size_t>( y ) * image.width;
+		uint8_t* pRow = &filtered[rowBytes * y];
+		*pRow++ = 1;
+
+		uint32_t previous = 0;
+		for( int x = 0; x < image.width; x++ )
+		{
+			uint32_t bits = pSource[x].bits;
+			*pRow++ = static_cast<uint8_t>( ( bits >> 16 ) - ( previous >> 16 ) );
+			*pRow++ = static_cast<uint8_t>( ( bits >> 8 ) - ( previous >> 8 ) );
+			*pRow++ = static_cast<uint8_t>( bits - previous );
+			previous = bits;
 		}
 	}
+
+	DeflateFixed( filtered, compressed );
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	png.assign( signature, signature + 8 );
+
+	std::vector<uint8_t> header;
+	WritePNGUint32( header, image.width );
+	WritePNGUint32( header, image.height );
+	header.push_back( 8 ); // Bit depth
+	header.push_back( 2 ); // Colour type: RGB
+	header.push_back( 0 ); // Compression method
+	header.push_back( 0 ); // Filter method
+	header.push_back( 0 ); // Not interlaced
+
+	WritePNGChunk( png, "IHDR", header.data(), header.size() );
+	WritePNGChunk( png, "IDAT", compressed.data(), compressed.size() );
+	WritePNGChunk( png, "IEND", nullptr, 0 );
 }
 
 //********************************************************************************************************************************
-// Basic drawing functions
+// YUV conversion
 //********************************************************************************************************************************
 
+// BT.601 limited range coefficients (scaled by 256) for a pixel's blue, green, red and alpha channels
+constexpr int YUV_Y[4] = { 25, 129, 66, 0 };
+constexpr int YUV_U[4] = { 112, -74, -38, 0 };
+constexpr int YUV_V[4] = { -18, -94, 112, 0 };
 
-
-void PlayGraphics::DrawPixel( Point2f pos, Pixel srcPix )
+// Converts the colour of a single pixel to Y, U or V using the coefficients given
+static inline uint8_t ConvertToYUV( uint32_t bits, const int coefficients[4], int offset )
 {
-	// Convert floating point co-ordinates to pixels
-	m_blitter.DrawPixel( static_cast<int>( pos.x + 0.5f ), static_cast<int>( pos.y + 0.5f ), srcPix );
+	int sum = coefficients[0] * static_cast<int>( bits & 0xFF ) + coefficients[1] * static_cast<int>( ( bits >> 8 ) & 0xFF ) + coefficients[2] * static_cast<int>( ( bits >> 16 ) & 0xFF );
+	return static_cast<uint8_t>( ( ( sum + 128 ) >> 8 ) + offset );
 }
 
-void PlayGraphics::DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
+// Averages the channels of two pixels, rounding up in the same way as _mm_avg_epu8
+static inline uint32_t AveragePixels( uint32_t a, uint32_t b )
 {
-	// Convert floating point co-ordinates to pixels
-	int x1 = static_cast<int>( startPos.x + 0.5f );
-	int y1 = static_cast<int>( startPos.y + 0.5f );
-	int x2 = static_cast<int>( endPos.x + 0.5f );
-	int y2 = static_cast<int>( endPos.y + 0.5f );
+	return ( a | b ) - ( ( ( a ^ b ) >> 1 ) & 0x7F7F7F7F );
+}
 
-	m_blitter.DrawLine( x1, y1, x2, y2, pix );
+#ifdef PLAY_SSE2
+// Multiplies the channels of four pixels by the coefficients given and sums them for each pixel
+static inline __m128i WeightedSum4( __m128i pixels, __m128i coefficients )
+{
+	const __m128i zero = _mm_setzero_si128();
+	// _mm_madd_epi16 adds pairs of products, leaving blue + green and red + alpha for each pixel
+	__m128 low = _mm_castsi128_ps( _mm_madd_epi16( _mm_unpacklo_epi8( pixels, zero ), coefficients ) );
+	__m128 high = _mm_castsi128_ps( _mm_madd_epi16( _mm_unpackhi_epi8( pixels, zero ), coefficients ) );
+	__m128i even = _mm_castps_si128( _mm_shuffle_ps( low, high, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+	__m128i odd = _mm_castps_si128( _mm_shuffle_ps( low, high, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+	return _mm_add_epi32( even, odd );
 }
 
+// Scales the sums down from WeightedSum4, adds the offset and packs the results into four bytes
+static inline int PackYUV4( __m128i sums, int offset )
+{
+	__m128i values = _mm_add_epi32( _mm_srai_epi32( _mm_add_epi32( sums, _mm_set1_epi32( 128 ) ), 8 ), _mm_set1_epi32( offset ) );
+	values = _mm_packs_epi32( values, values );
+	return _mm_cvtsi128_si32( _mm_packus_epi16( values, values ) );
+}
+#endif
 
+void PlayCapture::ConvertToYUV420( const PixelData& image, uint8_t* pY, uint8_t* pU, uint8_t* pV )
+{
+	const int width = image.width;
+	const int height = image.height;
+	const int chromaWidth = ( width + 1 ) / 2;
 
+#ifdef PLAY_SSE2
+	const __m128i yCoefficients = _mm_setr_epi16( YUV_Y[0], YUV_Y[1], YUV_Y[2], YUV_Y[3], YUV_Y[0], YUV_Y[1], YUV_Y[2], YUV_Y[3] );
+	const __m128i uCoefficients = _mm_setr_epi16( YUV_U[0], YUV_U[1], YUV_U[2], YUV_U[3], YUV_U[0], YUV_U[1], YUV_U[2], YUV_U[3] );
+	const __m128i vCoefficients = _mm_setr_epi16( YUV_V[0], YUV_V[1], YUV_V[2], YUV_V[3], YUV_V[0], YUV_V[1], YUV_V[2], YUV_V[3] );
+#endif
 
-void PlayGraphics::DrawRect( Point2f topLeft, Point2f bottomRight, Pixel pix, bool fill )
-{
-	// Convert floating point co-ordinates to pixels
-	int x1 = static_cast<int>( topLeft.x + 0.5f );
-	int x2 = static_cast<int>( bottomRight.x + 0.5f );
-	int y1 = static_cast<int>( topLeft.y + 0.5f );
-	int y2 = static_cast<int>( bottomRight.y + 0.5f );
+	// Each pass converts two rows of luma and the row of chroma they share
+	for( int y = 0; y < height; y += 2 )
+	{
+		const Pixel* pRow0 = image.pPixels + static_cast<size_t>( y ) * width;
+		// The last row is repeated for images with an odd height
+		const Pixel* pRow1 = y + 1 < height ? pRow0 + width : pRow0;
+		uint8_t* pY0 = pY + static_cast<size_t>( y ) * width;
+		uint8_t* pY1 = y + 1 < height ? pY0 + width : nullptr;
+		uint8_t* pURow = pU + static_cast<size_t>( y / 2 ) * chromaWidth;
+		uint8_t* pVRow = pV + static_cast<size_t>( y / 2 ) * chromaWidth;
+
+		int x = 0;
+#ifdef PLAY_SSE2
+		// Eight pixels from each row at a time
+		for( ; x + 8 <= width; x += 8 )
+		{
+			__m128i row0a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow0 + x ) );
+			__m128i row0b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow0 + x + 4 ) );
+			__m128i row1a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow1 + x ) );
+			__m128i row1b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pRow1 + x + 4 ) );
+
+			int y0a = PackYUV4( WeightedSum4( row0a, yCoefficients ), 16 );
+			int y0b = PackYUV4( WeightedSum4( row0b, yCoefficients ), 16 );
+			memcpy( pY0 + x, &y0a, 4 );
+			memcpy( pY0 + x + 4, &y0b, 4 );
+			if( pY1 )
+			{
+				int y1a = PackYUV4( WeightedSum4( row1a, yCoefficients ), 16 );
+				int y1b = PackYUV4( WeightedSum4( row1b, yCoefficients ), 16 );
+				memcpy( pY1 + x, &y1a, 4 );
+				memcpy( pY1 + x + 4, &y1b, 4 );
+			}
 
-	if( fill )
-	{
-		for( int x = x1; x < x2; x++ )
+			// Average vertically, then each pair of neighbouring pixels, leaving one pixel per 2x2 block in the even lanes
+			__m128i averageA = _mm_avg_epu8( row0a, row1a );
+			__m128i averageB = _mm_avg_epu8( row0b, row1b );
+			averageA = _mm_avg_epu8( averageA, _mm_srli_epi64( averageA, 32 ) );
+			averageB = _mm_avg_epu8( averageB, _mm_srli_epi64( averageB, 32 ) );
+			__m128i blocks = _mm_castps_si128( _mm_shuffle_ps( _mm_castsi128_ps( averageA ), _mm_castsi128_ps( averageB ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+
+			int u = PackYUV4( WeightedSum4( blocks, uCoefficients ), 128 );
+			int v = PackYUV4( WeightedSum4( blocks, vCoefficients ), 128 );
+			memcpy( pURow + x / 2, &u, 4 );
+			memcpy( pVRow + x / 2, &v, 4 );
+		}
+#endif
+		for( ; x < width; x += 2 )
 		{
-			for( int y = y1; y < y2; y++ )
-				m_blitter.DrawPixel( x, y, pix );
+			// The last column is repeated for images with an odd width
+			int x1 = x + 1 < width ? x + 1 : x;
+			pY0[x] = ConvertToYUV( pRow0[x].bits, YUV_Y, 16 );
+			if( x1 != x )
+				pY0[x1] = ConvertToYUV( pRow0[x1].bits, YUV_Y, 16 );
+			if( pY1 )
+			{
+				pY1[x] = ConvertToYUV( pRow1[x].bits, YUV_Y, 16 );
+				if( x1 != x )
+					pY1[x1] = ConvertToYUV( pRow1[x1].bits, YUV_Y, 16 );
+			}
+
+			uint32_t block = AveragePixels( AveragePixels( pRow0[x].bits, pRow1[x].bits ), AveragePixels( pRow0[x1].bits, pRow1[x1].bits ) );
+			pURow[x / 2] = ConvertToYUV( block, YUV_U, 128 );
+			pVRow[x / 2] = ConvertToYUV( block, YUV_V, 128 );
 		}
 	}
-	else
-	{
-		m_blitter.DrawLine( x1, y1, x2, y1, pix );
-		m_blitter.DrawLine( x2, y1, x2, y2, pix );
-		m_blitter.DrawLine( x2, y2, x1, y2, pix );
-		m_blitter.DrawLine( x1, y2, x1, y1, pix );
-	}
 }
 
-// Private function called by DrawCircle
-void PlayGraphics::DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix )
+//********************************************************************************************************************************
+// File:		PlaySpeaker.cpp
+// Description:	Implementation of a very simple audio manager using the MCI, and a software mixer for .wav sounds
+// Platform:	Windows or headless
+// Notes:		MP3 sounds use the MCI. The Windows multimedia library is extremely basic, but very quick easy to work with. 
+//				Playback isn't always instantaneous and can trigger small frame glitches when StartSound is called. 
+//				WAV sounds avoid this: they're decoded up front and mixed on an audio thread, which the game only
+//				passes commands to through a queue. Headless builds keep track of the MP3 sounds but are silent.
+//				The HelloWorld sample uses .wav for its sound effects and .mp3 only for its music.
+//********************************************************************************************************************************
+
+#ifndef PLAY_PLATFORM_HEADLESS
+// Instruct Visual Studio to link the multimedia library  
+#pragma comment(lib, "winmm.lib")
+#endif // PLAY_PLATFORM_HEADLESS
+
+PlayAudio* PlayAudio::s_pInstance = nullptr;
+
+// Sends a command string to the MCI (or nowhere when headless)
+static void SendAudioCommand( const std::string& command )
 {
-	DrawPixel( { posX + offX , posY + offY }, pix );
-	DrawPixel( { posX - offX , posY + offY }, pix );
-	DrawPixel( { posX + offX , posY - offY }, pix );
-	DrawPixel( { posX - offX , posY - offY }, pix );
-	DrawPixel( { posX - offY , posY + offX }, pix );
-	DrawPixel( { posX + offY , posY - offX }, pix );
-	DrawPixel( { posX - offY , posY - offX }, pix );
-	DrawPixel( { posX + offY , posY + offX }, pix );
+#ifndef PLAY_PLATFORM_HEADLESS
+	mciSendStringA( command.c_str(), NULL, 0, 0 );
+#else
+	(void)command;
+#endif // PLAY_PLATFORM_HEADLESS
 }
 
-void PlayGraphics::DrawCircle( Point2f pos, int radius, Pixel pix )
+//********************************************************************************************************************************
+// Constructor and destructor (private)
+//********************************************************************************************************************************
+PlayAudio::PlayAudio( const char* path )
 {
-	// Convert floating point co-ordinates to pixels
-	int x = static_cast<int>( pos.x + 0.5f );
-	int y = static_cast<int>( pos.y + 0.5f );
-
-	int dx = 0;
-	int dy = radius;
+	PLAY_ASSERT_MSG( !s_pInstance, "PlayAudio is a singleton class: multiple instances not allowed!" );
+	PLAY_ASSERT_MSG( std::filesystem::is_directory( PlatformPath( path ) ), "Audio directory does not exist!" );
 
-	int d = 3 - 2 * radius;
-	DrawCircleOctants( x, y, dx, dy, pix );
+	std::vector< std::string > vWavFiles;
+	std::vector< int > vWavSounds;
 
-	while( dy >= dx )
+	// Iterate through the directory
+	for( auto& p : std::filesystem::directory_iterator( PlatformPath( path ) ) )
 	{
-		dx++;
-		if( d > 0 )
+		// Switch everything to uppercase to avoid need to check case each time
+		std::string filename = p.path().string();
+		for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+
+		// Only load .mp3 and .wav files
+		bool mp3 = filename.find( ".MP3" ) != std::string::npos;
+		bool wav = filename.find( ".WAV" ) != std::string::npos;
+		if( !mp3 && !wav )
+			continue;
+
+		Sound sound;
+		sound.filename = filename;
+		if( mp3 )
 		{
-			dy--;
-			d = static_cast<int>( d + 4 * ( dx - dy ) + 10 );
+			sound.playCommand = "play " + filename + " from 0";
+			sound.loopCommand = sound.playCommand + " repeat";
+			sound.stopCommand = "stop " + filename;
+
+			std::string command = "open \"" + filename + "\" type mpegvideo alias " + filename;
+			SendAudioCommand( command );
 		}
 		else
 		{
-			d = static_cast<int>( d + 4 * dx + 6 );
+			vWavFiles.push_back( p.path().string() );
+			vWavSounds.push_back( static_cast<int>( vSounds.size() ) );
 		}
-		DrawCircleOctants( x, y, dx, dy, pix );
+		vSounds.push_back( sound );
+		m_soundIndex.emplace( HashSpriteName( p.path().stem().string().c_str() ).value, static_cast<int>( vSounds.size() ) - 1 );
 	}
-};
 
-void PlayGraphics::DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+	// Decode the .wav files on worker threads as they're read
+	ReadFileBatch( vWavFiles, [&]( int index, std::vector< uint8_t >& bytes )
+	{
+		Sound& sound = vSounds[vWavSounds[index]];
+		sound.mixed = DecodeWav( bytes, sound.samples );
+	} );
+
+	for( int soundId : vWavSounds )
+		PLAY_ASSERT_MSG( vSounds[soundId].mixed, std::string( "Unable to decode .wav file: " + vSounds[soundId].filename ).c_str() );
+
+	if( !vWavSounds.empty() )
+		StartMixer();
+
+	s_pInstance = this;
+}
+
+PlayAudio::~PlayAudio( void )
 {
-	if( !pixelData->preMultiplied )
+	StopMixer();
+
+	for( Sound& s : vSounds )
 	{
-		PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
-		pixelData->preMultiplied = true;
+		if( s.mixed )
+			continue;
+		std::string command = "close " + s.filename;
+		SendAudioCommand( command );
 	}
-	m_blitter.BlitPixels( *pixelData, 0, static_cast<int>(pos.x), static_cast<int>(pos.y), pixelData->width, pixelData->height, alpha );
-}
 
+	s_pInstance = nullptr;
+}
 
 //********************************************************************************************************************************
-// Debug font functions
+// Instance access functions
 //********************************************************************************************************************************
 
-// Settings for the embedded debug font
-#define FONT_IMAGE_WIDTH	96
-#define FONT_IMAGE_HEIGHT	36
-#define FONT_CHAR_WIDTH		6
-#define FONT_CHAR_HEIGHT	12
-
-// A 96x36 font image @ 1bpp containing basic ASCII characters from 0x30 (0) to 0x5F (underscore) at 6x12 pixels each
-static const uint32_t debugFontData[] =
+PlayAudio& PlayAudio::Instance()
 {
-	0x87304178, 0x0800861F, 0xFFFFFFE1, 0x7BBFBE79, 0xF7FE79EF, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EC, 0xFFFFFFFE, 0x7BBFBE79, 0xF7FE79EF, 0xFFEE3DFE, 0x6BB86080,	0x1078860F, 0xE3DFFEFE, 
-	0x5BB7FEFB, 0xE7BE7BEF, 0xFFBFFF41, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFDFFEDF, 0x7BB7FEFB, 0xE7BE7BEC, 0xFFEE3DDF, 0x7BB7FEFB, 0xE7BE7BEF, 0xFFFFFFFF, 0x7BB7BEF9, 0xE7BE7BEF,	0xFFFFFFDF, 0x87B001F8, 0x187E87EF, 0xFFFFFFDF, 
-	0x86106104, 0x00007A30, 0x1E7C5061, 0x79E79E79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E, 0x79E79F79, 0xF7DF7B7F, 0x5E7DA79E,	0x59E79F79, 0xF7DF7B7F, 0x597DA79E, 0x58005F78, 0x30D0037F, 0x477DA79E, 
-	0x59E79F79, 0xF7DE7B7F, 0x597DA79E, 0x59E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x41E79F79, 0xF7DE7B7F, 0x5E7DA79E, 0x7DE79F79,	0xF7DE7B7F, 0x5E7DA79E, 0x7DE79E79, 0xF7DE7B7F, 0x5E7DA79E, 0x81E06104, 0x07C17A38, 0xDE01A7A1, 
-	0x06106101, 0xE79E79E0, 0x337F3FFF, 0x79E79EED, 0xE79E79EF, 0xB77FBFFF, 0x79E79FED, 0xE79E79EF,	0xB7BFBFFF, 0x79E79FED, 0xE79A79EF, 0xB7BFBFFF, 0x79E75FED, 0xE79AB5EF, 0x77DFBFFF, 0x05E0E1ED, 0xE79ACC0E, 0xF7DFBFFF, 
-	0x7DE77EED, 0xE79AB7ED, 0xF7EFBFFF, 0x7DE7BEED, 0xE79A7BEB, 0xF7EFBFFF,	0x7DE7BEED, 0xE79A7BE7, 0xF7F7BFFF, 0x7DA7BEED, 0xE79A7BE7, 0xF7F7BCFF, 0x7DD79EED, 0xEB5A7BE7, 0xF7FBBCFF, 0x7C27A1EE, 0x1CE57810, 0x33FB3EC0
-};
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayAudio without initialising it!" );
+	return *s_pInstance;
+}
 
-void PlayGraphics::DecompressDubugFont( void )
+PlayAudio& PlayAudio::Instance( const char* path )
 {
-	m_pDebugFontBuffer = new uint8_t[FONT_IMAGE_WIDTH * FONT_IMAGE_HEIGHT];
-
-	for( int y = 0; y < FONT_IMAGE_HEIGHT; y++ )
-	{
-		for( int x = 0; x < FONT_IMAGE_WIDTH; x++ )
-		{
-			int bufferIndex = ( y * FONT_IMAGE_WIDTH ) + x;
-			int dataIndex = bufferIndex / 32;
-			int dataShift = 31 - ( bufferIndex % 32 );
-
-			// Convert 1bpp to an 8-bit array for easy data access
-			if( ( debugFontData[dataIndex] >> dataShift ) & 0x01 )
-				m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 0; // not ARGB just 0 (no pixel)
-			else
-				m_pDebugFontBuffer[( y * FONT_IMAGE_WIDTH ) + x] = 1; // not ARGB just 1 (a pixel)
-		}
-	}
+	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
+	s_pInstance = new PlayAudio( path );
+	return *s_pInstance;
 }
 
-int PlayGraphics::DrawDebugCharacter( Point2f pos, char c, Pixel pix )
+void PlayAudio::Destroy()
 {
-	// Limited character set in the font (0x30-0x5F) so includes translation of useful chars outside that range
-	switch( c )
-	{
-		case 0x2C: c = 0x5E; break; // Map full stop to comma (nearly the same!)
-		case 0x2D: c = 0x3B; break; // Map minus to semi-colon (rarely used)
-		case 0x28: c = 0x5B; break; // Map brackets to square brackets
-		case 0x29: c = 0x5D; break; // Map brackets to square brackets
-		case 0x2E: c = 0x5E; break; // Map full stop to carot (never used)
-	}
+	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayAudio which hasn't been instanced!" );
+	delete s_pInstance;
+	s_pInstance = nullptr;
+}
 
-	if( c < 0x30 || c > 0x5F )
-		return FONT_CHAR_WIDTH;
+//********************************************************************************************************************************
+// Sound playing functions
+//********************************************************************************************************************************
+int PlayAudio::GetSoundId( const char* name ) const
+{
+	uint64_t hash = HashSpriteName( name ).value;
+	auto it = m_soundIndex.find( hash );
+	if( it != m_soundIndex.end() )
+		return it->second;
 
-	int sourceX = ( ( c - 0x30 ) % 16 ) * FONT_CHAR_WIDTH;
-	int sourceY = ( ( c - 0x30 ) / 16 ) * FONT_CHAR_HEIGHT;
+	std::string filename( name );
+	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
 
-	// Loop over the bounding box of the glyph
-	for( int x = 0; x < FONT_CHAR_WIDTH; x++ )
+	// Not a whole filename, so search for the text within the paths and remember the answer for next time
+	for( size_t i = 0; i < vSounds.size(); i++ )
 	{
-		for( int y = 0; y < FONT_CHAR_HEIGHT; y++ )
+		if( vSounds[i].filename.find( filename ) != std::string::npos )
 		{
-			if( m_pDebugFontBuffer[( ( sourceY + y ) * FONT_IMAGE_WIDTH ) + ( sourceX + x )] > 0 )
-				DrawPixel( { pos.x + x, pos.y + y }, pix );
+			m_soundIndex.emplace( hash, static_cast<int>( i ) );
+			return static_cast<int>( i );
 		}
 	}
-
-	return FONT_CHAR_WIDTH;
+	return -1;
 }
 
-int PlayGraphics::DrawDebugString( Point2f pos, const std::string& s, Pixel pix, bool centred )
+void PlayAudio::StartAudio( const char* name, bool bLoop )
 {
-	if( m_pDebugFontBuffer == nullptr )
-		DecompressDubugFont();
-
-	if( centred )
-		pos.x -= GetDebugStringWidth( s ) / 2;
-
-	pos.y -= 6; // half the height of the debug font
+	int soundId = GetSoundId( name );
+	PLAY_ASSERT_MSG( soundId >= 0, std::string( "Trying to play unknown sound effect: " + std::string( name ) ).c_str() );
+	if( soundId >= 0 )
+		StartAudio( soundId, bLoop );
+}
 
-	for( char c : s )
-		pos.x += DrawDebugCharacter( pos, static_cast<char>( toupper( c ) ), pix ) + 1;
+void PlayAudio::StartAudio( int soundId, bool bLoop )
+{
+	PLAY_ASSERT_MSG( soundId >= 0 && soundId < static_cast<int>( vSounds.size() ), "Trying to play invalid sound id" );
+	if( soundId < 0 || soundId >= static_cast<int>( vSounds.size() ) )
+		return;
+	const Sound& sound = vSounds[soundId];
+	if( sound.mixed )
+		PushMixerCommand( { bLoop ? MixerCommand::LOOP : MixerCommand::PLAY, soundId } );
+	else
+		SendAudioCommand( bLoop ? sound.loopCommand : sound.playCommand );
+}
 
-	// Return horizontal position at the end of the string so strings can be concatenated easily
-	return static_cast<int>( pos.x );
+void PlayAudio::StopAudio( const char* name )
+{
+	int soundId = GetSoundId( name );
+	PLAY_ASSERT_MSG( soundId >= 0, std::string( "Trying to stop unknown sound effect: " + std::string( name ) ).c_str() );
+	if( soundId >= 0 )
+		StopAudio( soundId );
 }
 
-int PlayGraphics::GetDebugStringWidth( const std::string& s )
+void PlayAudio::StopAudio( int soundId )
 {
-	return static_cast<int>( s.length() ) * ( FONT_CHAR_WIDTH + 1 );
+	PLAY_ASSERT_MSG( soundId >= 0 && soundId < static_cast<int>( vSounds.size() ), "Trying to stop invalid sound id" );
+	if( soundId < 0 || soundId >= static_cast<int>( vSounds.size() ) )
+		return;
+	if( vSounds[soundId].mixed )
+		PushMixerCommand( { MixerCommand::STOP, soundId } );
+	else
+		SendAudioCommand( vSounds[soundId].stopCommand );
 }
 
 //********************************************************************************************************************************
-// Timing bar functions
+// Software mixer
 //********************************************************************************************************************************
-
-LARGE_INTEGER PlayGraphics::EndTimingSegment()
+bool PlayAudio::DecodeWav( const std::vector< uint8_t >& bytes, std::vector< int16_t >& samples )
 {
-	int size = static_cast<int>( m_vTimings.size() );
+	auto Read16 = [&]( size_t at ) { return static_cast<uint32_t>( bytes[at] | ( bytes[at + 1] << 8 ) ); };
+	auto Read32 = [&]( size_t at ) { return Read16( at ) | ( Read16( at + 2 ) << 16 ); };
 
-	LARGE_INTEGER now, freq;
-	QueryPerformanceCounter( &now );
-	QueryPerformanceFrequency( &freq );
+	if( bytes.size() < 12 || memcmp( bytes.data(), "RIFF", 4 ) != 0 || memcmp( bytes.data() + 8, "WAVE", 4 ) != 0 )
+		return false;
 
-	if( size > 0 )
+	// Walk the chunks for the format and the samples
+	uint32_t format = 0, channels = 0, rate = 0, bits = 0;
+	const uint8_t* pData = nullptr;
+	size_t dataBytes = 0;
+	for( size_t at = 12; at + 8 <= bytes.size(); )
 	{
-		m_vTimings[size - 1].end = now.QuadPart;
-		m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin );
-		m_vTimings[size - 1].millisecs = static_cast<float>( ( m_vTimings[size - 1].millisecs * 1000.0f ) / freq.QuadPart );
+		size_t body = at + 8;
+		size_t size = std::min< size_t >( Read32( at + 4 ), bytes.size() - body );
+
+		if( memcmp( &bytes[at], "fmt ", 4 ) == 0 && size >= 16 )
+		{
+			format = Read16( body );
+			channels = Read16( body + 2 );
+			rate = Read32( body + 4 );
+			bits = Read16( body + 14 );
+			// WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of its sub-format GUID
+			if( format == 0xFFFE && size >= 26 )
+				format = Read16( body + 24 );
+		}
+		else if( memcmp( &bytes[at], "data", 4 ) == 0 )
+		{
+			pData = &bytes[body];
+			dataBytes = size;
+		}
+
+		at = body + size + ( size & 1 ); // Chunks are padded to an even size
 	}
 
-	return now;
+	bool pcm = format == 1 && ( bits == 8 || bits == 16 );
+	bool floats = format == 3 && bits == 32;
+	if( !pData || ( !pcm && !floats ) || channels == 0 || rate == 0 )
+		return false;
+
+	size_t frameBytes = channels * ( bits / 8 );
+	size_t srcFrames = dataBytes / frameBytes;
+
+	// Reads one channel of a frame as -1 to 1
+	auto Sample = [&]( size_t frame, uint32_t channel )
+	{
+		const uint8_t* p = pData + ( frame * frameBytes ) + ( channel * ( bits / 8 ) );
+		if( bits == 8 )
+			return ( p[0] - 128 ) / 128.0f;
+		if( bits == 16 )
+			return static_cast<int16_t>( p[0] | ( p[1] << 8 ) ) / 32768.0f;
+		float f;
+		memcpy( &f, p, sizeof( f ) );
+		return f;
+	};
+
+	// Resample to the mixer's rate with linear interpolation, keeping the first two channels (mono goes to both)
+	size_t dstFrames = static_cast<size_t>( ( static_cast<uint64_t>( srcFrames ) * AUDIO_SAMPLE_RATE ) / rate );
+	double step = static_cast<double>( rate ) / AUDIO_SAMPLE_RATE;
+	samples.resize( dstFrames * 2 );
+
+	for( size_t i = 0; i < dstFrames; i++ )
+	{
+		double pos = i * step;
+		size_t f0 = static_cast<size_t>( pos );
+		size_t f1 = std::min( f0 + 1, srcFrames - 1 );
+		float t = static_cast<float>( pos - f0 );
+
+		for( uint32_t c = 0; c < 2; c++ )
+		{
+			uint32_t channel = c < channels ? c : 0;
+			float s0 = Sample( f0, channel );
+			float value = ( s0 + ( ( Sample( f1, channel ) - s0 ) * t ) ) * 32768.0f;
+			samples[( i * 2 ) + c] = static_cast<int16_t>( std::clamp( lroundf( value ), -32768l, 32767l ) );
+		}
+	}
+	return true;
 }
 
-int PlayGraphics::SetTimingBarColour( Pixel pix )
+void PlayAudio::PushMixerCommand( MixerCommand command )
 {
-	TimingSegment newData;
-	newData.pix = pix;
-	newData.begin = EndTimingSegment().QuadPart;
-
-	m_vTimings.push_back( newData );
+	uint32_t tail = m_commandTail.load( std::memory_order_relaxed );
+	if( tail - m_commandHead.load( std::memory_order_acquire ) >= AUDIO_COMMAND_QUEUE_SIZE )
+	{
+		m_commandsDropped++;
+		return;
+	}
 
-	return static_cast<int>( m_vTimings.size() );
-};
+	m_commands[tail % AUDIO_COMMAND_QUEUE_SIZE] = command;
+	m_commandTail.store( tail + 1, std::memory_order_release );
+}
 
-void PlayGraphics::DrawTimingBar( Point2f pos, Point2f size )
+void PlayAudio::StartMixer()
 {
-	EndTimingSegment();
+	if( m_mixerThread.joinable() )
+		return;
 
-	int startPixel{ 0 };
-	int endPixel{ 0 };
-	for( const TimingSegment& t : m_vPrevTimings )
+	if( !m_pOutput )
 	{
-		endPixel += static_cast<int>( ( size.width * t.millisecs ) / 16.667f );
-		DrawRect( { pos.x + startPixel, pos.y }, { pos.x + endPixel, pos.y + size.height }, t.pix, true );
-		startPixel = endPixel;
+#ifndef PLAY_PLATFORM_HEADLESS
+		m_pOutput = std::make_unique< PlayWaveOutAudioOutput >();
+#else
+		m_pOutput = std::make_unique< PlayNullAudioOutput >();
+#endif
 	}
-
-	DrawRect( { pos.x, pos.y }, { pos.x + size.width, pos.y + size.height }, PIX_BLACK, false );
-	DrawRect( { pos.x - 1, pos.y - 1 }, { pos.x + size.width + 1 , pos.y + size.height + 1 }, PIX_WHITE, false );
+
+	m_mixBuffer.assign( AUDIO_BLOCK_FRAMES * 2, 0 );
+	m_stopMixer = false;
+	m_mixerThread = std::thread( &PlayAudio::MixerThread, this );
 }
 
-float PlayGraphics::GetTimingSegmentDuration( int id ) const
+void PlayAudio::StopMixer()
 {
-	PLAY_ASSERT_MSG( static_cast<size_t>(id) < m_vTimings.size(), "Invalid id for timing data." );
-	return m_vTimings[id].millisecs;
+	if( !m_mixerThread.joinable() )
+		return;
+
+	m_stopMixer = true;
+	m_mixerThread.join();
 }
 
-void PlayGraphics::TimingBarBegin( Pixel pix )
+void PlayAudio::SetOutput( std::unique_ptr< PlayAudioOutput > pOutput )
 {
-	EndTimingSegment();
-	m_vPrevTimings = m_vTimings;
-	m_vTimings.clear();
-	SetTimingBarColour( pix );
+	bool running = m_mixerThread.joinable();
+	StopMixer();
+	m_pOutput = std::move( pOutput );
+	if( running )
+		StartMixer();
 }
-//********************************************************************************************************************************
-// File:		PlaySpeaker.cpp
-// Description:	Implementation of a very simple audio manager using the MCI
-// Platform:	Windows
-// Notes:		Uses MP3 format. The Windows multimedia library is extremely basic, but very quick easy to work with. 
-//				Playback isn't always instantaneous and can trigger small frame glitches when StartSound is called. 
-//				Consider XAudio2 as a potential next step.
-//********************************************************************************************************************************
 
+AudioMixerStats PlayAudio::GetMixerStats() const
+{
+	AudioMixerStats stats;
+	stats.voicesPlaying = m_voicesPlaying;
+	stats.voicesStolen = m_voicesStolen;
+	stats.commandsDropped = m_commandsDropped;
+	stats.blocksMixed = m_blocksMixed;
+	return stats;
+}
 
-// Instruct Visual Studio to link the multimedia library  
-#pragma comment(lib, "winmm.lib")
+void PlayAudio::MixerThread()
+{
+	std::vector< int16_t > block( AUDIO_BLOCK_FRAMES * 2 );
 
-PlayAudio* PlayAudio::s_pInstance = nullptr;
+	while( !m_stopMixer )
+	{
+		MixBlock( block.data() );
+		m_pOutput->Write( block.data(), AUDIO_BLOCK_FRAMES );
+	}
+}
 
-//********************************************************************************************************************************
-// Constructor and destructor (private)
-//********************************************************************************************************************************
-PlayAudio::PlayAudio( const char* path )
+void PlayAudio::MixBlock( int16_t* pOut )
 {
-	PLAY_ASSERT_MSG( !s_pInstance, "PlayAudio is a singleton class: multiple instances not allowed!" );
-	PLAY_ASSERT_MSG( std::filesystem::is_directory( path ), "Audio directory does not exist!" );
-
-	// Iterate through the directory
-	for( auto& p : std::filesystem::directory_iterator( path ) )
+	// Apply the commands which have arrived since the last block
+	uint32_t head = m_commandHead.load( std::memory_order_relaxed );
+	uint32_t tail = m_commandTail.load( std::memory_order_acquire );
+	for( ; head != tail; head++ )
 	{
-		// Switch everything to uppercase to avoid need to check case each time
-		std::string filename = p.path().string();
-		for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+		const MixerCommand& command = m_commands[head % AUDIO_COMMAND_QUEUE_SIZE];
 
-		// Only load .mp3 files
-		if( filename.find( ".MP3" ) != std::string::npos )
+		if( command.type == MixerCommand::STOP )
 		{
-			vSoundStrings.push_back( filename );
-			std::string command = "open \"" + filename + "\" type mpegvideo alias " + filename;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+			for( Voice& voice : m_voices )
+			{
+				if( voice.soundId == command.soundId )
+					voice.soundId = -1;
+			}
+			continue;
+		}
+
+		// Use a free voice, or take over the one which has been playing longest (loops are only taken if every voice is looping)
+		Voice* pVoice = &m_voices[0];
+		for( Voice& voice : m_voices )
+		{
+			if( voice.soundId < 0 )
+			{
+				pVoice = &voice;
+				break;
+			}
+			if( ( voice.loop == pVoice->loop ) ? voice.started < pVoice->started : pVoice->loop )
+				pVoice = &voice;
 		}
+		if( pVoice->soundId >= 0 )
+			m_voicesStolen++;
+
+		pVoice->soundId = command.soundId;
+		pVoice->frame = 0;
+		pVoice->loop = command.type == MixerCommand::LOOP;
+		pVoice->started = m_voicesStarted++;
 	}
+	m_commandHead.store( head, std::memory_order_release );
 
-	s_pInstance = this;
-}
+	// Add up the voices at 32 bits so that they can't overflow
+	std::fill( m_mixBuffer.begin(), m_mixBuffer.end(), 0 );
+	int playing = 0;
 
-PlayAudio::~PlayAudio( void )
-{
-	for( std::string& s : vSoundStrings )
+	for( Voice& voice : m_voices )
+	{
+		if( voice.soundId < 0 )
+			continue;
+
+		const std::vector< int16_t >& samples = vSounds[voice.soundId].samples;
+		size_t frames = samples.size() / 2;
+		int mixed = 0;
+
+		while( mixed < AUDIO_BLOCK_FRAMES && frames > 0 )
+		{
+			if( voice.frame >= frames )
+			{
+				if( !voice.loop )
+					break;
+				voice.frame = 0;
+			}
+
+			size_t count = std::min< size_t >( AUDIO_BLOCK_FRAMES - mixed, frames - voice.frame );
+			const int16_t* pSrc = &samples[voice.frame * 2];
+			int32_t* pMix = &m_mixBuffer[static_cast<size_t>( mixed ) * 2];
+			for( size_t i = 0; i < count * 2; i++ )
+				pMix[i] += pSrc[i];
+
+			mixed += static_cast<int>( count );
+			voice.frame += count;
+		}
+
+		if( voice.frame >= frames && !( voice.loop && frames > 0 ) )
+			voice.soundId = -1;
+		else
+			playing++;
+	}
+
+	// Clamp the mix back to 16 bits
+	int i = 0;
+#ifdef PLAY_SSE2
+	for( ; i + 8 <= AUDIO_BLOCK_FRAMES * 2; i += 8 )
 	{
-		std::string command = "close " + s;
-		mciSendStringA( command.c_str(), NULL, 0, 0 );
+		__m128i lo = _mm_loadu_si128( reinterpret_cast<const __m128i*>( &m_mixBuffer[i] ) );
+		__m128i hi = _mm_loadu_si128( reinterpret_cast<const __m128i*>( &m_mixBuffer[i + 4] ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pOut + i ), _mm_packs_epi32( lo, hi ) );
 	}
+#endif
+	for( ; i < AUDIO_BLOCK_FRAMES * 2; i++ )
+		pOut[i] = static_cast<int16_t>( std::clamp( m_mixBuffer[i], -32768, 32767 ) );
 
-	s_pInstance = nullptr;
+	m_voicesPlaying = playing;
+	m_blocksMixed++;
 }
 
 //********************************************************************************************************************************
-// Instance access functions
+// Audio outputs
 //********************************************************************************************************************************
+void PlayNullAudioOutput::Write( const int16_t*, int frames )
+{
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point now = Clock::now();
 
-PlayAudio& PlayAudio::Instance()
+	// Start timing again from now on the first block, or if the mixer has fallen a long way behind
+	if( m_deadline == Clock::time_point() || now - m_deadline > std::chrono::milliseconds( 100 ) )
+		m_deadline = now;
+
+	m_deadline += std::chrono::duration_cast< Clock::duration >( std::chrono::duration< double >( static_cast<double>( frames ) / AUDIO_SAMPLE_RATE ) );
+	std::this_thread::sleep_until( m_deadline );
+}
+
+// Writes a little-endian value to a stream
+template< typename T > static void WriteLittleEndian( std::ofstream& file, T value )
 {
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use PlayAudio without initialising it!" );
-	return *s_pInstance;
+	for( size_t i = 0; i < sizeof( T ); i++ )
+		file.put( static_cast<char>( ( value >> ( i * 8 ) ) & 0xFF ) );
 }
 
-PlayAudio& PlayAudio::Instance( const char* path )
+PlayWavFileAudioOutput::PlayWavFileAudioOutput( const std::string& fileAndPath )
+	: m_file( PlatformPath( fileAndPath ), std::ios::binary )
 {
-	PLAY_ASSERT_MSG( !s_pInstance, "Trying to create multiple instances of singleton class!" );
-	s_pInstance = new PlayAudio( path );
-	return *s_pInstance;
+	PLAY_ASSERT_MSG( m_file.is_open(), std::string( "Unable to create audio file: " + fileAndPath ).c_str() );
+
+	// A 16-bit stereo PCM header, with the sizes filled in when the file is closed
+	m_file.write( "RIFF", 4 );
+	WriteLittleEndian< uint32_t >( m_file, 0 );
+	m_file.write( "WAVEfmt ", 8 );
+	WriteLittleEndian< uint32_t >( m_file, 16 );
+	WriteLittleEndian< uint16_t >( m_file, 1 );
+	WriteLittleEndian< uint16_t >( m_file, 2 );
+	WriteLittleEndian< uint32_t >( m_file, AUDIO_SAMPLE_RATE );
+	WriteLittleEndian< uint32_t >( m_file, AUDIO_SAMPLE_RATE * 4 );
+	WriteLittleEndian< uint16_t >( m_file, 4 );
+	WriteLittleEndian< uint16_t >( m_file, 16 );
+	m_file.write( "data", 4 );
+	WriteLittleEndian< uint32_t >( m_file, 0 );
 }
 
-void PlayAudio::Destroy()
+PlayWavFileAudioOutput::~PlayWavFileAudioOutput()
 {
-	PLAY_ASSERT_MSG( s_pInstance, "Trying to use destroy PlayAudio which hasn't been instanced!" );
-	delete s_pInstance;
-	s_pInstance = nullptr;
+	m_file.seekp( 4 );
+	WriteLittleEndian< uint32_t >( m_file, 36 + m_dataBytes );
+	m_file.seekp( 40 );
+	WriteLittleEndian< uint32_t >( m_file, m_dataBytes );
 }
 
-//********************************************************************************************************************************
-// Sound playing functions
-//********************************************************************************************************************************
-void PlayAudio::StartAudio( const char* name, bool bLoop )
+void PlayWavFileAudioOutput::Write( const int16_t* pSamples, int frames )
 {
-	std::string filename( name );
-	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
+	for( int i = 0; i < frames * 2; i++ )
+		WriteLittleEndian< uint16_t >( m_file, static_cast<uint16_t>( pSamples[i] ) );
+	m_dataBytes += frames * 4;
+
+	PlayNullAudioOutput::Write( pSamples, frames );
+}
+
+#ifndef PLAY_PLATFORM_HEADLESS
+PlayWaveOutAudioOutput::PlayWaveOutAudioOutput()
+{
+	WAVEFORMATEX format{};
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = 2;
+	format.nSamplesPerSec = AUDIO_SAMPLE_RATE;
+	format.wBitsPerSample = 16;
+	format.nBlockAlign = 4;
+	format.nAvgBytesPerSec = AUDIO_SAMPLE_RATE * 4;
+
+	m_hDoneEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+	if( waveOutOpen( &m_hWaveOut, WAVE_MAPPER, &format, reinterpret_cast<DWORD_PTR>( m_hDoneEvent ), 0, CALLBACK_EVENT ) != MMSYSERR_NOERROR )
+		m_hWaveOut = nullptr;
+}
 
-	// Iterate through the sound data 
-	for( std::string& s : vSoundStrings )
+PlayWaveOutAudioOutput::~PlayWaveOutAudioOutput()
+{
+	if( m_hWaveOut )
 	{
-		if( s.find( filename ) != std::string::npos )
+		waveOutReset( m_hWaveOut );
+		for( WAVEHDR& header : m_headers )
 		{
-			std::string command = "play " + s + " from 0";
-			if( bLoop ) command += " repeat";
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
-			return;
+			if( header.dwFlags & WHDR_PREPARED )
+				waveOutUnprepareHeader( m_hWaveOut, &header, sizeof( WAVEHDR ) );
 		}
+		waveOutClose( m_hWaveOut );
 	}
-	PLAY_ASSERT_MSG( false, std::string( "Trying to play unknown sound effect: " + std::string( name ) ).c_str() );
+	CloseHandle( m_hDoneEvent );
 }
 
-void PlayAudio::StopAudio( const char* name )
+void PlayWaveOutAudioOutput::Write( const int16_t* pSamples, int frames )
 {
-	std::string filename( name );
-	for( char& c : filename ) c = static_cast<char>( toupper( c ) );
-
-	// Iterate through the sound data 
-	for( std::string& s : vSoundStrings )
+	if( !m_hWaveOut )
 	{
-		if( s.find( filename ) != std::string::npos )
-		{
-			std::string command = "stop " + s;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
-			return;
-		}
+		m_nullOutput.Write( pSamples, frames );
+		return;
 	}
-	PLAY_ASSERT_MSG( false, std::string( "Trying to stop unknown sound effect: " + std::string( name ) ).c_str() );
+
+	// Wait for the device to finish with the oldest block before reusing its buffer
+	WAVEHDR& header = m_headers[m_nextBuffer];
+	while( ( header.dwFlags & WHDR_PREPARED ) && !( header.dwFlags & WHDR_DONE ) )
+		WaitForSingleObject( m_hDoneEvent, 100 );
+	if( header.dwFlags & WHDR_PREPARED )
+		waveOutUnprepareHeader( m_hWaveOut, &header, sizeof( WAVEHDR ) );
+
+	std::vector< int16_t >& buffer = m_buffers[m_nextBuffer];
+	buffer.assign( pSamples, pSamples + ( frames * 2 ) );
+
+	header = {};
+	header.lpData = reinterpret_cast<LPSTR>( buffer.data() );
+	header.dwBufferLength = static_cast<DWORD>( buffer.size() * sizeof( int16_t ) );
+	waveOutPrepareHeader( m_hWaveOut, &header, sizeof( WAVEHDR ) );
+	waveOutWrite( m_hWaveOut, &header, sizeof( WAVEHDR ) );
+
+	m_nextBuffer = ( m_nextBuffer + 1 ) % BUFFER_COUNT;
 }
+#endif // PLAY_PLATFORM_HEADLESS
+
 //********************************************************************************************************************************
 // File:		PlayInput.cpp
 // Description:	Manages keyboard and mouse input 
-// Platform:	Windows
+// Platform:	Windows or headless
 // Notes:		Obtains mouse data from PlayWindow via MouseData structure
 //********************************************************************************************************************************
 
@@ -3974,8 +9872,19 @@ bool PlayInput::KeyPressed( int vKey, int frame )
 
 bool PlayInput::KeyDown( int vKey )
 {
+#ifndef PLAY_PLATFORM_HEADLESS
 	return GetAsyncKeyState( vKey ) & 0x8000; // Don't want multiple calls to KeyState
+#else
+	return m_keyDown[vKey & 0xFF];
+#endif // PLAY_PLATFORM_HEADLESS
+}
+
+#ifdef PLAY_PLATFORM_HEADLESS
+void PlayInput::SetKeyState( int vKey, bool down )
+{
+	m_keyDown[vKey & 0xFF] = down;
 }
+#endif // PLAY_PLATFORM_HEADLESS
 //********************************************************************************************************************************
 // File:		PlayManager.cpp
 // Description:	A manager for providing simplified access to the PlayBuffer framework
@@ -4012,28 +9921,42 @@ namespace Play
 	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
 	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
 
+	// Working space for the batch operations, kept between calls to avoid allocating every frame
+	struct BatchScratch
+	{
+		std::vector<GameObject*> vObjects;
+		std::vector<float> vPosX, vPosY;
+		std::vector<float> vVelX, vVelY;
+		std::vector<float> vAccX, vAccY;
+		std::vector<float> vDistSqr;
+		std::vector<int> vCollisionIds;
+	};
+	static BatchScratch batchScratch;
+
 #endif 
 
-	// A set of default colour definitions
-	Colour cBlack{ 0.0f, 0.0f, 0.0f };
-	Colour cRed{ 100.0f, 0.0f, 0.0f };
-	Colour cGreen{ 0.0f, 100.0f, 0.0f };
-	Colour cBlue{ 0.0f, 0.0f, 100.0f };
-	Colour cMagenta{ 100.0f, 0.0f, 100.0f };
-	Colour cCyan{ 0.0f, 100.0f, 100.0f };
-	Colour cYellow{ 100.0f, 100.0f, 0.0f };
-	Colour cOrange{ 100.0f, 50.0f, 0.0f };
-	Colour cWhite{ 100.0f, 100.0f, 100.0f };
-	Colour cGrey{ 50.0f, 50.0f, 50.0f };
+	int frameCount = 0; // Updated in Play::Present, and by each FixedStep
 
-	int frameCount = 0; // Updated in Play::Present
+	// The fixed timestep accumulator
+	struct FixedTimestep
+	{
+		bool enabled{ false };
+		float stepTime{ 0.0f };
+		int maxStepsPerFrame{ 0 };
+		float accumulator{ 0.0f };
+		int stepsRemaining{ 0 };
+		float alpha{ 1.0f };
+		// The frameCount of the most recent step
+		int lastStep{ -1 };
+	};
+	FixedTimestep fixedTimestep;
 
 	// The camera
 	Point2f cameraPos{ 0.0f, 0.0f };
 	DrawingSpace drawSpace = WORLD;
 
 	#define TRANSFORM_SPACE( p )  drawSpace == WORLD ? p - cameraPos : p
-	#define TRANSFORM_MATRIX_SPACE( t ) drawSpace == WORLD ? (MatrixTranslation( -cameraPos.x, -cameraPos.y ) * t) : t
+	#define TRANSFORM_AFFINE_SPACE( t ) drawSpace == WORLD ? ( t ).Translated( -cameraPos ) : ( t )
 
 	//**************************************************************************************************
 	// Manager creation and deletion
@@ -4041,16 +9964,19 @@ namespace Play
 
 	void CreateManager( int displayWidth, int displayHeight, int displayScale )
 	{
-		PlayGraphics::Instance( displayWidth, displayHeight, "Data\\Sprites\\" );
+		// The sprites are loaded on the other cores while this thread opens the sounds, keeping all the MCI commands on one thread
+		std::future<void> spritesLoaded = std::async( std::launch::async, [=]() { PlayGraphics::Instance( displayWidth, displayHeight, "Data\\Sprites\\" ); } );
+		PlayAudio::Instance( "Data\\Audio\\" );
+		spritesLoaded.get();
 		PlayWindow::Instance( PlayGraphics::Instance().GetDrawingBuffer(), displayScale );
 		PlayWindow::Instance().RegisterMouse( PlayInput::Instance().GetMouseData() );
-		PlayAudio::Instance( "Data\\Audio\\" );
 		// Seed the game's random number generator based on the time
 		srand( (int)time( NULL ) );
 	}
 
 	void DestroyManager()
 	{
+		PlayWindow::Instance().WaitForPresents(); // The present thread may still be using a drawing buffer
 		PlayAudio::Destroy();
 		PlayGraphics::Destroy();
 		PlayWindow::Destroy();
@@ -4072,16 +9998,99 @@ namespace Play
 		return PlayWindow::Instance().GetHeight();
 	}
 
+	void SetTargetFrameRate( int framesPerSecond )
+	{
+		PlayWindow::Instance().GetScheduler().SetTargetFrameRate( framesPerSecond );
+	}
+
+	const FrameStats& GetFrameStats()
+	{
+		return PlayWindow::Instance().GetScheduler().GetStats();
+	}
+
+	void SetDrawingBufferCount( int count )
+	{
+		PlayWindow::Instance().WaitForPresents();
+		PlayGraphics::Instance().SetDrawingBufferCount( count );
+	}
+
+	void BeginCapture( const char* path, CaptureFormat format )
+	{
+		PlayGraphics::Instance().BeginCapture( path, format, PlayWindow::Instance().GetScheduler().GetTargetFrameRate() );
+	}
+
+	CaptureStats EndCapture()
+	{
+		return PlayGraphics::Instance().EndCapture();
+	}
+
+	void SetSpriteMemoryBudget( size_t bytes, int unusedFrames, bool compress )
+	{
+		PlayGraphics::Instance().SetSpriteMemoryBudget( bytes, unusedFrames, compress );
+	}
+
+	//**************************************************************************************************
+	// Fixed timestep functions
+	//**************************************************************************************************
+
+	void SetFixedTimestep( int stepsPerSecond, int maxStepsPerFrame )
+	{
+		PLAY_ASSERT_MSG( stepsPerSecond >= 0 && maxStepsPerFrame > 0, "Invalid fixed timestep settings!" );
+		fixedTimestep = FixedTimestep();
+		fixedTimestep.enabled = stepsPerSecond > 0;
+		fixedTimestep.stepTime = stepsPerSecond > 0 ? 1.0f / stepsPerSecond : 0.0f;
+		fixedTimestep.maxStepsPerFrame = maxStepsPerFrame;
+	}
+
+	int BeginFixedUpdate( float elapsedTime )
+	{
+		FixedTimestep& f = fixedTimestep;
+		PLAY_ASSERT_MSG( f.enabled, "Call Play::SetFixedTimestep before using fixed timestep updates!" );
+
+		f.accumulator += elapsedTime;
+		int steps = static_cast<int>( f.accumulator / f.stepTime );
+
+		// Drop any time we can't catch up on, so a long frame slows the game rather than causing ever longer frames
+		if( steps > f.maxStepsPerFrame )
+		{
+			steps = f.maxStepsPerFrame;
+			f.accumulator = steps * f.stepTime;
+		}
+
+		f.accumulator -= steps * f.stepTime;
+		f.stepsRemaining = steps;
+		f.alpha = std::clamp( f.accumulator / f.stepTime, 0.0f, 1.0f );
+		return steps;
+	}
+
+	bool FixedStep()
+	{
+		if( fixedTimestep.stepsRemaining <= 0 )
+			return false;
+
+		fixedTimestep.stepsRemaining--;
+		frameCount++; // Each step counts as a frame for the GameObject update checks and KeyPressed
+		fixedTimestep.lastStep = frameCount;
+		return true;
+	}
+
+	float GetFixedStepTime()
+	{
+		return fixedTimestep.stepTime;
+	}
+
+	float GetInterpolationAlpha()
+	{
+		return fixedTimestep.enabled ? fixedTimestep.alpha : 1.0f;
+	}
+
 	//**************************************************************************************************
 	// PlayGraphics functions
 	//**************************************************************************************************
 
-	void ClearDrawingBuffer( Colour c )
+	void ClearDrawingBuffer( Pixel c )
 	{
-		int r = static_cast<int>( c.red * 2.55f );
-		int g = static_cast<int>( c.green * 2.55f );
-		int b = static_cast<int>( c.blue * 2.55f );
-		PlayGraphics::Instance().ClearBuffer( { r, g, b } );
+		PlayGraphics::Instance().ClearBuffer( c );
 	}
 
 	int LoadBackground( const char* pngFilename )
@@ -4094,9 +10103,9 @@ namespace Play
 		PlayGraphics::Instance().DrawBackground( background );
 	}
 
-	void DrawDebugText( Point2D pos, const char* text, Colour c, bool centred )
+	void DrawDebugText( Point2D pos, const char* text, Pixel c, bool centred )
 	{
-		PlayGraphics::Instance().DrawDebugString( TRANSFORM_SPACE( pos ), text, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, centred );
+		PlayGraphics::Instance().DrawDebugString( TRANSFORM_SPACE( pos ), text, c, centred );
 	}
 
 	void PresentDrawingBuffer()
@@ -4115,11 +10124,7 @@ namespace Play
 			int textX = 10;
 			int textY = 10;
 			std::string s = "PlayBuffer Version:" + std::string( PLAY_VERSION );
-			pblt.DrawDebugString( { textX - 1, textY - 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX + 1, textY + 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX + 1, textY - 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX - 1, textY + 1 }, s, PIX_BLACK, false );
-			pblt.DrawDebugString( { textX, textY }, s, PIX_YELLOW, false );
+			pblt.DrawDebugStringOutlined( { textX, textY }, s, PIX_YELLOW, PIX_BLACK, false );
 
 			drawSpace = WORLD;
 
@@ -4154,7 +10159,12 @@ namespace Play
 #endif
 		}
 
-		PlayWindow::Instance().Present();
+		pblt.CaptureFrame();
+		pblt.UpdateSpriteMemory();
+		if( pblt.GetDrawingBufferCount() > 1 )
+			PlayWindow::Instance().PresentAsync( pblt.SwapDrawingBuffers(), pblt.GetDrawingBufferCount() - 1 );
+		else
+			PlayWindow::Instance().Present();
 		frameCount++;
 
 		drawSpace = originalDrawSpace;
@@ -4191,6 +10201,26 @@ namespace Play
 		PlayAudio::Instance().StopAudio( fileName );
 	}
 
+	int GetAudioId( const char* fileName )
+	{
+		return PlayAudio::Instance().GetSoundId( fileName );
+	}
+
+	void PlayAudio( int audioId )
+	{
+		PlayAudio::Instance().StartAudio( audioId, false );
+	}
+
+	void StartAudioLoop( int audioId )
+	{
+		PlayAudio::Instance().StartAudio( audioId, true );
+	}
+
+	void StopAudioLoop( int audioId )
+	{
+		PlayAudio::Instance().StopAudio( audioId );
+	}
+
 	//**************************************************************************************************
 	// Camera functions
 	//**************************************************************************************************
@@ -4212,6 +10242,16 @@ namespace Play
 		return PlayGraphics::Instance().GetSpriteId( spriteName );
 	}
 
+	int GetSpriteId( SpriteHash spriteName )
+	{
+		return PlayGraphics::Instance().GetSpriteId( spriteName );
+	}
+
+	int FindSpriteId( const char* text )
+	{
+		return PlayGraphics::Instance().FindSpriteId( text );
+	}
+
 	int GetSpriteHeight( const char* spriteName )
 	{
 		return static_cast<int>(PlayGraphics::Instance().GetSpriteSize( GetSpriteId( spriteName ) ).height);
@@ -4252,15 +10292,20 @@ namespace Play
 		return PlayGraphics::Instance().GetSpritePixelData( spriteId );
 	}
 
+	void PrefetchSprites( const std::vector< std::string >& names )
+	{
+		PlayGraphics::Instance().Prefetch( names );
+	}
+
 	int GetSpriteFrames( int spriteId )
 	{
 		return static_cast<int>( PlayGraphics::Instance().GetSpriteFrames( spriteId ) );
 	}
 
-	void ColourSprite( const char* spriteName, Colour c )
+	void ColourSprite( const char* spriteName, Pixel c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( spriteName );
-		PlayGraphics::Instance().ColourSprite( spriteId, static_cast<int>( c.red * 2.55f ), static_cast<int>( c.green * 2.55f), static_cast<int>( c.blue * 2.55f ) );
+		PlayGraphics::Instance().ColourSprite( spriteId, c.r, c.g, c.b );
 	}
 
 	void CentreSpriteOrigin( const char* spriteName )
@@ -4351,25 +10396,30 @@ namespace Play
 
 	void DrawSpriteTransformed( int spriteID, const Matrix2D& transform, int frameIndex, float opacity  )
 	{
-		PlayGraphics::Instance().DrawTransformed( spriteID, TRANSFORM_MATRIX_SPACE( transform ), frameIndex, opacity );
+		PlayGraphics::Instance().DrawTransformed( spriteID, TRANSFORM_AFFINE_SPACE( Affine2D( transform ) ), frameIndex, opacity );
+	}
+
+	void DrawSpriteTransformed( int spriteID, const Affine2D& transform, int frameIndex, float opacity )
+	{
+		PlayGraphics::Instance().DrawTransformed( spriteID, TRANSFORM_AFFINE_SPACE( transform ), frameIndex, opacity );
 	}
 
-	void DrawLine( Point2f start, Point2f end, Colour c )
+	void DrawLine( Point2f start, Point2f end, Pixel c )
 	{
-		return PlayGraphics::Instance().DrawLine( TRANSFORM_SPACE( start ), TRANSFORM_SPACE( end ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }  );
+		return PlayGraphics::Instance().DrawLine( TRANSFORM_SPACE( start ), TRANSFORM_SPACE( end ), c );
 	}
 
-	void DrawCircle( Point2D pos, int radius, Colour c )
+	void DrawCircle( Point2D pos, int radius, Pixel c )
 	{
-		PlayGraphics::Instance().DrawCircle( TRANSFORM_SPACE( pos ), radius, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f } );
+		PlayGraphics::Instance().DrawCircle( TRANSFORM_SPACE( pos ), radius, c );
 	}
 
-	void DrawRect( Point2D topLeft, Point2D bottomRight, Colour c, bool fill )
+	void DrawRect( Point2D topLeft, Point2D bottomRight, Pixel c, bool fill )
 	{
-		PlayGraphics::Instance().DrawRect( TRANSFORM_SPACE( topLeft ), TRANSFORM_SPACE( bottomRight ), { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, fill );
+		PlayGraphics::Instance().DrawRect( TRANSFORM_SPACE( topLeft ), TRANSFORM_SPACE( bottomRight ), c, fill );
 	}
 
-	void DrawSpriteLine( Point2f startPos, Point2f endPos, const char* penSprite, Colour c )
+	void DrawSpriteLine( Point2f startPos, Point2f endPos, const char* penSprite, Pixel c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
 		ColourSprite( penSprite, c );
@@ -4428,7 +10478,7 @@ namespace Play
 		Play::DrawSprite( spriteId, { x - oy, y - ox }, 0 );
 	}
 
-	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Colour c )
+	void DrawSpriteCircle( Point2D pos, int radius, const char* penSprite, Pixel c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
 		ColourSprite( penSprite, c );
@@ -4455,14 +10505,11 @@ namespace Play
 		}
 	};
 
-	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify )
+	void DrawFontText( const char* fontId, const std::string& text, Point2D pos, Align justify, Pixel col )
 	{
 		int font = PlayGraphics::Instance().GetSpriteId( fontId );
 
-		int totalWidth{ 0 };
-
-		for( char c : text )
-			totalWidth += PlayGraphics::Instance().GetFontCharWidth( font, c );
+		int totalWidth = PlayGraphics::Instance().GetStringWidth( font, text );
 
 		switch( justify )
 		{
@@ -4477,17 +10524,17 @@ namespace Play
 		}
 
 		pos.x += PlayGraphics::Instance().GetSpriteOrigin( font ).x;
-		PlayGraphics::Instance().DrawString( font, TRANSFORM_SPACE( pos ), text );
+		PlayGraphics::Instance().DrawString( font, TRANSFORM_SPACE( pos ), text, col );
 	}
 
-	void BeginTimingBar( Colour c )
+	void BeginTimingBar( Pixel c )
 	{
-		PlayGraphics::Instance().TimingBarBegin( Pixel( c.red*2.55f, c.green*2.55f, c.blue*2.55f ) );
+		PlayGraphics::Instance().TimingBarBegin( c );
 	}
 
-	int ColourTimingBar( Colour c )
+	int ColourTimingBar( Pixel c )
 	{
-		return PlayGraphics::Instance().SetTimingBarColour( Pixel( c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f ) );
+		return PlayGraphics::Instance().SetTimingBarColour( c );
 	}
 
 	void DrawTimingBar( Point2f pos, Point2f size )
@@ -4561,10 +10608,9 @@ namespace Play
 		return vec; // Returning a copy of the vector
 	}
 
-	void UpdateGameObject( GameObject& obj, bool bWrap, int wrapBorderSize, bool allowMultipleUpdatesPerFrame )
+	// Handles the parts of UpdateGameObject which come before the object is moved
+	static void BeginGameObjectUpdate( GameObject& obj, bool allowMultipleUpdatesPerFrame )
 	{
-		if( obj.type == -1 ) return; // Don't update noObject
-
 		// We allow multiple updates if the object type has changed
 		PLAY_ASSERT_MSG( obj.lastFrameUpdated != frameCount || obj.type != obj.oldType || allowMultipleUpdatesPerFrame, "Trying to update the same GameObject more than once in the same frame!" );
 		obj.lastFrameUpdated = frameCount;
@@ -4572,10 +10618,11 @@ namespace Play
 		// Save the current position in case we need to go back
 		obj.oldPos = obj.pos;
 		obj.oldRot = obj.rotation;
+	}
 
-		// Move the object according to a very simple physical model
-		obj.velocity += obj.acceleration;
-		obj.pos += obj.velocity;
+	// Handles the parts of UpdateGameObject which come after the object is moved
+	static void EndGameObjectUpdate( GameObject& obj, bool bWrap, int wrapBorderSize )
+	{
 		obj.rotation += obj.rotSpeed;
 
 		// Handle the animation frame update
@@ -4606,6 +10653,75 @@ namespace Play
 
 	}
 
+	// Makes room in the scratch arrays for moving count objects
+	static void ReserveGameObjectMoves( size_t count )
+	{
+		BatchScratch& b = batchScratch;
+		b.vObjects.resize( count );
+		b.vPosX.resize( count ); b.vPosY.resize( count );
+		b.vVelX.resize( count ); b.vVelY.resize( count );
+		b.vAccX.resize( count ); b.vAccY.resize( count );
+	}
+
+	// Gathers an object's position, velocity and acceleration into separate arrays at the given index
+	static void GatherGameObjectMove( GameObject& obj, size_t index )
+	{
+		BatchScratch& b = batchScratch;
+		b.vObjects[index] = &obj;
+		b.vPosX[index] = obj.pos.x; b.vPosY[index] = obj.pos.y;
+		b.vVelX[index] = obj.velocity.x; b.vVelY[index] = obj.velocity.y;
+		b.vAccX[index] = obj.acceleration.x; b.vAccY[index] = obj.acceleration.y;
+	}
+
+	// Moves the first count gathered objects according to a very simple physical model, and scatters the results back
+	// > One object or all of them are moved by the same batch functions, so UpdateGameObject and UpdateAllGameObjects always agree
+	static void MoveGatheredGameObjects( size_t count )
+	{
+		BatchScratch& b = batchScratch;
+		BatchAddScaled( b.vVelX.data(), b.vVelY.data(), b.vAccX.data(), b.vAccY.data(), 1.0f, static_cast<int>( count ) );
+		BatchAddScaled( b.vPosX.data(), b.vPosY.data(), b.vVelX.data(), b.vVelY.data(), 1.0f, static_cast<int>( count ) );
+
+		for( size_t i = 0; i < count; i++ )
+		{
+			GameObject& obj = *b.vObjects[i];
+			obj.velocity = { b.vVelX[i], b.vVelY[i] };
+			obj.pos = { b.vPosX[i], b.vPosY[i] };
+		}
+	}
+
+	void UpdateGameObject( GameObject& obj, bool bWrap, int wrapBorderSize, bool allowMultipleUpdatesPerFrame )
+	{
+		if( obj.type == -1 ) return; // Don't update noObject
+
+		BeginGameObjectUpdate( obj, allowMultipleUpdatesPerFrame );
+
+		ReserveGameObjectMoves( 1 );
+		GatherGameObjectMove( obj, 0 );
+		MoveGatheredGameObjects( 1 );
+
+		EndGameObjectUpdate( obj, bWrap, wrapBorderSize );
+	}
+
+	void UpdateAllGameObjects( bool bWrap, int wrapBorderSize )
+	{
+		ReserveGameObjectMoves( objectMap.size() );
+
+		size_t n = 0;
+		for( std::pair<const int, GameObject&>& i : objectMap )
+		{
+			GameObject& obj = i.second;
+			if( obj.type == -1 ) continue; // Don't update objects set to the same type as noObject
+
+			BeginGameObjectUpdate( obj, false );
+			GatherGameObjectMove( obj, n++ );
+		}
+
+		MoveGatheredGameObjects( n );
+
+		for( size_t i = 0; i < n; i++ )
+			EndGameObjectUpdate( *batchScratch.vObjects[i], bWrap, wrapBorderSize );
+	}
+
 	void DestroyGameObject( int ID )
 	{
 		if( objectMap.find( ID ) == objectMap.end() )
@@ -4627,18 +10743,66 @@ namespace Play
 			DestroyGameObject( typeVec[i] );
 	}
 
+	// Adds a collision candidate's position to the scratch arrays, truncated to whole pixels
+	static void GatherCollisionCandidate( GameObject& obj )
+	{
+		BatchScratch& b = batchScratch;
+		b.vObjects.push_back( &obj );
+		b.vPosX.push_back( static_cast<float>( int( obj.pos.x ) ) );
+		b.vPosY.push_back( static_cast<float>( int( obj.pos.y ) ) );
+	}
+
+	// Tests the gathered candidates against an object, adding the ids of those it collides with
+	// > One candidate or many are tested by the same batch function, so IsColliding and CollectCollidingGameObjectIDs always agree
+	static void CollideGatheredCandidates( GameObject& object, std::vector<int>& ids )
+	{
+		BatchScratch& b = batchScratch;
+		int count = static_cast<int>( b.vObjects.size() );
+		b.vDistSqr.resize( count );
+		Point2f target( int( object.pos.x ), int( object.pos.y ) );
+		BatchDistanceSqr( b.vPosX.data(), b.vPosY.data(), target, b.vDistSqr.data(), count );
+
+		// Game progammers don't do square root!
+		for( int i = 0; i < count; i++ )
+		{
+			float radii = static_cast<float>( b.vObjects[i]->radius + object.radius );
+			if( b.vDistSqr[i] < radii * radii )
+				ids.push_back( b.vObjects[i]->GetId() );
+		}
+	}
+
 	bool IsColliding( GameObject& object1, GameObject& object2 )
 	{
 		//Don't collide with noObject
 		if( object1.type == -1 || object2.type == -1 )
 			return false;
 
-		int xDiff = int( object1.pos.x ) - int( object2.pos.x );
-		int yDiff = int( object1.pos.y ) - int( object2.pos.y );
-		int radii = object2.radius + object1.radius;
+		BatchScratch& b = batchScratch;
+		b.vObjects.clear(); b.vPosX.clear(); b.vPosY.clear();
+		GatherCollisionCandidate( object2 );
 
-		// Game progammers don't do square root!
-		return( ( xDiff * xDiff ) + ( yDiff * yDiff ) < radii * radii );
+		std::vector<int>& ids = b.vCollisionIds;
+		ids.clear();
+		CollideGatheredCandidates( object1, ids );
+		return !ids.empty();
+	}
+
+	std::vector<int> CollectCollidingGameObjectIDs( GameObject& object, int type )
+	{
+		std::vector<int> vec;
+		if( object.type == -1 || type == -1 ) return vec; // Don't collide with noObject
+
+		BatchScratch& b = batchScratch;
+		b.vObjects.clear(); b.vPosX.clear(); b.vPosY.clear();
+		for( std::pair<const int, GameObject&>& i : objectMap )
+		{
+			GameObject& obj = i.second;
+			if( obj.type == type && &obj != &object )
+				GatherCollisionCandidate( obj );
+		}
+
+		CollideGatheredCandidates( object, vec );
+		return vec; // Returning a copy of the vector
 	}
 
 	bool IsVisible( GameObject& obj )
@@ -4702,8 +10866,10 @@ namespace Play
 	{
 		if( obj.type == -1 ) return; // Not for noObject
 
-		obj.velocity.x = speed * sin( angle );
-		obj.velocity.y = speed * -cos( angle );
+		float s, c;
+		PlaySinCos( angle, s, c );
+		obj.velocity.x = speed * s;
+		obj.velocity.y = speed * -c;
 	}
 
 	void PointGameObject( GameObject& obj, int speed, int targetX, int targetY )
@@ -4713,10 +10879,12 @@ namespace Play
 		float xdiff = obj.pos.x - targetX;
 		float ydiff = obj.pos.y - targetY;
 
-		obj.rotation = atan2( ydiff, xdiff ) - (PLAY_PI/2);
+		obj.rotation = PlayAtan2( ydiff, xdiff ) - (PLAY_PI/2);
 
-		obj.velocity.x = speed * sin( obj.rotation );
-		obj.velocity.y = speed * -cos( obj.rotation );
+		float s, c;
+		PlaySinCos( obj.rotation, s, c );
+		obj.velocity.x = speed * s;
+		obj.velocity.y = speed * -c;
 	}
 
 	void SetSprite( GameObject& obj, const char* spriteName, float animSpeed )
@@ -4729,22 +10897,45 @@ namespace Play
 		obj.animSpeed = animSpeed;
 	}
 
+	// Gets the position to draw the object at, interpolated between its last two fixed steps
+	// > Objects which weren't updated in the last step, or which jumped more than half the display (e.g. wrapping), aren't interpolated
+	static Point2f InterpolatedPos( const GameObject& obj )
+	{
+		if( !fixedTimestep.enabled || obj.lastFrameUpdated != fixedTimestep.lastStep )
+			return obj.pos;
+
+		Vector2f step = obj.pos - obj.oldPos;
+		if( std::abs( step.x ) * 2 > PlayWindow::Instance().GetWidth() || std::abs( step.y ) * 2 > PlayWindow::Instance().GetHeight() )
+			return obj.pos;
+
+		return obj.oldPos + step * fixedTimestep.alpha;
+	}
+
+	// Gets the rotation to draw the object at, interpolated in the same way as its position
+	static float InterpolatedRot( const GameObject& obj )
+	{
+		if( !fixedTimestep.enabled || obj.lastFrameUpdated != fixedTimestep.lastStep )
+			return obj.rotation;
+
+		return obj.oldRot + ( obj.rotation - obj.oldRot ) * fixedTimestep.alpha;
+	}
+
 	void DrawObject( GameObject& obj )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().Draw( obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame );
+		PlayGraphics::Instance().Draw( obj.spriteId, TRANSFORM_SPACE( InterpolatedPos( obj ) ), obj.frame );
 	}
 
 	void DrawObjectTransparent( GameObject& obj, float opacity )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().DrawTransparent( obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame, opacity );
+		PlayGraphics::Instance().DrawTransparent( obj.spriteId, TRANSFORM_SPACE( InterpolatedPos( obj ) ), obj.frame, opacity );
 	}
 
 	void DrawObjectRotated( GameObject& obj, float opacity )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().DrawRotated( obj.spriteId, TRANSFORM_SPACE( obj.pos ), obj.frame, obj.rotation, obj.scale, opacity );
+		PlayGraphics::Instance().DrawRotated( obj.spriteId, TRANSFORM_SPACE( InterpolatedPos( obj ) ), obj.frame, InterpolatedRot( obj ), obj.scale, opacity );
 	}
 
 #endif